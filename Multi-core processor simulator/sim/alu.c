@@ -1,39 +1,34 @@
 // alu.c
 #include "alu.h"
 
-uint32_t alu_execute(alu_op_t op, uint32_t a, uint32_t b) {
-    switch (op) {
-    case ALU_ADD:
-        return a + b;
-
-    case ALU_SUB:
-        return a - b;
-
-    case ALU_AND:
-        return a & b;
-
-    case ALU_OR:
-        return a | b;
-
-    case ALU_XOR:
-        return a ^ b;
-
-    case ALU_MUL:
-        return a * b;
+static uint32_t alu_add(uint32_t a, uint32_t b) { return a + b; }
+static uint32_t alu_sub(uint32_t a, uint32_t b) { return a - b; }
+static uint32_t alu_and(uint32_t a, uint32_t b) { return a & b; }
+static uint32_t alu_or(uint32_t a, uint32_t b) { return a | b; }
+static uint32_t alu_xor(uint32_t a, uint32_t b) { return a ^ b; }
+static uint32_t alu_mul(uint32_t a, uint32_t b) { return a * b; }
+
+static uint32_t alu_sll(uint32_t a, uint32_t b) {
+    return a << (b & 0x1F); // Shift by lower 5 bits only
+}
+
+static uint32_t alu_sra(uint32_t a, uint32_t b) {
+    // Sign-extended right shift
+    int32_t signed_a = (int32_t)a;
+    return (uint32_t)(signed_a >> (b & 0x1F));
+}
+
+static uint32_t alu_srl(uint32_t a, uint32_t b) {
+    return a >> (b & 0x1F); // Logical right shift
+}
+
+const alu_fn_t alu_functions[ALU_OP_COUNT] = {
+    alu_add, alu_sub, alu_and, alu_or, alu_xor, alu_mul, alu_sll, alu_sra, alu_srl
+};
 
-    case ALU_SLL:
-        return a << (b & 0x1F); // Shift by lower 5 bits only
-
-    case ALU_SRA: {
-        // Sign-extended right shift
-        int32_t signed_a = (int32_t)a;
-        return (uint32_t)(signed_a >> (b & 0x1F));
-    }
-
-    case ALU_SRL:
-        return a >> (b & 0x1F); // Logical right shift
-
-    default:
+uint32_t alu_execute(alu_op_t op, uint32_t a, uint32_t b) {
+    if ((unsigned)op >= ALU_OP_COUNT) {
         return 0;
     }
-}
\ No newline at end of file
+    return alu_functions[op](a, b);
+}
@@ -14,9 +14,16 @@ typedef enum {
     ALU_MUL,  // mul
     ALU_SLL,  // sll
     ALU_SRA,  // sra (arithmetic)
-    ALU_SRL   // srl (logical)
+    ALU_SRL,  // srl (logical)
+    ALU_OP_COUNT
 } alu_op_t;
 
+// One ALU operation applied to its two operands
+typedef uint32_t (*alu_fn_t)(uint32_t a, uint32_t b);
+
+// Function of each operation, indexed by alu_op_t
+extern const alu_fn_t alu_functions[ALU_OP_COUNT];
+
 uint32_t alu_execute(alu_op_t op, uint32_t a, uint32_t b);
 
 #endif
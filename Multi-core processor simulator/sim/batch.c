@@ -0,0 +1,719 @@
+/**
+ * @file batch.c
+ * @brief Implementation of the batch runner
+ *
+ * A batch is executed in three steps:
+ * 1. The manifest is parsed and every run's input files are resolved
+ * 2. Each distinct input file is parsed once into a shared image
+ * 3. The runs are simulated, each on its own context
+ * Steps 2 and 3 hand out work items to the pool workers through an atomic
+ * counter, so long and short runs balance out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "run_files.h"
+#include "thread_pool.h"
+#include "platform.h"
+
+#define BATCH_LINE_MAX 4096  ///< Longest manifest line
+#define BATCH_NAME_MAX 48    ///< Longest run name
+
+/**
+ * @brief Input file or checkpoint shared between runs
+ */
+typedef struct {
+    char* path;            ///< File name
+    bool is_checkpoint;    ///< Checkpoint file rather than a word image
+    sim_image_t* image;    ///< Parsed contents (NULL if missing)
+    sim_checkpoint_t* checkpoint;  ///< Parsed checkpoint (NULL if not loaded)
+    bool required;         ///< Missing file is an error (instruction memory)
+    bool failed;           ///< File exists but could not be loaded
+} batch_image_t;
+
+/**
+ * @brief One run of the manifest and its results
+ */
+typedef struct {
+    char* name;              ///< Run name, also its output sub-directory
+    int line;                ///< Manifest line number
+    sim_config_t config;     ///< Simulation parameters
+    bool trace;              ///< Write core and bus traces
+    const char* trace_cores; ///< Cores with a pipeline trace (NULL = all)
+    const char* in_dir;      ///< Input directory (may be NULL)
+    const char* restore;     ///< Checkpoint to start from (NULL = input files)
+    const char* memin;       ///< Explicit memin file (NULL = default name)
+    const char** imem;       ///< Explicit imem files (entries may be NULL)
+    int num_imem;            ///< Length of the imem array
+
+    /* Resolved Inputs */
+    int restore_image;       ///< Index of the checkpoint (-1 = input files)
+    int memin_image;         ///< Index of the memory image
+    int* imem_images;        ///< Index of the program image per core
+
+    /* Results */
+    bool ok;                 ///< Run completed and saved its outputs
+    uint64_t cycles;         ///< Global cycles until all cores finished
+    sim_core_stats_t totals; ///< Statistics summed over all cores
+} batch_run_t;
+
+/**
+ * @brief Complete batch state
+ */
+typedef struct {
+    batch_run_t* runs;       ///< Runs in manifest order
+    int num_runs;
+    int runs_capacity;
+
+    batch_image_t* images;   ///< Distinct input files
+    int num_images;
+    int images_capacity;
+
+    char** strings;          ///< Strings owned by the batch
+    int num_strings;
+    int strings_capacity;
+
+    const char* out_dir;     ///< Batch output directory (may be NULL)
+    volatile long next_task; ///< Next work item handed to a worker
+} batch_t;
+
+/* Storage Helpers */
+
+/**
+ * @brief Make sure a dynamic array can hold one more element
+ * @param items Pointer to the array pointer
+ * @param count Current element count
+ * @param capacity Pointer to the current capacity
+ * @param size Element size
+ * @return false on allocation failure
+ */
+static bool grow_array(void** items, int count, int* capacity, size_t size) {
+    if (count < *capacity) return true;
+
+    int new_capacity = *capacity ? *capacity * 2 : 16;
+    void* grown = realloc(*items, new_capacity * size);
+    if (!grown) return false;
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+/**
+ * @brief Take ownership of an allocated string
+ * @param batch Batch state
+ * @param str String (may be NULL)
+ * @return The string, or NULL on allocation failure
+ */
+static char* keep_string(batch_t* batch, char* str) {
+    if (!str || !grow_array((void**)&batch->strings, batch->num_strings,
+        &batch->strings_capacity, sizeof(char*))) {
+        free(str);
+        return NULL;
+    }
+    batch->strings[batch->num_strings++] = str;
+    return str;
+}
+
+/**
+ * @brief Copy a string into batch-owned storage
+ * @param batch Batch state
+ * @param str String to copy
+ * @return Copy, or NULL on allocation failure
+ */
+static char* copy_string(batch_t* batch, const char* str) {
+    char* copy = (char*)malloc(strlen(str) + 1);
+    if (copy) {
+        strcpy(copy, str);
+    }
+    return keep_string(batch, copy);
+}
+
+/**
+ * @brief Find an input file or add it to the image table
+ * @param batch Batch state
+ * @param path File name
+ * @param required Missing file is an error
+ * @param is_checkpoint The file is a checkpoint
+ * @return Image index, or -1 on allocation failure
+ */
+static int find_image(batch_t* batch, const char* path, bool required, bool is_checkpoint) {
+    for (int i = 0; i < batch->num_images; i++) {
+        if (strcmp(batch->images[i].path, path) == 0 &&
+            batch->images[i].is_checkpoint == is_checkpoint) {
+            batch->images[i].required |= required;
+            return i;
+        }
+    }
+
+    if (!grow_array((void**)&batch->images, batch->num_images,
+        &batch->images_capacity, sizeof(batch_image_t))) {
+        return -1;
+    }
+    batch_image_t* image = &batch->images[batch->num_images];
+    image->path = copy_string(batch, path);
+    image->is_checkpoint = is_checkpoint;
+    image->image = NULL;
+    image->checkpoint = NULL;
+    image->required = required;
+    image->failed = false;
+    return image->path ? batch->num_images++ : -1;
+}
+
+/* Manifest Parsing */
+
+/**
+ * @brief Parse a non-negative integer value
+ * @param value Text
+ * @param result Receives the number
+ * @return false if the text is not a number
+ */
+static bool parse_int(const char* value, int* result) {
+    char* end;
+    long number = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || number < 0 || number > 1 << 20) {
+        return false;
+    }
+    *result = (int)number;
+    return true;
+}
+
+/**
+ * @brief Check that a run name can be used as a directory name
+ * @param name Run name
+ */
+static bool valid_run_name(const char* name) {
+    size_t len = strlen(name);
+    if (len == 0 || len > BATCH_NAME_MAX) return false;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.')) {
+            return false;
+        }
+    }
+    return strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+/**
+ * @brief Apply one key=value setting to a run
+ * @param batch Batch state
+ * @param run Run to modify
+ * @param key Setting name
+ * @param value Setting value
+ * @return false on an unknown key or invalid value
+ */
+static bool apply_setting(batch_t* batch, batch_run_t* run, const char* key,
+    const char* value) {
+    int number;
+
+    if (is_config_option(key)) {
+        return parse_config_option(key, value, &run->config);
+    }
+    if (strcmp(key, "trace") == 0) {
+        // 0 disables traces, 1 selects text, otherwise a format name
+        run->trace = strcmp(value, "0") != 0;
+        if (strcmp(value, "0") == 0 || strcmp(value, "1") == 0) {
+            run->config.trace_format = SIM_TRACE_TEXT;
+            return true;
+        }
+        return parse_trace_format(value, &run->config.trace_format);
+    }
+    if (strcmp(key, "async") == 0) {
+        if (strcmp(value, "0") == 0) {
+            run->config.trace_mode = SIM_TRACE_SYNC;
+            return true;
+        }
+        return parse_trace_mode(value, &run->config.trace_mode);
+    }
+    if (strcmp(key, "dump") == 0) {
+        return parse_dump_format(value, &run->config.dump_format);
+    }
+    if (strcmp(key, "trace-cores") == 0) {
+        // Checked against the core count when the run starts
+        return (run->trace_cores = copy_string(batch, value)) != NULL;
+    }
+    if (strncmp(key, "trace-", 6) == 0) {
+        return parse_trace_filter_option(key, value, &run->config.trace_filter);
+    }
+    if (strcmp(key, "indir") == 0) {
+        return (run->in_dir = copy_string(batch, value)) != NULL;
+    }
+    if (strcmp(key, "restore") == 0) {
+        return (run->restore = copy_string(batch, value)) != NULL;
+    }
+    if (strcmp(key, "memin") == 0) {
+        return (run->memin = copy_string(batch, value)) != NULL;
+    }
+    if (strncmp(key, "imem", 4) == 0 && parse_int(key + 4, &number)) {
+        // Grow the override list up to the given core index
+        if (number >= run->num_imem) {
+            const char** imem = (const char**)realloc((void*)run->imem,
+                (number + 1) * sizeof(char*));
+            if (!imem) return false;
+            for (int i = run->num_imem; i <= number; i++) {
+                imem[i] = NULL;
+            }
+            run->imem = imem;
+            run->num_imem = number + 1;
+        }
+        return (run->imem[number] = copy_string(batch, value)) != NULL;
+    }
+    return false;
+}
+
+/**
+ * @brief Copy a run's settings, duplicating its override list
+ * @param dst Destination run
+ * @param src Source run
+ * @return false on allocation failure
+ */
+static bool copy_settings(batch_run_t* dst, const batch_run_t* src) {
+    *dst = *src;
+    dst->imem = NULL;
+    if (src->num_imem > 0) {
+        dst->imem = (const char**)malloc(src->num_imem * sizeof(char*));
+        if (!dst->imem) return false;
+        memcpy((void*)dst->imem, src->imem, src->num_imem * sizeof(char*));
+    }
+    return true;
+}
+
+/**
+ * @brief Parse the manifest into the run list
+ * @param batch Batch state
+ * @param manifest Manifest file name
+ * @param defaults Settings in effect before the first line
+ * @return true if successful, false on error
+ */
+static bool parse_manifest(batch_t* batch, const char* manifest, batch_run_t* defaults) {
+    FILE* f = fopen(manifest, "r");
+    if (!f) {
+        printf("Error: Failed to open manifest file %s\n", manifest);
+        return false;
+    }
+
+    char line[BATCH_LINE_MAX];
+    int line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        line_number++;
+        char* name = strtok(line, " \t\r\n");
+        if (!name || name[0] == '#') continue;
+
+        batch_run_t run;
+        bool is_default = strcmp(name, "default") == 0;
+        if (!is_default && !valid_run_name(name)) {
+            printf("Error: %s:%d: invalid run name %s\n", manifest, line_number, name);
+            ok = false;
+            break;
+        }
+        for (int i = 0; i < batch->num_runs; i++) {
+            if (strcmp(batch->runs[i].name, name) == 0) {
+                printf("Error: %s:%d: duplicate run name %s\n", manifest, line_number, name);
+                ok = false;
+            }
+        }
+        if (!ok || !copy_settings(&run, defaults)) {
+            ok = false;
+            break;
+        }
+        run.line = line_number;
+
+        // Remaining tokens are key=value settings
+        char* token;
+        while (ok && (token = strtok(NULL, " \t\r\n")) != NULL) {
+            char* value = strchr(token, '=');
+            if (value) {
+                *value++ = '\0';
+            }
+            if (!value || !apply_setting(batch, &run, token, value)) {
+                printf("Error: %s:%d: invalid setting %s\n", manifest, line_number, token);
+                ok = false;
+            }
+        }
+
+        if (!ok) {
+            free((void*)run.imem);
+        }
+        else if (is_default) {
+            free((void*)defaults->imem);
+            *defaults = run;
+        }
+        else if (!grow_array((void**)&batch->runs, batch->num_runs,
+            &batch->runs_capacity, sizeof(batch_run_t)) ||
+            !(run.name = copy_string(batch, name))) {
+            printf("Error: Memory allocation failed\n");
+            free((void*)run.imem);
+            ok = false;
+        }
+        else {
+            batch->runs[batch->num_runs++] = run;
+        }
+    }
+
+    fclose(f);
+    return ok;
+}
+
+/**
+ * @brief Map every run's input files onto the shared image table
+ * @param batch Batch state
+ * @param manifest Manifest file name (for messages)
+ * @return true if successful, false on error
+ */
+static bool resolve_inputs(batch_t* batch, const char* manifest) {
+    for (int r = 0; r < batch->num_runs; r++) {
+        batch_run_t* run = &batch->runs[r];
+        int num_cores = run->config.num_cores;
+
+        const char* error = sim_config_error(&run->config);
+        if (error) {
+            printf("Error: %s:%d: %s\n", manifest, run->line, error);
+            return false;
+        }
+        if (run->num_imem > num_cores) {
+            printf("Error: %s:%d: imem%d given for a %d-core run\n",
+                manifest, run->line, run->num_imem - 1, num_cores);
+            return false;
+        }
+
+        // A checkpoint holds memory and programs, so no input file is read
+        run->restore_image = -1;
+        if (run->restore) {
+            run->restore_image = find_image(batch, run->restore, true, true);
+            if (run->restore_image < 0) {
+                printf("Error: Memory allocation failed\n");
+                return false;
+            }
+            continue;
+        }
+
+        const char* memin = run->memin ? run->memin :
+            keep_string(batch, make_file_name(run->in_dir, "memin.txt", 0));
+        run->memin_image = memin ? find_image(batch, memin, false, false) : -1;
+        run->imem_images = (int*)malloc(num_cores * sizeof(int));
+        if (run->memin_image < 0 || !run->imem_images) {
+            printf("Error: Memory allocation failed\n");
+            return false;
+        }
+
+        for (int i = 0; i < num_cores; i++) {
+            const char* imem = (i < run->num_imem && run->imem[i]) ? run->imem[i] :
+                keep_string(batch, make_file_name(run->in_dir, "imem%d.txt", i));
+            run->imem_images[i] = imem ? find_image(batch, imem, true, false) : -1;
+            if (run->imem_images[i] < 0) {
+                printf("Error: Memory allocation failed\n");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Parallel Execution */
+
+/**
+ * @brief Hand out the next work item
+ * @param batch Batch state
+ * @param count Number of work items
+ * @return Item index, or -1 when all items are taken
+ */
+static int next_task(batch_t* batch, int count) {
+    long task = sim_atomic_add(&batch->next_task, 1) - 1;
+    return task < count ? (int)task : -1;
+}
+
+/**
+ * @brief Parse input files until none are left
+ */
+static void load_images_task(void* arg, int worker, int num_workers) {
+    batch_t* batch = (batch_t*)arg;
+    int i;
+    (void)worker;
+    (void)num_workers;
+
+    while ((i = next_task(batch, batch->num_images)) >= 0) {
+        batch_image_t* image = &batch->images[i];
+        if (image->is_checkpoint) {
+            const char* error = "";
+            image->checkpoint = sim_checkpoint_load(image->path, &error);
+            if (!image->checkpoint) {
+                printf("Error: %s: %s\n", image->path, error);
+                image->failed = true;
+            }
+            continue;
+        }
+
+        // A missing memin file leaves memory zeroed
+        sim_load_status_t status;
+        int line = 0;
+        image->image = sim_image_load(image->path, &status, &line);
+        if (status == SIM_LOAD_MISSING) {
+            if (image->required) {
+                printf("Error: Failed to open IMEM file %s\n", image->path);
+            }
+        }
+        else if (status == SIM_LOAD_MALFORMED) {
+            printf("Error: %s:%d: %s\n", image->path, line, sim_load_status_message(status));
+            image->failed = true;
+        }
+        else if (status != SIM_LOAD_OK) {
+            printf("Error: %s: %s\n", image->path, sim_load_status_message(status));
+            image->failed = true;
+        }
+    }
+}
+
+/**
+ * @brief Simulate one run and save its outputs
+ * @param batch Batch state
+ * @param run Run to execute
+ * @return true if successful, false on error
+ */
+static bool execute_run(batch_t* batch, batch_run_t* run) {
+    int num_cores = run->config.num_cores;
+
+    const sim_checkpoint_t* restore = NULL;
+    if (run->restore_image >= 0) {
+        restore = batch->images[run->restore_image].checkpoint;
+        if (!restore) {
+            return false;
+        }
+    }
+    else {
+        if (batch->images[run->memin_image].failed) {
+            return false;
+        }
+        for (int i = 0; i < num_cores; i++) {
+            if (!batch->images[run->imem_images[i]].image) {
+                return false;
+            }
+        }
+    }
+
+    char* run_dir = make_file_name(batch->out_dir, run->name, 0);
+    char* log_name = make_file_name(run_dir, "log.txt", 0);
+    char** list = make_default_file_list(&run->config, NULL, run_dir);
+    FILE** core_traces = (FILE**)calloc(num_cores, sizeof(FILE*));
+    bool* traced = (bool*)malloc(num_cores * sizeof(bool));
+    FILE* bus_trace = NULL;
+    FILE* log = NULL;
+    sim_context_t* sim = NULL;
+    bool ok = false;
+
+    if (!run_dir || !log_name || !list || !core_traces || !traced) {
+        printf("Error: Memory allocation failed\n");
+    }
+    else if (!parse_core_list(run->trace_cores, num_cores, traced)) {
+        printf("Error: Invalid trace core list %s for run %s\n", run->trace_cores, run->name);
+    }
+    else if (sim_make_dir(run_dir) != 0) {
+        printf("Error: Failed to create directory %s\n", run_dir);
+    }
+    else if (!(log = fopen(log_name, "w"))) {
+        printf("Error: Failed to open log file %s\n", log_name);
+    }
+    else if (!(sim = sim_create(&run->config))) {
+        printf("Error: Failed to create a %d-core simulation\n", num_cores);
+    }
+    else {
+        sim_files_t files;
+        files_from_list(&files, (const char**)list, num_cores);
+        sim_set_log(sim, log);
+
+        // Memory shares the image or checkpoint pages, programs are copied
+        bool loaded = true;
+        if (restore) {
+            loaded = sim_restore_checkpoint(sim, restore);
+        }
+        else {
+            sim_load_memory_image(sim, batch->images[run->memin_image].image);
+            for (int i = 0; i < num_cores; i++) {
+                sim_load_imem_image(sim, i, batch->images[run->imem_images[i]].image);
+            }
+        }
+
+        if (loaded && (!run->trace || open_trace_files(sim, &files,
+            run->config.trace_format != SIM_TRACE_TEXT, traced, core_traces, &bus_trace))) {
+            sim_run(sim);
+            ok = save_output_files(sim, &files);
+        }
+
+        run->cycles = sim_get_cycle(sim);
+        for (int i = 0; i < num_cores; i++) {
+            sim_core_stats_t stats;
+            sim_get_core_stats(sim, i, &stats);
+            run->totals.cycles += stats.cycles;
+            run->totals.instructions += stats.instructions;
+            run->totals.read_hit += stats.read_hit;
+            run->totals.write_hit += stats.write_hit;
+            run->totals.read_miss += stats.read_miss;
+            run->totals.write_miss += stats.write_miss;
+            run->totals.decode_stalls += stats.decode_stalls;
+            run->totals.mem_stalls += stats.mem_stalls;
+            run->totals.bus_requests += stats.bus_requests;
+            run->totals.bus_wait_cycles += stats.bus_wait_cycles;
+        }
+    }
+
+    // Cleanup
+    if (core_traces) {
+        close_trace_files(sim, num_cores, core_traces, bus_trace);
+    }
+    if (log) {
+        fclose(log);
+    }
+    sim_destroy(sim);
+    free(core_traces);
+    free(traced);
+    free_file_list(list, num_cores);
+    free(log_name);
+    free(run_dir);
+    return ok;
+}
+
+/**
+ * @brief Execute runs until none are left
+ */
+static void execute_runs_task(void* arg, int worker, int num_workers) {
+    batch_t* batch = (batch_t*)arg;
+    int i;
+    (void)worker;
+    (void)num_workers;
+
+    while ((i = next_task(batch, batch->num_runs)) >= 0) {
+        batch_run_t* run = &batch->runs[i];
+        run->ok = execute_run(batch, run);
+        printf("%s: %s after %llu cycles\n", run->name, run->ok ? "done" : "failed",
+            (unsigned long long)run->cycles);
+    }
+}
+
+/* Summary */
+
+/**
+ * @brief Write one row per run with the statistics summed over all cores
+ * @param batch Batch state
+ * @param filename Summary file name
+ * @return true if successful, false on error
+ */
+static bool write_summary(batch_t* batch, const char* filename) {
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        printf("Error: Failed to open summary file %s\n", filename);
+        return false;
+    }
+
+    int width = 4;
+    for (int r = 0; r < batch->num_runs; r++) {
+        int len = (int)strlen(batch->runs[r].name);
+        if (len > width) width = len;
+    }
+
+    fprintf(f, "%-*s %-6s %5s %12s %12s %10s %10s %10s %10s %12s %12s %10s\n",
+        width, "name", "status", "cores", "cycles", "instructions",
+        "read_hit", "write_hit", "read_miss", "write_miss",
+        "decode_stall", "mem_stall", "bus_wait");
+    for (int r = 0; r < batch->num_runs; r++) {
+        batch_run_t* run = &batch->runs[r];
+
+        // Average cycles a BusRd/BusRdX queued before its grant
+        const sim_core_stats_t* totals = &run->totals;
+        double bus_wait = totals->bus_requests ?
+            (double)totals->bus_wait_cycles / totals->bus_requests : 0.0;
+        fprintf(f, "%-*s %-6s %5d %12llu %12d %10d %10d %10d %10d %12d %12d %10.2f\n",
+            width, run->name, run->ok ? "ok" : "failed", run->config.num_cores,
+            (unsigned long long)run->cycles, totals->instructions,
+            totals->read_hit, totals->write_hit,
+            totals->read_miss, totals->write_miss,
+            totals->decode_stalls, totals->mem_stalls, bus_wait);
+    }
+
+    fclose(f);
+    return true;
+}
+
+/**
+ * @brief Free all batch state
+ * @param batch Batch state
+ */
+static void free_batch(batch_t* batch) {
+    for (int r = 0; r < batch->num_runs; r++) {
+        free((void*)batch->runs[r].imem);
+        free(batch->runs[r].imem_images);
+    }
+    for (int i = 0; i < batch->num_images; i++) {
+        sim_image_destroy(batch->images[i].image);
+        sim_checkpoint_destroy(batch->images[i].checkpoint);
+    }
+    for (int i = 0; i < batch->num_strings; i++) {
+        free(batch->strings[i]);
+    }
+    free(batch->runs);
+    free(batch->images);
+    free(batch->strings);
+}
+
+bool batch_run(const char* manifest, const sim_config_t* config, const char* trace_cores,
+    const char* restore, const char* in_dir, const char* out_dir, int num_jobs) {
+    batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.out_dir = out_dir;
+
+    batch_run_t defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    defaults.config = *config;
+    defaults.trace = true;
+    defaults.trace_cores = trace_cores;
+    defaults.restore = restore;
+    defaults.in_dir = in_dir;
+
+    bool ok = parse_manifest(&batch, manifest, &defaults) &&
+        resolve_inputs(&batch, manifest);
+    free((void*)defaults.imem);
+
+    if (ok && batch.num_runs == 0) {
+        printf("Error: No runs in manifest %s\n", manifest);
+        ok = false;
+    }
+    if (ok && out_dir && sim_make_dir(out_dir) != 0) {
+        printf("Error: Failed to create directory %s\n", out_dir);
+        ok = false;
+    }
+
+    // More workers than runs would only wait
+    if (num_jobs <= 0) {
+        num_jobs = thread_pool_host_cpus();
+    }
+    if (num_jobs > batch.num_runs) {
+        num_jobs = batch.num_runs;
+    }
+
+    thread_pool_t* pool = ok ? thread_pool_create(num_jobs) : NULL;
+    if (ok && !pool) {
+        printf("Error: Failed to create %d worker threads\n", num_jobs);
+        ok = false;
+    }
+
+    if (ok) {
+        batch.next_task = 0;
+        thread_pool_run(pool, load_images_task, &batch);
+        batch.next_task = 0;
+        thread_pool_run(pool, execute_runs_task, &batch);
+
+        char* summary = make_file_name(out_dir, "summary.txt", 0);
+        ok = summary && write_summary(&batch, summary);
+        free(summary);
+
+        for (int r = 0; r < batch.num_runs && ok; r++) {
+            ok = batch.runs[r].ok;
+        }
+    }
+
+    thread_pool_destroy(pool);
+    free_batch(&batch);
+    return ok;
+}
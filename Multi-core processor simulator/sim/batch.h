@@ -0,0 +1,58 @@
+/**
+ * @file batch.h
+ * @brief Batch runner for design-space sweeps
+ *
+ * A manifest lists one simulation run per line:
+ * @code
+ * # name      key=value ...
+ * default     indir=tests/counter cores=4
+ * base
+ * fast        event=1
+ * other_data  memin=inputs/other.txt
+ * @endcode
+ *
+ * Keys:
+ * - cores=N, threads=T, event=0|1, memory-bits=B - simulation parameters
+ * - cache-size=S, block-size=B, cache-ways=W, cache-policy=lru|plru|random|rrip
+ *   - data cache organization
+ * - memory-delay=D, bus-delay=D, imem-size=S - memory timing and program size
+ * - trace=0|1|text|binary|compressed - trace files and their format
+ *   (default 1, text)
+ * - async=0|block|drop - background trace writer and its back-pressure
+ * - dump=full|trim|sparse|binary - format of memout, regout, dsram and tsram
+ * - trace-window, trace-on-pc, trace-on-addr, trace-cores, trace-bus-cmd,
+ *   trace-bus-addr - trace filters, same values as the command-line options
+ * - indir=DIR - directory holding imem<i>.txt and memin.txt
+ * - memin=FILE, imem<i>=FILE - override single input files
+ * - restore=FILE - start from a checkpoint instead of the input files
+ *
+ * A line named "default" sets keys for all following runs. Every distinct
+ * input file and checkpoint is parsed once and shared by all runs that use
+ * it (main memory copy-on-write), so many divergent runs can start from one
+ * warmed-up checkpoint. Runs execute concurrently on a thread pool; each
+ * writes the usual output files, plus log.txt with its console output, into
+ * <outdir>/<name>/, and summary.txt in <outdir> holds one row per run.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include "sim.h"
+
+/**
+ * @brief Run every simulation listed in a manifest
+ * @param manifest Manifest file name
+ * @param config Parameters used by runs unless the manifest overrides them
+ * @param trace_cores Default list of cores with a pipeline trace (NULL = all)
+ * @param restore Default checkpoint to start from (NULL = input files)
+ * @param in_dir Default input directory (may be NULL)
+ * @param out_dir Directory receiving the run directories and the summary
+ *                (NULL for the current directory)
+ * @param num_jobs Runs simulated at the same time (0 = one per host CPU)
+ * @return true if the manifest was valid and every run succeeded
+ */
+bool batch_run(const char* manifest, const sim_config_t* config, const char* trace_cores,
+    const char* restore, const char* in_dir, const char* out_dir, int num_jobs);
+
+#endif /* BATCH_H */
@@ -3,22 +3,43 @@
  * @brief Implementation of bus system functionality for MESI protocol
  */
 
+#include <stdlib.h>
 #include "bus_system.h"
 
-#define WORDS_IN_BLOCK 4  ///< Number of words per cache block
+bool bus_init(bus_system_t* bus, int num_cores, int block_size, int arbitration_delay, bool split,
+    int outstanding) {
+    if (num_cores < 1 || num_cores > BUS_MAX_CORES || outstanding < 1) return false;
+
+    // One request line per core plus one for main memory
+    bus->num_cores = num_cores;
+    bus->memory_id = num_cores;
+    bus->block_size = (uint32_t)block_size;
+    bus->arbitration_delay = arbitration_delay;
+    bus->split = split;
+    bus->txn_slots = split ? outstanding : 1;
+    bus->last_txn = 0;
+    bus->ports = (bus_port_t*)sim_aligned_alloc((num_cores + 1) * sizeof(bus_port_t),
+        SIM_CACHE_LINE);
+    bus->txns = split ? (bus_txn_t*)calloc((size_t)num_cores * outstanding, sizeof(bus_txn_t)) : NULL;
+    if (!bus->ports || (split && !bus->txns)) {
+        bus_free(bus);
+        return false;
+    }
 
-void bus_init(bus_system_t* bus) {
     // Initialize bus lines
     bus->bus_origid = 0;
     bus->bus_cmd = BUS_NO_CMD;
     bus->bus_addr = 0;
     bus->bus_data = 0;
+    bus->bus_dest = BUS_NO_DEST;
+    bus->addr_mask = UINT32_MAX;  // Narrowed to the width of main memory by its owner
     bus->bus_shared.D = 0;
     bus->bus_shared.Q = 0;
+    bus->memory_inhibit = false;
     bus->busy = false;
     bus->new_request = false;
     bus->flush_count = 0;
-    bus->last_granted = 3;  // Start with core 3 as last granted
+    bus->last_granted = num_cores - 1;  // Start with the last core as last granted
     bus->global_cycles = 0;
     bus->delay_in_progress = false;
     bus->delay_cycles = 0;
@@ -28,53 +49,291 @@ void bus_init(bus_system_t* bus) {
     bus->pending_data = 0;
 
     bus->new_request = false;
-    for (int i = 0; i < 4; i++) {
-        bus->bus_request[i] = false;
-        bus->bus_cmd_in[i] = BUS_NO_CMD;
-        bus->bus_addr_in[i] = 0;
-        bus->bus_data_in[i] = 0;
+    for (int i = 0; i <= num_cores; i++) {
+        bus->ports[i].request = false;
+        bus->ports[i].cmd = BUS_NO_CMD;
+        bus->ports[i].addr = 0;
+        bus->ports[i].data = 0;
+        bus->ports[i].shared = false;
+        bus->ports[i].inhibit = false;
+        bus->ports[i].dest = BUS_NO_DEST;
+        bus->ports[i].low_priority = false;
+        bus->ports[i].queued_since = -1;
+        bus->ports[i].requests = 0;
+        bus->ports[i].wait_cycles = 0;
     }
+    return true;
+}
+
+void bus_free(bus_system_t* bus) {
+    sim_aligned_free(bus->ports);
+    free(bus->txns);
+    bus->ports = NULL;
+    bus->txns = NULL;
 }
 
 void bus_request(bus_system_t* bus, int core_id, bus_cmd_t cmd, uint32_t addr, uint32_t data) {
     // Validate core ID
-    if (core_id < 0 || core_id > 4) return;
+    if (core_id < 0 || core_id > bus->memory_id) return;
+
+    // A demand request replacing a queued prefetch starts its own wait
+    bus_port_t* port = &bus->ports[core_id];
+    if (port->request && port->low_priority && cmd != BUS_FLUSH) {
+        port->queued_since = -1;
+    }
 
     // Store request in core's request buffer
-    bus->bus_request[core_id] = true;
-    bus->bus_cmd_in[core_id] = cmd;
-    bus->bus_addr_in[core_id] = addr;
-    bus->bus_data_in[core_id] = data;
+    port->request = true;
+    port->cmd = cmd;
+    port->addr = addr;
+    port->data = data;
+    port->dest = BUS_NO_DEST;
+    port->low_priority = false;
+
+    // A request posted again keeps the cycle it was first queued in
+    if (cmd != BUS_FLUSH && port->queued_since < 0) {
+        port->queued_since = bus->global_cycles;
+    }
+}
+
+void bus_prefetch(bus_system_t* bus, int core_id, uint32_t addr) {
+    bus_request(bus, core_id, BUS_RD, addr, 0);
+    bus->ports[core_id].low_priority = true;
+}
+
+void bus_respond(bus_system_t* bus, int core_id, int dest, uint32_t addr, uint32_t data) {
+    bus_request(bus, core_id, BUS_FLUSH, addr, data);
+    bus->ports[core_id].dest = (uint16_t)dest;
+}
+
+void bus_set_shared(bus_system_t* bus, int core_id) {
+    bus->ports[core_id].shared = true;
+}
+
+void bus_set_inhibit(bus_system_t* bus, int core_id) {
+    bus->ports[core_id].inhibit = true;
 }
 
-void bus_set_shared(bus_system_t* bus) {
-    bus->bus_shared.D = 1;
+void bus_latch_shared(bus_system_t* bus) {
+    bus->memory_inhibit = false;
+    for (int i = 0; i < bus->num_cores; i++) {
+        if (bus->ports[i].shared) {
+            bus->bus_shared.D = 1;
+            bus->ports[i].shared = false;
+        }
+        if (bus->ports[i].inhibit) {
+            bus->memory_inhibit = true;
+            bus->ports[i].inhibit = false;
+        }
+    }
+
+    // On a split bus the answer to a request is kept with its transaction
+    // and shown again with each of its response words
+    if (bus->split) {
+        if (bus->bus_cmd == BUS_RD || bus->bus_cmd == BUS_RDX) {
+            bus->txns[bus->last_txn].shared = bus->bus_shared.D != 0;
+        }
+        bus->bus_shared.D = 0;
+    }
+    bus->bus_shared.Q = bus->bus_shared.D;
+}
+
+/**
+ * @brief Find a core's transaction slot (split mode)
+ * @param bus Pointer to bus system
+ * @param core Requesting core
+ * @param block Base address of the block, or any value with valid false
+ * @param valid Look for the outstanding transaction of block instead of a free slot
+ * @return Index into txns, or -1 if there is none
+ */
+static int find_txn(const bus_system_t* bus, int core, uint32_t block, bool valid) {
+    int first = core * bus->txn_slots;
+    for (int i = first; i < first + bus->txn_slots; i++) {
+        if (valid ? bus->txns[i].valid && bus->txns[i].block == block : !bus->txns[i].valid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Hand the bus to a queued BusRd/BusRdX and start its delay
+ * @param bus Pointer to bus system
+ * @param current Granted core
+ */
+static void grant_request(bus_system_t* bus, int current) {
+    bus_port_t* port = &bus->ports[current];
+    bus->delay_in_progress = true;
+    bus->delay_cycles = bus->arbitration_delay;
+    bus->pending_cmd = port->cmd;
+    bus->pending_origid = current;
+    bus->pending_addr = port->addr;
+    bus->pending_data = port->data;
+    port->request = false;
+    bus->last_granted = current;
+
+    // Queueing latency from the request to the grant
+    port->requests++;
+    port->wait_cycles += bus->global_cycles - port->queued_since;
+    port->queued_since = -1;
+}
+
+/**
+ * @brief Drive the granted RD/RDX transaction once its delay has passed
+ * @param bus Pointer to bus system
+ */
+static void start_transaction(bus_system_t* bus) {
+    bus->delay_in_progress = false;
+    bus->bus_cmd = bus->pending_cmd;
+    bus->bus_origid = bus->pending_origid;
+    bus->bus_addr = bus->pending_addr;
+    bus->pending_addr = bus->pending_addr & ~(bus->block_size - 1);
+    bus->bus_data = bus->pending_data;
+    bus->flush_count = 0;
+    bus->new_request = true;
+
+    if (bus->split) {
+        // The bus is free again after this cycle; the block follows later
+        bus->last_txn = find_txn(bus, bus->bus_origid, 0, false);
+        bus_txn_t* txn = &bus->txns[bus->last_txn];
+        txn->valid = true;
+        txn->shared = false;
+        txn->block = bus->pending_addr;
+        txn->words = 0;
+        bus->bus_dest = BUS_NO_DEST;
+        return;
+    }
+    bus->busy = true;
+}
+
+/**
+ * @brief Check whether a block is being transferred to some core (split mode)
+ * @param bus Pointer to bus system
+ * @param addr Any address within the block
+ */
+static bool block_outstanding(const bus_system_t* bus, uint32_t addr) {
+    uint32_t block = addr & ~(bus->block_size - 1);
+    for (int i = 0; i < bus->num_cores * bus->txn_slots; i++) {
+        if (bus->txns[i].valid && bus->txns[i].block == block) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Pick the next queued BusRd/BusRdX round-robin, demand requests before prefetches
+ * @param bus Pointer to bus system
+ * @return Core to grant, or -1 if no request can be granted
+ *
+ * On a split bus requests for a block still in flight wait, so at most one
+ * transaction per block is outstanding and no cache snoops a block being
+ * filled, and so do the requests of a core whose transaction slots are
+ * all in use.
+ */
+static int arbitrate(const bus_system_t* bus) {
+    for (int pass = 0; pass < 2; pass++) {
+        int current = (bus->last_granted + 1) % bus->num_cores;
+        for (int checked = 0; checked < bus->num_cores; checked++) {
+            const bus_port_t* port = &bus->ports[current];
+            if (port->request && port->cmd != BUS_FLUSH && port->low_priority == (pass == 1) &&
+                (!bus->split || (!block_outstanding(bus, port->addr) &&
+                    find_txn(bus, current, 0, false) >= 0))) {
+                return current;
+            }
+            current = (current + 1) % bus->num_cores;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Grant the next queued BusRd/BusRdX (split mode)
+ * @param bus Pointer to bus system
+ * @return true if a request was granted
+ */
+static bool arbitrate_split(bus_system_t* bus) {
+    int current = arbitrate(bus);
+    if (current < 0) {
+        return false;
+    }
+    grant_request(bus, current);
+    return true;
+}
+
+/**
+ * @brief Clock a split-transaction bus
+ * @param bus Pointer to bus system
+ */
+static void bus_clock_split(bus_system_t* bus) {
+    // Address phase: a granted request takes the lines once its delay is over
+    if (bus->delay_in_progress && --bus->delay_cycles == 0) {
+        start_transaction(bus);
+        return;
+    }
+    if (!bus->delay_in_progress && arbitrate_split(bus) && bus->delay_cycles == 0) {
+        start_transaction(bus);
+        return;
+    }
+
+    // Data phase: one Flush word per cycle, cores ahead of memory
+    for (int current = 0; current <= bus->memory_id; current++) {
+        bus_port_t* port = &bus->ports[current];
+        if (port->request && port->cmd == BUS_FLUSH) {
+            bus->bus_origid = (uint16_t)current;
+            bus->bus_cmd = BUS_FLUSH;
+            bus->bus_addr = port->addr;
+            bus->bus_data = port->data;
+            bus->bus_dest = port->dest;
+            port->request = false;
+
+            // Words answering a request carry its shared line and complete it
+            int slot = port->dest < bus->num_cores ?
+                find_txn(bus, port->dest, port->addr & ~(bus->block_size - 1), true) : -1;
+            if (slot >= 0) {
+                bus_txn_t* txn = &bus->txns[slot];
+                bus->bus_shared.Q = txn->shared;
+                if (++txn->words == bus->block_size) {
+                    txn->valid = false;
+                }
+            }
+            bus->new_request = true;
+            return;
+        }
+    }
+
+    bus->bus_cmd = BUS_NO_CMD;
+    bus->bus_dest = BUS_NO_DEST;
+    bus->new_request = false;
 }
 
 void bus_clock(bus_system_t* bus) {
+    if (bus->split) {
+        bus_clock_split(bus);
+        return;
+    }
+
     // If in delay for RD/RDX request
     if (bus->delay_in_progress) {
         bus->delay_cycles--;
         if (bus->delay_cycles == 0) {
             // Delay complete - start actual transaction
-            bus->delay_in_progress = false;
-            bus->bus_cmd = bus->pending_cmd;
-            bus->bus_origid = bus->pending_origid;
-            bus->bus_addr = bus->pending_addr;
-            bus->pending_addr = bus->pending_addr - bus->pending_addr % 4;
-            bus->bus_data = bus->pending_data;
-            bus->busy = true;
-            bus->flush_count = 0;
-            bus->new_request = true;
+            start_transaction(bus);
+        }
+        else {
+            // Further delay cycles leave the bus idle
+            bus->bus_cmd = BUS_NO_CMD;
+            bus->new_request = false;
         }
         return;
     }
 
     // First priority: Handle FLUSH requests
-    for (int current = 0; current < 5; current++) {
-        if (bus->bus_request[current] && bus->bus_cmd_in[current] == BUS_FLUSH) {
+    for (int current = 0; current <= bus->memory_id; current++) {
+        bus_port_t* port = &bus->ports[current];
+        if (port->request && port->cmd == BUS_FLUSH) {
             // Only process FLUSH if it's for the current block or bus is free
-            if (bus->pending_addr != bus->bus_addr_in[current] && bus->busy) {
+            if (bus->pending_addr != port->addr && bus->busy) {
                 continue;
             }
             bus->pending_addr++;
@@ -82,14 +341,14 @@ void bus_clock(bus_system_t* bus) {
             // Process FLUSH immediately
             bus->bus_origid = current;
             bus->bus_cmd = BUS_FLUSH;
-            bus->bus_addr = bus->bus_addr_in[current];
-            bus->bus_data = bus->bus_data_in[current];
-            bus->bus_request[current] = false;
+            bus->bus_addr = port->addr;
+            bus->bus_data = port->data;
+            port->request = false;
 
             // Update block flush status
             if (bus->busy) {
                 bus->flush_count++;
-                if (bus->flush_count == WORDS_IN_BLOCK) {
+                if (bus->flush_count == bus->block_size) {
                     bus->busy = false;
                     bus->bus_shared.D = 0;
                     bus->flush_count = 0;
@@ -106,27 +365,168 @@ void bus_clock(bus_system_t* bus) {
     }
 
     // Handle non-FLUSH requests with round-robin arbitration
-    int checked = 0;
-    int current = (bus->last_granted + 1) % 4;
-
-    while (checked < 4) {
-        if (bus->bus_request[current] && bus->bus_cmd_in[current] != BUS_FLUSH) {
-            // Start delay for new request
-            bus->delay_in_progress = true;
-            bus->delay_cycles = 1;  // Use original delay value
-            bus->pending_cmd = bus->bus_cmd_in[current];
-            bus->pending_origid = current;
-            bus->pending_addr = bus->bus_addr_in[current];
-            bus->pending_data = bus->bus_data_in[current];
-            bus->bus_request[current] = false;
-            bus->last_granted = current;
-            return;
+    int current = arbitrate(bus);
+    if (current >= 0) {
+        // Start delay for new request
+        grant_request(bus, current);
+        if (bus->delay_cycles == 0) {
+            start_transaction(bus);
         }
-        current = (current + 1) % 4;
-        checked++;
+        return;
     }
 
     // No requests - bus goes idle
     bus->bus_cmd = BUS_NO_CMD;
     bus->new_request = false;
-}
\ No newline at end of file
+}
+
+bool bus_is_quiescent(bus_system_t* bus) {
+    // A split bus only waits while it carries nothing
+    bool held = bus->split ? bus->bus_cmd == BUS_NO_CMD : bus->busy;
+    if (!held || bus->delay_in_progress || bus->new_request ||
+        bus->bus_cmd == BUS_FLUSH) {
+        return false;
+    }
+
+    for (int i = 0; i <= bus->memory_id; i++) {
+        if (bus->ports[i].request) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bus_is_idle(const bus_system_t* bus) {
+    if (bus->busy || bus->delay_in_progress || bus->bus_cmd != BUS_NO_CMD) {
+        return false;
+    }
+    for (int i = 0; i <= bus->memory_id; i++) {
+        if (bus->ports[i].request) {
+            return false;
+        }
+    }
+    for (int i = 0; bus->split && i < bus->num_cores * bus->txn_slots; i++) {
+        if (bus->txns[i].valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Checkpoints */
+
+void bus_checkpoint(const bus_system_t* bus, ckpt_writer_t* out) {
+    ckpt_put_u32(out, bus->bus_origid);
+    ckpt_put_u8(out, (uint8_t)bus->bus_cmd);
+    ckpt_put_u32(out, bus->bus_addr);
+    ckpt_put_u32(out, bus->bus_data);
+    ckpt_put_register(out, &bus->bus_shared);
+    ckpt_put_u8(out, bus->memory_inhibit);
+    ckpt_put_u8(out, bus->new_request);
+    ckpt_put_u32(out, (uint32_t)bus->global_cycles);
+    ckpt_put_u8(out, bus->delay_in_progress);
+    ckpt_put_u32(out, (uint32_t)bus->delay_cycles);
+    ckpt_put_u8(out, bus->busy);
+    ckpt_put_u32(out, bus->flush_count);
+    ckpt_put_u32(out, bus->last_granted);
+    ckpt_put_u8(out, (uint8_t)bus->pending_cmd);
+    ckpt_put_u32(out, bus->pending_origid);
+    ckpt_put_u32(out, bus->pending_addr);
+    ckpt_put_u32(out, bus->pending_data);
+
+    for (int i = 0; i <= bus->memory_id; i++) {
+        const bus_port_t* port = &bus->ports[i];
+        ckpt_put_u8(out, port->request);
+        ckpt_put_u8(out, (uint8_t)port->cmd);
+        ckpt_put_u32(out, port->addr);
+        ckpt_put_u32(out, port->data);
+        ckpt_put_u8(out, port->shared);
+        ckpt_put_u8(out, port->inhibit);
+        ckpt_put_u32(out, port->dest);
+        ckpt_put_u8(out, port->low_priority);
+        ckpt_put_u32(out, (uint32_t)port->queued_since);
+        ckpt_put_u32(out, (uint32_t)port->requests);
+        ckpt_put_u32(out, (uint32_t)port->wait_cycles);
+    }
+
+    ckpt_put_u32(out, bus->bus_dest);
+    for (int i = 0; bus->split && i < bus->num_cores * bus->txn_slots; i++) {
+        const bus_txn_t* txn = &bus->txns[i];
+        ckpt_put_u8(out, txn->valid);
+        ckpt_put_u8(out, txn->shared);
+        ckpt_put_u32(out, txn->block);
+        ckpt_put_u32(out, txn->words);
+    }
+}
+
+/**
+ * @brief Check a decoded Flush destination
+ * @return true for a core of this bus or BUS_NO_DEST
+ */
+static bool valid_dest(const bus_system_t* bus, uint32_t dest) {
+    return dest < (uint32_t)bus->num_cores || dest == BUS_NO_DEST;
+}
+
+void bus_restore(bus_system_t* bus, ckpt_reader_t* in) {
+    uint32_t origid = ckpt_get_u32(in);
+    bus->bus_cmd = (bus_cmd_t)ckpt_get_enum(in, BUS_FLUSH);
+    bus->bus_addr = ckpt_get_u32(in);
+    bus->bus_data = ckpt_get_u32(in);
+    ckpt_get_register(in, &bus->bus_shared);
+    bus->memory_inhibit = ckpt_get_bool(in);
+    bus->new_request = ckpt_get_bool(in);
+    bus->global_cycles = (int)ckpt_get_u32(in);
+    bus->delay_in_progress = ckpt_get_bool(in);
+    bus->delay_cycles = (int)ckpt_get_u32(in);
+    bus->busy = ckpt_get_bool(in);
+    bus->flush_count = ckpt_get_u32(in);
+    uint32_t last_granted = ckpt_get_u32(in);
+    bus->pending_cmd = (bus_cmd_t)ckpt_get_enum(in, BUS_FLUSH);
+    uint32_t pending_origid = ckpt_get_u32(in);
+    bus->pending_addr = ckpt_get_u32(in);
+    bus->pending_data = ckpt_get_u32(in);
+
+    // Requester IDs index the ports
+    if (origid > (uint32_t)bus->memory_id || pending_origid > (uint32_t)bus->memory_id ||
+        last_granted >= (uint32_t)bus->num_cores) {
+        in->ok = false;
+        return;
+    }
+    bus->bus_origid = (uint16_t)origid;
+    bus->pending_origid = (uint16_t)pending_origid;
+    bus->last_granted = (uint16_t)last_granted;
+
+    for (int i = 0; i <= bus->memory_id; i++) {
+        bus_port_t* port = &bus->ports[i];
+        port->request = ckpt_get_bool(in);
+        port->cmd = (bus_cmd_t)ckpt_get_enum(in, BUS_FLUSH);
+        port->addr = ckpt_get_u32(in);
+        port->data = ckpt_get_u32(in);
+        port->shared = ckpt_get_bool(in);
+        port->inhibit = ckpt_get_bool(in);
+        uint32_t dest = ckpt_get_u32(in);
+        port->low_priority = ckpt_get_bool(in);
+        port->queued_since = (int)ckpt_get_u32(in);
+        port->requests = (int)ckpt_get_u32(in);
+        port->wait_cycles = (int)ckpt_get_u32(in);
+        if (!valid_dest(bus, dest)) {
+            in->ok = false;
+            return;
+        }
+        port->dest = (uint16_t)dest;
+    }
+
+    uint32_t bus_dest = ckpt_get_u32(in);
+    if (!valid_dest(bus, bus_dest)) {
+        in->ok = false;
+        return;
+    }
+    bus->bus_dest = (uint16_t)bus_dest;
+    for (int i = 0; bus->split && i < bus->num_cores * bus->txn_slots; i++) {
+        bus_txn_t* txn = &bus->txns[i];
+        txn->valid = ckpt_get_bool(in);
+        txn->shared = ckpt_get_bool(in);
+        txn->block = ckpt_get_u32(in);
+        txn->words = ckpt_get_u32(in);
+    }
+}
@@ -3,10 +3,16 @@
  * @brief Implementation of the system bus with MESI coherency protocol support
  *
  * This bus system implements:
- * - Support for 4 processor cores plus main memory
+ * - Support for a configurable number of processor cores plus main memory
  * - MESI coherency protocol commands (BusRd, BusRdX, Flush)
  * - Round-robin arbitration for bus access
  * - Shared line for cache-to-cache transfers
+ * - Memory inhibit line for blocks a cache supplies in place of memory (MOESI)
+ * - Optional split transactions: a BusRd/BusRdX only holds the bus for its
+ *   own cycle, and the Flush words answering it are tagged with the
+ *   requester, so misses to different blocks can be outstanding at once
+ * - Low-priority BusRd requests for prefetches, granted only when no
+ *   demand request is waiting
  */
 
 #ifndef BUS_SYSTEM_H
@@ -15,6 +21,12 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "register.h"
+#include "checkpoint.h"
+#include "platform.h"
+
+#define BUS_MAX_CORES 1024  ///< Upper bound on the runtime core count
+#define BUS_DEFAULT_DELAY 1 ///< Default cycles from grant to the start of a BusRd/BusRdX
+#define BUS_NO_DEST 0xFFFF  ///< Destination of Flush words that answer no request (write-backs)
 
  /**
   * @brief Bus commands for MESI protocol
@@ -26,16 +38,48 @@ typedef enum {
     BUS_FLUSH = 3    ///< Write modified data back
 } bus_cmd_t;
 
+/**
+ * @brief Request lines of one bus requester (core or memory)
+ *
+ * Each port sits on its own host cache line so cores running on different
+ * host threads never write to the same line.
+ */
+typedef struct {
+    SIM_ALIGNED(SIM_CACHE_LINE) bool request;  ///< Bus request signal
+    bus_cmd_t cmd;           ///< Requested command
+    uint32_t addr;           ///< Requested address
+    uint32_t data;           ///< Data to transfer
+    bool shared;             ///< Shared line asserted by this requester this cycle
+    bool inhibit;            ///< Memory inhibit line asserted by this requester this cycle
+    uint16_t dest;           ///< Requester a Flush word answers (BUS_NO_DEST if none)
+    bool low_priority;       ///< The queued BusRd is a prefetch, granted after demand requests
+    int queued_since;        ///< Cycle the queued BusRd/BusRdX was requested (-1 = none)
+    int requests;            ///< BusRd/BusRdX requests granted
+    int wait_cycles;         ///< Cycles the granted requests waited for the bus
+} bus_port_t;
+
+/**
+ * @brief Outstanding BusRd/BusRdX of a core on a split-transaction bus
+ */
+typedef struct {
+    bool valid;              ///< The request was driven and its block is still arriving
+    bool shared;             ///< Another cache asserted the shared line for it
+    uint32_t block;          ///< Base address of the requested block
+    uint32_t words;          ///< Response words driven so far
+} bus_txn_t;
+
 /**
  * @brief Main bus system structure
  */
 typedef struct {
     /* Bus Command Lines */
-    uint8_t bus_origid;      ///< Transaction originator (0-3: cores, 4: memory)
+    uint16_t bus_origid;     ///< Transaction originator (cores 0..N-1, memory N)
     bus_cmd_t bus_cmd;       ///< Current bus command
-    uint32_t bus_addr;       ///< 20-bit address bus
+    uint32_t bus_addr;       ///< Word address bus (20 bits by default)
     uint32_t bus_data;       ///< 32-bit data bus
+    uint16_t bus_dest;       ///< Requester a Flush word answers (split mode, BUS_NO_DEST if none)
     Register bus_shared;     ///< Shared line for cache-to-cache transfer
+    bool memory_inhibit;     ///< A cache supplies the block of last cycle's BusRd/BusRdX
     bool new_request;        ///< Indicates new bus transaction
 
     /* System State */
@@ -43,45 +87,115 @@ typedef struct {
     bool delay_in_progress;  ///< Initial delay for bus operations
     int delay_cycles;        ///< Remaining delay cycles
 
-    /* Request Lines (per core + memory) */
-    bool bus_request[5];     ///< Bus request signals
-    bus_cmd_t bus_cmd_in[5]; ///< Requested commands
-    uint32_t bus_addr_in[5]; ///< Requested addresses
-    uint32_t bus_data_in[5]; ///< Data to transfer
+    /* Topology */
+    int num_cores;           ///< Number of processor cores on the bus
+    int memory_id;           ///< Requester ID of main memory (== num_cores)
+    uint32_t addr_mask;      ///< Word address mask of main memory
+    uint32_t block_size;     ///< Words per cache block (power of two)
+    int arbitration_delay;   ///< Cycles from grant to the start of a BusRd/BusRdX
+    bool split;              ///< Split transactions with tagged responses
+
+    /* Request Lines (per core + memory, num_cores + 1 entries) */
+    bus_port_t* ports;       ///< Per-requester request lines
 
     /* Bus Control State */
     bool busy;              ///< Bus is processing a transaction
     uint32_t flush_count;   ///< Number of words flushed in current block
-    uint8_t last_granted;   ///< Last core granted for round-robin
+    uint16_t last_granted;  ///< Last core granted for round-robin
 
     /* Pending Transaction */
     bus_cmd_t pending_cmd;   ///< Command waiting for delay
-    uint8_t pending_origid;  ///< Originator of pending command
+    uint16_t pending_origid; ///< Originator of pending command
     uint32_t pending_addr;   ///< Address of pending transaction
     uint32_t pending_data;   ///< Data for pending transaction
+
+    /* Split Transactions */
+    bus_txn_t* txns;         ///< Outstanding requests, txn_slots per core (split mode only, else NULL)
+    int txn_slots;           ///< Requests a core may have outstanding at once (split mode)
+    int last_txn;            ///< Transaction started by this cycle's BusRd/BusRdX
 } bus_system_t;
 
 /**
  * @brief Initialize the bus system
  * @param bus Pointer to bus system structure
+ * @param num_cores Number of processor cores (1..BUS_MAX_CORES)
+ * @param block_size Words per cache block (power of two)
+ * @param arbitration_delay Cycles from grant to the start of a BusRd/BusRdX
+ *                          (0 = the granted transaction is driven at once)
+ * @param split Decouple requests from their tagged responses instead of
+ *              holding the bus until the block has been transferred
+ * @param outstanding BusRd/BusRdX requests per core in flight at once on a
+ *                    split bus (at least 1; ignored on an atomic bus)
+ * @return true on success, false if the request lines could not be allocated
  */
-void bus_init(bus_system_t* bus);
+bool bus_init(bus_system_t* bus, int num_cores, int block_size, int arbitration_delay, bool split,
+    int outstanding);
+
+/**
+ * @brief Release the request lines and transaction table allocated by bus_init
+ * @param bus Pointer to bus system structure
+ */
+void bus_free(bus_system_t* bus);
 
 /**
  * @brief Request bus access for a transaction
  * @param bus Pointer to bus system
- * @param core_id Requesting core (0-3) or memory (4)
+ * @param core_id Requesting core (0..N-1) or memory (N)
  * @param cmd Bus command to execute
  * @param addr Target address
  * @param data Data to transfer (for writes)
  */
 void bus_request(bus_system_t* bus, int core_id, bus_cmd_t cmd, uint32_t addr, uint32_t data);
 
+/**
+ * @brief Request a BusRd for a prefetch at low priority
+ * @param bus Pointer to bus system
+ * @param core_id Requesting core
+ * @param addr Address within the prefetched block
+ *
+ * Arbitration grants it only in a cycle where no core requests a demand
+ * BusRd/BusRdX. A later bus_request on the same port replaces it.
+ */
+void bus_prefetch(bus_system_t* bus, int core_id, uint32_t addr);
+
+/**
+ * @brief Request bus access for a Flush word answering a BusRd/BusRdX
+ * @param bus Pointer to bus system
+ * @param core_id Supplying core (0..N-1) or memory (N)
+ * @param dest Core whose request is answered
+ * @param addr Word address
+ * @param data Word to transfer
+ *
+ * On a split-transaction bus the tag routes the word to the requester and
+ * completes its transaction; on an atomic bus it is ignored.
+ */
+void bus_respond(bus_system_t* bus, int core_id, int dest, uint32_t addr, uint32_t data);
+
 /**
  * @brief Set shared line to indicate cache-to-cache transfer
  * @param bus Pointer to bus system
+ * @param core_id Core asserting the line
+ *
+ * The assertion is recorded on the core's own port and merged into the
+ * shared register by bus_latch_shared() at the end of the cycle.
  */
-void bus_set_shared(bus_system_t* bus);
+void bus_set_shared(bus_system_t* bus, int core_id);
+
+/**
+ * @brief Tell main memory that a cache supplies the block of the current BusRd/BusRdX
+ * @param bus Pointer to bus system
+ * @param core_id Core asserting the line
+ *
+ * Recorded on the core's port like the shared line; memory sees the
+ * merged line in the next cycle, together with the request.
+ */
+void bus_set_inhibit(bus_system_t* bus, int core_id);
+
+/**
+ * @brief Merge this cycle's shared and inhibit assertions and clock the shared line
+ * @param bus Pointer to bus system
+ */
+void bus_latch_shared(bus_system_t* bus);
 
 /**
  * @brief Update bus state each clock cycle
@@ -92,7 +206,45 @@ void bus_set_shared(bus_system_t* bus);
  * 2. Processes initial delay for new transactions
  * 3. Performs round-robin arbitration for new requests
  * 4. Updates bus state and signals
+ *
+ * In split mode a BusRd/BusRdX whose delay has passed takes the bus for
+ * one cycle, and in every other cycle one Flush word moves; arbitration
+ * runs alongside and skips requests for blocks already outstanding.
+ * In both modes prefetches are granted only when no demand request waits.
  */
 void bus_clock(bus_system_t* bus);
 
+/**
+ * @brief Check if the bus will stay unchanged on the next clock
+ * @param bus Pointer to bus system
+ * @return true if a RD/RDX transaction holds the bus (split mode: the
+ *         bus is idle) and nothing is requested or being arbitrated
+ */
+bool bus_is_quiescent(bus_system_t* bus);
+
+/**
+ * @brief Check if the bus has finished every transaction
+ * @param bus Pointer to bus system
+ * @return true if nothing is driven, requested, delayed or in flight, so
+ *         main memory has taken every word flushed to it
+ */
+bool bus_is_idle(const bus_system_t* bus);
+
+/**
+ * @brief Encode the bus lines, transaction state and request ports
+ * @param bus Pointer to bus system
+ * @param out Checkpoint state section
+ */
+void bus_checkpoint(const bus_system_t* bus, ckpt_writer_t* out);
+
+/**
+ * @brief Decode the state written by bus_checkpoint
+ * @param bus Bus initialized for the same core count
+ * @param in Checkpoint state section
+ *
+ * Topology, block size, delay, mode and the address mask are kept;
+ * out-of-range requester IDs clear in->ok.
+ */
+void bus_restore(bus_system_t* bus, ckpt_reader_t* in);
+
 #endif
\ No newline at end of file
@@ -1,351 +1,900 @@
 ﻿/**
  * @file cache.c
  * @brief Implementation of cache functionality with MESI protocol
+ *
+ * The access and bus functions live in cache_kernel.h and are instantiated
+ * below, once generically and once per specialized organization; the
+ * public functions dispatch through the kernel chosen at initialization.
  */
 
+#include <stdlib.h>
 #include "cache.h"
 
  /* Address Manipulation Functions */
 
-uint32_t get_tag(uint32_t addr) {
-    return addr >> TAG_SHIFT;
+uint32_t get_tag(const cache_t* cache, uint32_t addr) {
+    return addr >> cache->tag_shift;
 }
 
-uint32_t get_index(uint32_t addr) {
-    return (addr >> INDEX_SHIFT) & INDEX_MASK;
+uint32_t get_index(const cache_t* cache, uint32_t addr) {
+    return (addr >> cache->block_bits) & cache->index_mask;
 }
 
-uint32_t get_block_offset(uint32_t addr) {
-    return addr & BLOCK_OFFSET_MASK;
+uint32_t get_block_offset(const cache_t* cache, uint32_t addr) {
+    return addr & cache->offset_mask;
 }
 
-uint32_t get_block_addr(uint32_t addr) {
-    return addr & ~BLOCK_OFFSET_MASK;
+uint32_t get_block_addr(const cache_t* cache, uint32_t addr) {
+    return addr & ~cache->offset_mask;
 }
 
-/* Core Cache Functions */
+/* Miss Status Holding Registers */
 
-void cache_init(cache_t* cache, int core_id) {
-    // Set core ID
-    cache->cache_id = core_id;
+#define LINE_PREFETCHED 1  ///< Line filled by a prefetch and not used since
+#define LINE_DISPLACED 2   ///< cache_t.displaced holds the block a prefetch evicted from the line
 
-    // Initialize TSRAM - all entries invalid
-    for (int i = 0; i < NUM_SETS; i++) {
-        cache->tsram[i].state = MESI_I;
-        cache->tsram[i].tag = 0;
+/**
+ * @brief Find the MSHR fetching a block
+ * @param cache Pointer to cache structure
+ * @param block Base address of the block
+ * @return MSHR index, or -1 if no miss to the block is outstanding
+ */
+static int find_mshr(const cache_t* cache, uint32_t block) {
+    for (int i = 0; i < cache->num_mshrs; i++) {
+        if (cache->mshrs[i].valid && cache->mshrs[i].block == block) {
+            return i;
+        }
     }
+    return -1;
+}
 
-    // Initialize DSRAM to zero
-    for (int i = 0; i < CACHE_SIZE; i++) {
-        cache->dsram[i] = 0;
+/**
+ * @brief Check whether a line is being filled by an outstanding miss
+ * @param cache Pointer to cache structure
+ * @param line Line index
+ */
+static bool line_reserved(const cache_t* cache, int line) {
+    for (int i = 0; cache->mshr_active > 0 && i < cache->num_mshrs; i++) {
+        if (cache->mshrs[i].valid && cache->mshrs[i].line == line) {
+            return true;
+        }
     }
-
-    // Initialize bus transaction state
-    cache->is_mine = false;
-    cache->waiting_for_bus = false;
-    cache->sending_flush = false;
-
-    // Initialize performance counters
-    cache->read_hit = 0;
-    cache->write_hit = 0;
-    cache->read_miss = 0;
-    cache->write_miss = 0;
-
-    // Initialize block replacement state
-    cache->need_to_clean_first = false;
-    cache->words_left = -1;
+    return false;
 }
 
-void cache_read(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t* data, bool* ready) {
-    // Cannot process new request if busy with bus
-    if (cache->waiting_for_bus || cache->sending_flush) {
-        *ready = false;
-        return;
+/**
+ * @brief Check whether a new miss in a set can start
+ * @param cache Pointer to cache structure
+ * @param set Set index of the missing block
+ * @return false if every MSHR in the limit is in use, or every way of the
+ *         set is being filled
+ */
+static bool mshr_available(const cache_t* cache, uint32_t set) {
+    if (cache->mshr_active >= cache->mshr_limit) {
+        return false;
+    }
+    int first = (int)set << cache->way_bits;
+    for (int line = first; line < first + cache->ways; line++) {
+        if (!line_reserved(cache, line)) {
+            return true;
+        }
     }
+    return false;
+}
 
-    // Extract address components
-    uint32_t tag = get_tag(addr);
-    uint32_t index = get_index(addr);
-    uint32_t offset = get_block_offset(addr);
+/**
+ * @brief Count an access that finds no free MSHR or way, once however long it retries
+ * @param cache Pointer to cache structure
+ */
+static void wait_for_mshr(cache_t* cache) {
+    if (!cache->mshr_waiting) {
+        cache->mshr_full++;
+        cache->mshr_waiting = true;
+    }
+}
 
-    // Check for cache hit
-    if (cache->tsram[index].tag == tag && cache->tsram[index].state != MESI_I) {
-        // Cache hit - return data immediately
-        *data = cache->dsram[index * BLOCK_SIZE + offset];
-        *ready = true;
-        cache->read_hit++;
-        cache->is_mine = false;
+/**
+ * @brief Note that a Flush word is about to overwrite a request queued on our port
+ * @param cache Pointer to cache structure
+ * @param port Our bus port, holding a BusRd/BusRdX
+ *
+ * The MSHR is issued again by cache_clock once the port is free.
+ */
+static void displace_request(cache_t* cache, const bus_port_t* port) {
+    if (!cache->mshrs) {
+        cache->resend_request = true;
         return;
     }
+    int index = find_mshr(cache, port->addr & ~cache->offset_mask);
+    if (index >= 0) {
+        cache->mshrs[index].issued = false;
+    }
+}
 
-    // Cache miss - handle replacement if necessary
-    if (cache->tsram[index].state == MESI_M && !cache->need_to_clean_first) {
-        // Need to write back modified block first
-        cache->need_to_clean_first = true;
-        cache->words_left = 0;
-        uint32_t block_addr = (cache->tsram[index].tag << TAG_SHIFT) | (index << INDEX_SHIFT);
-        *ready = false;
-        cache->read_miss++;
-        // Start flush of first word
-        bus_request(bus, cache->cache_id, BUS_FLUSH,
-            block_addr + cache->words_left - 1,
-            cache->dsram[index * BLOCK_SIZE + cache->words_left++]);
-    }
-    else if (cache->need_to_clean_first) {
-        // Continue flushing remaining words
-        uint32_t block_addr = (cache->tsram[index].tag << TAG_SHIFT) | (index << INDEX_SHIFT);
-        bus_request(bus, cache->cache_id, BUS_FLUSH,
-            block_addr + cache->words_left - 1,
-            cache->dsram[index * BLOCK_SIZE + cache->words_left++]);
-
-        if (cache->words_left == BLOCK_SIZE) {
-            // Finished flushing
-            cache->need_to_clean_first = false;
-            cache->tsram[index].state = MESI_I;
+/**
+ * @brief Queue the request of an MSHR on our bus port if the port is free
+ * @param cache Pointer to cache structure
+ * @param bus Pointer to bus system
+ * @param mshr MSHR not yet issued
+ * @return true if the request was queued
+ *
+ * A demand miss takes the port from a queued prefetch, which is issued
+ * again later.
+ */
+static bool issue_mshr(cache_t* cache, bus_system_t* bus, mshr_t* mshr) {
+    const bus_port_t* port = &bus->ports[cache->cache_id];
+    if (port->request) {
+        if (mshr->prefetch || !port->low_priority) {
+            return false;
         }
-        *ready = false;
-        cache->read_miss++;
+        displace_request(cache, port);
+    }
+    if (mshr->prefetch) {
+        bus_prefetch(bus, cache->cache_id, mshr->addr);
     }
     else {
-        // Standard cache miss - request block
-        cache->waiting_for_bus = true;
-        cache->waiting_addr = addr;
-        cache->is_write_request = false;
-        *ready = false;
-        cache->read_miss++;
-        bus_request(bus, cache->cache_id, BUS_RD, addr, 0);
-        cache->read_hit--; // Adjust for initial increment
+        bus_request(bus, cache->cache_id, mshr->is_write ? BUS_RDX : BUS_RD, mshr->addr, 0);
     }
+    mshr->issued = true;
+    return true;
 }
 
-void cache_write(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t data, bool* ready) {
-    // Cannot process new request if busy with bus
-    if (cache->waiting_for_bus || cache->sending_flush) {
-        *ready = false;
-        return;
+/**
+ * @brief Start a miss in a free MSHR and request its block
+ * @param cache Pointer to cache structure (mshr_available was true)
+ * @param bus Pointer to bus system
+ * @param addr Word address of the access
+ * @param line Line receiving the block
+ * @param is_write Request the block exclusively for a store
+ * @param data Data of the store
+ * @param prefetch Requested by the prefetcher rather than an access
+ * @return The new MSHR
+ */
+static mshr_t* open_mshr(cache_t* cache, bus_system_t* bus, uint32_t addr, int line,
+    bool is_write, uint32_t data, bool prefetch) {
+    mshr_t* mshr = cache->mshrs;
+    while (mshr->valid) {
+        mshr++;
+    }
+    mshr->valid = true;
+    mshr->issued = false;
+    mshr->driven = false;
+    mshr->is_write = is_write;
+    mshr->prefetch = prefetch;
+    mshr->addr = addr;
+    mshr->block = addr & ~cache->offset_mask;
+    mshr->line = line;
+    mshr->write_data = data;
+    mshr->num_targets = 0;
+
+    cache->waiting_for_bus = true;
+    cache->mshr_waiting = false;
+    if (++cache->mshr_active > cache->mshr_peak) {
+        cache->mshr_peak = cache->mshr_active;
     }
+    issue_mshr(cache, bus, mshr);
+    return mshr;
+}
 
-    // Extract address components
-    uint32_t tag = get_tag(addr);
-    uint32_t index = get_index(addr);
-    uint32_t offset = get_block_offset(addr);
-
-    // Check for cache hit with correct tag
-    if (cache->tsram[index].tag == tag) {
-        switch (cache->tsram[index].state) {
-        case MESI_M:
-        case MESI_E:
-            // Can write directly in Modified or Exclusive state
-            cache->dsram[index * BLOCK_SIZE + offset] = data;
-            cache->tsram[index].state = MESI_M;
-            *ready = true;
-            cache->write_hit++;
-            cache->is_mine = false;
-            break;
-
-        case MESI_S:
-            // Need exclusive access - request upgrade
-            cache->waiting_for_bus = true;
-            cache->waiting_addr = addr;
-            cache->is_write_request = true;
-            cache->write_data = data;
-            *ready = false;
-            cache->write_miss++;
-            bus_request(bus, cache->cache_id, BUS_RDX, addr, 0);
-            bus_set_shared(bus);
-            cache->write_hit--;
-            break;
-
-        case MESI_I:
-            // Need to fetch block first
-            cache->waiting_for_bus = true;
-            cache->waiting_addr = addr;
-            cache->is_write_request = true;
-            cache->write_data = data;
-            *ready = false;
-            cache->write_miss++;
-            bus_request(bus, cache->cache_id, BUS_RDX, addr, 0);
-            cache->write_hit--;
-            break;
-        }
+/**
+ * @brief Retire an MSHR whose block has arrived
+ * @param cache Pointer to cache structure
+ * @param mshr Valid MSHR
+ */
+static void close_mshr(cache_t* cache, mshr_t* mshr) {
+    mshr->valid = false;
+    cache->mshr_active--;
+    cache->waiting_for_bus = cache->mshr_active > 0;
+}
+
+/* Prefetch Accounting */
+
+/**
+ * @brief Report a demand access to the prefetcher and count prefetch use
+ * @param cache Pointer to cache structure
+ * @param pc Address of the accessing instruction
+ * @param addr Word address (within the memory width)
+ * @param line Line hit, or -1 for a miss that opened an MSHR
+ */
+static void note_access(cache_t* cache, uint32_t pc, uint32_t addr, int line) {
+    if (cache->prefetch.policy == PREFETCH_NONE) {
         return;
     }
 
-    // Cache miss - handle replacement if necessary
-    if (cache->tsram[index].state == MESI_M && !cache->need_to_clean_first) {
-        // Need to write back modified block first
-        cache->need_to_clean_first = true;
-        cache->words_left = 0;
-        uint32_t block_addr = (cache->tsram[index].tag << TAG_SHIFT) | (index << INDEX_SHIFT);
-        *ready = false;
-        cache->write_miss++;
-        bus_request(bus, cache->cache_id, BUS_FLUSH,
-            block_addr + cache->words_left - 1,
-            cache->dsram[index * BLOCK_SIZE + cache->words_left++]);
-    }
-    else if (cache->need_to_clean_first) {
-        // Continue flushing remaining words
-        uint32_t block_addr = (cache->tsram[index].tag << TAG_SHIFT) | (index << INDEX_SHIFT);
-        bus_request(bus, cache->cache_id, BUS_FLUSH,
-            block_addr + cache->words_left - 1,
-            cache->dsram[index * BLOCK_SIZE + cache->words_left++]);
-
-        if (cache->words_left == BLOCK_SIZE) {
-            cache->need_to_clean_first = false;
-            *ready = false;
-            cache->write_miss++;
+    prefetch_event_t event = PREFETCH_HIT;
+    if (line < 0) {
+        // A miss to a block that a prefetch pushed out of its set
+        uint32_t block = get_block_addr(cache, addr);
+        int first = (int)get_index(cache, addr) << cache->way_bits;
+        for (int i = first; i < first + cache->ways; i++) {
+            if ((cache->prefetched[i] & LINE_DISPLACED) && cache->displaced[i] == block) {
+                cache->prefetched[i] &= (uint8_t)~LINE_DISPLACED;
+                cache->prefetch_polluting++;
+            }
         }
+        event = PREFETCH_MISS;
     }
-    else {
-        // Standard cache miss - request block with exclusive access
-        cache->waiting_for_bus = true;
-        cache->waiting_addr = addr;
-        cache->is_write_request = true;
-        cache->write_data = data;
-        *ready = false;
-        cache->write_miss++;
-        bus_request(bus, cache->cache_id, BUS_RDX, addr, 0);
-        cache->write_hit--;
+    else if (cache->prefetched[line] & LINE_PREFETCHED) {
+        cache->prefetched[line] &= (uint8_t)~LINE_PREFETCHED;
+        cache->prefetch_useful++;
+        event = PREFETCH_USE;
     }
+    prefetch_train(&cache->prefetch, pc, addr, event);
 }
 
-void cache_snoop(cache_t* cache, bus_system_t* bus) {
-    // Ignore our own transactions except flushes
-    if (bus->bus_origid == cache->cache_id &&
-        bus->bus_cmd != BUS_NO_CMD &&
-        bus->bus_cmd != BUS_FLUSH) {
-        cache->is_mine = true;
-        return;
+/**
+ * @brief Hand a prefetch still in flight to the demand access that reached it
+ * @param cache Pointer to cache structure
+ * @param mshr MSHR of the accessed block
+ * @param pc Address of the accessing instruction
+ * @param addr Word address
+ * @return true if the MSHR was a prefetch (the access has been trained on)
+ */
+static bool claim_prefetch(cache_t* cache, mshr_t* mshr, uint32_t pc, uint32_t addr) {
+    if (!mshr->prefetch) {
+        return false;
     }
+    mshr->prefetch = false;
+    cache->prefetch_late++;
+    prefetch_train(&cache->prefetch, pc, addr, PREFETCH_USE);
+    return true;
+}
+
+/* Replacement */
 
-    // Handle block cleaning state update
-    if (cache->need_to_clean_first) {
-        if (bus->bus_cmd != BUS_FLUSH || bus->bus_origid != cache->cache_id) {
-            cache->words_left--;
+/**
+ * @brief Choose the line that receives a missing block
+ * @param cache Pointer to cache structure
+ * @param set Set index of the missing block
+ * @return Line index within the set
+ *
+ * Lines being filled by outstanding misses are passed over (with MSHRs the
+ * caller has checked that the set has another line).
+ */
+static int choose_victim(cache_t* cache, uint32_t set) {
+    int first = (int)set << cache->way_bits;
+    int last = first + cache->ways;
+
+    // Free lines first
+    for (int line = first; line < last; line++) {
+        if (cache->tsram[line].state == MESI_I && !line_reserved(cache, line)) {
+            return line;
         }
     }
 
-    // Extract address components for current bus transaction
-    uint32_t index = get_index(bus->bus_addr);
-    uint32_t tag = get_tag(bus->bus_addr);
-
-    // Check if we have this block in our cache
-    if (cache->tsram[index].tag == tag && cache->tsram[index].state != MESI_I) {
-        switch (bus->bus_cmd) {
-        case BUS_RD:
-            // Handle read request from another cache
-            if (cache->tsram[index].state == MESI_M) {
-                // We have modified data - need to provide it
-                bus_set_shared(bus);
-                // Prepare to flush our modified data
-                cache->sending_flush = true;
-                cache->flush_block_addr = get_block_addr(bus->bus_addr);
-                cache->words_left_to_flush = BLOCK_SIZE;
-                // Change our state to Shared
-                cache->tsram[index].state = MESI_S;
-            }
-            else if (cache->tsram[index].state == MESI_E) {
-                // We have exclusive but unmodified data
-                cache->tsram[index].state = MESI_S;
-                bus_set_shared(bus);
+    int victim;
+    switch (cache->policy) {
+    case CACHE_LRU:
+        victim = first;
+        for (int line = first + 1; line < last; line++) {
+            if (cache->repl[line] > cache->repl[victim]) {
+                victim = line;
             }
-            else if (cache->tsram[index].state == MESI_S) {
-                // Already in shared state - just signal presence
-                bus_set_shared(bus);
+        }
+        break;
+
+    case CACHE_PLRU: {
+        // Follow the tree bits from the root (node 1) to a leaf
+        int node = 1;
+        while (node < cache->ways) {
+            node = 2 * node + ((cache->plru[set] >> node) & 1);
+        }
+        victim = first + node - cache->ways;
+        break;
+    }
+
+    case CACHE_RANDOM: {
+        uint32_t x = cache->random_state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        cache->random_state = x;
+        victim = first + (int)(x & (uint32_t)(cache->ways - 1));
+        break;
+    }
+
+    case CACHE_RRIP:
+    default:
+        // Age the whole set until some line is predicted to be re-referenced last
+        for (victim = -1; victim < 0;) {
+            for (int line = first; line < last; line++) {
+                if (cache->repl[line] >= RRIP_MAX) {
+                    victim = line;
+                    break;
+                }
             }
-            break;
-
-        case BUS_RDX:
-            // Handle exclusive read request
-            if (cache->tsram[index].state == MESI_M) {
-                // Need to flush our modified data
-                cache->sending_flush = true;
-                cache->flush_block_addr = get_block_addr(bus->bus_addr);
-                cache->words_left_to_flush = BLOCK_SIZE;
+            for (int line = first; victim < 0 && line < last; line++) {
+                cache->repl[line]++;
             }
-            // Must invalidate our copy
-            cache->tsram[index].state = MESI_I;
-            break;
         }
+        break;
     }
+
+    // The policy's choice is being filled: take the first line that is not
+    for (int line = first; line < last && line_reserved(cache, victim); line++) {
+        victim = line;
+    }
+    return victim;
 }
 
-void cache_handle_bus_response(cache_t* cache, bus_system_t* bus) {
-    // Only process responses for our own pending requests
-    if (!cache->waiting_for_bus || !cache->is_mine) {
-        return;
+/**
+ * @brief Check whether a flushed word still waits for the bus on our port
+ * @param cache Pointer to cache structure
+ * @param bus Pointer to bus system
+ *
+ * The last word of a snoop response or write-back is requested in the cycle
+ * the flush ends; a new request in that cycle would overwrite it, so the
+ * miss waits until the bus has taken the word. Words of a write-back still
+ * in progress are resent by write_back_victim instead.
+ */
+static bool flush_word_pending(const cache_t* cache, const bus_system_t* bus) {
+    const bus_port_t* port = &bus->ports[cache->cache_id];
+    return !cache->need_to_clean_first && port->request && port->cmd == BUS_FLUSH;
+}
+
+/* Kernels */
+
+/**
+ * @brief Access and bus functions compiled for one organization
+ */
+struct cache_kernel {
+    const char* name;   ///< Organization the kernel is compiled for
+    int block_bits;     ///< log2 of the block size (-1 for the generic kernel)
+    int set_bits;       ///< log2 of the number of sets
+    int way_bits;       ///< log2 of the associativity
+    void (*read)(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t* data, bool* ready);
+    void (*write)(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t data, bool* ready);
+    cache_status_t (*load)(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t pc, int tag,
+        uint32_t* data);
+    void (*store)(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t pc, uint32_t data,
+        bool* ready);
+    void (*snoop)(cache_t* cache, bus_system_t* bus);
+    void (*handle_bus_response)(cache_t* cache, bus_system_t* bus);
+    void (*clock)(cache_t* cache, bus_system_t* bus);
+    void (*bus_cycle)(cache_t* cache, bus_system_t* bus);
+};
+
+#define KERNEL_SUFFIX _generic
+#define KERNEL_NAME "generic"
+#include "cache_kernel.h"
+
+#ifndef SIM_NO_CACHE_KERNELS
+#define KERNEL_SUFFIX _256w_4b_1way
+#define KERNEL_NAME "256w-4b-1way"
+#define KERNEL_BLOCK_BITS 2
+#define KERNEL_SET_BITS 6
+#define KERNEL_WAY_BITS 0
+#include "cache_kernel.h"
+
+#define KERNEL_SUFFIX _256w_4b_2way
+#define KERNEL_NAME "256w-4b-2way"
+#define KERNEL_BLOCK_BITS 2
+#define KERNEL_SET_BITS 5
+#define KERNEL_WAY_BITS 1
+#include "cache_kernel.h"
+
+#define KERNEL_SUFFIX _256w_4b_4way
+#define KERNEL_NAME "256w-4b-4way"
+#define KERNEL_BLOCK_BITS 2
+#define KERNEL_SET_BITS 4
+#define KERNEL_WAY_BITS 2
+#include "cache_kernel.h"
+
+#define KERNEL_SUFFIX _1024w_4b_1way
+#define KERNEL_NAME "1024w-4b-1way"
+#define KERNEL_BLOCK_BITS 2
+#define KERNEL_SET_BITS 8
+#define KERNEL_WAY_BITS 0
+#include "cache_kernel.h"
+
+#define KERNEL_SUFFIX _1024w_4b_4way
+#define KERNEL_NAME "1024w-4b-4way"
+#define KERNEL_BLOCK_BITS 2
+#define KERNEL_SET_BITS 6
+#define KERNEL_WAY_BITS 2
+#include "cache_kernel.h"
+
+#define KERNEL_SUFFIX _1024w_8b_1way
+#define KERNEL_NAME "1024w-8b-1way"
+#define KERNEL_BLOCK_BITS 3
+#define KERNEL_SET_BITS 7
+#define KERNEL_WAY_BITS 0
+#include "cache_kernel.h"
+
+/** Specialized kernels, matched against the geometry by cache_select_kernel */
+static const cache_kernel_t* const cache_kernels[] = {
+    &cache_kernel_256w_4b_1way,
+    &cache_kernel_256w_4b_2way,
+    &cache_kernel_256w_4b_4way,
+    &cache_kernel_1024w_4b_1way,
+    &cache_kernel_1024w_4b_4way,
+    &cache_kernel_1024w_8b_1way
+};
+#endif
+
+void cache_select_kernel(cache_t* cache, bool specialized) {
+    cache->kernel = &cache_kernel_generic;
+#ifndef SIM_NO_CACHE_KERNELS
+    if (!specialized) return;
+
+    int set_bits = cache->tag_shift - cache->block_bits;
+    for (size_t i = 0; i < sizeof(cache_kernels) / sizeof(cache_kernels[0]); i++) {
+        const cache_kernel_t* kernel = cache_kernels[i];
+        if (kernel->block_bits == cache->block_bits && kernel->set_bits == set_bits &&
+            kernel->way_bits == cache->way_bits) {
+            cache->kernel = kernel;
+            return;
+        }
     }
+#else
+    (void)specialized;
+#endif
+}
 
-    // Handle incoming flush data
-    if (bus->bus_cmd == BUS_FLUSH) {
-        uint32_t index = get_index(bus->bus_addr);
-        uint32_t offset = get_block_offset(bus->bus_addr);
+const char* cache_kernel_name(const cache_t* cache) {
+    return cache->kernel->name;
+}
 
-        // Store the received word in our cache
-        cache->dsram[index * BLOCK_SIZE + offset] = bus->bus_data;
+void cache_read(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t* data, bool* ready) {
+    cache->kernel->read(cache, bus, addr, data, ready);
+}
 
-        // Check if this completes the block transfer
-        if (offset == BLOCK_SIZE - 1) {
-            // Update tag and state
-            cache->tsram[index].tag = get_tag(bus->bus_addr);
+cache_status_t cache_load(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t pc, int tag,
+    uint32_t* data) {
+    if (cache->mshrs) {
+        return cache->kernel->load(cache, bus, addr, pc, tag, data);
+    }
+    bool ready;
+    cache->kernel->read(cache, bus, addr, data, &ready);
+    return ready ? CACHE_READY : CACHE_BUSY;
+}
 
-            if (cache->is_write_request) {
-                // For write requests, transition to Modified
-                cache->tsram[index].state = MESI_M;
-                // Perform the pending write operation
-                offset = get_block_offset(cache->waiting_addr);
-                cache->dsram[index * BLOCK_SIZE + offset] = cache->write_data;
-            }
-            else {
-                // For read requests, state depends on shared signal
-                cache->tsram[index].state = bus->bus_shared.Q == 1 ? MESI_S : MESI_E;
-            }
+void cache_write(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t pc, uint32_t data,
+    bool* ready) {
+    if (cache->mshrs) {
+        cache->kernel->store(cache, bus, addr, pc, data, ready);
+        return;
+    }
+    cache->kernel->write(cache, bus, addr, data, ready);
+}
 
-            // Transaction is complete
-            cache->waiting_for_bus = false;
+bool cache_misses_issued(const cache_t* cache) {
+    if (cache->prefetch.count > 0) {
+        return false;
+    }
+    for (int i = 0; i < cache->num_mshrs; i++) {
+        if (cache->mshrs[i].valid && !cache->mshrs[i].issued) {
+            return false;
         }
     }
+    return true;
+}
+
+void cache_snoop(cache_t* cache, bus_system_t* bus) {
+    cache->kernel->snoop(cache, bus);
+}
+
+void cache_handle_bus_response(cache_t* cache, bus_system_t* bus) {
+    cache->kernel->handle_bus_response(cache, bus);
 }
 
 void cache_clock(cache_t* cache, bus_system_t* bus) {
-    // First priority: handle any pending flushes
-    if (cache->sending_flush && cache->words_left_to_flush > 0) {
-        // Calculate address and data for current word
-        uint32_t curr_word = BLOCK_SIZE - cache->words_left_to_flush;
-        uint32_t send_addr = cache->flush_block_addr + curr_word;
-        uint32_t index = get_index(cache->flush_block_addr);
-        uint32_t offset = curr_word;
-
-        // Get data to send
-        uint32_t data = cache->dsram[index * BLOCK_SIZE + offset];
-
-        // Send flush command for current word
-        bus_request(bus, cache->cache_id, BUS_FLUSH, send_addr, data);
-
-        // Update flush progress
-        cache->words_left_to_flush--;
-        if (cache->words_left_to_flush == 0) {
-            cache->sending_flush = false;
+    cache->kernel->clock(cache, bus);
+}
+
+void cache_bus_cycle(cache_t* cache, bus_system_t* bus) {
+    cache->kernel->bus_cycle(cache, bus);
+}
+
+/* Core Cache Functions */
+
+/**
+ * @brief Get log2 of a power of two
+ */
+static int log2_int(int value) {
+    int bits = 0;
+    while ((1 << bits) < value) {
+        bits++;
+    }
+    return bits;
+}
+
+/**
+ * @brief Check that a value is a power of two within a range
+ */
+static bool is_power_of_two(int value, int max) {
+    return value >= 1 && value <= max && (value & (value - 1)) == 0;
+}
+
+const char* cache_geometry_error(const cache_geometry_t* geometry) {
+    if (!is_power_of_two(geometry->size, CACHE_MAX_SIZE)) {
+        return "Cache size must be a power of two up to 1M words";
+    }
+    if (!is_power_of_two(geometry->block_size, BLOCK_MAX_SIZE)) {
+        return "Block size must be a power of two up to 256 words";
+    }
+    if (!is_power_of_two(geometry->ways, CACHE_MAX_WAYS)) {
+        return "Cache associativity must be 1, 2, 4, 8 or 16";
+    }
+    if (geometry->policy < CACHE_LRU || geometry->policy > CACHE_RRIP) {
+        return "Unknown replacement policy";
+    }
+    if (geometry->block_size * geometry->ways > geometry->size) {
+        return "Cache must hold at least one set of blocks";
+    }
+    return NULL;
+}
+
+bool cache_init(cache_t* cache, int core_id, const cache_geometry_t* geometry) {
+    // Set core ID
+    cache->cache_id = core_id;
+
+    // Derive the address split from the geometry
+    cache->size = geometry->size;
+    cache->block_size = geometry->block_size;
+    cache->block_bits = log2_int(geometry->block_size);
+    cache->offset_mask = (uint32_t)geometry->block_size - 1;
+    cache->num_lines = geometry->size / geometry->block_size;
+    cache->ways = geometry->ways;
+    cache->way_bits = log2_int(geometry->ways);
+    cache->num_sets = cache->num_lines / geometry->ways;
+    cache->index_mask = (uint32_t)cache->num_sets - 1;
+    cache->tag_shift = cache->block_bits + log2_int(cache->num_sets);
+    cache->policy = geometry->policy;
+    cache->random_state = 0x2545F491u ^ (uint32_t)core_id;
+    cache->fill_line = 0;
+    cache->victim_line = 0;
+    cache->flush_line = 0;
+
+    // DSRAM and PLRU bits start zeroed
+    cache->dsram = (uint32_t*)calloc(cache->size, sizeof(uint32_t));
+    cache->tsram = (tsram_entry_t*)malloc(cache->num_lines * sizeof(tsram_entry_t));
+    cache->repl = (uint8_t*)malloc(cache->num_lines);
+    cache->plru = (uint16_t*)calloc(cache->num_sets, sizeof(uint16_t));
+    if (!cache->dsram || !cache->tsram || !cache->repl || !cache->plru) {
+        return false;
+    }
+
+    // Initialize TSRAM - all entries invalid, LRU ages distinct within a set
+    for (int i = 0; i < cache->num_lines; i++) {
+        cache->tsram[i].state = MESI_I;
+        cache->tsram[i].tag = 0;
+        cache->repl[i] = cache->policy == CACHE_LRU ? (uint8_t)(i & (cache->ways - 1)) :
+            cache->policy == CACHE_RRIP ? RRIP_MAX : 0;
+    }
+
+    // Initialize bus transaction state
+    cache->is_mine = false;
+    cache->waiting_for_bus = false;
+    cache->resend_request = false;
+    cache->sending_flush = false;
+    cache->flush_dest = 0;
+
+    // Initialize performance counters
+    cache->read_hit = 0;
+    cache->write_hit = 0;
+    cache->read_miss = 0;
+    cache->write_miss = 0;
+    cache->supplied_clean = 0;
+    cache->supplied_dirty = 0;
+    cache->mshr_merged = 0;
+    cache->mshr_full = 0;
+    cache->mshr_peak = 0;
+    cache->mshr_cycles = 0;
+    cache->prefetch_issued = 0;
+    cache->prefetch_useful = 0;
+    cache->prefetch_late = 0;
+    cache->prefetch_polluting = 0;
+    cache->protocol = CACHE_MESI;
+
+    // Blocking until cache_enable_mshrs
+    cache->mshrs = NULL;
+    cache->num_mshrs = 0;
+    cache->mshr_limit = 0;
+    cache->mshr_active = 0;
+    cache->mshr_waiting = false;
+    cache->fills = NULL;
+    cache->num_fills = 0;
+    prefetch_init(&cache->prefetch, PREFETCH_NONE, 1, cache->block_bits);
+    cache->prefetched = NULL;
+    cache->displaced = NULL;
+
+    // Initialize block replacement state
+    cache->need_to_clean_first = false;
+    cache->words_left = -1;
+    cache_select_kernel(cache, true);
+    return true;
+}
+
+bool cache_enable_mshrs(cache_t* cache, int count, int limit) {
+    cache->mshrs = (mshr_t*)calloc(count, sizeof(mshr_t));
+    cache->fills = (cache_fill_t*)calloc(MSHR_MAX_TARGETS, sizeof(cache_fill_t));
+    cache->prefetched = (uint8_t*)calloc(cache->num_lines, sizeof(uint8_t));
+    cache->displaced = (uint32_t*)calloc(cache->num_lines, sizeof(uint32_t));
+    if (!cache->mshrs || !cache->fills || !cache->prefetched || !cache->displaced) {
+        return false;
+    }
+    cache->num_mshrs = count;
+    cache->mshr_limit = limit;
+    return true;
+}
+
+void cache_enable_prefetch(cache_t* cache, prefetch_policy_t policy, int degree) {
+    prefetch_init(&cache->prefetch, policy, degree, cache->block_bits);
+}
+
+void cache_free(cache_t* cache) {
+    free(cache->dsram);
+    free(cache->tsram);
+    free(cache->repl);
+    free(cache->plru);
+    free(cache->mshrs);
+    free(cache->fills);
+    free(cache->prefetched);
+    free(cache->displaced);
+    cache->dsram = NULL;
+    cache->tsram = NULL;
+    cache->repl = NULL;
+    cache->plru = NULL;
+    cache->mshrs = NULL;
+    cache->fills = NULL;
+    cache->prefetched = NULL;
+    cache->displaced = NULL;
+}
+
+/* Functional Warming */
+
+void cache_write_back(cache_t* cache, main_memory_t* mem, bool invalidate) {
+    for (int line = 0; line < cache->num_lines; line++) {
+        tsram_entry_t* entry = &cache->tsram[line];
+        if (entry->state == MESI_M || entry->state == MESI_O) {
+            uint32_t block = (entry->tag << cache->tag_shift) |
+                ((uint32_t)(line >> cache->way_bits) << cache->block_bits);
+            const uint32_t* data = &cache->dsram[line << cache->block_bits];
+            for (int i = 0; i < cache->block_size; i++) {
+                memory_write(mem, block + i, data[i]);
+            }
+        }
+        if (invalidate) {
+            entry->state = MESI_I;
         }
-        return;
     }
+}
 
-    // If waiting for bus response, no other actions needed
-    if (cache->waiting_for_bus) {
-        return;
+bool cache_warm_needs_snoop(const cache_t* cache, uint32_t addr, bool is_write) {
+    int line = find_line_generic(cache, get_index(cache, addr), get_tag(cache, addr));
+    if (line < 0) {
+        return true;
+    }
+    mesi_state_t state = cache->tsram[line].state;
+    return is_write && (state == MESI_S || state == MESI_O);
+}
+
+bool cache_warm_snoop(cache_t* cache, uint32_t addr, bool is_write) {
+    int line = find_line_generic(cache, get_index(cache, addr), get_tag(cache, addr));
+    if (line < 0) {
+        return false;
     }
 
-    // Check if we need to initiate a new bus request
-    if (cache->waiting_for_bus) {
-        if (cache->is_write_request) {
-            // Write requests need exclusive access - use BusRdX
-            bus_request(bus, cache->cache_id, BUS_RDX,
-                get_block_addr(cache->waiting_addr), 0);
+    tsram_entry_t* entry = &cache->tsram[line];
+    if (is_write) {
+        entry->state = MESI_I;
+    }
+    else if (entry->state == MESI_M) {
+        entry->state = cache->protocol == CACHE_MOESI ? MESI_O : MESI_S;
+    }
+    else if (entry->state == MESI_E) {
+        entry->state = MESI_S;
+    }
+    return true;
+}
+
+void cache_warm_access(cache_t* cache, const main_memory_t* mem, uint32_t addr, bool is_write,
+    bool shared) {
+    uint32_t set = get_index(cache, addr);
+    int line = find_line_generic(cache, set, get_tag(cache, addr));
+    uint32_t* data;
+    if (line >= 0) {
+        touch_line_generic(cache, line, false);
+        data = &cache->dsram[line << cache->block_bits];
+    }
+    else {
+        // Main memory is current, so the victim is simply overwritten
+        line = choose_victim(cache, set);
+        cache->tsram[line].tag = get_tag(cache, addr);
+        cache->tsram[line].state = shared ? MESI_S : MESI_E;
+        if (cache->prefetched) {
+            cache->prefetched[line] = 0;
         }
-        else {
-            // Read requests can use shared access - use BusRd
-            bus_request(bus, cache->cache_id, BUS_RD,
-                get_block_addr(cache->waiting_addr), 0);
+        touch_line_generic(cache, line, true);
+
+        uint32_t block = get_block_addr(cache, addr);
+        data = &cache->dsram[line << cache->block_bits];
+        for (int i = 0; i < cache->block_size; i++) {
+            data[i] = memory_read(mem, block + i);
         }
     }
-}
\ No newline at end of file
+
+    if (is_write) {
+        cache->tsram[line].state = MESI_M;
+        data[get_block_offset(cache, addr)] = memory_read(mem, addr);
+    }
+}
+
+/* Checkpoints */
+
+/**
+ * @brief Read a line index, which must lie within the cache
+ * @param cache Pointer to cache structure
+ * @param in Checkpoint state section
+ * @return The line, or 0 with ok cleared if it is out of range
+ */
+static int get_line(const cache_t* cache, ckpt_reader_t* in) {
+    uint32_t line = ckpt_get_u32(in);
+    if (line >= (uint32_t)cache->num_lines) {
+        in->ok = false;
+        return 0;
+    }
+    return (int)line;
+}
+
+void cache_checkpoint(const cache_t* cache, ckpt_writer_t* out) {
+    ckpt_put_words(out, cache->dsram, (uint32_t)cache->size);
+    for (int i = 0; i < cache->num_lines; i++) {
+        ckpt_put_u32(out, cache->tsram[i].tag);
+        ckpt_put_u8(out, (uint8_t)cache->tsram[i].state);
+        ckpt_put_u8(out, cache->repl[i]);
+    }
+    for (int i = 0; i < cache->num_sets; i++) {
+        ckpt_put_u32(out, cache->plru[i]);
+    }
+    ckpt_put_u32(out, cache->random_state);
+    ckpt_put_u32(out, (uint32_t)cache->fill_line);
+    ckpt_put_u32(out, (uint32_t)cache->victim_line);
+    ckpt_put_u32(out, (uint32_t)cache->flush_line);
+
+    ckpt_put_u8(out, cache->waiting_for_bus);
+    ckpt_put_u32(out, cache->waiting_addr);
+    ckpt_put_u8(out, cache->is_write_request);
+    ckpt_put_u32(out, cache->write_data);
+    ckpt_put_u8(out, cache->is_mine);
+    ckpt_put_u8(out, cache->resend_request);
+
+    ckpt_put_u8(out, cache->sending_flush);
+    ckpt_put_u32(out, cache->flush_block_addr);
+    ckpt_put_u32(out, (uint32_t)cache->flush_dest);
+    ckpt_put_u32(out, (uint32_t)cache->words_left_to_flush);
+    ckpt_put_u8(out, cache->need_to_clean_first);
+    ckpt_put_u32(out, (uint32_t)cache->words_left);
+
+    ckpt_put_u32(out, (uint32_t)cache->read_hit);
+    ckpt_put_u32(out, (uint32_t)cache->write_hit);
+    ckpt_put_u32(out, (uint32_t)cache->read_miss);
+    ckpt_put_u32(out, (uint32_t)cache->write_miss);
+    ckpt_put_u32(out, (uint32_t)cache->supplied_clean);
+    ckpt_put_u32(out, (uint32_t)cache->supplied_dirty);
+
+    // MSHRs (none for a blocking cache); fills are collected within the cycle
+    for (int i = 0; i < cache->num_mshrs; i++) {
+        const mshr_t* mshr = &cache->mshrs[i];
+        ckpt_put_u8(out, mshr->valid);
+        ckpt_put_u8(out, mshr->issued);
+        ckpt_put_u8(out, mshr->driven);
+        ckpt_put_u8(out, mshr->is_write);
+        ckpt_put_u8(out, mshr->prefetch);
+        ckpt_put_u32(out, mshr->addr);
+        ckpt_put_u32(out, (uint32_t)mshr->line);
+        ckpt_put_u32(out, mshr->write_data);
+        ckpt_put_u32(out, (uint32_t)mshr->num_targets);
+        for (int t = 0; t < mshr->num_targets; t++) {
+            ckpt_put_u8(out, mshr->targets[t].offset);
+            ckpt_put_u8(out, mshr->targets[t].tag);
+        }
+    }
+    ckpt_put_u8(out, cache->mshr_waiting);
+    ckpt_put_u32(out, (uint32_t)cache->mshr_merged);
+    ckpt_put_u32(out, (uint32_t)cache->mshr_full);
+    ckpt_put_u32(out, (uint32_t)cache->mshr_peak);
+    ckpt_put_u32(out, (uint32_t)cache->mshr_cycles);
+
+    // Prefetcher and the use of prefetched lines (caches with MSHRs)
+    if (cache->num_mshrs > 0) {
+        prefetch_checkpoint(&cache->prefetch, out);
+        for (int i = 0; i < cache->num_lines; i++) {
+            ckpt_put_u8(out, cache->prefetched[i]);
+            ckpt_put_u32(out, cache->displaced[i]);
+        }
+    }
+    ckpt_put_u32(out, (uint32_t)cache->prefetch_issued);
+    ckpt_put_u32(out, (uint32_t)cache->prefetch_useful);
+    ckpt_put_u32(out, (uint32_t)cache->prefetch_late);
+    ckpt_put_u32(out, (uint32_t)cache->prefetch_polluting);
+}
+
+void cache_restore(cache_t* cache, ckpt_reader_t* in) {
+    ckpt_get_words(in, cache->dsram, (uint32_t)cache->size);
+    uint8_t max_repl = cache->policy == CACHE_LRU ? (uint8_t)(cache->ways - 1) : RRIP_MAX;
+    for (int i = 0; i < cache->num_lines; i++) {
+        cache->tsram[i].tag = ckpt_get_u32(in);
+        cache->tsram[i].state = (mesi_state_t)ckpt_get_enum(in,
+            cache->protocol == CACHE_MOESI ? MESI_O : MESI_M);
+        cache->repl[i] = ckpt_get_enum(in, max_repl);
+    }
+    for (int i = 0; i < cache->num_sets; i++) {
+        cache->plru[i] = (uint16_t)ckpt_get_u32(in);
+    }
+    cache->random_state = ckpt_get_u32(in);
+    cache->fill_line = get_line(cache, in);
+    cache->victim_line = get_line(cache, in);
+    cache->flush_line = get_line(cache, in);
+
+    cache->waiting_for_bus = ckpt_get_bool(in);
+    cache->waiting_addr = ckpt_get_u32(in);
+    cache->is_write_request = ckpt_get_bool(in);
+    cache->write_data = ckpt_get_u32(in);
+    cache->is_mine = ckpt_get_bool(in);
+    cache->resend_request = ckpt_get_bool(in);
+
+    cache->sending_flush = ckpt_get_bool(in);
+    cache->flush_block_addr = ckpt_get_u32(in);
+    uint32_t flush_dest = ckpt_get_u32(in);
+    if (flush_dest >= BUS_MAX_CORES) {
+        in->ok = false;
+    }
+    cache->flush_dest = (int)flush_dest;
+    cache->words_left_to_flush = (int)ckpt_get_u32(in);
+    cache->need_to_clean_first = ckpt_get_bool(in);
+    cache->words_left = (int)ckpt_get_u32(in);
+
+    cache->read_hit = (int)ckpt_get_u32(in);
+    cache->write_hit = (int)ckpt_get_u32(in);
+    cache->read_miss = (int)ckpt_get_u32(in);
+    cache->write_miss = (int)ckpt_get_u32(in);
+    cache->supplied_clean = (int)ckpt_get_u32(in);
+    cache->supplied_dirty = (int)ckpt_get_u32(in);
+
+    cache->mshr_active = 0;
+    cache->num_fills = 0;
+    for (int i = 0; i < cache->num_mshrs; i++) {
+        mshr_t* mshr = &cache->mshrs[i];
+        mshr->valid = ckpt_get_bool(in);
+        mshr->issued = ckpt_get_bool(in);
+        mshr->driven = ckpt_get_bool(in);
+        mshr->is_write = ckpt_get_bool(in);
+        mshr->prefetch = ckpt_get_bool(in);
+        mshr->addr = ckpt_get_u32(in);
+        mshr->block = mshr->addr & ~cache->offset_mask;
+        mshr->line = get_line(cache, in);
+        mshr->write_data = ckpt_get_u32(in);
+        uint32_t targets = ckpt_get_u32(in);
+        if (targets > MSHR_MAX_TARGETS) {
+            in->ok = false;
+            return;
+        }
+        mshr->num_targets = (int)targets;
+        for (int t = 0; t < mshr->num_targets; t++) {
+            mshr->targets[t].offset = (uint8_t)(ckpt_get_u8(in) & cache->offset_mask);
+            mshr->targets[t].tag = ckpt_get_u8(in);
+        }
+        if (mshr->valid) {
+            cache->mshr_active++;
+        }
+    }
+    cache->mshr_waiting = ckpt_get_bool(in);
+    cache->mshr_merged = (int)ckpt_get_u32(in);
+    cache->mshr_full = (int)ckpt_get_u32(in);
+    cache->mshr_peak = (int)ckpt_get_u32(in);
+    cache->mshr_cycles = (int)ckpt_get_u32(in);
+
+    if (cache->num_mshrs > 0) {
+        prefetch_restore(&cache->prefetch, in);
+        for (int i = 0; i < cache->num_lines; i++) {
+            cache->prefetched[i] = ckpt_get_enum(in, LINE_PREFETCHED | LINE_DISPLACED);
+            cache->displaced[i] = ckpt_get_u32(in);
+        }
+    }
+    cache->prefetch_issued = (int)ckpt_get_u32(in);
+    cache->prefetch_useful = (int)ckpt_get_u32(in);
+    cache->prefetch_late = (int)ckpt_get_u32(in);
+    cache->prefetch_polluting = (int)ckpt_get_u32(in);
+}
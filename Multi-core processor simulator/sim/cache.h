@@ -1,6 +1,30 @@
 /**
  * @file cache.h
  * @brief Header file for cache implementation with MESI coherency protocol
+ *
+ * The size, block size and associativity are chosen at run time. The cache
+ * holds size / block_size lines arranged as sets of ways lines each; line i
+ * of set s is stored at index s * ways + i of the TSRAM, and its words at
+ * that index times the block size in the DSRAM. The default 256-word,
+ * 4-word-block, one-way geometry is the original direct-mapped cache.
+ *
+ * The access and bus functions are compiled as kernels: a generic one
+ * that reads the shifts and masks derived by cache_init, and specialized
+ * ones for common organizations in which they are compile-time constants
+ * (see cache_kernel.h). cache_init selects a specialized kernel when one
+ * matches the geometry; building with SIM_NO_CACHE_KERNELS leaves only the
+ * generic kernel. All kernels produce identical results.
+ *
+ * By default the cache blocks on a miss. With miss status holding
+ * registers (cache_enable_mshrs) it keeps serving hits while misses are
+ * outstanding, merges loads to a block already being fetched, and returns
+ * the data of missed loads later through cache_t.fills. A cache with MSHRs
+ * may also prefetch (cache_enable_prefetch): cache_clock requests the
+ * blocks its prefetcher predicts through MSHRs left free by demand misses.
+ *
+ * While cores execute functionally, the cache_warm_* functions apply the
+ * effect of their accesses on contents, states and replacement order
+ * without bus transactions, so detailed simulation resumes with warm caches.
  */
 
 #ifndef CACHE_H
@@ -9,26 +33,106 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "bus_system.h"
+#include "main_memory.h"
+#include "prefetch.h"
 
  /* Cache Configuration Constants */
-#define CACHE_SIZE 256        ///< Total cache size in words
-#define BLOCK_SIZE 4         ///< Number of words per block
-#define NUM_SETS 64          ///< Number of sets (CACHE_SIZE/BLOCK_SIZE)
-#define TAG_SHIFT 8          ///< Bit position for tag extraction
-#define INDEX_SHIFT 2        ///< Bit position for index extraction
-#define INDEX_MASK 0x3F      ///< Mask for extracting index bits
-#define BLOCK_OFFSET_MASK 0x3 ///< Mask for extracting block offset bits
+#define CACHE_DEFAULT_SIZE 256    ///< Default total cache size in words
+#define BLOCK_DEFAULT_SIZE 4      ///< Default number of words per block
+#define CACHE_MAX_SIZE (1 << 20)  ///< Largest cache size in words
+#define BLOCK_MAX_SIZE 256        ///< Largest block size in words
+#define CACHE_MAX_WAYS 16         ///< Highest associativity
+#define RRIP_MAX 3                ///< Re-reference prediction of a line to evict (2 bits)
+#define CACHE_MAX_MSHRS 16        ///< Most miss status holding registers per cache
+#define MSHR_MAX_TARGETS 8        ///< Most loads waiting for one block
 
 /**
- * @brief MESI protocol states for cache coherency
+ * @brief MESI protocol states for cache coherency (plus Owned for MOESI)
  */
 typedef enum {
     MESI_I = 0,  ///< Invalid: Block not present or invalid
     MESI_S = 1,  ///< Shared: Block present and potentially in other caches
     MESI_E = 2,  ///< Exclusive: Block present only in this cache
-    MESI_M = 3   ///< Modified: Block modified in this cache only
+    MESI_M = 3,  ///< Modified: Block modified in this cache only
+    MESI_O = 4   ///< Owned: Block modified, possibly shared; this cache supplies it (MOESI only)
 } mesi_state_t;
 
+/**
+ * @brief Coherence protocol
+ */
+typedef enum {
+    CACHE_MESI = 0,   ///< Dirty blocks are written back when another cache reads them
+    CACHE_MOESI = 1   ///< Dirty blocks are shared in the Owned state; owners supply
+                      ///< blocks cache-to-cache and inhibit main memory
+} cache_protocol_t;
+
+/**
+ * @brief Victim selection among the ways of a set
+ *
+ * Invalid ways are always filled first.
+ */
+typedef enum {
+    CACHE_LRU = 0,     ///< Least recently used way
+    CACHE_PLRU = 1,    ///< Tree pseudo-LRU
+    CACHE_RANDOM = 2,  ///< Pseudo-random way (same sequence every run)
+    CACHE_RRIP = 3     ///< Static re-reference interval prediction
+} cache_policy_t;
+
+/**
+ * @brief Cache organization chosen at run time
+ */
+typedef struct {
+    int size;               ///< Total size in words (power of two)
+    int block_size;         ///< Words per block (power of two, at most size)
+    int ways;               ///< Lines per set (power of two, at most CACHE_MAX_WAYS)
+    cache_policy_t policy;  ///< Victim selection among the ways of a set
+} cache_geometry_t;
+
+/**
+ * @brief Outcome of a load from cache_load
+ */
+typedef enum {
+    CACHE_READY = 0,    ///< Hit: the data is returned at once
+    CACHE_PENDING = 1,  ///< Miss taken by an MSHR: the data arrives later in cache_t.fills
+    CACHE_BUSY = 2      ///< Not accepted this cycle: retry
+} cache_status_t;
+
+/**
+ * @brief Load waiting in an MSHR for its block
+ */
+typedef struct {
+    uint8_t offset;       ///< Word within the block
+    uint8_t tag;          ///< Requester's tag, returned with the data
+} mshr_target_t;
+
+/**
+ * @brief Miss status holding register: one block being fetched
+ */
+typedef struct {
+    bool valid;           ///< A miss to block is outstanding
+    bool issued;          ///< Its BusRd/BusRdX is queued on our port or has been granted
+    bool driven;          ///< The request has been on the bus; Flush words of block are ours
+    bool is_write;        ///< BusRdX of a store, which waits in MEM until the block is filled
+    bool prefetch;        ///< Requested by the prefetcher, and no demand access has reached it yet
+    uint32_t addr;        ///< Word address of the access that missed
+    uint32_t block;       ///< Base address of the block
+    int line;             ///< Line receiving the block (never a victim meanwhile)
+    uint32_t write_data;  ///< Data of the store, written when the block arrives
+    int num_targets;      ///< Loads waiting for the block
+    mshr_target_t targets[MSHR_MAX_TARGETS];  ///< Waiting loads in program order
+} mshr_t;
+
+/**
+ * @brief Load completed by a fill, for the requester to collect
+ */
+typedef struct {
+    uint8_t tag;          ///< Tag given to cache_load
+    uint32_t data;        ///< Word loaded
+} cache_fill_t;
+
+/** @brief Access and bus functions compiled for one organization (private to cache.c) */
+typedef struct cache_kernel cache_kernel_t;
+
 /**
  * @brief Tag and state storage (TSRAM) entry structure
  */
@@ -42,20 +146,61 @@ typedef struct {
  */
 typedef struct {
     /* Core Memory Components */
-    uint32_t dsram[CACHE_SIZE];     ///< Data storage array
-    tsram_entry_t tsram[NUM_SETS];  ///< Tag and state array
+    uint32_t* dsram;                ///< Data storage array (size words)
+    tsram_entry_t* tsram;           ///< Tag and state array (num_lines entries)
     int cache_id;                   ///< Core ID this cache belongs to
 
+    /* Geometry (derived once from cache_geometry_t) */
+    int size;                       ///< Total size in words
+    int block_size;                 ///< Words per block
+    int block_bits;                 ///< log2 of block_size (index shift)
+    uint32_t offset_mask;           ///< Mask for extracting block offset bits
+    int num_lines;                  ///< Number of blocks (size / block_size)
+    int num_sets;                   ///< Number of sets (num_lines / ways)
+    int ways;                       ///< Lines per set (1 = direct-mapped)
+    int way_bits;                   ///< log2 of ways
+    uint32_t index_mask;            ///< Mask for extracting set index bits
+    int tag_shift;                  ///< Bit position for tag extraction
+    const cache_kernel_t* kernel;   ///< Functions compiled for this geometry
+
+    /* Coherence */
+    cache_protocol_t protocol;      ///< MESI or MOESI (set after cache_init, default MESI)
+
+    /* Replacement State */
+    cache_policy_t policy;          ///< Victim selection
+    uint8_t* repl;                  ///< Per line: LRU age (0 = most recent) or RRIP prediction
+    uint16_t* plru;                 ///< Per set: tree-PLRU bits, node n at bit n
+    uint32_t random_state;          ///< Xorshift state of random replacement
+    int fill_line;                  ///< Line receiving the pending bus response
+    int victim_line;                ///< Line being written back before a miss
+    int flush_line;                 ///< Line being flushed to another cache
+
     /* Bus Transaction State */
     bool waiting_for_bus;           ///< Waiting for bus response
     uint32_t waiting_addr;          ///< Address of pending request
     bool is_write_request;          ///< True if pending request is write
     uint32_t write_data;            ///< Data to write after bus response
     bool is_mine;                   ///< Current bus transaction belongs to this cache
+    bool resend_request;            ///< A flush displaced the queued request from the bus port
+
+    /* Miss Status Holding Registers */
+    mshr_t* mshrs;                  ///< Outstanding misses (NULL = blocking cache using the fields above)
+    int num_mshrs;                  ///< Entries in mshrs
+    int mshr_limit;                 ///< Misses outstanding at once (1 on an atomic bus)
+    int mshr_active;                ///< Valid entries in mshrs
+    bool mshr_waiting;              ///< The access being retried found no free MSHR or way
+    cache_fill_t* fills;            ///< Loads completed this cycle, collected by the core
+    int num_fills;                  ///< Entries in fills
+
+    /* Prefetching (caches with MSHRs) */
+    prefetcher_t prefetch;          ///< Prefetch policy, tables and queued blocks
+    uint8_t* prefetched;            ///< Per line: LINE_PREFETCHED and LINE_DISPLACED flags
+    uint32_t* displaced;            ///< Per line: block a prefetch evicted from it (if LINE_DISPLACED)
 
     /* Block Replacement State */
     bool sending_flush;             ///< Currently sending flush command
     uint32_t flush_block_addr;      ///< Base address of block being flushed
+    int flush_dest;                 ///< Core the flushed block is supplied to
     int words_left_to_flush;        ///< Remaining words to flush
     bool need_to_clean_first;       ///< Block needs cleaning before replacement
     int words_left;                 ///< Counter for block cleaning
@@ -65,6 +210,16 @@ typedef struct {
     int write_hit;                  ///< Number of write hits
     int read_miss;                  ///< Number of read misses
     int write_miss;                 ///< Number of write misses
+    int supplied_clean;             ///< Blocks supplied from Exclusive in place of memory (MOESI)
+    int supplied_dirty;             ///< Blocks supplied from Modified/Owned in place of memory (MOESI)
+    int mshr_merged;                ///< Loads merged into an outstanding miss to their block
+    int mshr_full;                  ///< Accesses that had to wait for a free MSHR or way
+    int mshr_peak;                  ///< Most MSHRs in use at once
+    int mshr_cycles;                ///< MSHRs in use summed over cycles (occupancy)
+    int prefetch_issued;            ///< Prefetches requested on the bus
+    int prefetch_useful;            ///< Prefetched blocks used after they had arrived
+    int prefetch_late;              ///< Prefetches a demand access reached while still in flight
+    int prefetch_polluting;         ///< Demand misses to blocks a prefetch had evicted
 } cache_t;
 
 /* Core Functions */
@@ -73,8 +228,63 @@ typedef struct {
  * @brief Initialize cache structure
  * @param cache Pointer to cache structure
  * @param core_id ID of core this cache belongs to
+ * @param geometry Valid organization (see cache_geometry_error)
+ * @return false if the arrays could not be allocated
+ */
+bool cache_init(cache_t* cache, int core_id, const cache_geometry_t* geometry);
+
+/**
+ * @brief Free the arrays allocated by cache_init
+ * @param cache Pointer to cache structure (may be zero-filled and never initialized)
+ */
+void cache_free(cache_t* cache);
+
+/**
+ * @brief Give the cache miss status holding registers
+ * @param cache Initialized cache
+ * @param count MSHRs (1 to CACHE_MAX_MSHRS)
+ * @param limit Misses outstanding at once, at most count (1 unless the
+ *              bus is split and has count transaction slots per core)
+ * @return false if the registers could not be allocated
+ *
+ * Loads then go through cache_load, which does not block on a miss.
+ */
+bool cache_enable_mshrs(cache_t* cache, int count, int limit);
+
+/**
+ * @brief Start prefetching into a cache with MSHRs
+ * @param cache Cache after cache_enable_mshrs
+ * @param policy Prefetch policy
+ * @param degree Blocks predicted per trigger (1 to PREFETCH_MAX_DEGREE)
+ *
+ * A queued block is requested once an MSHR and a clean or free way of its
+ * set are available and no demand access waits for one. The request is
+ * granted only when no core has a demand request waiting; a demand miss of
+ * the same cache replaces it on the bus port.
+ */
+void cache_enable_prefetch(cache_t* cache, prefetch_policy_t policy, int degree);
+
+/**
+ * @brief Choose between the generic and a specialized kernel
+ * @param cache Initialized cache
+ * @param specialized Use a kernel compiled for the geometry if there is one
+ *                    (the default after cache_init)
+ */
+void cache_select_kernel(cache_t* cache, bool specialized);
+
+/**
+ * @brief Get the name of the kernel a cache uses
+ * @param cache Initialized cache
+ * @return "generic" or the organization, e.g. "256w-4b-1way"
+ */
+const char* cache_kernel_name(const cache_t* cache);
+
+/**
+ * @brief Check a cache organization
+ * @param geometry Organization to check
+ * @return NULL if it is valid, otherwise a description of the problem
  */
-void cache_init(cache_t* cache, int core_id);
+const char* cache_geometry_error(const cache_geometry_t* geometry);
 
 /**
  * @brief Process a read request to the cache
@@ -86,15 +296,45 @@ void cache_init(cache_t* cache, int core_id);
  */
 void cache_read(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t* data, bool* ready);
 
+/**
+ * @brief Process a load that need not wait for a miss
+ * @param cache Pointer to cache structure
+ * @param bus Pointer to bus system
+ * @param addr Memory address to read
+ * @param pc Address of the load instruction (trains the prefetcher)
+ * @param tag Returned with the data once a missed block arrives, or -1 to
+ *            keep retrying until the load hits (as cache_read does)
+ * @param data Receives the word on CACHE_READY
+ * @return CACHE_READY on a hit, CACHE_PENDING if an MSHR took the miss,
+ *         CACHE_BUSY if the load must be retried
+ *
+ * Without MSHRs the load behaves as cache_read and never becomes pending.
+ */
+cache_status_t cache_load(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t pc, int tag,
+    uint32_t* data);
+
 /**
  * @brief Process a write request to the cache
  * @param cache Pointer to cache structure
  * @param bus Pointer to bus system
  * @param addr Memory address to write
+ * @param pc Address of the store instruction (trains the prefetcher)
  * @param data Data to write
  * @param ready Set true if write completes, false if cache miss
+ *
+ * With MSHRs a store waits for an outstanding miss to its block, and a
+ * missing store waits for its own; hits to other blocks proceed.
+ */
+void cache_write(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t pc, uint32_t data,
+    bool* ready);
+
+/**
+ * @brief Check whether every outstanding miss has been requested on the bus
+ * @param cache Pointer to cache structure
+ * @return false if an MSHR waits for the bus port to become free or a
+ *         prefetch is queued
  */
-void cache_write(cache_t* cache, bus_system_t* bus, uint32_t addr, uint32_t data, bool* ready);
+bool cache_misses_issued(const cache_t* cache);
 
 /* Cache Coherency Functions */
 
@@ -119,34 +359,109 @@ void cache_handle_bus_response(cache_t* cache, bus_system_t* bus);
  */
 void cache_clock(cache_t* cache, bus_system_t* bus);
 
+/**
+ * @brief Run cache_snoop, cache_handle_bus_response and cache_clock in one call
+ * @param cache Pointer to cache structure
+ * @param bus Pointer to bus system
+ */
+void cache_bus_cycle(cache_t* cache, bus_system_t* bus);
+
+/* Functional Warming */
+
+/*
+ * Functional execution reads and writes main memory directly, so before it
+ * starts every modified block is written back (cache_write_back), and
+ * while it runs main memory stays current: a missing block is copied from
+ * it and the victim is dropped. No statistic is counted.
+ */
+
+/**
+ * @brief Write every modified or owned block to main memory
+ * @param cache Pointer to cache structure with no transaction in progress
+ * @param mem Main memory
+ * @param invalidate Also empty the cache; otherwise lines keep their state
+ */
+void cache_write_back(cache_t* cache, main_memory_t* mem, bool invalidate);
+
+/**
+ * @brief Check whether a functional access changes other caches
+ * @param cache Pointer to cache structure of the accessing core
+ * @param addr Word address (within the memory width)
+ * @param is_write True for a store
+ * @return true for a miss, or a store to a shared or owned block
+ */
+bool cache_warm_needs_snoop(const cache_t* cache, uint32_t addr, bool is_write);
+
+/**
+ * @brief Apply another core's functional access to a cache
+ * @param cache Pointer to cache structure
+ * @param addr Word address (within the memory width)
+ * @param is_write True for a store, which invalidates the block; a load
+ *                 leaves it shared (owned if it was modified under MOESI)
+ * @return true if the block was cached
+ */
+bool cache_warm_snoop(cache_t* cache, uint32_t addr, bool is_write);
+
+/**
+ * @brief Apply a functional access of the cache's own core
+ * @param cache Pointer to cache structure
+ * @param mem Main memory, already holding a stored word
+ * @param addr Word address (within the memory width)
+ * @param is_write True for a store, which leaves the block modified
+ * @param shared Another cache holds the block (a loaded block is then
+ *               shared, otherwise exclusive)
+ */
+void cache_warm_access(cache_t* cache, const main_memory_t* mem, uint32_t addr, bool is_write,
+    bool shared);
+
+/* Checkpoints */
+
+/**
+ * @brief Encode the cache contents, replacement state, pending bus transaction and counters
+ * @param cache Pointer to cache structure
+ * @param out Checkpoint state section
+ */
+void cache_checkpoint(const cache_t* cache, ckpt_writer_t* out);
+
+/**
+ * @brief Decode the state written by cache_checkpoint
+ * @param cache Pointer to cache structure (keeps its cache_id and geometry)
+ * @param in Checkpoint state section
+ */
+void cache_restore(cache_t* cache, ckpt_reader_t* in);
+
 /* Address Manipulation Functions */
 
 /**
  * @brief Extract tag from memory address
+ * @param cache Pointer to cache structure
  * @param addr Full memory address
  * @return Tag portion of address
  */
-uint32_t get_tag(uint32_t addr);
+uint32_t get_tag(const cache_t* cache, uint32_t addr);
 
 /**
  * @brief Extract set index from memory address
+ * @param cache Pointer to cache structure
  * @param addr Full memory address
  * @return Cache set index
  */
-uint32_t get_index(uint32_t addr);
+uint32_t get_index(const cache_t* cache, uint32_t addr);
 
 /**
  * @brief Extract block offset from memory address
+ * @param cache Pointer to cache structure
  * @param addr Full memory address
  * @return Offset within cache block
  */
-uint32_t get_block_offset(uint32_t addr);
+uint32_t get_block_offset(const cache_t* cache, uint32_t addr);
 
 /**
  * @brief Get block-aligned address
+ * @param cache Pointer to cache structure
  * @param addr Full memory address
  * @return Address aligned to block boundary
  */
-uint32_t get_block_addr(uint32_t addr);
+uint32_t get_block_addr(const cache_t* cache, uint32_t addr);
 
 #endif /* CACHE_H */
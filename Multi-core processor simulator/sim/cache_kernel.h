@@ -0,0 +1,792 @@
+/**
+ * @file cache_kernel.h
+ * @brief Cache access and bus functions, instantiated once per kernel
+ *
+ * This file has no include guard: cache.c includes it once for the generic
+ * kernel, which reads the geometry from cache_t, and once for every
+ * organization listed there, with the geometry fixed at compile time so
+ * that address splits fold into constant shifts and the way loops unroll.
+ *
+ * Before each inclusion define:
+ * - KERNEL_SUFFIX: token appended to the names of the generated functions
+ * - KERNEL_NAME: string returned by cache_kernel_name
+ * - KERNEL_BLOCK_BITS, KERNEL_SET_BITS, KERNEL_WAY_BITS: log2 of the block
+ *   size, set count and associativity (leave undefined for the generic kernel)
+ *
+ * The result is a static cache_kernel_t named cache_kernel<KERNEL_SUFFIX>.
+ * All macros are undefined again at the end.
+ */
+
+#define KERNEL_CAT2(a, b) a##b
+#define KERNEL_CAT(a, b) KERNEL_CAT2(a, b)
+#define KERNEL_FN(name) KERNEL_CAT(name, KERNEL_SUFFIX)
+
+#ifdef KERNEL_BLOCK_BITS
+#define K_BLOCK_BITS KERNEL_BLOCK_BITS
+#define K_BLOCK_SIZE (1 << KERNEL_BLOCK_BITS)
+#define K_OFFSET_MASK ((uint32_t)(1 << KERNEL_BLOCK_BITS) - 1)
+#define K_INDEX_MASK ((uint32_t)(1 << KERNEL_SET_BITS) - 1)
+#define K_TAG_SHIFT (KERNEL_BLOCK_BITS + KERNEL_SET_BITS)
+#define K_WAY_BITS KERNEL_WAY_BITS
+#define K_WAYS (1 << KERNEL_WAY_BITS)
+#else
+#define K_BLOCK_BITS (cache->block_bits)
+#define K_BLOCK_SIZE (cache->block_size)
+#define K_OFFSET_MASK (cache->offset_mask)
+#define K_INDEX_MASK (cache->index_mask)
+#define K_TAG_SHIFT (cache->tag_shift)
+#define K_WAY_BITS (cache->way_bits)
+#define K_WAYS (cache->ways)
+#endif
+
+#define K_TAG(addr) ((addr) >> K_TAG_SHIFT)
+#define K_INDEX(addr) (((addr) >> K_BLOCK_BITS) & K_INDEX_MASK)
+#define K_OFFSET(addr) ((addr) & K_OFFSET_MASK)
+
+/**
+ * @brief Find the valid line holding a block
+ * @param cache Pointer to cache structure
+ * @param set Set index of the block
+ * @param tag Tag of the block
+ * @return Line index, or -1 if the block is not cached
+ */
+static int KERNEL_FN(find_line)(const cache_t* cache, uint32_t set, uint32_t tag) {
+    int first = (int)set << K_WAY_BITS;
+    for (int line = first; line < first + K_WAYS; line++) {
+        if (cache->tsram[line].tag == tag && cache->tsram[line].state != MESI_I) {
+            return line;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Update the replacement state after a hit or a fill
+ * @param cache Pointer to cache structure
+ * @param line Line that was used
+ * @param fill True if the line has just been filled from the bus
+ */
+static void KERNEL_FN(touch_line)(cache_t* cache, int line, bool fill) {
+    // A direct-mapped set has nothing to order
+    if (K_WAYS == 1 && cache->policy != CACHE_RRIP) return;
+
+    int way = line & (K_WAYS - 1);
+    int first = line - way;
+
+    switch (cache->policy) {
+    case CACHE_LRU:
+        // Lines used more recently than this one age by one
+        for (int i = first; i < first + K_WAYS; i++) {
+            if (cache->repl[i] < cache->repl[line]) {
+                cache->repl[i]++;
+            }
+        }
+        cache->repl[line] = 0;
+        break;
+
+    case CACHE_PLRU: {
+        // Point every node on the path to this way at the other subtree
+        uint16_t* bits = &cache->plru[line >> K_WAY_BITS];
+        for (int node = way + K_WAYS; node > 1; node /= 2) {
+            if (node & 1) {
+                *bits &= (uint16_t)~(1u << (node / 2));
+            }
+            else {
+                *bits |= (uint16_t)(1u << (node / 2));
+            }
+        }
+        break;
+    }
+
+    case CACHE_RRIP:
+        // New lines are predicted to be re-referenced late, hit lines soon
+        cache->repl[line] = fill ? RRIP_MAX - 1 : 0;
+        break;
+
+    case CACHE_RANDOM:
+        break;
+    }
+}
+
+/**
+ * @brief Make room for a missing block
+ * @param cache Pointer to cache structure
+ * @param bus Pointer to bus system
+ * @param set Set index of the missing block
+ * @return true while a modified victim is being written back (one word per
+ *         call), false once the block can be requested into fill_line
+ */
+static bool KERNEL_FN(write_back_victim)(cache_t* cache, bus_system_t* bus, uint32_t set) {
+    if (!cache->need_to_clean_first) {
+        int victim = choose_victim(cache, set);
+        if (cache->tsram[victim].state != MESI_M && cache->tsram[victim].state != MESI_O) {
+            // Other transactions run while a split bus fills the line, and
+            // hits continue with MSHRs, so a clean victim is dropped now
+            // rather than snooped or read half-filled
+            if (bus->split || cache->mshrs) {
+                cache->tsram[victim].state = MESI_I;
+            }
+            cache->fill_line = victim;
+            return false;
+        }
+
+        // Need to write back a dirty block first
+        cache->need_to_clean_first = true;
+        cache->victim_line = victim;
+        cache->words_left = 0;
+    }
+
+    // Flush the next word of the victim, once the last word of a block
+    // supplied to another cache meanwhile has left the port (on a split
+    // bus, once any supplied word has left, since it carries a tag)
+    int line = cache->victim_line;
+    uint32_t block_addr = (cache->tsram[line].tag << K_TAG_SHIFT) |
+        ((uint32_t)(line >> K_WAY_BITS) << K_BLOCK_BITS);
+    const bus_port_t* port = &bus->ports[cache->cache_id];
+    if (port->request && port->cmd == BUS_FLUSH &&
+        (bus->split ? port->dest != BUS_NO_DEST : (port->addr & ~K_OFFSET_MASK) != block_addr)) {
+        return true;
+    }
+    if (port->request && port->cmd != BUS_FLUSH) {
+        displace_request(cache, port);
+    }
+    bus_request(bus, cache->cache_id, BUS_FLUSH, block_addr + cache->words_left,
+        cache->dsram[(line << K_BLOCK_BITS) + cache->words_left]);
+    cache->words_left++;
+
+    if (cache->words_left == K_BLOCK_SIZE) {
+        // Finished flushing
+        cache->need_to_clean_first = false;
+        cache->tsram[line].state = MESI_I;
+    }
+    return true;
+}
+
+static void KERNEL_FN(cache_read)(cache_t* cache, bus_system_t* bus, uint32_t addr,
+    uint32_t* data, bool* ready) {
+    // Cannot process new request if busy with bus
+    if (cache->waiting_for_bus || cache->sending_flush) {
+        *ready = false;
+        return;
+    }
+
+    // Extract address components (bits beyond the memory width are not wired)
+    addr &= bus->addr_mask;
+    uint32_t tag = K_TAG(addr);
+    uint32_t index = K_INDEX(addr);
+    uint32_t offset = K_OFFSET(addr);
+
+    // Check for cache hit
+    int line = KERNEL_FN(find_line)(cache, index, tag);
+    if (line >= 0) {
+        // Cache hit - return data immediately
+        *data = cache->dsram[(line << K_BLOCK_BITS) + offset];
+        *ready = true;
+        cache->read_hit++;
+        cache->is_mine = false;
+        KERNEL_FN(touch_line)(cache, line, false);
+        return;
+    }
+
+    // Cache miss - write back a modified victim first
+    *ready = false;
+    if (flush_word_pending(cache, bus)) {
+        return;
+    }
+    cache->read_miss++;
+    if (!KERNEL_FN(write_back_victim)(cache, bus, index)) {
+        // Standard cache miss - request block
+        cache->waiting_for_bus = true;
+        cache->waiting_addr = addr;
+        cache->is_write_request = false;
+        bus_request(bus, cache->cache_id, BUS_RD, addr, 0);
+        cache->read_hit--; // Adjust for initial increment
+    }
+}
+
+static void KERNEL_FN(cache_write)(cache_t* cache, bus_system_t* bus, uint32_t addr,
+    uint32_t data, bool* ready) {
+    // Cannot process new request if busy with bus
+    if (cache->waiting_for_bus || cache->sending_flush) {
+        *ready = false;
+        return;
+    }
+
+    // Extract address components (bits beyond the memory width are not wired)
+    addr &= bus->addr_mask;
+    uint32_t tag = K_TAG(addr);
+    uint32_t index = K_INDEX(addr);
+    uint32_t offset = K_OFFSET(addr);
+
+    // Check for cache hit with correct tag
+    int line = KERNEL_FN(find_line)(cache, index, tag);
+    if (line >= 0) {
+        if (cache->tsram[line].state == MESI_S || cache->tsram[line].state == MESI_O) {
+            // Need exclusive access - request upgrade
+            if (flush_word_pending(cache, bus)) {
+                *ready = false;
+                return;
+            }
+            cache->waiting_for_bus = true;
+            cache->waiting_addr = addr;
+            cache->is_write_request = true;
+            cache->write_data = data;
+            cache->fill_line = line;
+            *ready = false;
+            cache->write_miss++;
+            bus_request(bus, cache->cache_id, BUS_RDX, addr, 0);
+            bus_set_shared(bus, cache->cache_id);
+            cache->write_hit--;
+        }
+        else {
+            // Can write directly in Modified or Exclusive state
+            cache->dsram[(line << K_BLOCK_BITS) + offset] = data;
+            cache->tsram[line].state = MESI_M;
+            *ready = true;
+            cache->write_hit++;
+            cache->is_mine = false;
+            KERNEL_FN(touch_line)(cache, line, false);
+        }
+        return;
+    }
+
+    // Cache miss - write back a modified victim first
+    *ready = false;
+    if (flush_word_pending(cache, bus)) {
+        return;
+    }
+    cache->write_miss++;
+    if (!KERNEL_FN(write_back_victim)(cache, bus, index)) {
+        // Standard cache miss - request block with exclusive access
+        cache->waiting_for_bus = true;
+        cache->waiting_addr = addr;
+        cache->is_write_request = true;
+        cache->write_data = data;
+        bus_request(bus, cache->cache_id, BUS_RDX, addr, 0);
+        cache->write_hit--;
+    }
+}
+
+/**
+ * @brief Load through the MSHRs (see cache_load)
+ */
+static cache_status_t KERNEL_FN(cache_load)(cache_t* cache, bus_system_t* bus, uint32_t addr,
+    uint32_t pc, int tag, uint32_t* data) {
+    // The DSRAM is busy sending a block
+    if (cache->sending_flush) {
+        return CACHE_BUSY;
+    }
+
+    // Extract address components (bits beyond the memory width are not wired)
+    addr &= bus->addr_mask;
+    uint32_t index = K_INDEX(addr);
+    uint32_t offset = K_OFFSET(addr);
+
+    // A miss to the block is outstanding - wait for it with the other loads
+    int pending = find_mshr(cache, addr & ~K_OFFSET_MASK);
+    if (pending >= 0) {
+        mshr_t* mshr = &cache->mshrs[pending];
+        bool claimed = claim_prefetch(cache, mshr, pc, addr);
+        if (tag < 0 || mshr->is_write || mshr->num_targets == MSHR_MAX_TARGETS) {
+            return CACHE_BUSY;
+        }
+        mshr->targets[mshr->num_targets].offset = (uint8_t)offset;
+        mshr->targets[mshr->num_targets].tag = (uint8_t)tag;
+        mshr->num_targets++;
+        cache->read_miss++;
+        cache->mshr_merged++;
+        cache->mshr_waiting = false;
+        if (!claimed) {
+            prefetch_train(&cache->prefetch, pc, addr, PREFETCH_HIT);
+        }
+        return CACHE_PENDING;
+    }
+
+    // Check for cache hit
+    int line = KERNEL_FN(find_line)(cache, index, K_TAG(addr));
+    if (line >= 0) {
+        *data = cache->dsram[(line << K_BLOCK_BITS) + offset];
+        cache->read_hit++;
+        cache->mshr_waiting = false;
+        KERNEL_FN(touch_line)(cache, line, false);
+        note_access(cache, pc, addr, line);
+        return CACHE_READY;
+    }
+
+    // Cache miss - wait for an MSHR and a line, write back a modified victim
+    if (flush_word_pending(cache, bus)) {
+        return CACHE_BUSY;
+    }
+    if (!cache->need_to_clean_first && !mshr_available(cache, index)) {
+        wait_for_mshr(cache);
+        return CACHE_BUSY;
+    }
+    cache->read_miss++;
+    if (KERNEL_FN(write_back_victim)(cache, bus, index)) {
+        return CACHE_BUSY;
+    }
+    mshr_t* mshr = open_mshr(cache, bus, addr, cache->fill_line, false, 0, false);
+    note_access(cache, pc, addr, -1);
+    if (tag < 0) {
+        // Retried until it hits, like a blocking miss
+        cache->read_hit--;
+        return CACHE_BUSY;
+    }
+    mshr->targets[0].offset = (uint8_t)offset;
+    mshr->targets[0].tag = (uint8_t)tag;
+    mshr->num_targets = 1;
+    return CACHE_PENDING;
+}
+
+/**
+ * @brief Store through the MSHRs (see cache_write)
+ */
+static void KERNEL_FN(cache_store)(cache_t* cache, bus_system_t* bus, uint32_t addr,
+    uint32_t pc, uint32_t data, bool* ready) {
+    *ready = false;
+    if (cache->sending_flush) {
+        return;
+    }
+
+    // Extract address components (bits beyond the memory width are not wired)
+    addr &= bus->addr_mask;
+    uint32_t index = K_INDEX(addr);
+    uint32_t offset = K_OFFSET(addr);
+
+    // Wait for an outstanding miss to the block, our own included
+    int pending = find_mshr(cache, addr & ~K_OFFSET_MASK);
+    if (pending >= 0) {
+        claim_prefetch(cache, &cache->mshrs[pending], pc, addr);
+        return;
+    }
+
+    int line = KERNEL_FN(find_line)(cache, index, K_TAG(addr));
+    if (line >= 0) {
+        if (cache->tsram[line].state == MESI_S || cache->tsram[line].state == MESI_O) {
+            // Need exclusive access - request upgrade into the same line
+            if (flush_word_pending(cache, bus)) {
+                return;
+            }
+            if (cache->mshr_active >= cache->mshr_limit) {
+                wait_for_mshr(cache);
+                return;
+            }
+            mshr_t* mshr = open_mshr(cache, bus, addr, line, true, data, false);
+            cache->write_miss++;
+            cache->write_hit--;
+            if (mshr->issued) {
+                bus_set_shared(bus, cache->cache_id);
+            }
+            note_access(cache, pc, addr, line);
+        }
+        else {
+            // Can write directly in Modified or Exclusive state
+            cache->dsram[(line << K_BLOCK_BITS) + offset] = data;
+            cache->tsram[line].state = MESI_M;
+            *ready = true;
+            cache->write_hit++;
+            cache->mshr_waiting = false;
+            KERNEL_FN(touch_line)(cache, line, false);
+            note_access(cache, pc, addr, line);
+        }
+        return;
+    }
+
+    // Cache miss - wait for an MSHR and a line, write back a modified victim
+    if (flush_word_pending(cache, bus)) {
+        return;
+    }
+    if (!cache->need_to_clean_first && !mshr_available(cache, index)) {
+        wait_for_mshr(cache);
+        return;
+    }
+    cache->write_miss++;
+    if (!KERNEL_FN(write_back_victim)(cache, bus, index)) {
+        open_mshr(cache, bus, addr, cache->fill_line, true, data, false);
+        note_access(cache, pc, addr, -1);
+        cache->write_hit--;
+    }
+}
+
+/**
+ * @brief Start sending a block on the bus, one word per cycle from cache_clock
+ * @param cache Pointer to cache structure
+ * @param line Line holding the block
+ * @param addr Any address within the block
+ * @param dest Core the block is supplied to
+ */
+static void KERNEL_FN(start_flush)(cache_t* cache, int line, uint32_t addr, int dest) {
+    cache->sending_flush = true;
+    cache->flush_dest = dest;
+    cache->flush_block_addr = addr & ~K_OFFSET_MASK;
+    cache->flush_line = line;
+    cache->words_left_to_flush = K_BLOCK_SIZE;
+}
+
+/**
+ * @brief Answer another cache's BusRd or BusRdX under MOESI
+ * @param cache Pointer to cache structure
+ * @param bus Pointer to bus system
+ * @param line Line holding the requested block
+ *
+ * Any copy but a shared one supplies the block and inhibits main memory,
+ * which neither answers nor takes the words: a dirty block stays dirty in
+ * the Owned state (or moves on in a BusRdX) instead of being written back.
+ * A block that is being written back reaches memory anyway, so it is
+ * supplied as under MESI and memory takes the words.
+ */
+static void KERNEL_FN(snoop_moesi)(cache_t* cache, bus_system_t* bus, int line) {
+    mesi_state_t state = cache->tsram[line].state;
+    bool read = bus->bus_cmd == BUS_RD;
+    bool writing_back = cache->need_to_clean_first && cache->victim_line == line;
+
+    if (state != MESI_S) {
+        KERNEL_FN(start_flush)(cache, line, bus->bus_addr, bus->bus_origid);
+        if (!writing_back) {
+            bus_set_inhibit(bus, cache->cache_id);
+            if (state == MESI_E) {
+                cache->supplied_clean++;
+            }
+            else {
+                cache->supplied_dirty++;
+            }
+        }
+    }
+
+    if (!read) {
+        // Exclusive read - the requester takes over the block
+        cache->tsram[line].state = MESI_I;
+        return;
+    }
+    bus_set_shared(bus, cache->cache_id);
+    if (state == MESI_E || writing_back) {
+        cache->tsram[line].state = MESI_S;
+    }
+    else if (state == MESI_M) {
+        cache->tsram[line].state = MESI_O;
+    }
+}
+
+static void KERNEL_FN(cache_snoop)(cache_t* cache, bus_system_t* bus) {
+    // Ignore our own transactions except flushes
+    if (bus->bus_origid == cache->cache_id &&
+        bus->bus_cmd != BUS_NO_CMD &&
+        bus->bus_cmd != BUS_FLUSH) {
+        cache->is_mine = true;
+
+        // With MSHRs, Flush words of the block now answer this request
+        int line = cache->fill_line;
+        if (cache->mshrs) {
+            int index = find_mshr(cache, bus->bus_addr & ~K_OFFSET_MASK);
+            if (index < 0) return;
+            cache->mshrs[index].driven = true;
+            line = cache->mshrs[index].line;
+        }
+
+        // An owner upgrading its block supplies it to itself, since the
+        // copy in main memory is stale
+        if (bus->bus_cmd == BUS_RDX && cache->tsram[line].state == MESI_O &&
+            cache->tsram[line].tag == K_TAG(bus->bus_addr)) {
+            KERNEL_FN(start_flush)(cache, line, bus->bus_addr, cache->cache_id);
+            bus_set_inhibit(bus, cache->cache_id);
+        }
+        return;
+    }
+
+    // Handle block cleaning state update
+    if (cache->need_to_clean_first) {
+        if (bus->bus_cmd != BUS_FLUSH || bus->bus_origid != cache->cache_id) {
+            cache->words_left--;
+        }
+    }
+
+    // Only reads by other caches affect our copy
+    if (bus->bus_cmd != BUS_RD && bus->bus_cmd != BUS_RDX) {
+        return;
+    }
+
+    // Extract address components for current bus transaction
+    uint32_t index = K_INDEX(bus->bus_addr);
+    uint32_t tag = K_TAG(bus->bus_addr);
+
+    // Check if we have this block in our cache
+    int line = KERNEL_FN(find_line)(cache, index, tag);
+    if (line >= 0 && cache->protocol == CACHE_MOESI) {
+        KERNEL_FN(snoop_moesi)(cache, bus, line);
+    }
+    else if (line >= 0) {
+        switch (bus->bus_cmd) {
+        case BUS_RD:
+            // Handle read request from another cache
+            if (cache->tsram[line].state == MESI_M) {
+                // We have modified data - need to provide it
+                bus_set_shared(bus, cache->cache_id);
+                // Prepare to flush our modified data
+                KERNEL_FN(start_flush)(cache, line, bus->bus_addr, bus->bus_origid);
+                // Change our state to Shared
+                cache->tsram[line].state = MESI_S;
+            }
+            else if (cache->tsram[line].state == MESI_E) {
+                // We have exclusive but unmodified data
+                cache->tsram[line].state = MESI_S;
+                bus_set_shared(bus, cache->cache_id);
+            }
+            else if (cache->tsram[line].state == MESI_S) {
+                // Already in shared state - just signal presence
+                bus_set_shared(bus, cache->cache_id);
+            }
+            break;
+
+        case BUS_RDX:
+            // Handle exclusive read request
+            if (cache->tsram[line].state == MESI_M) {
+                // Need to flush our modified data
+                KERNEL_FN(start_flush)(cache, line, bus->bus_addr, bus->bus_origid);
+            }
+            // Must invalidate our copy
+            cache->tsram[line].state = MESI_I;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Take a Flush word answering one of our MSHRs
+ * @param cache Pointer to cache structure
+ * @param bus Pointer to bus system
+ *
+ * The last word completes the miss: a store is written, and the waiting
+ * loads read the block in program order into cache->fills. A block no
+ * demand access has reached yet is marked as prefetched.
+ */
+static void KERNEL_FN(mshr_response)(cache_t* cache, bus_system_t* bus) {
+    if (bus->bus_cmd != BUS_FLUSH || (bus->split && bus->bus_dest != cache->cache_id)) {
+        return;
+    }
+    int index = find_mshr(cache, bus->bus_addr & ~K_OFFSET_MASK);
+    if (index < 0 || !cache->mshrs[index].driven) {
+        return;
+    }
+
+    mshr_t* mshr = &cache->mshrs[index];
+    uint32_t* words = &cache->dsram[mshr->line << K_BLOCK_BITS];
+    uint32_t offset = K_OFFSET(bus->bus_addr);
+    words[offset] = bus->bus_data;
+    if (offset != K_OFFSET_MASK) {
+        return;
+    }
+
+    cache->tsram[mshr->line].tag = K_TAG(bus->bus_addr);
+    if (mshr->is_write) {
+        cache->tsram[mshr->line].state = MESI_M;
+        words[K_OFFSET(mshr->addr)] = mshr->write_data;
+    }
+    else {
+        cache->tsram[mshr->line].state = bus->bus_shared.Q == 1 ? MESI_S : MESI_E;
+    }
+    for (int i = 0; i < mshr->num_targets; i++) {
+        cache_fill_t* fill = &cache->fills[cache->num_fills++];
+        fill->tag = mshr->targets[i].tag;
+        fill->data = words[mshr->targets[i].offset];
+    }
+    if (mshr->prefetch) {
+        cache->prefetched[mshr->line] |= LINE_PREFETCHED;
+    }
+    else {
+        cache->prefetched[mshr->line] &= (uint8_t)~LINE_PREFETCHED;
+    }
+    KERNEL_FN(touch_line)(cache, mshr->line, true);
+    close_mshr(cache, mshr);
+}
+
+static void KERNEL_FN(cache_handle_bus_response)(cache_t* cache, bus_system_t* bus) {
+    if (cache->mshrs) {
+        KERNEL_FN(mshr_response)(cache, bus);
+        return;
+    }
+
+    // Only process responses for our own pending requests
+    if (!cache->waiting_for_bus || !cache->is_mine) {
+        return;
+    }
+
+    // Handle incoming flush data (tagged for us on a split bus)
+    if (bus->bus_cmd == BUS_FLUSH && (!bus->split || bus->bus_dest == cache->cache_id)) {
+        int line = cache->fill_line;
+        uint32_t offset = K_OFFSET(bus->bus_addr);
+
+        // Store the received word in our cache
+        cache->dsram[(line << K_BLOCK_BITS) + offset] = bus->bus_data;
+
+        // Check if this completes the block transfer
+        if (offset == K_OFFSET_MASK) {
+            // Update tag and state
+            cache->tsram[line].tag = K_TAG(bus->bus_addr);
+
+            if (cache->is_write_request) {
+                // For write requests, transition to Modified
+                cache->tsram[line].state = MESI_M;
+                // Perform the pending write operation
+                offset = K_OFFSET(cache->waiting_addr);
+                cache->dsram[(line << K_BLOCK_BITS) + offset] = cache->write_data;
+            }
+            else {
+                // For read requests, state depends on shared signal
+                cache->tsram[line].state = bus->bus_shared.Q == 1 ? MESI_S : MESI_E;
+            }
+            KERNEL_FN(touch_line)(cache, line, true);
+
+            // Transaction is complete
+            cache->waiting_for_bus = false;
+        }
+    }
+}
+
+/**
+ * @brief Request the oldest queued prefetch that is still worth fetching
+ * @param cache Pointer to cache structure (our bus port is free)
+ * @param bus Pointer to bus system
+ *
+ * Blocks already cached or being fetched are dropped, and so is a block
+ * whose victim is modified, since a prefetch does not start a write-back.
+ * The queue waits while no MSHR or way is free or a demand access waits
+ * for one, and while a victim is being written back.
+ */
+static void KERNEL_FN(issue_prefetch)(cache_t* cache, bus_system_t* bus) {
+    uint32_t block;
+    while (prefetch_peek(&cache->prefetch, &block)) {
+        block &= bus->addr_mask;
+        uint32_t index = K_INDEX(block);
+        if (find_mshr(cache, block) >= 0 || KERNEL_FN(find_line)(cache, index, K_TAG(block)) >= 0) {
+            prefetch_pop(&cache->prefetch);
+            continue;
+        }
+        if (cache->mshr_waiting || cache->need_to_clean_first || !mshr_available(cache, index)) {
+            return;
+        }
+        prefetch_pop(&cache->prefetch);
+
+        int victim = choose_victim(cache, index);
+        mesi_state_t state = cache->tsram[victim].state;
+        if (state == MESI_M || state == MESI_O) {
+            return;
+        }
+
+        // Remember a valid victim, so that a miss to it counts as pollution
+        if (state != MESI_I) {
+            cache->displaced[victim] = (cache->tsram[victim].tag << K_TAG_SHIFT) |
+                (index << K_BLOCK_BITS);
+            cache->prefetched[victim] |= LINE_DISPLACED;
+            cache->tsram[victim].state = MESI_I;
+        }
+        open_mshr(cache, bus, block, victim, false, 0, true);
+        cache->prefetch_issued++;
+        return;
+    }
+}
+
+static void KERNEL_FN(cache_clock)(cache_t* cache, bus_system_t* bus) {
+    bus_port_t* port = &bus->ports[cache->cache_id];
+    cache->mshr_cycles += cache->mshr_active;
+
+    // Send the next word of a pending flush; a split bus may leave the
+    // previous word waiting behind other requesters
+    if (cache->sending_flush && cache->words_left_to_flush > 0) {
+        if (bus->split && port->request && port->cmd == BUS_FLUSH) {
+            return;
+        }
+
+        // A block supplied while our own miss waits for the bus takes the
+        // port; the miss is requested again once the words are out
+        if (port->request && port->cmd != BUS_FLUSH) {
+            displace_request(cache, port);
+        }
+
+        // Calculate address and data for current word
+        uint32_t curr_word = K_BLOCK_SIZE - cache->words_left_to_flush;
+        uint32_t send_addr = cache->flush_block_addr + curr_word;
+
+        // Get data to send
+        uint32_t data = cache->dsram[(cache->flush_line << K_BLOCK_BITS) + curr_word];
+
+        // Send flush command for current word
+        bus_respond(bus, cache->cache_id, cache->flush_dest, send_addr, data);
+
+        // Update flush progress
+        cache->words_left_to_flush--;
+        if (cache->words_left_to_flush == 0) {
+            cache->sending_flush = false;
+        }
+    }
+    else if (cache->mshrs) {
+        // Queue the next miss still to be requested, demand misses first,
+        // then start the next prefetch
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < cache->num_mshrs; i++) {
+                mshr_t* mshr = &cache->mshrs[i];
+                if (mshr->valid && !mshr->issued && mshr->prefetch == (pass == 1)) {
+                    issue_mshr(cache, bus, mshr);
+                }
+            }
+        }
+        if (!port->request && cache->prefetch.count > 0) {
+            KERNEL_FN(issue_prefetch)(cache, bus);
+        }
+    }
+    else if (cache->resend_request && !port->request) {
+        cache->resend_request = false;
+        bus_request(bus, cache->cache_id, cache->is_write_request ? BUS_RDX : BUS_RD,
+            cache->waiting_addr, 0);
+    }
+}
+
+/**
+ * @brief Snoop, take responses and send flush words for one cycle
+ * @param cache Pointer to cache structure
+ * @param bus Pointer to bus system
+ */
+static void KERNEL_FN(cache_bus_cycle)(cache_t* cache, bus_system_t* bus) {
+    KERNEL_FN(cache_snoop)(cache, bus);
+    KERNEL_FN(cache_handle_bus_response)(cache, bus);
+    KERNEL_FN(cache_clock)(cache, bus);
+}
+
+/** @brief Kernel table entry for this instantiation */
+static const cache_kernel_t KERNEL_FN(cache_kernel) = {
+    KERNEL_NAME,
+#ifdef KERNEL_BLOCK_BITS
+    KERNEL_BLOCK_BITS, KERNEL_SET_BITS, KERNEL_WAY_BITS,
+#else
+    -1, -1, -1,
+#endif
+    KERNEL_FN(cache_read),
+    KERNEL_FN(cache_write),
+    KERNEL_FN(cache_load),
+    KERNEL_FN(cache_store),
+    KERNEL_FN(cache_snoop),
+    KERNEL_FN(cache_handle_bus_response),
+    KERNEL_FN(cache_clock),
+    KERNEL_FN(cache_bus_cycle)
+};
+
+#undef K_TAG
+#undef K_INDEX
+#undef K_OFFSET
+#undef K_BLOCK_BITS
+#undef K_BLOCK_SIZE
+#undef K_OFFSET_MASK
+#undef K_INDEX_MASK
+#undef K_TAG_SHIFT
+#undef K_WAY_BITS
+#undef K_WAYS
+#undef KERNEL_FN
+#undef KERNEL_CAT
+#undef KERNEL_CAT2
+#undef KERNEL_SUFFIX
+#undef KERNEL_NAME
+#undef KERNEL_BLOCK_BITS
+#undef KERNEL_SET_BITS
+#undef KERNEL_WAY_BITS
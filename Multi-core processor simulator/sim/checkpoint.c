@@ -0,0 +1,292 @@
+/**
+ * @file checkpoint.c
+ * @brief Implementation of checkpoint encoding and files
+ *
+ * Components encode their own fields with the ckpt_put and ckpt_get
+ * helpers; this file only knows the file layout. The memory section is
+ * turned into a memory image while reading, so the page contents are held
+ * once however many contexts restore the checkpoint.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkpoint.h"
+#include "main_memory.h"
+
+static const char checkpoint_magic[8] = { 'S', 'I', 'M', 'C', 'K', 'P', 'T', 0 };
+
+/* Encoding */
+
+void ckpt_writer_init(ckpt_writer_t* out) {
+    out->data = NULL;
+    out->size = 0;
+    out->capacity = 0;
+    out->ok = true;
+}
+
+void ckpt_writer_free(ckpt_writer_t* out) {
+    free(out->data);
+    out->data = NULL;
+    out->size = 0;
+    out->capacity = 0;
+}
+
+/**
+ * @brief Reserve room for more bytes
+ * @return Pointer to the reserved bytes, or NULL on allocation failure
+ */
+static uint8_t* reserve(ckpt_writer_t* out, size_t count) {
+    if (!out->ok) return NULL;
+
+    if (out->size + count > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity : 4096;
+        while (capacity < out->size + count) {
+            capacity *= 2;
+        }
+        uint8_t* data = (uint8_t*)realloc(out->data, capacity);
+        if (!data) {
+            out->ok = false;
+            return NULL;
+        }
+        out->data = data;
+        out->capacity = capacity;
+    }
+    uint8_t* p = out->data + out->size;
+    out->size += count;
+    return p;
+}
+
+void ckpt_put_u8(ckpt_writer_t* out, uint8_t value) {
+    uint8_t* p = reserve(out, 1);
+    if (p) *p = value;
+}
+
+void ckpt_put_u32(ckpt_writer_t* out, uint32_t value) {
+    uint8_t* p = reserve(out, 4);
+    if (!p) return;
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+void ckpt_put_u64(ckpt_writer_t* out, uint64_t value) {
+    ckpt_put_u32(out, (uint32_t)value);
+    ckpt_put_u32(out, (uint32_t)(value >> 32));
+}
+
+void ckpt_patch_u32(ckpt_writer_t* out, size_t offset, uint32_t value) {
+    if (!out->ok || offset + 4 > out->size) return;
+    uint8_t* p = out->data + offset;
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+void ckpt_put_words(ckpt_writer_t* out, const uint32_t* words, uint32_t count) {
+    uint8_t* p = reserve(out, (size_t)count * 4);
+    if (!p) return;
+    for (uint32_t i = 0; i < count; i++, p += 4) {
+        p[0] = (uint8_t)words[i];
+        p[1] = (uint8_t)(words[i] >> 8);
+        p[2] = (uint8_t)(words[i] >> 16);
+        p[3] = (uint8_t)(words[i] >> 24);
+    }
+}
+
+void ckpt_put_register(ckpt_writer_t* out, const Register* reg) {
+    ckpt_put_u32(out, reg->Q);
+    ckpt_put_u32(out, reg->D);
+    ckpt_put_u8(out, (uint8_t)(reg->valid | reg->enable << 1));
+}
+
+/* Decoding */
+
+void ckpt_reader_init(ckpt_reader_t* in, const uint8_t* data, size_t size) {
+    in->data = data;
+    in->size = size;
+    in->pos = 0;
+    in->ok = true;
+}
+
+/**
+ * @brief Take the next bytes
+ * @return Pointer to the bytes, or NULL past the end
+ */
+static const uint8_t* take(ckpt_reader_t* in, size_t count) {
+    if (!in->ok || in->size - in->pos < count) {
+        in->ok = false;
+        return NULL;
+    }
+    const uint8_t* p = in->data + in->pos;
+    in->pos += count;
+    return p;
+}
+
+uint8_t ckpt_get_u8(ckpt_reader_t* in) {
+    const uint8_t* p = take(in, 1);
+    return p ? *p : 0;
+}
+
+uint32_t ckpt_get_u32(ckpt_reader_t* in) {
+    const uint8_t* p = take(in, 4);
+    if (!p) return 0;
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+uint64_t ckpt_get_u64(ckpt_reader_t* in) {
+    uint64_t low = ckpt_get_u32(in);
+    return low | (uint64_t)ckpt_get_u32(in) << 32;
+}
+
+bool ckpt_get_bool(ckpt_reader_t* in) {
+    return ckpt_get_enum(in, 1) != 0;
+}
+
+uint8_t ckpt_get_enum(ckpt_reader_t* in, uint8_t max) {
+    uint8_t value = ckpt_get_u8(in);
+    if (value > max) {
+        in->ok = false;
+        return 0;
+    }
+    return value;
+}
+
+void ckpt_get_words(ckpt_reader_t* in, uint32_t* words, uint32_t count) {
+    const uint8_t* p = take(in, (size_t)count * 4);
+    if (!p) {
+        memset(words, 0, (size_t)count * sizeof(uint32_t));
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++, p += 4) {
+        words[i] = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+            (uint32_t)p[3] << 24;
+    }
+}
+
+void ckpt_get_register(ckpt_reader_t* in, Register* reg) {
+    reg->Q = ckpt_get_u32(in);
+    reg->D = ckpt_get_u32(in);
+    uint8_t flags = ckpt_get_enum(in, 3);
+    reg->valid = (flags & 1) != 0;
+    reg->enable = (flags & 2) != 0;
+}
+
+/* Files */
+
+bool checkpoint_write(const char* filename, int num_cores, int memory_bits, uint64_t cycle,
+    const ckpt_writer_t* state, const ckpt_writer_t* memory) {
+    if (!state->ok || !memory->ok) return false;
+
+    ckpt_writer_t header;
+    ckpt_writer_init(&header);
+    uint8_t* magic = reserve(&header, sizeof(checkpoint_magic));
+    if (magic) memcpy(magic, checkpoint_magic, sizeof(checkpoint_magic));
+    ckpt_put_u32(&header, CHECKPOINT_VERSION);
+    ckpt_put_u32(&header, (uint32_t)num_cores);
+    ckpt_put_u32(&header, (uint32_t)memory_bits);
+    ckpt_put_u32(&header, 0);
+    ckpt_put_u64(&header, cycle);
+    ckpt_put_u64(&header, state->size);
+
+    FILE* f = fopen(filename, "wb");
+    bool ok = header.ok && f &&
+        fwrite(header.data, 1, header.size, f) == header.size &&
+        fwrite(state->data, 1, state->size, f) == state->size &&
+        fwrite(memory->data, 1, memory->size, f) == memory->size;
+    if (f && fclose(f) != 0) {
+        ok = false;
+    }
+    ckpt_writer_free(&header);
+    return ok;
+}
+
+/**
+ * @brief Read a whole file into memory
+ * @return Newly allocated buffer, or NULL on failure
+ */
+static uint8_t* read_file(const char* filename, size_t* size) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) return NULL;
+
+    ckpt_writer_t buffer;
+    ckpt_writer_init(&buffer);
+    for (;;) {
+        uint8_t* p = reserve(&buffer, 1024 * 1024);
+        if (!p) break;
+        size_t got = fread(p, 1, 1024 * 1024, f);
+        buffer.size -= 1024 * 1024 - got;
+        if (got == 0) break;
+    }
+    if (!buffer.ok || ferror(f)) {
+        ckpt_writer_free(&buffer);
+    }
+    fclose(f);
+    *size = buffer.size;
+    return buffer.data;
+}
+
+/**
+ * @brief Decode the header and both sections of a checkpoint file
+ * @param ckpt Checkpoint to fill
+ * @param data File contents
+ * @param size Number of bytes
+ * @return NULL on success, otherwise a static description of the problem
+ */
+static const char* parse_checkpoint(checkpoint_t* ckpt, const uint8_t* data, size_t size) {
+    ckpt_reader_t in;
+    ckpt_reader_init(&in, data, size);
+    const uint8_t* magic = take(&in, sizeof(checkpoint_magic));
+    if (!magic || memcmp(magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0) {
+        return "not a checkpoint file";
+    }
+    if (ckpt_get_u32(&in) != CHECKPOINT_VERSION) {
+        return "unsupported checkpoint version";
+    }
+    ckpt->num_cores = (int)ckpt_get_u32(&in);
+    ckpt->memory_bits = (int)ckpt_get_u32(&in);
+    ckpt_get_u32(&in);
+    ckpt->cycle = ckpt_get_u64(&in);
+    uint64_t state_size = ckpt_get_u64(&in);
+    if (!in.ok || state_size > size - in.pos) {
+        return "truncated checkpoint";
+    }
+
+    // The state section is kept, the memory section becomes a shared image
+    ckpt->state_size = (size_t)state_size;
+    ckpt->state = (uint8_t*)malloc(ckpt->state_size ? ckpt->state_size : 1);
+    if (!ckpt->state) {
+        return "memory allocation failed";
+    }
+    memcpy(ckpt->state, take(&in, ckpt->state_size), ckpt->state_size);
+    ckpt->memory = memory_image_from_checkpoint(&in);
+    if (!ckpt->memory) {
+        return in.ok ? "memory allocation failed" : "truncated checkpoint";
+    }
+    return NULL;
+}
+
+checkpoint_t* checkpoint_read(const char* filename, const char** error) {
+    size_t size = 0;
+    uint8_t* data = read_file(filename, &size);
+    checkpoint_t* ckpt = (checkpoint_t*)calloc(1, sizeof(checkpoint_t));
+    const char* message = !data ? "cannot read file" :
+        !ckpt ? "memory allocation failed" : parse_checkpoint(ckpt, data, size);
+
+    free(data);
+    if (message) {
+        if (error) *error = message;
+        checkpoint_free(ckpt);
+        return NULL;
+    }
+    return ckpt;
+}
+
+void checkpoint_free(checkpoint_t* ckpt) {
+    if (!ckpt) return;
+    memory_image_free(ckpt->memory);
+    free(ckpt->state);
+    free(ckpt);
+}
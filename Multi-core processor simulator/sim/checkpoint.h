@@ -0,0 +1,150 @@
+/**
+ * @file checkpoint.h
+ * @brief Binary snapshots of the complete simulator state
+ *
+ * Checkpoint file layout (all integers little-endian):
+ * - 32-byte header: magic "SIMCKPT\0", version, core count, memory address
+ *   width, reserved word, global cycle
+ * - State section: 64-bit size, then the cache size, block size,
+ *   associativity, replacement policy, coherence protocol, bus mode, the
+ *   instruction memory size, the store buffer depth and the MSHR count,
+ *   the bus, the main memory response state and every core with its cache,
+ *   each written field by field by the component that owns it
+ * - Memory section: 32-bit page count, then per non-zero page its 32-bit
+ *   page number and MEMORY_PAGE_SIZE words
+ *
+ * A loaded checkpoint keeps the state section as bytes and the memory
+ * section as a shared memory image, so it can be restored into any number
+ * of contexts; each maps the pages copy-on-write like a memin image.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "register.h"
+
+#define CHECKPOINT_VERSION 11 ///< File format version
+
+/**
+ * @brief Growable buffer receiving checkpoint fields
+ */
+typedef struct {
+    uint8_t* data;       ///< Encoded bytes
+    size_t size;         ///< Bytes used
+    size_t capacity;     ///< Bytes allocated
+    bool ok;             ///< No allocation has failed
+} ckpt_writer_t;
+
+/**
+ * @brief Cursor over encoded checkpoint fields
+ *
+ * Reading past the end yields zeros and clears ok, so callers can read a
+ * whole component and check once.
+ */
+typedef struct {
+    const uint8_t* data; ///< Encoded bytes
+    size_t size;         ///< Number of bytes
+    size_t pos;          ///< Next byte to read
+    bool ok;             ///< Every read was in range and valid
+} ckpt_reader_t;
+
+/**
+ * @brief Loaded checkpoint, shared read-only by the contexts restored from it
+ */
+typedef struct checkpoint {
+    int num_cores;                 ///< Core count of the saved system
+    int memory_bits;               ///< Memory address width of the saved system
+    uint64_t cycle;                ///< Global cycle at which it was taken
+    uint8_t* state;                ///< State section
+    size_t state_size;             ///< Bytes in the state section
+    struct memory_image* memory;   ///< Main memory contents
+} checkpoint_t;
+
+/* Encoding */
+
+/** @brief Start an empty buffer */
+void ckpt_writer_init(ckpt_writer_t* out);
+
+/** @brief Free the buffer */
+void ckpt_writer_free(ckpt_writer_t* out);
+
+/** @brief Append a byte (also used for flags and enum values) */
+void ckpt_put_u8(ckpt_writer_t* out, uint8_t value);
+
+/** @brief Append a 32-bit value */
+void ckpt_put_u32(ckpt_writer_t* out, uint32_t value);
+
+/** @brief Append a 64-bit value */
+void ckpt_put_u64(ckpt_writer_t* out, uint64_t value);
+
+/** @brief Overwrite a 32-bit value appended earlier at a byte offset */
+void ckpt_patch_u32(ckpt_writer_t* out, size_t offset, uint32_t value);
+
+/** @brief Append an array of 32-bit words */
+void ckpt_put_words(ckpt_writer_t* out, const uint32_t* words, uint32_t count);
+
+/** @brief Append a pipeline register (D, Q, valid and enable) */
+void ckpt_put_register(ckpt_writer_t* out, const Register* reg);
+
+/* Decoding */
+
+/** @brief Start reading a byte array */
+void ckpt_reader_init(ckpt_reader_t* in, const uint8_t* data, size_t size);
+
+/** @brief Read a byte */
+uint8_t ckpt_get_u8(ckpt_reader_t* in);
+
+/** @brief Read a 32-bit value */
+uint32_t ckpt_get_u32(ckpt_reader_t* in);
+
+/** @brief Read a 64-bit value */
+uint64_t ckpt_get_u64(ckpt_reader_t* in);
+
+/** @brief Read a flag byte, which must be 0 or 1 */
+bool ckpt_get_bool(ckpt_reader_t* in);
+
+/** @brief Read an array of 32-bit words */
+void ckpt_get_words(ckpt_reader_t* in, uint32_t* words, uint32_t count);
+
+/** @brief Read a pipeline register */
+void ckpt_get_register(ckpt_reader_t* in, Register* reg);
+
+/**
+ * @brief Read a byte that must not exceed a limit (flags and enum values)
+ * @return The value, or 0 with ok cleared if it is larger than max
+ */
+uint8_t ckpt_get_enum(ckpt_reader_t* in, uint8_t max);
+
+/* Files */
+
+/**
+ * @brief Write a checkpoint file
+ * @param filename File to create
+ * @param num_cores Core count
+ * @param memory_bits Memory address width
+ * @param cycle Global cycle
+ * @param state Encoded state section
+ * @param memory Encoded memory section
+ * @return false if the file could not be written
+ */
+bool checkpoint_write(const char* filename, int num_cores, int memory_bits, uint64_t cycle,
+    const ckpt_writer_t* state, const ckpt_writer_t* memory);
+
+/**
+ * @brief Read a checkpoint file
+ * @param filename Checkpoint file
+ * @param error Receives a static description of the failure (may be NULL)
+ * @return New checkpoint, or NULL if the file is missing or malformed
+ */
+checkpoint_t* checkpoint_read(const char* filename, const char** error);
+
+/**
+ * @brief Free a checkpoint
+ * @param ckpt Checkpoint (may be NULL)
+ */
+void checkpoint_free(checkpoint_t* ckpt);
+
+#endif /* CHECKPOINT_H */
@@ -1,26 +1,101 @@
 // core.c
 #include "core.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
-void core_init(core_t* core, int id) {
-    core->core_id = id;
-    register_init(&core->pc);
-    register_set_next(&core->pc, 0);
-    core->halted = false;
-    pipeline_regs_init(&core->pipe);
-    cache_init(&core->cache, id);
+/**
+ * @brief Split instruction memory words into their fields
+ * @param core Pointer to core structure
+ * @param first First word address
+ * @param count Number of words
+ */
+static void predecode(core_t* core, uint32_t first, uint32_t count) {
+    for (uint32_t addr = first; addr < first + count; addr++) {
+        uint32_t word = core->imem[addr];
+        decoded_instr_t* inst = &core->decoded[addr];
+        inst->opcode = (word >> 24) & 0xFF;
+        inst->rd = (word >> 20) & 0xF;
+        inst->rs = (word >> 16) & 0xF;
+        inst->rt = (word >> 12) & 0xF;
+        inst->immediate = word & 0xFFF;
 
-    for (int i = 0; i < 16; i++) {
-        register_init(&core->registers[i]);
+        // ALU operations (add .. srl) and lw/sw address calculation
+        if (inst->opcode < ALU_OP_COUNT) {
+            inst->execute = alu_functions[inst->opcode];
+        }
+        else if (inst->opcode == 16 || inst->opcode == 17) {
+            inst->execute = alu_functions[ALU_ADD];
+        }
+        else {
+            inst->execute = NULL;
+        }
     }
-    register_set_next(&core->registers[0], 0);  // R0 always 0
+}
+
+bool core_init(core_t* core, int id, int imem_size, const cache_geometry_t* geometry,
+    int store_buffer) {
+    core->imem = (uint32_t*)calloc((size_t)imem_size, sizeof(uint32_t));
+    core->decoded = (decoded_instr_t*)malloc((size_t)imem_size * sizeof(decoded_instr_t));
+    core->imem_size = (uint32_t)imem_size;
+    core->imem_mask = (uint32_t)imem_size - 1;
+    core->stores = store_buffer > 0 ?
+        (store_entry_t*)calloc((size_t)store_buffer, sizeof(store_entry_t)) : NULL;
+    core->store_capacity = store_buffer;
+    if (!core->imem || !core->decoded || (store_buffer > 0 && !core->stores) ||
+        !cache_init(&core->cache, id, geometry)) return false;
+    predecode(core, 0, core->imem_size);
+
+    core->core_id = id;
+    core->halted = false;
+    pipeline_regs_init(&core->pipe);  // PC and registers (R0 always 0) start at 0
 
     core->cycles = 0;
     core->instructions = 0;
     core->decode_stalls = 0;
     core->mem_stalls = 0;
+    core->stores_buffered = 0;
+    core->loads_forwarded = 0;
+    core->stalls_avoided = 0;
+    core->functional_instructions = 0;
     core->pc_updated_by_branch = false;
+    core->forwarding = false;
+    core->draining = false;
+    core->written_back = 0;
+    core->store_head = 0;
+    core->store_count = 0;
+    core->store_retiring = false;
+    core->pending_loads = 0;
+    core->landed_loads = 0;
+    return true;
+}
+
+void core_free(core_t* core) {
+    free(core->imem);
+    core->imem = NULL;
+    free(core->decoded);
+    core->decoded = NULL;
+    free(core->stores);
+    core->stores = NULL;
+    cache_free(&core->cache);
+}
+
+/**
+ * @brief Write the data of missed loads that the cache completed this cycle
+ *
+ * Their registers stay pending until core_clock has latched the values.
+ */
+static void land_loads(core_t* core) {
+    cache_t* cache = &core->cache;
+    for (int i = 0; i < cache->num_fills; i++) {
+        uint8_t rd = cache->fills[i].tag;
+        if (rd > 1) {
+            core->pipe.next->registers[rd] = cache->fills[i].data;
+            core->landed_loads |= (uint16_t)(1u << rd);
+        }
+    }
+    cache->num_fills = 0;
 }
 
 /**
@@ -29,10 +104,17 @@ void core_init(core_t* core, int id) {
  * Responsibilities:
  * 1. Write results back to register file
  * 2. Skip writes to R0 and R1
+ * 3. Write loads completed by the cache's MSHRs
  */
 void core_writeback(core_t* core) {
+    const MEM_WB_Reg* mem_wb = &core->pipe.cur->mem_wb;
+    core->written_back = 0;
+    if (core->cache.num_fills > 0) {
+        land_loads(core);
+    }
+
     // Skip if stage contains NOP
-    if (core->pipe.mem_wb.pc.Q == -1) {
+    if (mem_wb->pc == -1) {
         return;
     }
 
@@ -40,10 +122,10 @@ void core_writeback(core_t* core) {
     // 1. Write is enabled
     // 2. Target is not R0 (constant 0)
     // 3. Target is not R1 (immediate value)
-    if (core->pipe.mem_wb.write_reg &&
-        core->pipe.mem_wb.rd.Q > 1) {  // Combines both R0 and R1 checks
-        register_set_next(&core->registers[core->pipe.mem_wb.rd.Q],
-            core->pipe.mem_wb.write_data.Q);
+    if (mem_wb->write_reg &&
+        mem_wb->rd > 1) {  // Combines both R0 and R1 checks
+        core->pipe.next->registers[mem_wb->rd] = mem_wb->write_data;
+        core->written_back = mem_wb->rd;
     }
 }
 
@@ -52,10 +134,119 @@ void core_writeback(core_t* core) {
  */
 static inline void handle_cache_miss(core_t* core) {
     core->mem_stalls++;
-    for (int i = 0; i <= 2; i++) {  // Stall IF, ID, EX stages
-        pipeline_stall_stage(&core->pipe, i);
+    // Stall IF, ID, EX stages
+    pipeline_hold(&core->pipe, PIPE_PC | PIPE_IF_ID | PIPE_ID_EX | PIPE_EX_MEM);
+}
+
+/**
+ * @brief Write the oldest buffered store to the data cache
+ *
+ * Called only in cycles where MEM leaves the cache alone, since a cache
+ * takes one access per cycle. On a miss the store keeps the cache until
+ * its block arrives.
+ */
+static void retire_store(core_t* core, bus_system_t* bus) {
+    if (core->store_count == 0) return;
+
+    const store_entry_t* store = &core->stores[core->store_head];
+    bool ready;
+    cache_write(&core->cache, bus, store->addr, store->pc, store->data, &ready);
+    core->store_retiring = !ready;
+    if (ready) {
+        core->store_head = (core->store_head + 1) % core->store_capacity;
+        core->store_count--;
+        core->stores_buffered++;
     }
-    core->pc.enable = false;
+}
+
+/**
+ * @brief Read the word of the load in MEM from the data cache
+ * @param core Pointer to core structure
+ * @param bus Pointer to bus system
+ * @param addr Word address
+ * @param deferred Set true if the load missed and leaves MEM without its data
+ * @return false if the load must stay in MEM
+ *
+ * With MSHRs a missed load is left to the cache, which hands its data to
+ * core_writeback once the block arrives; decode holds back instructions
+ * naming its destination until then. The load stays in MEM instead if the
+ * instruction behind it writes the same register, as the late data would
+ * overwrite that result.
+ */
+static bool load_word(core_t* core, bus_system_t* bus, uint32_t addr, bool* deferred) {
+    const ID_EX_Reg* next = &core->pipe.cur->id_ex;
+    uint8_t rd = core->pipe.cur->ex_mem.rd;
+    bool overwritten = next->pc != -1 &&
+        ((next->write_reg && next->rd == rd) || (next->opcode == 15 && rd == 15));
+
+    uint32_t data;
+    cache_status_t status = cache_load(&core->cache, bus, addr, core->pipe.cur->ex_mem.pc,
+        overwritten ? -1 : rd, &data);
+    if (status == CACHE_READY) {
+        core->pipe.next->mem_wb.write_data = data;
+    }
+    else if (status == CACHE_PENDING) {
+        *deferred = true;
+        if (rd > 1) {
+            core->pending_loads |= (uint16_t)(1u << rd);
+        }
+    }
+    return status != CACHE_BUSY;
+}
+
+/**
+ * @brief Memory access of the instruction in MEM through the store buffer
+ * @return false if the instruction must stay in MEM
+ *
+ * Stores are queued, loads are answered by the youngest queued store to the
+ * same word or else by the cache, and fences wait for the queue to empty.
+ * The oldest store is retired whenever the cache is left unused.
+ */
+static bool buffered_access(core_t* core, bus_system_t* bus, bool* deferred) {
+    const EX_MEM_Reg* ex_mem = &core->pipe.cur->ex_mem;
+    uint32_t addr = ex_mem->mem_addr & bus->addr_mask;
+    bool ready = true;
+    bool cache_used = false;
+
+    if (ex_mem->is_mem_read) {
+        int found = -1;
+        for (int i = core->store_count - 1; i >= 0 && found < 0; i--) {
+            int slot = (core->store_head + i) % core->store_capacity;
+            if (core->stores[slot].addr == addr) found = slot;
+        }
+        if (found >= 0) {
+            core->pipe.next->mem_wb.write_data = core->stores[found].data;
+            core->loads_forwarded++;
+        }
+        else if (core->store_retiring) {
+            ready = false;
+        }
+        else {
+            ready = load_word(core, bus, addr, deferred);
+            cache_used = true;
+        }
+    }
+    else if (ex_mem->is_mem_write) {
+        if (core->store_count < core->store_capacity) {
+            store_entry_t* store = &core->stores[
+                (core->store_head + core->store_count) % core->store_capacity];
+            store->addr = addr;
+            store->data = ex_mem->rd;
+            store->pc = ex_mem->pc;
+            core->store_count++;
+        }
+        else {
+            ready = false;
+        }
+    }
+    else if (ex_mem->is_fence) {
+        ready = core->store_count == 0;
+    }
+
+    if (!cache_used) {
+        retire_store(core, bus);
+    }
+    return ready;
 }
 
 /**
@@ -67,53 +258,59 @@ static inline void handle_cache_miss(core_t* core) {
  * - Memory read operations (lw)
  * - Memory write operations (sw)
  * - Pipeline stalls on cache misses
+ * - Store buffer retirement and fences when a store buffer is configured
  * - Forwarding results to writeback stage
  */
 void core_memory(core_t* core, bus_system_t* bus) {
+    const EX_MEM_Reg* ex_mem = &core->pipe.cur->ex_mem;
+    MEM_WB_Reg* mem_wb = &core->pipe.next->mem_wb;
+
     // Skip if stage contains NOP
-    if (core->pipe.ex_mem.pc.Q == -1) {
-        register_set_next(&core->pipe.mem_wb.pc, -1);
+    if (ex_mem->pc == -1) {
+        mem_wb->pc = -1;
+        if (core->stores) {
+            retire_store(core, bus);
+        }
         return;
     }
 
     // Default to NOP for next stage
-    register_set_next(&core->pipe.mem_wb.pc, -1);
+    mem_wb->pc = -1;
 
     bool ready = true;
-    uint32_t store_data = core->pipe.ex_mem.rd.Q;
+    bool deferred = false;
+    uint32_t store_data = ex_mem->rd;
 
     // Handle memory operations
-    if (core->pipe.ex_mem.is_mem_read || core->pipe.ex_mem.is_mem_write) {
-        if (core->pipe.ex_mem.is_mem_read) {
-            uint32_t data;
-            cache_read(&core->cache, bus,
-                core->pipe.ex_mem.mem_addr.Q, &data, &ready);
-            if (ready) {
-                register_set_next(&core->pipe.mem_wb.write_data, data);
-            }
+    if (core->stores) {
+        ready = buffered_access(core, bus, &deferred);
+    }
+    else if (ex_mem->is_mem_read || ex_mem->is_mem_write) {
+        if (ex_mem->is_mem_read) {
+            ready = load_word(core, bus, ex_mem->mem_addr, &deferred);
         }
         else {
             cache_write(&core->cache, bus,
-                core->pipe.ex_mem.mem_addr.Q,
+                ex_mem->mem_addr, ex_mem->pc,
                 store_data, &ready);
         }
+    }
 
-        if (!ready) {
-            handle_cache_miss(core);
-            return;
-        }
+    if (!ready) {
+        handle_cache_miss(core);
+        return;
     }
 
     // Forward to WB stage (no stall)
-    register_set_next(&core->pipe.mem_wb.pc, core->pipe.ex_mem.pc.Q);
-    register_set_next(&core->pipe.mem_wb.rd, core->pipe.ex_mem.rd.Q);
-    register_set_next(&core->pipe.mem_wb.write_data,
-        core->pipe.ex_mem.is_mem_read ?
-        core->pipe.mem_wb.write_data.D :  // Keep the data from cache read
-        core->pipe.ex_mem.alu_result.Q);  // Use ALU result for non-read ops
+    mem_wb->pc = ex_mem->pc;
+    mem_wb->rd = ex_mem->rd;
+    if (!ex_mem->is_mem_read) {
+        mem_wb->write_data = ex_mem->alu_result;  // Loads already wrote the data read
+    }
 
-    // Set control signals once
-    core->pipe.mem_wb.write_reg = core->pipe.ex_mem.write_reg;
+    // Set control signals once (a deferred load is written by land_loads)
+    mem_wb->write_reg = ex_mem->write_reg && !deferred;
+    mem_wb->is_mem_read = ex_mem->is_mem_read;
 }
 
 /**
@@ -126,40 +323,41 @@ void core_memory(core_t* core, bus_system_t* bus) {
  * - Sets control signals for memory operations
  */
 void core_execute(core_t* core) {
+    const ID_EX_Reg* id_ex = &core->pipe.cur->id_ex;
+    EX_MEM_Reg* ex_mem = &core->pipe.next->ex_mem;
+
     // Skip if stage contains NOP
-    if (core->pipe.id_ex.pc.Q == -1) {
-        register_set_next(&core->pipe.ex_mem.pc, -1);
+    if (id_ex->pc == -1) {
+        ex_mem->pc = -1;
         return;
     }
 
     uint32_t result = 0;
-    uint8_t op = core->pipe.id_ex.opcode.Q;
+    uint8_t op = id_ex->opcode;
 
-    // Execute operation based on opcode
-    if (op <= 8) {  // ALU operations (add, sub, and, or, xor, mul, sll, sra, srl)
-        result = alu_execute(op, core->pipe.id_ex.rs_value.Q, core->pipe.id_ex.rt_value.Q);
-    }
-    else if (op == 16 || op == 17) {  // Memory operations (lw, sw)
-        result = core->pipe.id_ex.rs_value.Q + core->pipe.id_ex.rt_value.Q;
+    // Execute through the handler resolved when the word was pre-decoded
+    const decoded_instr_t* inst = &core->decoded[id_ex->pc & core->imem_mask];
+    if (inst->execute) {
+        result = inst->execute(id_ex->rs_value, id_ex->rt_value);
     }
 
     // Forward results to MEM stage
-    register_set_next(&core->pipe.ex_mem.pc, core->pipe.id_ex.pc.Q);
-    register_set_next(&core->pipe.ex_mem.alu_result, result);
-    register_set_next(&core->pipe.ex_mem.rd, core->pipe.id_ex.rd.Q);
+    ex_mem->pc = id_ex->pc;
+    ex_mem->alu_result = result;
+    ex_mem->rd = id_ex->rd;
 
     // Set control signals
-    core->pipe.ex_mem.is_mem_read = (op == 16);   // lw
-    core->pipe.ex_mem.is_mem_write = (op == 17);  // sw
-    core->pipe.ex_mem.write_reg = (op <= 15);     // All non-memory operations write to register
+    ex_mem->is_mem_read = (op == 16);   // lw
+    ex_mem->is_mem_write = (op == 17);  // sw
+    ex_mem->is_fence = (op == 18);      // fence
 
     // For store operations, save the data to be stored
-    if (core->pipe.ex_mem.is_mem_write) {
-        register_set_next(&core->pipe.ex_mem.mem_write_data, core->pipe.id_ex.rd.Q);
+    if (ex_mem->is_mem_write) {
+        ex_mem->mem_write_data = id_ex->rd;
     }
 
-    register_set_next(&core->pipe.ex_mem.mem_addr, result);
-    core->pipe.ex_mem.write_reg = core->pipe.id_ex.write_reg;
+    ex_mem->mem_addr = result;
+    ex_mem->write_reg = id_ex->write_reg;
 }
 
 /**
@@ -199,27 +397,136 @@ static bool check_hazard_stage(uint8_t rs, uint8_t rt, uint8_t rd, uint8_t opcod
  * @brief Check for all data hazards in pipeline
  */
 static bool check_data_hazards(core_t* core, uint8_t opcode, uint8_t rs, uint8_t rt, uint8_t rd) {
+    const Pipeline_State* cur = core->pipe.cur;
+    const Pipeline_State* next = core->pipe.next;
+
     // Only check for hazards in relevant instructions
     if ((opcode > 14) && (opcode != 16) && (opcode != 17)) return false;
 
-    // Check each pipeline stage
+    // Check each pipeline stage (EX and MEM have already set the write
+    // signals they pass on)
     if (check_hazard_stage(rs, rt, rd, opcode,
-        core->pipe.id_ex.rd.Q,
-        core->pipe.id_ex.write_reg,
-        core->pipe.id_ex.pc.Q != -1)) return true;
+        cur->id_ex.rd,
+        cur->id_ex.write_reg,
+        cur->id_ex.pc != -1)) return true;
 
     if (check_hazard_stage(rs, rt, rd, opcode,
-        core->pipe.ex_mem.rd.Q,
-        core->pipe.ex_mem.write_reg,
-        core->pipe.ex_mem.pc.Q != -1)) return true;
+        cur->ex_mem.rd,
+        next->ex_mem.write_reg,
+        cur->ex_mem.pc != -1)) return true;
 
     if (check_hazard_stage(rs, rt, rd, opcode,
-        core->pipe.mem_wb.rd.Q,
-        core->pipe.mem_wb.write_reg,
-        core->pipe.mem_wb.pc.Q != -1)) return true;
+        cur->mem_wb.rd,
+        next->mem_wb.write_reg,
+        cur->mem_wb.pc != -1)) return true;
 
     return false;
 }
+
+/**
+ * @brief Check whether an instruction names a register a missed load has yet to write
+ *
+ * Sources wait for the data, and destinations too, so that the late load
+ * cannot overwrite a younger result.
+ */
+static bool waits_for_load(const core_t* core, uint8_t opcode, uint8_t rs, uint8_t rt, uint8_t rd) {
+    if (core->pending_loads == 0 || opcode > 17) return false;
+
+    uint32_t regs = (1u << rs) | (1u << rt) | (1u << rd);
+    if (opcode == 15) {
+        regs |= 1u << 15;  // jal writes R15
+    }
+    return (regs & core->pending_loads) != 0;
+}
+
+/**
+ * @brief Stage of the youngest instruction in flight that writes a register
+ *
+ * The value is the number of cycles decode would still wait without
+ * forwarding.
+ */
+typedef enum {
+    PRODUCER_NONE = 0,  ///< The register file is up to date
+    PRODUCER_WB = 1,    ///< Written back this cycle
+    PRODUCER_MEM = 2,   ///< Result left MEM this cycle
+    PRODUCER_EX = 3     ///< Result left EX this cycle
+} producer_t;
+
+/**
+ * @brief Find the youngest instruction in flight that writes a register
+ *
+ * Decode runs after the later stages, so the values they latch for the
+ * next cycle are already known.
+ */
+static producer_t find_producer(const core_t* core, uint8_t reg) {
+    const ID_EX_Reg* id_ex = &core->pipe.cur->id_ex;
+    const MEM_WB_Reg* mem_wb = &core->pipe.next->mem_wb;
+    if (reg <= 1) return PRODUCER_NONE;
+
+    if (id_ex->pc != -1 && id_ex->write_reg && id_ex->rd == reg) {
+        return PRODUCER_EX;
+    }
+    if (mem_wb->pc != -1 && mem_wb->write_reg && mem_wb->rd == reg) {
+        return PRODUCER_MEM;
+    }
+    return core->written_back == reg ? PRODUCER_WB : PRODUCER_NONE;
+}
+
+/**
+ * @brief Read a register through the forwarding network
+ */
+static uint32_t forward_value(core_t* core, uint8_t reg, producer_t producer) {
+    switch (producer) {
+    case PRODUCER_EX:  return core->pipe.next->ex_mem.alu_result;  // EX -> EX
+    case PRODUCER_MEM: return core->pipe.next->mem_wb.write_data;  // MEM -> EX
+    case PRODUCER_WB:  return core->pipe.next->registers[reg];      // WB -> ID
+    default:           return core->pipe.cur->registers[reg];
+    }
+}
+
+/**
+ * @brief Check whether forwarding cannot supply an operand in time
+ *
+ * A load's data exists only after MEM, so the instruction right behind it
+ * waits one cycle. Branches compare in decode, so a result still in EX is
+ * too late for them as well, and so is a load in MEM.
+ */
+static bool operand_late(const core_t* core, producer_t producer, bool branch) {
+    if (producer == PRODUCER_EX) {
+        return branch || core->pipe.cur->id_ex.opcode == 16;
+    }
+    return producer == PRODUCER_MEM && branch && core->pipe.next->mem_wb.is_mem_read;
+}
+
+/**
+ * @brief Read the source registers and store data through the forwarding network
+ * @return false if decode must stall
+ */
+static bool forward_operands(core_t* core, uint8_t opcode, uint8_t rs, uint8_t rt, uint8_t rd,
+    uint32_t* rs_val, uint32_t* rt_val, uint32_t* rd_val) {
+    producer_t from_rs = find_producer(core, rs);
+    producer_t from_rt = find_producer(core, rt);
+    producer_t from_rd = opcode == 17 ? find_producer(core, rd) : PRODUCER_NONE;
+
+    // Same instructions as check_data_hazards
+    if (opcode <= 14 || opcode == 16 || opcode == 17) {
+        bool branch = opcode >= 9 && opcode <= 14;
+        if (operand_late(core, from_rs, branch) || operand_late(core, from_rt, branch) ||
+            operand_late(core, from_rd, false)) {
+            return false;
+        }
+
+        // Without forwarding the instruction would wait for its youngest producer
+        producer_t youngest = from_rs > from_rt ? from_rs : from_rt;
+        core->stalls_avoided += youngest > from_rd ? youngest : from_rd;
+    }
+
+    *rs_val = forward_value(core, rs, from_rs);
+    *rt_val = forward_value(core, rt, from_rt);
+    *rd_val = forward_value(core, rd, from_rd);
+    return true;
+}
+
 /**
  * @brief Evaluate branch condition
  */
@@ -239,50 +546,60 @@ static bool evaluate_branch(uint8_t opcode, uint32_t rs_val, uint32_t rt_val) {
  * @brief Handle pipeline stall
  */
 static void stall_pipeline(core_t* core) {
-    register_set_next(&core->pipe.id_ex.pc, -1);
-    pipeline_stall_stage(&core->pipe, 0);
-    core->pc.enable = false;
+    core->pipe.next->id_ex.pc = -1;
+    pipeline_hold(&core->pipe, PIPE_PC | PIPE_IF_ID);
     core->decode_stalls++;
 }
 
 void core_decode(core_t* core) {
+    Pipeline_State* cur = core->pipe.cur;
+    Pipeline_State* next = core->pipe.next;
+
     // Skip if stage contains NOP
-    if (core->pipe.if_id.pc.Q == -1) {
-        register_set_next(&core->pipe.id_ex.pc, -1);
+    if (cur->if_id.pc == -1) {
+        next->id_ex.pc = -1;
         return;
     }
 
-    // Decode instruction fields
-    uint32_t instruction = core->pipe.if_id.instruction.Q;
-    uint8_t opcode = (instruction >> 24) & 0xFF;
-    uint8_t rd = (instruction >> 20) & 0xF;
-    uint8_t rs = (instruction >> 16) & 0xF;
-    uint8_t rt = (instruction >> 12) & 0xF;
-    uint16_t immediate = instruction & 0xFFF;
+    // Instruction fields, extracted when imem was written
+    const decoded_instr_t* inst = &core->decoded[cur->if_id.pc & core->imem_mask];
+    uint8_t opcode = inst->opcode;
+    uint8_t rd = inst->rd;
+    uint8_t rs = inst->rs;
+    uint8_t rt = inst->rt;
+    uint16_t immediate = inst->immediate;
 
     // Update R1 with sign-extended immediate
-    core->registers[1].Q = (int16_t)immediate;
+    cur->registers[1] = (int16_t)immediate;
 
-    // Check for data hazards
-    if (check_data_hazards(core, opcode, rs, rt, rd)) {
+    // Check for data hazards, or take the operands from the forwarding network
+    uint32_t rs_val;
+    uint32_t rt_val;
+    uint32_t rd_val;
+    bool hazard = waits_for_load(core, opcode, rs, rt, rd) || (core->forwarding ?
+        !forward_operands(core, opcode, rs, rt, rd, &rs_val, &rt_val, &rd_val) :
+        check_data_hazards(core, opcode, rs, rt, rd));
+    if (hazard) {
         stall_pipeline(core);
         return;
     }
+    if (!core->forwarding) {
+        rs_val = cur->registers[rs];
+        rt_val = cur->registers[rt];
+        rd_val = cur->registers[rd];
+    }
 
     // Handle control instructions
     if (opcode >= 9 && opcode <= 14) {  // Branch instructions
-        uint32_t rs_val = register_get_value(&core->registers[rs]);
-        uint32_t rt_val = register_get_value(&core->registers[rt]);
-
         if (evaluate_branch(opcode, rs_val, rt_val)) {
-            uint32_t target = core->registers[rd].Q & 0x3FF;
-            register_set_next(&core->pc, target);
+            uint32_t target = cur->registers[rd] & core->imem_mask;
+            next->pc = target;
             core->pc_updated_by_branch = true;
         }
     }
     else if (opcode == 15) {  // jal
-        register_set_next(&core->registers[15], core->pc.Q + 1);
-        register_set_next(&core->pc, rd & 0x3FF);
+        next->registers[15] = cur->pc + 1;
+        next->pc = rd & core->imem_mask;
         core->pc_updated_by_branch = true;
     }
     else if (opcode == 20) {  // halt
@@ -290,17 +607,18 @@ void core_decode(core_t* core) {
     }
 
     // Forward to EX stage
-    register_set_next(&core->pipe.id_ex.pc, core->pipe.if_id.pc.Q);
-    register_set_next(&core->pipe.id_ex.opcode, opcode);
-    register_set_next(&core->pipe.id_ex.rd, opcode == 17 ? core->registers[rd].Q : rd);
-    register_set_next(&core->pipe.id_ex.rs, rs);
-    register_set_next(&core->pipe.id_ex.rt, rt);
-    register_set_next(&core->pipe.id_ex.rs_value, register_get_value(&core->registers[rs]));
-    register_set_next(&core->pipe.id_ex.rt_value, register_get_value(&core->registers[rt]));
-    register_set_next(&core->pipe.id_ex.immediate, immediate);
+    ID_EX_Reg* id_ex = &next->id_ex;
+    id_ex->pc = cur->if_id.pc;
+    id_ex->opcode = opcode;
+    id_ex->rd = opcode == 17 ? rd_val : rd;
+    id_ex->rs = rs;
+    id_ex->rt = rt;
+    id_ex->rs_value = rs_val;
+    id_ex->rt_value = rt_val;
+    id_ex->immediate = immediate;
 
     // Set write_reg for non-branch, non-store instructions
-    core->pipe.id_ex.write_reg = (opcode <= 16) && (opcode < 9 || opcode > 14);
+    id_ex->write_reg = (opcode <= 16) && (opcode < 9 || opcode > 14);
 }
 /**
  * @brief Fetch stage of the pipeline
@@ -311,85 +629,343 @@ void core_decode(core_t* core) {
  * 3. Track instruction count
  */
 void core_fetch(core_t* core) {
+    Pipeline_State* next = core->pipe.next;
     if (core->halted) {
-        register_set_next(&core->pipe.if_id.pc, -1);
-        core->pc.D = -1;
+        next->if_id.pc = -1;
+        next->pc = -1;
+        return;
+    }
+
+    // A draining core only fetches the delay slot of a branch taken this cycle
+    if (core->draining && !core->pc_updated_by_branch) {
+        next->if_id.pc = -1;
         return;
     }
 
     // Count valid instruction fetch
-    if (core->pc.enable) {
+    if (!pipeline_is_held(&core->pipe, PIPE_PC)) {
         core->instructions++;
     }
 
-    const uint32_t curr_pc = core->pc.Q;
+    const uint32_t curr_pc = core->pipe.cur->pc;
 
     // Fetch and forward instruction in one step
-    register_set_next(&core->pipe.if_id.instruction, core->imem[curr_pc]);
-    register_set_next(&core->pipe.if_id.pc, curr_pc);
+    next->if_id.instruction = core->imem[curr_pc & core->imem_mask];
+    next->if_id.pc = curr_pc;
 
     // Update PC unless modified by branch
     if (!core->pc_updated_by_branch) {
-        register_set_next(&core->pc, curr_pc + 1);
+        next->pc = curr_pc + 1;
     }
     core->pc_updated_by_branch = false;
 }
 
-void core_load_imem(core_t* core, const char* filename) {
-    FILE* f = fopen(filename, "r");
-    if (!f) return;
+/* Functional Execution */
+
+uint64_t core_run_functional(core_t* core, main_memory_t* mem, uint64_t count, uint32_t stop_pc,
+    core_access_fn access, void* arg) {
+    Pipeline_State* state = core->pipe.cur;
+    uint32_t* regs = state->registers;
+    uint32_t pc = state->pc;
+    uint32_t npc = pc + 1;  // Executed after pc: the next word, or a branch target
+
+    // A delay slot left fetched by the last call runs first
+    if (state->if_id.pc != CORE_NO_PC) {
+        npc = pc;
+        pc = state->if_id.pc;
+        state->if_id.pc = CORE_NO_PC;
+        core->instructions--;
+    }
+
+    uint64_t done = 0;
+    while (done < count && !core->halted && pc != stop_pc) {
+        const decoded_instr_t* inst = &core->decoded[pc & core->imem_mask];
+        uint32_t target = npc + 1;
+        regs[1] = (int16_t)inst->immediate;
 
-    int addr = 0;
-    uint32_t value;
-    while (addr < 1024 && fscanf(f, "%x", &value) == 1) {
-        core->imem[addr++] = value;
+        uint32_t result = 0;
+        if (inst->execute) {
+            result = inst->execute(regs[inst->rs], regs[inst->rt]);
+        }
+
+        switch (inst->opcode) {
+        case 9: case 10: case 11: case 12: case 13: case 14:  // Branches
+            if (evaluate_branch(inst->opcode, regs[inst->rs], regs[inst->rt])) {
+                target = regs[inst->rd] & core->imem_mask;
+            }
+            break;
+
+        case 15:  // jal (its rd field is written with the ALU result 0, as in WB)
+            regs[15] = npc + 1;
+            target = inst->rd & core->imem_mask;
+            if (inst->rd > 1) {
+                regs[inst->rd] = 0;
+            }
+            break;
+
+        case 16: {  // lw
+            uint32_t addr = result & mem->addr_mask;
+            uint32_t data = memory_read(mem, addr);
+            if (access) {
+                access(arg, core->core_id, addr, false);
+            }
+            if (inst->rd > 1) {
+                regs[inst->rd] = data;
+            }
+            break;
+        }
+
+        case 17: {  // sw
+            uint32_t addr = result & mem->addr_mask;
+            memory_write(mem, addr, regs[inst->rd]);
+            if (access) {
+                access(arg, core->core_id, addr, true);
+            }
+            break;
+        }
+
+        case 20:  // halt
+            core->halted = true;
+            break;
+
+        default:  // ALU operations; any other opcode does nothing
+            if (inst->opcode < ALU_OP_COUNT && inst->rd > 1) {
+                regs[inst->rd] = result;
+            }
+            break;
+        }
+
+        done++;
+        pc = npc;
+        npc = target;
+    }
+
+    // R1 only holds an immediate while its instruction is decoded
+    regs[1] = 0;
+    core->functional_instructions += done;
+    if (core->halted) {
+        state->pc = CORE_NO_PC;
+    }
+    else if (npc != pc + 1) {
+        // Stopped in a delay slot: fetch it, so the target follows it
+        state->if_id.pc = pc;
+        state->if_id.instruction = core->imem[pc & core->imem_mask];
+        state->pc = npc;
+        core->instructions++;
     }
-    fclose(f);
+    else {
+        state->pc = pc;
+    }
+    return done;
 }
-void print_core_state(core_t* core) {
-    printf("\n=== Core %d State (Cycle %d) ===\n", core->core_id, core->cycles);
+
+/**
+ * @brief Load sink copying words into instruction memory
+ */
+static bool store_imem(void* target, uint32_t addr, const uint32_t* words, uint32_t count) {
+    core_t* core = (core_t*)target;
+    memcpy(core->imem + addr, words, count * sizeof(uint32_t));
+    predecode(core, addr, count);
+    return true;
+}
+
+load_status_t core_load_imem(core_t* core, const char* filename, int* error_line) {
+    return load_words(filename, core->imem_size, store_imem, core, error_line);
+}
+
+void core_write_imem(core_t* core, uint32_t addr, uint32_t word) {
+    core->imem[addr] = word;
+    predecode(core, addr, 1);
+}
+/* Checkpoints */
+
+void core_checkpoint(const core_t* core, ckpt_writer_t* out) {
+    const Pipeline_State* state = core->pipe.cur;
+    ckpt_put_u32(out, state->if_id.pc);
+    ckpt_put_u32(out, state->if_id.instruction);
+
+    ckpt_put_u32(out, state->id_ex.pc);
+    ckpt_put_u8(out, state->id_ex.opcode);
+    ckpt_put_u32(out, state->id_ex.rd);
+    ckpt_put_u8(out, state->id_ex.rs);
+    ckpt_put_u8(out, state->id_ex.rt);
+    ckpt_put_u32(out, state->id_ex.rs_value);
+    ckpt_put_u32(out, state->id_ex.rt_value);
+    ckpt_put_u32(out, state->id_ex.immediate);
+    ckpt_put_u8(out, state->id_ex.write_reg);
+
+    ckpt_put_u32(out, state->ex_mem.pc);
+    ckpt_put_u32(out, state->ex_mem.alu_result);
+    ckpt_put_u32(out, state->ex_mem.rd);
+    ckpt_put_u32(out, state->ex_mem.mem_addr);
+    ckpt_put_u32(out, state->ex_mem.mem_write_data);
+    ckpt_put_u8(out, state->ex_mem.is_mem_read);
+    ckpt_put_u8(out, state->ex_mem.is_mem_write);
+    ckpt_put_u8(out, state->ex_mem.write_reg);
+    ckpt_put_u8(out, state->ex_mem.is_fence);
+
+    ckpt_put_u32(out, state->mem_wb.pc);
+    ckpt_put_u32(out, state->mem_wb.write_data);
+    ckpt_put_u32(out, state->mem_wb.rd);
+    ckpt_put_u8(out, state->mem_wb.write_reg);
+    ckpt_put_u8(out, state->mem_wb.is_mem_read);
+
+    ckpt_put_words(out, state->registers, 16);
+    ckpt_put_u32(out, state->pc);
+    ckpt_put_u8(out, core->pipe.held);
+    ckpt_put_u8(out, core->halted);
+    ckpt_put_u8(out, core->pc_updated_by_branch);
+
+    ckpt_put_u32(out, (uint32_t)core->cycles);
+    ckpt_put_u32(out, (uint32_t)core->instructions);
+    ckpt_put_u32(out, (uint32_t)core->decode_stalls);
+    ckpt_put_u32(out, (uint32_t)core->mem_stalls);
+    ckpt_put_u32(out, (uint32_t)core->stalls_avoided);
+    ckpt_put_u64(out, core->functional_instructions);
+
+    // Store buffer, oldest entry first (its depth is part of the configuration)
+    ckpt_put_u32(out, (uint32_t)core->store_count);
+    for (int i = 0; i < core->store_count; i++) {
+        const store_entry_t* store = &core->stores[(core->store_head + i) % core->store_capacity];
+        ckpt_put_u32(out, store->addr);
+        ckpt_put_u32(out, store->data);
+        ckpt_put_u32(out, store->pc);
+    }
+    ckpt_put_u8(out, core->store_retiring);
+    ckpt_put_u32(out, (uint32_t)core->stores_buffered);
+    ckpt_put_u32(out, (uint32_t)core->loads_forwarded);
+    ckpt_put_u32(out, core->pending_loads);
+
+    cache_checkpoint(&core->cache, out);
+
+    // Instruction memory without its trailing zero words
+    uint32_t size = core->imem_size;
+    while (size > 0 && core->imem[size - 1] == 0) {
+        size--;
+    }
+    ckpt_put_u32(out, size);
+    ckpt_put_words(out, core->imem, size);
+}
+
+void core_restore(core_t* core, ckpt_reader_t* in) {
+    pipeline_regs_init(&core->pipe);
+    Pipeline_State* state = core->pipe.cur;
+    state->if_id.pc = ckpt_get_u32(in);
+    state->if_id.instruction = ckpt_get_u32(in);
+
+    state->id_ex.pc = ckpt_get_u32(in);
+    state->id_ex.opcode = ckpt_get_u8(in);
+    state->id_ex.rd = ckpt_get_u32(in);
+    state->id_ex.rs = ckpt_get_enum(in, 15);
+    state->id_ex.rt = ckpt_get_enum(in, 15);
+    state->id_ex.rs_value = ckpt_get_u32(in);
+    state->id_ex.rt_value = ckpt_get_u32(in);
+    state->id_ex.immediate = (uint16_t)ckpt_get_u32(in);
+    state->id_ex.write_reg = ckpt_get_bool(in);
+
+    state->ex_mem.pc = ckpt_get_u32(in);
+    state->ex_mem.alu_result = ckpt_get_u32(in);
+    state->ex_mem.rd = ckpt_get_u32(in);
+    state->ex_mem.mem_addr = ckpt_get_u32(in);
+    state->ex_mem.mem_write_data = ckpt_get_u32(in);
+    state->ex_mem.is_mem_read = ckpt_get_bool(in);
+    state->ex_mem.is_mem_write = ckpt_get_bool(in);
+    state->ex_mem.write_reg = ckpt_get_bool(in);
+    state->ex_mem.is_fence = ckpt_get_bool(in);
+
+    state->mem_wb.pc = ckpt_get_u32(in);
+    state->mem_wb.write_data = ckpt_get_u32(in);
+    state->mem_wb.rd = ckpt_get_u32(in);
+    state->mem_wb.write_reg = ckpt_get_bool(in);
+    state->mem_wb.is_mem_read = ckpt_get_bool(in);
+    if (state->mem_wb.write_reg && state->mem_wb.rd > 15) {
+        in->ok = false;
+    }
+
+    ckpt_get_words(in, state->registers, 16);
+    state->pc = ckpt_get_u32(in);
+    core->pipe.held = ckpt_get_enum(in, PIPE_IF_ID | PIPE_ID_EX | PIPE_EX_MEM | PIPE_MEM_WB | PIPE_PC);
+    core->halted = ckpt_get_bool(in);
+    core->pc_updated_by_branch = ckpt_get_bool(in);
+
+    core->cycles = (int)ckpt_get_u32(in);
+    core->instructions = (int)ckpt_get_u32(in);
+    core->decode_stalls = (int)ckpt_get_u32(in);
+    core->mem_stalls = (int)ckpt_get_u32(in);
+    core->stalls_avoided = (int)ckpt_get_u32(in);
+    core->functional_instructions = ckpt_get_u64(in);
+
+    uint32_t stores = ckpt_get_u32(in);
+    if (stores > (uint32_t)core->store_capacity) {
+        in->ok = false;
+        return;
+    }
+    core->store_head = 0;
+    core->store_count = (int)stores;
+    for (int i = 0; i < core->store_count; i++) {
+        core->stores[i].addr = ckpt_get_u32(in);
+        core->stores[i].data = ckpt_get_u32(in);
+        core->stores[i].pc = ckpt_get_u32(in);
+    }
+    core->store_retiring = ckpt_get_bool(in);
+    core->stores_buffered = (int)ckpt_get_u32(in);
+    core->loads_forwarded = (int)ckpt_get_u32(in);
+    core->pending_loads = (uint16_t)ckpt_get_u32(in);
+    core->landed_loads = 0;
+
+    cache_restore(&core->cache, in);
+
+    uint32_t size = ckpt_get_u32(in);
+    if (size > core->imem_size) {
+        in->ok = false;
+        return;
+    }
+    ckpt_get_words(in, core->imem, size);
+    memset(core->imem + size, 0, (core->imem_size - size) * sizeof(uint32_t));
+    predecode(core, 0, core->imem_size);
+}
+
+void print_core_state(FILE* out, core_t* core) {
+    const Pipeline_State* state = core->pipe.cur;
+    fprintf(out, "\n=== Core %d State (Cycle %d) ===\n", core->core_id, core->cycles);
 
     // PC and Halt state
-    printf("PC: %08X  Halted: %d\n", core->pc.Q, core->halted);
+    fprintf(out, "PC: %08X  Halted: %d\n", state->pc, core->halted);
 
     // Registers (non-zero only)
-    printf("\nRegisters:\n");
+    fprintf(out, "\nRegisters:\n");
     for (int i = 2; i < 16; i++) {
-        if (core->registers[i].Q != 0) {
-            printf("R%d: %08X  ", i, core->registers[i].Q);
-            if ((i - 1) % 4 == 0) printf("\n");
+        if (state->registers[i] != 0) {
+            fprintf(out, "R%d: %08X  ", i, state->registers[i]);
+            if ((i - 1) % 4 == 0) fprintf(out, "\n");
         }
     }
 
     // Pipeline stages
-    printf("\nPipeline:\n");
-    printf("IF/ID:  PC=%03X  Inst=%08X  Valid=%d\n",
-        core->pipe.if_id.pc.Q,
-        core->pipe.if_id.instruction.Q,
-        core->pipe.if_id.valid);
+    fprintf(out, "\nPipeline:\n");
+    fprintf(out, "IF/ID:  PC=%03X  Inst=%08X\n",
+        state->if_id.pc,
+        state->if_id.instruction);
 
-    printf("ID/EX:  PC=%03X  Op=%02X  rd=%d  rs=%d  rt=%d  Valid=%d\n",
-        core->pipe.id_ex.pc.Q,
-        core->pipe.id_ex.opcode.Q,
-        core->pipe.id_ex.rd.Q,
-        core->pipe.id_ex.rs.Q,
-        core->pipe.id_ex.rt.Q,
-        core->pipe.id_ex.valid);
+    fprintf(out, "ID/EX:  PC=%03X  Op=%02X  rd=%d  rs=%d  rt=%d\n",
+        state->id_ex.pc,
+        state->id_ex.opcode,
+        state->id_ex.rd,
+        state->id_ex.rs,
+        state->id_ex.rt);
 
-    printf("EX/MEM: PC=%03X  Rd=%d  Addr=%08X  Data=%08X  Valid=%d\n",
-        core->pipe.ex_mem.pc.Q,
-        core->pipe.ex_mem.rd.Q,
-        core->pipe.ex_mem.mem_addr.Q,
-        core->pipe.ex_mem.mem_write_data.Q,
-        core->pipe.ex_mem.valid);
+    fprintf(out, "EX/MEM: PC=%03X  Rd=%d  Addr=%08X  Data=%08X\n",
+        state->ex_mem.pc,
+        state->ex_mem.rd,
+        state->ex_mem.mem_addr,
+        state->ex_mem.mem_write_data);
 
-    printf("MEM/WB: PC=%03X  Rd=%d  Data=%08X  Valid=%d\n",
-        core->pipe.mem_wb.pc.Q,
-        core->pipe.mem_wb.rd.Q,
-        core->pipe.mem_wb.write_data.Q,
-        core->pipe.mem_wb.valid);
+    fprintf(out, "MEM/WB: PC=%03X  Rd=%d  Data=%08X\n",
+        state->mem_wb.pc,
+        state->mem_wb.rd,
+        state->mem_wb.write_data);
 
-    printf("==========================================\n");
+    fprintf(out, "==========================================\n");
 }
 
 
@@ -400,39 +976,74 @@ void print_core_state(core_t* core) {
  * @param bus Pointer to bus system
  */
 void core_clock(core_t* core, bus_system_t* bus) {
-    // Enable all registers for next cycle
-    pipeline_regs_enable_all(&core->pipe);
-    core->pc.enable = true;
+    // Release the stalls of the last cycle
+    pipeline_regs_begin_cycle(&core->pipe);
 
     // Execute pipeline stages
     core_run_pipeline(core, bus);
 
-    // Update all registers
+    // Latch PC, registers and pipeline registers
     pipeline_regs_clock_update(&core->pipe);
-    register_clock_update(&core->pc);
-    for (int i = 0; i < 16; i++) {
-        register_clock_update(&core->registers[i]);
-    }
+    core->pending_loads &= (uint16_t)~core->landed_loads;
+    core->landed_loads = 0;
 }
 
 bool pipeline_is_empty(Pipeline_Regs* pipe) {
-    return pipe->if_id.pc.Q == -1 &&
-        pipe->id_ex.pc.Q == -1 &&
-        pipe->ex_mem.pc.Q == -1 &&
-        pipe->mem_wb.pc.Q == -1;
+    const Pipeline_State* state = pipe->cur;
+    return state->if_id.pc == -1 &&
+        state->id_ex.pc == -1 &&
+        state->ex_mem.pc == -1 &&
+        state->mem_wb.pc == -1;
+}
+
+bool core_is_done(core_t* core) {
+    return core->halted && pipeline_is_empty(&core->pipe) && core->store_count == 0 &&
+        core->cache.mshr_active == 0 && core->cache.prefetch.count == 0;
+}
+
+bool core_is_drained(core_t* core) {
+    const cache_t* cache = &core->cache;
+    return pipeline_is_empty(&core->pipe) && core->store_count == 0 &&
+        core->pending_loads == 0 && cache->mshr_active == 0 && cache->prefetch.count == 0 &&
+        !cache->waiting_for_bus && !cache->sending_flush && !cache->need_to_clean_first;
+}
+
+bool core_is_frozen(core_t* core) {
+    if (core_is_done(core)) {
+        return true;
+    }
+
+    // Stalled in MEM last cycle (IF/ID/EX and PC held by handle_cache_miss)
+    // while the cache waits for its own request to be answered
+    return pipeline_is_held(&core->pipe, PIPE_PC) &&
+        pipeline_is_held(&core->pipe, PIPE_EX_MEM) &&
+        core->cache.waiting_for_bus &&
+        !core->cache.sending_flush &&
+        !core->cache.resend_request &&
+        !core->cache.need_to_clean_first &&
+        cache_misses_issued(&core->cache);
+}
+
+void core_skip_cycles(core_t* core, int count) {
+    if (core_is_done(core)) {
+        return;
+    }
+    core->cycles += count;
+    core->mem_stalls += count;
+    core->cache.mshr_cycles += count * core->cache.mshr_active;
 }
 
 void core_run_pipeline(core_t* core, bus_system_t* bus) {
     // Execute pipeline stages in reverse order
     core_writeback(core);
     core_memory(core, bus);
-    if (core->pipe.id_ex.rd.enable) {
+    if (!pipeline_is_held(&core->pipe, PIPE_ID_EX)) {
         core_execute(core);
         core_decode(core);
         core_fetch(core);
     }
     // Update cycle count and statistics
-    if (!core->halted || !pipeline_is_empty(&core->pipe)) {
+    if (!core_is_done(core)) {
         core->cycles++;
     }
 }
\ No newline at end of file
@@ -5,50 +5,137 @@
  * This core implements:
  * - 5-stage pipeline (Fetch, Decode, Execute, Memory, Writeback)
  * - 16 32-bit registers (R0-R15)
- * - Private instruction memory (1024 words)
+ * - Private instruction memory (1024 words by default, configurable), kept
+ *   pre-decoded so decode and execute never re-extract instruction fields
  * - Private data cache with MESI coherency
- * - Support for data hazards and pipeline stalls
+ * - Support for data hazards and pipeline stalls, or optionally a forwarding
+ *   network that leaves only the load-use bubble (and branch operands still
+ *   being computed) to stall decode
+ * - Optional store buffer between MEM and the data cache (TSO), with a
+ *   fence instruction that waits for it to drain
+ * - Non-blocking loads when the data cache has MSHRs: a missed load leaves
+ *   MEM and only the instructions naming its destination wait for it
+ * - A functional mode that executes the same ISA without pipeline or timing,
+ *   reading and writing main memory directly (fast-forwarding)
  */
 
 #ifndef CORE_H
 #define CORE_H
 
+#include <stdio.h>
 #include "pipeline_regs.h"
 #include "cache.h"
+#include "main_memory.h"
 #include "alu.h"
+#include "platform.h"
+#include "load.h"
+
+#define IMEM_DEFAULT_SIZE 1024     ///< Default instruction memory words
+#define IMEM_MAX_SIZE (1 << 20)    ///< Largest instruction memory (words)
+#define STORE_BUFFER_MAX 64        ///< Deepest store buffer (entries)
+#define CORE_NO_PC UINT32_MAX      ///< PC of an empty stage or a halted core (also: no stop PC)
+
+/**
+ * @brief Instruction memory word split into its fields
+ *
+ * Entries are rebuilt whenever their word is written, so the array always
+ * matches imem.
+ */
+typedef struct {
+    alu_fn_t execute;      ///< Result computed in EX: ALU operation or lw/sw address (NULL = none)
+    uint8_t opcode;        ///< Operation code (bits 31:24)
+    uint8_t rd;            ///< Destination, branch target or store data register (bits 23:20)
+    uint8_t rs;            ///< First source register (bits 19:16)
+    uint8_t rt;            ///< Second source register (bits 15:12)
+    uint16_t immediate;    ///< Immediate field (bits 11:0)
+} decoded_instr_t;
+
+/**
+ * @brief Store that has left MEM but not yet been written to the data cache
+ */
+typedef struct {
+    uint32_t addr;         ///< Word address (within the memory width)
+    uint32_t data;         ///< Value stored
+    uint32_t pc;           ///< Address of the store instruction
+} store_entry_t;
 
  /**
   * @brief Main processor core structure
+  *
+  * Fields written every cycle come first and start on a host cache line;
+  * the cache and the read-only instruction memory follow. The structure is
+  * padded to a multiple of the cache line so that adjacent cores in an array
+  * never share a line when they are clocked on different host threads.
   */
 typedef struct {
     /* Pipeline Components */
-    Pipeline_Regs pipe;    ///< Pipeline registers between stages
-    Register registers[16]; ///< Register file (R0-R15)
-    Register pc;           ///< Program counter 
-
-    /* Memory Components */
-    uint32_t imem[1024];   ///< Private instruction memory
-    cache_t cache;         ///< Private data cache
+    SIM_ALIGNED(SIM_CACHE_LINE) Pipeline_Regs pipe;  ///< PC, register file (R0-R15) and pipeline registers
 
     /* Core State */
     bool halted;                 ///< Core has reached halt instruction
-    int core_id;                ///< Core identifier (0-3)
+    int core_id;                ///< Core identifier (0..N-1)
     bool pc_updated_by_branch;  ///< PC was modified by branch instruction
+    bool forwarding;            ///< Bypass results to decode instead of waiting for writeback
+    bool draining;              ///< Fetch stopped so the pipeline empties (functional switch-over)
+    uint8_t written_back;       ///< Register written by WB this cycle (0 = none)
+
+    /* Store Buffer */
+    store_entry_t* stores;  ///< Ring of pending stores, oldest at store_head (NULL = none)
+    int store_capacity;     ///< Entries in the ring (0 = stores write the cache from MEM)
+    int store_head;         ///< Oldest pending store
+    int store_count;        ///< Pending stores
+    bool store_retiring;    ///< The oldest store missed and owns the cache until written
+
+    /* Loads Left to the Cache's MSHRs */
+    uint16_t pending_loads; ///< Registers waiting for the data of a missed load
+    uint16_t landed_loads;  ///< Pending registers written this cycle
 
     /* Performance Counters */
     int cycles;          ///< Total execution cycles
     int instructions;    ///< Total instructions executed
     int decode_stalls;   ///< Stalls due to data hazards
     int mem_stalls;      ///< Stalls due to cache misses
+    int stores_buffered; ///< Stores retired through the store buffer
+    int loads_forwarded; ///< Loads answered from the store buffer
+    int stalls_avoided;  ///< Decode stalls the forwarding network saved
+    uint64_t functional_instructions;  ///< Instructions executed by the functional model
+
+    /* Memory Components */
+    SIM_ALIGNED(SIM_CACHE_LINE) cache_t cache;  ///< Private data cache
+    uint32_t* imem;        ///< Private instruction memory
+    decoded_instr_t* decoded;  ///< Fields of every imem word
+    uint32_t imem_size;    ///< Instruction memory words (power of two)
+    uint32_t imem_mask;    ///< Mask applied to fetch and jump addresses
 } core_t;
 
 /* Core Initialization and Control */
 /**
  * @brief Initialize a processor core
  * @param core Pointer to core structure
- * @param id Core identifier (0-3)
+ * @param id Core identifier (0..N-1)
+ * @param imem_size Instruction memory words (power of two up to IMEM_MAX_SIZE)
+ * @param geometry Data cache organization
+ * @param store_buffer Store buffer entries (0 to STORE_BUFFER_MAX, 0 = none)
+ * @return false if the instruction memory, store buffer or cache could not
+ *         be allocated
+ */
+bool core_init(core_t* core, int id, int imem_size, const cache_geometry_t* geometry,
+    int store_buffer);
+
+/**
+ * @brief Data access of an instruction executed functionally
+ * @param arg Context given to core_run_functional
+ * @param core_id Core executing the instruction
+ * @param addr Word address (within the memory width)
+ * @param is_write true for a store, which main memory already holds
  */
-void core_init(core_t* core, int id);
+typedef void (*core_access_fn)(void* arg, int core_id, uint32_t addr, bool is_write);
+
+/**
+ * @brief Free the instruction memory, store buffer and cache allocated by core_init
+ * @param core Pointer to core structure (may be zero-filled and never initialized)
+ */
+void core_free(core_t* core);
 
 /**
  * @brief Perform one clock cycle of core execution
@@ -57,12 +144,66 @@ void core_init(core_t* core, int id);
  */
 void core_clock(core_t* core, bus_system_t* bus);
 
+/**
+ * @brief Execute instructions without pipeline or timing
+ * @param core Core whose pipeline has drained (see core_is_drained)
+ * @param mem Main memory, read and written directly
+ * @param count Most instructions to execute
+ * @param stop_pc Stop before executing this PC (CORE_NO_PC = no stop)
+ * @param access Called after every load and store (NULL = none)
+ * @param arg Context passed to access
+ * @return Number of instructions executed
+ *
+ * Instructions have the effect they have in the pipeline, with every
+ * operand taken from the register file: a branch or jal takes effect after
+ * its delay slot, and halt stops the core. No cycle or cache counter
+ * changes. If execution stops between a taken branch and its delay slot,
+ * the delay slot is left in IF/ID as if just fetched, and the PC holds the
+ * target, so the pipeline and the next call both resume correctly.
+ */
+uint64_t core_run_functional(core_t* core, main_memory_t* mem, uint64_t count, uint32_t stop_pc,
+    core_access_fn access, void* arg);
+
 /**
  * @brief Load instruction memory from file
  * @param core Pointer to core structure
- * @param filename Name of file containing instructions
+ * @param filename Hex text or .bin image of the instructions
+ * @param error_line Receives the line of a malformed word (may be NULL)
+ * @return LOAD_OK, or why loading failed
+ */
+load_status_t core_load_imem(core_t* core, const char* filename, int* error_line);
+
+/**
+ * @brief Write one word of instruction memory
+ * @param core Pointer to core structure
+ * @param addr Word address (below imem_size)
+ * @param word Instruction
+ *
+ * Every write to imem goes through here or core_load_imem, which keep the
+ * pre-decoded entries in step.
+ */
+void core_write_imem(core_t* core, uint32_t addr, uint32_t word);
+
+/**
+ * @brief Encode the complete core state, including its cache and program
+ * @param core Pointer to core structure
+ * @param out Checkpoint state section
+ */
+void core_checkpoint(const core_t* core, ckpt_writer_t* out);
+
+/**
+ * @brief Decode the state written by core_checkpoint
+ * @param core Initialized core (keeps its core_id)
+ * @param in Checkpoint state section
  */
-void core_load_imem(core_t* core, const char* filename);
+void core_restore(core_t* core, ckpt_reader_t* in);
+
+/**
+ * @brief Print a human-readable dump of the core state for debugging
+ * @param out Output stream
+ * @param core Pointer to core structure
+ */
+void print_core_state(FILE* out, core_t* core);
 
 /* Pipeline Stage Functions */
 /**
@@ -77,7 +218,12 @@ void core_fetch(core_t* core);
  * @brief Instruction decode stage
  * @param core Pointer to core structure
  *
- * Decodes instruction, reads registers, and handles data hazards
+ * Decodes instruction, reads registers, and handles data hazards. Without
+ * forwarding an instruction waits until every older writer of its sources
+ * has left WB. With forwarding it takes results from EX (next cycle's
+ * EX/MEM), MEM (next cycle's MEM/WB) and WB (the register being written)
+ * and waits only for a load still in EX, or, for a branch, for a result
+ * still in EX or a load in MEM.
  */
 void core_decode(core_t* core);
 
@@ -94,7 +240,13 @@ void core_execute(core_t* core);
  * @param core Pointer to core structure
  * @param bus Pointer to system bus
  *
- * Handles memory operations through cache
+ * Handles memory operations through cache. With a store buffer, stores
+ * are queued instead and written to the cache in program order whenever
+ * MEM leaves it free; loads take the youngest queued store to their
+ * address, so only a load's own order against stores to other addresses
+ * is relaxed (total store order). A fence waits in MEM until the buffer
+ * is empty. With MSHRs a load that misses moves on to WB without its data
+ * and is written later, so younger accesses may perform before it.
  */
 void core_memory(core_t* core, bus_system_t* bus);
 
@@ -102,7 +254,8 @@ void core_memory(core_t* core, bus_system_t* bus);
  * @brief Writeback stage
  * @param core Pointer to core structure
  *
- * Writes results back to register file
+ * Writes results back to register file, and the data of missed loads
+ * that arrived this cycle
  */
 void core_writeback(core_t* core);
 
@@ -114,6 +267,45 @@ void core_writeback(core_t* core);
  */
 bool pipeline_is_empty(Pipeline_Regs* pipe);
 
+/**
+ * @brief Check if the core has finished
+ * @param core Pointer to core structure
+ * @return true if the core is halted, its pipeline is drained, every
+ *         buffered store has reached the cache and no miss or prefetch is
+ *         outstanding
+ */
+bool core_is_done(core_t* core);
+
+/**
+ * @brief Check if the core has nothing in flight
+ * @param core Pointer to core structure
+ * @return true if the pipeline is empty, every buffered store has reached
+ *         the cache and the cache has no transaction, miss or prefetch
+ *         outstanding
+ *
+ * Set draining to have the core stop fetching until this holds; the delay
+ * slot of a branch taken meanwhile is still fetched.
+ */
+bool core_is_drained(core_t* core);
+
+/**
+ * @brief Check if the core will repeat its last cycle unchanged
+ * @param core Pointer to core structure
+ * @return true if the core is done, or has been stalled in MEM
+ *         for at least one full cycle waiting on its own bus transaction
+ *
+ * A frozen core only advances its cycle and stall counters until the bus
+ * delivers data to its cache, which lets the main loop skip those cycles.
+ */
+bool core_is_frozen(core_t* core);
+
+/**
+ * @brief Account for cycles skipped while the core was frozen
+ * @param core Pointer to core structure
+ * @param count Number of skipped cycles
+ */
+void core_skip_cycles(core_t* core, int count);
+
 /**
  * @brief Execute one cycle of all pipeline stages
  * @param core Pointer to core structure
@@ -0,0 +1,171 @@
+/**
+ * @file dump.c
+ * @brief Implementation of the word image writer
+ *
+ * Hex digits are produced with a table lookup per nibble directly into the
+ * output buffer. Text files are opened in text mode like the original
+ * fprintf output, so line endings on the host are unchanged.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dump.h"
+
+#define DUMP_LINE_MAX 18  ///< Longest encoded word ("AAAAAAAA:VVVVVVVV\n")
+
+struct dump_file {
+    FILE* f;                  ///< Output stream
+    dump_format_t format;     ///< File encoding
+    uint32_t addr;            ///< Address of the next word
+    uint32_t pending_zeros;   ///< Zero words not written yet (DUMP_TRIM)
+    bool ok;                  ///< No write has failed
+    size_t used;              ///< Bytes in the buffer
+    char buffer[DUMP_BUFFER_SIZE];
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/**
+ * @brief Write the buffer to the file
+ */
+static void flush_buffer(dump_file_t* dump) {
+    if (dump->used > 0 && fwrite(dump->buffer, 1, dump->used, dump->f) != dump->used) {
+        dump->ok = false;
+    }
+    dump->used = 0;
+}
+
+/**
+ * @brief Encode a value as 8 upper-case hex digits
+ */
+static void put_hex(char* out, uint32_t value) {
+    for (int i = 7; i >= 0; i--) {
+        out[i] = hex_digits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+/**
+ * @brief Encode one word at the current address
+ */
+static void encode_word(dump_file_t* dump, uint32_t value) {
+    if (dump->used + DUMP_LINE_MAX > DUMP_BUFFER_SIZE) {
+        flush_buffer(dump);
+    }
+    char* out = dump->buffer + dump->used;
+
+    switch (dump->format) {
+    case DUMP_FULL:
+    case DUMP_TRIM:
+        put_hex(out, value);
+        out[8] = '\n';
+        dump->used += 9;
+        break;
+    case DUMP_SPARSE:
+        if (value != 0) {
+            put_hex(out, dump->addr);
+            out[8] = ':';
+            put_hex(out + 9, value);
+            out[17] = '\n';
+            dump->used += 18;
+        }
+        break;
+    case DUMP_BINARY:
+        out[0] = (char)(value & 0xFF);
+        out[1] = (char)((value >> 8) & 0xFF);
+        out[2] = (char)((value >> 16) & 0xFF);
+        out[3] = (char)(value >> 24);
+        dump->used += 4;
+        break;
+    }
+    dump->addr++;
+}
+
+/**
+ * @brief Encode a run of zero words, filling the buffer a chunk at a time
+ */
+static void encode_zeros(dump_file_t* dump, uint32_t count) {
+    size_t word_size = dump->format == DUMP_BINARY ? 4 : 9;
+    dump->addr += count;
+    if (dump->format == DUMP_SPARSE) return;
+
+    while (count > 0) {
+        size_t room = (DUMP_BUFFER_SIZE - dump->used) / word_size;
+        if (room == 0) {
+            flush_buffer(dump);
+            continue;
+        }
+        uint32_t chunk = count < room ? count : (uint32_t)room;
+        char* out = dump->buffer + dump->used;
+
+        if (dump->format == DUMP_BINARY) {
+            memset(out, 0, chunk * word_size);
+        }
+        else {
+            for (uint32_t i = 0; i < chunk; i++) {
+                memcpy(out + i * word_size, "00000000\n", word_size);
+            }
+        }
+        dump->used += chunk * word_size;
+        count -= chunk;
+    }
+}
+
+dump_file_t* dump_open(const char* filename, dump_format_t format) {
+    dump_file_t* dump = (dump_file_t*)malloc(sizeof(dump_file_t));
+    if (!dump) return NULL;
+
+    dump->f = fopen(filename, format == DUMP_BINARY ? "wb" : "w");
+    if (!dump->f) {
+        free(dump);
+        return NULL;
+    }
+    dump->format = format;
+    dump->addr = 0;
+    dump->pending_zeros = 0;
+    dump->ok = true;
+    dump->used = 0;
+    return dump;
+}
+
+void dump_words(dump_file_t* dump, const uint32_t* words, uint32_t count) {
+    if (dump->format != DUMP_TRIM) {
+        for (uint32_t i = 0; i < count; i++) {
+            encode_word(dump, words[i]);
+        }
+        return;
+    }
+
+    // Zeros are only written once a non-zero word follows them
+    for (uint32_t i = 0; i < count; i++) {
+        if (words[i] == 0) {
+            dump->pending_zeros++;
+            continue;
+        }
+        if (dump->pending_zeros > 0) {
+            encode_zeros(dump, dump->pending_zeros);
+            dump->pending_zeros = 0;
+        }
+        encode_word(dump, words[i]);
+    }
+}
+
+void dump_zeros(dump_file_t* dump, uint32_t count) {
+    if (dump->format == DUMP_TRIM) {
+        dump->pending_zeros += count;
+    }
+    else {
+        encode_zeros(dump, count);
+    }
+}
+
+bool dump_close(dump_file_t* dump) {
+    flush_buffer(dump);
+    bool ok = dump->ok;
+    if (fclose(dump->f) != 0) {
+        ok = false;
+    }
+    free(dump);
+    return ok;
+}
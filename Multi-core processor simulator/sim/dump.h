@@ -0,0 +1,71 @@
+/**
+ * @file dump.h
+ * @brief Fast output of word images (memout, regout, dsram and tsram)
+ *
+ * Words are appended in address order and encoded into a large buffer
+ * that is written with a single fwrite when full, instead of one
+ * formatted stdio call per word. Runs of zero words are passed as a count,
+ * so untouched memory pages cost no per-word work in the trimmed, sparse
+ * and binary formats.
+ *
+ * Formats:
+ * - DUMP_FULL: one "%08X" line per word (the original result files)
+ * - DUMP_TRIM: as DUMP_FULL without the trailing zero words; loading the
+ *   file gives the same contents since missing words are zero
+ * - DUMP_SPARSE: one "AAAAAAAA:VVVVVVVV" line (hex address and value) per
+ *   non-zero word
+ * - DUMP_BINARY: every word as 4 little-endian bytes, so word i is at byte
+ *   offset 4 * i and the file can be memory-mapped by the consumer
+ */
+
+#ifndef DUMP_H
+#define DUMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DUMP_BUFFER_SIZE (256 * 1024)  ///< Bytes encoded before each write
+
+/**
+ * @brief Encoding of a word image file
+ */
+typedef enum {
+    DUMP_FULL = 0,    ///< Hex line per word
+    DUMP_TRIM = 1,    ///< Hex line per word up to the last non-zero word
+    DUMP_SPARSE = 2,  ///< Address:value line per non-zero word
+    DUMP_BINARY = 3   ///< Raw little-endian words
+} dump_format_t;
+
+typedef struct dump_file dump_file_t;
+
+/**
+ * @brief Create a word image file
+ * @param filename File to create
+ * @param format File encoding
+ * @return New dump, or NULL if the file cannot be created
+ */
+dump_file_t* dump_open(const char* filename, dump_format_t format);
+
+/**
+ * @brief Append words at the next addresses
+ * @param dump Word image file
+ * @param words Word values
+ * @param count Number of words
+ */
+void dump_words(dump_file_t* dump, const uint32_t* words, uint32_t count);
+
+/**
+ * @brief Append zero words at the next addresses
+ * @param dump Word image file
+ * @param count Number of words
+ */
+void dump_zeros(dump_file_t* dump, uint32_t count);
+
+/**
+ * @brief Write the buffered data and close the file
+ * @param dump Word image file
+ * @return false if a write failed
+ */
+bool dump_close(dump_file_t* dump);
+
+#endif /* DUMP_H */
@@ -0,0 +1,241 @@
+/**
+ * @file load.c
+ * @brief Implementation of the word image reader
+ *
+ * The 8-digit fast path packs the characters little-endian into a 64-bit
+ * word (character 0 in the low byte) and checks all of them at once: a
+ * byte is a digit if it lies in '0'-'9', or a letter if it lies in 'a'-'f'
+ * after setting the lower-case bit. Each range test adds a bias that moves
+ * the lower bound to 0x80 and the upper bound + 1 to 0x100, so the high bit
+ * of every byte tells whether it is in range. The nibble of a character is
+ * its low four bits, plus 9 for letters (bit 6 set).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "load.h"
+
+#define LOAD_READ_SIZE (1024 * 1024)    ///< Bytes requested per read
+#define ONES 0x0101010101010101ULL      ///< 1 in every byte
+#define HIGH_BITS 0x8080808080808080ULL ///< High bit of every byte
+
+/**
+ * @brief Check whether a character separates words
+ */
+static bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/**
+ * @brief Value of a hex digit, or -1
+ */
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/**
+ * @brief Convert exactly 8 hex digits
+ * @param p First of 8 characters
+ * @param value Receives the word
+ * @return false if any character is not a hex digit
+ */
+static bool parse_hex8(const char* p, uint32_t* value) {
+    const unsigned char* u = (const unsigned char*)p;
+    uint64_t v = (uint64_t)u[0] | (uint64_t)u[1] << 8 | (uint64_t)u[2] << 16 |
+        (uint64_t)u[3] << 24 | (uint64_t)u[4] << 32 | (uint64_t)u[5] << 40 |
+        (uint64_t)u[6] << 48 | (uint64_t)u[7] << 56;
+
+    // Range tests need every byte below 0x80 so that no carry crosses bytes
+    if (v & HIGH_BITS) return false;
+    uint64_t digit = (v + (0x80 - '0') * ONES) & ~(v + (0x80 - '9' - 1) * ONES);
+    uint64_t lower = v | 0x20 * ONES;
+    uint64_t letter = (lower + (0x80 - 'a') * ONES) & ~(lower + (0x80 - 'f' - 1) * ONES);
+    if (((digit | letter) & HIGH_BITS) != HIGH_BITS) return false;
+
+    // Nibble per byte, then pairs of nibbles, then the four bytes
+    uint64_t nibbles = (v & 0x0F * ONES) + ((v >> 6) & ONES) * 9;
+    uint64_t pairs = ((nibbles & 0x000F000F000F000FULL) << 4) |
+        ((nibbles >> 8) & 0x000F000F000F000FULL);
+    *value = (uint32_t)((pairs & 0xFF) << 24 | ((pairs >> 16) & 0xFF) << 16 |
+        ((pairs >> 32) & 0xFF) << 8 | ((pairs >> 48) & 0xFF));
+    return true;
+}
+
+/**
+ * @brief Convert a word of any length, with an optional 0x prefix
+ * @param p Start of the word
+ * @param end End of the text
+ * @param value Receives the word
+ * @return Pointer past the word, or NULL if it is not a 32-bit hex number
+ */
+static const char* parse_hex_token(const char* p, const char* end, uint32_t* value) {
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && hex_value(p[2]) >= 0) {
+        p += 2;
+    }
+
+    const char* start = p;
+    uint32_t result = 0;
+    int digit;
+    while (p < end && (digit = hex_value(*p)) >= 0) {
+        if (result >> 28) return NULL;
+        result = (result << 4) | (uint32_t)digit;
+        p++;
+    }
+    if (p == start || (p < end && !is_space(*p))) return NULL;
+
+    *value = result;
+    return p;
+}
+
+/**
+ * @brief Read a whole stream into memory
+ * @param f Input stream
+ * @param size Receives the number of bytes
+ * @return Newly allocated buffer, or NULL on failure
+ */
+static char* read_all(FILE* f, size_t* size) {
+    size_t capacity = LOAD_READ_SIZE;
+    size_t used = 0;
+    char* data = (char*)malloc(capacity);
+    if (!data) return NULL;
+
+    for (;;) {
+        if (used == capacity) {
+            char* grown = (char*)realloc(data, capacity * 2);
+            if (!grown) {
+                free(data);
+                return NULL;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        size_t got = fread(data + used, 1, capacity - used, f);
+        used += got;
+        if (got == 0) break;
+    }
+    if (ferror(f)) {
+        free(data);
+        return NULL;
+    }
+    *size = used;
+    return data;
+}
+
+/**
+ * @brief Parse a text image
+ */
+static load_status_t load_text(FILE* f, uint32_t max_words, load_sink_t sink,
+    void* target, int* error_line) {
+    size_t size;
+    char* data = read_all(f, &size);
+    if (!data) return ferror(f) ? LOAD_READ_ERROR : LOAD_NO_MEMORY;
+
+    uint32_t chunk[LOAD_CHUNK_WORDS];
+    uint32_t addr = 0;
+    uint32_t count = 0;
+    const char* p = data;
+    const char* end = data + size;
+    int line = 1;
+    load_status_t status = LOAD_OK;
+
+    while (addr + count < max_words) {
+        while (p < end && is_space(*p)) {
+            if (*p == '\n') line++;
+            p++;
+        }
+        if (p == end) break;
+
+        uint32_t value;
+        if (end - p > 8 && is_space(p[8]) && parse_hex8(p, &value)) {
+            p += 8;
+        }
+        else if (!(p = parse_hex_token(p, end, &value))) {
+            if (error_line) *error_line = line;
+            status = LOAD_MALFORMED;
+            break;
+        }
+
+        chunk[count++] = value;
+        if (count == LOAD_CHUNK_WORDS) {
+            if (!sink(target, addr, chunk, count)) {
+                count = 0;
+                status = LOAD_NO_MEMORY;
+                break;
+            }
+            addr += count;
+            count = 0;
+        }
+    }
+    if (count > 0 && !sink(target, addr, chunk, count)) {
+        status = LOAD_NO_MEMORY;
+    }
+
+    free(data);
+    return status;
+}
+
+/**
+ * @brief Copy a binary image of little-endian words
+ */
+static load_status_t load_binary(FILE* f, uint32_t max_words, load_sink_t sink, void* target) {
+    unsigned char bytes[LOAD_CHUNK_WORDS * 4];
+    uint32_t chunk[LOAD_CHUNK_WORDS];
+    uint32_t addr = 0;
+
+    while (addr < max_words) {
+        uint32_t want = max_words - addr < LOAD_CHUNK_WORDS ? max_words - addr : LOAD_CHUNK_WORDS;
+        size_t got = fread(bytes, 1, want * 4, f);
+        if (got % 4 != 0) return LOAD_TRUNCATED;
+        if (got == 0) break;
+
+        uint32_t count = (uint32_t)(got / 4);
+        for (uint32_t i = 0; i < count; i++) {
+            const unsigned char* b = bytes + 4 * i;
+            chunk[i] = (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 |
+                (uint32_t)b[3] << 24;
+        }
+        if (!sink(target, addr, chunk, count)) return LOAD_NO_MEMORY;
+        addr += count;
+        if (got < want * 4) break;
+    }
+    return ferror(f) ? LOAD_READ_ERROR : LOAD_OK;
+}
+
+/**
+ * @brief Check for the ".bin" extension of binary images
+ */
+static bool is_binary_name(const char* filename) {
+    size_t len = strlen(filename);
+    if (len < 4) return false;
+    const char* ext = filename + len - 4;
+    return ext[0] == '.' && (ext[1] | 0x20) == 'b' && (ext[2] | 0x20) == 'i' &&
+        (ext[3] | 0x20) == 'n';
+}
+
+load_status_t load_words(const char* filename, uint32_t max_words, load_sink_t sink,
+    void* target, int* error_line) {
+    bool binary = is_binary_name(filename);
+    FILE* f = fopen(filename, binary ? "rb" : "r");
+    if (!f) return LOAD_MISSING;
+
+    load_status_t status = binary ? load_binary(f, max_words, sink, target) :
+        load_text(f, max_words, sink, target, error_line);
+    fclose(f);
+    return status;
+}
+
+const char* load_status_message(load_status_t status) {
+    switch (status) {
+    case LOAD_OK: return "ok";
+    case LOAD_MISSING: return "cannot open file";
+    case LOAD_MALFORMED: return "malformed hex word";
+    case LOAD_TRUNCATED: return "binary image is not a whole number of words";
+    case LOAD_READ_ERROR: return "read error";
+    case LOAD_NO_MEMORY: return "memory allocation failed";
+    }
+    return "unknown error";
+}
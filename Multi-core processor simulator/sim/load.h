@@ -0,0 +1,67 @@
+/**
+ * @file load.h
+ * @brief Fast reading of word images (imem and memin)
+ *
+ * Text files are read into memory with a few large reads and parsed by a
+ * hand-written hex parser: words that are exactly 8 hex digits (the format
+ * the assembler and the simulator write) are validated and converted 8
+ * digits at a time with 64-bit SWAR arithmetic, anything else goes through
+ * a general token parser. Words are separated by any whitespace and may
+ * have a 0x prefix. Files ending in ".bin" are raw little-endian words as
+ * written by the DUMP_BINARY result format and are copied without parsing.
+ *
+ * Words are handed to a sink in consecutive runs of at most
+ * LOAD_CHUNK_WORDS, starting at address 0.
+ */
+
+#ifndef LOAD_H
+#define LOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LOAD_CHUNK_WORDS 1024  ///< Longest run of words passed to a sink
+
+/**
+ * @brief Result of loading a word image
+ */
+typedef enum {
+    LOAD_OK = 0,          ///< All words loaded
+    LOAD_MISSING = 1,     ///< File could not be opened
+    LOAD_MALFORMED = 2,   ///< Text that is not a 32-bit hex word
+    LOAD_TRUNCATED = 3,   ///< Binary image that is not a whole number of words
+    LOAD_READ_ERROR = 4,  ///< Read failed
+    LOAD_NO_MEMORY = 5    ///< Allocation failed (also a failing sink)
+} load_status_t;
+
+/**
+ * @brief Receiver of loaded words
+ * @param target Sink state
+ * @param addr Address of the first word
+ * @param words Word values
+ * @param count Number of words
+ * @return false to abort loading (reported as LOAD_NO_MEMORY)
+ */
+typedef bool (*load_sink_t)(void* target, uint32_t addr, const uint32_t* words, uint32_t count);
+
+/**
+ * @brief Load a text or binary word image
+ * @param filename Image file
+ * @param max_words Words after this many are ignored
+ * @param sink Receiver of the words
+ * @param target Sink state
+ * @param error_line Receives the line of a malformed word (may be NULL)
+ * @return LOAD_OK, or why loading stopped (words before the error have
+ *         already been passed to the sink)
+ */
+load_status_t load_words(const char* filename, uint32_t max_words, load_sink_t sink,
+    void* target, int* error_line);
+
+/**
+ * @brief Describe a load status
+ * @param status Load status
+ * @return Static message
+ */
+const char* load_status_message(load_status_t status);
+
+#endif /* LOAD_H */
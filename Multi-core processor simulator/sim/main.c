@@ -2,291 +2,446 @@
  * @file main.c
  * @brief Main simulation control for multi-core processor
  *
- * Implements a cycle-accurate simulator for a 4-core processor system with:
+ * Command-line front end of the cycle-accurate simulator for an N-core
+ * processor system with:
  * - Shared memory architecture
  * - MESI cache coherency
  * - Pipelined cores
  * - Trace generation
+ *
+ * The simulation itself lives in the sim library (sim.h); this file only
+ * parses options, maps file names and hands open streams to the library.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include "core.h"
-#include "bus_system.h"
-#include "main_memory.h"
-
- /* Helper Functions */
-
- /**
-  * @brief Format PC value for trace output
-  * @param buffer Output buffer
-  * @param pc Program counter value
-  */
-void format_pc(char* buffer, int pc) {
-    if (pc == -1) {
-        sprintf(buffer, "---");
-    }
-    else {
-        sprintf(buffer, "%03X", pc);
-    }
-}
+#include <string.h>
+#include "sim.h"
+#include "run_files.h"
+#include "batch.h"
 
 /**
- * @brief Write core execution trace to file
- * @param trace_file Output trace file
- * @param core Processor core
+ * @brief Print command-line usage
+ * @param prog Program name
  */
-void write_core_trace(FILE* trace_file, core_t* core) {
-    char fetch[4], decode[4], execute[4], mem[4], wb[4];
-
-    // Format pipeline stage PCs
-    format_pc(fetch, core->pc.Q);
-    format_pc(decode, core->pipe.if_id.pc.Q);
-    format_pc(execute, core->pipe.id_ex.pc.Q);
-    format_pc(mem, core->pipe.ex_mem.pc.Q);
-    format_pc(wb, core->pipe.mem_wb.pc.Q);
-
-    // Write formatted trace line
-    fprintf(trace_file, "%d %s %s %s %s %s",
-        core->cycles, fetch, decode, execute, mem, wb);
-
-    // Write register values
-    for (int r = 2; r < 16; r++) {
-        fprintf(trace_file, " %08X", register_get_value(&core->registers[r]));
-    }
-    fprintf(trace_file, "\n");
+void print_usage(const char* prog) {
+    printf("Usage: %s [options] [files...]\n", prog);
+    printf("  -cores N      Number of cores (default 4)\n");
+    printf("  -indir DIR    Read imem<i>.txt and memin.txt from DIR\n");
+    printf("  -outdir DIR   Write all output files to DIR\n");
+    printf("  -event        Skip quiescent memory-wait cycles\n");
+    printf("  -forwarding   Forward results to dependent instructions instead of\n");
+    printf("                stalling decode until writeback\n");
+    printf("  -memory-bits B\n");
+    printf("                Main memory of 2^B words, B = 10..32 (default 20)\n");
+    printf("  -cache-size S Data cache words per core, a power of two (default 256)\n");
+    printf("  -block-size B Words per cache block and bus transfer (default 4)\n");
+    printf("  -cache-ways W Data cache associativity: 1, 2, 4, 8 or 16 (default 1)\n");
+    printf("  -cache-policy lru|plru|random|rrip\n");
+    printf("                Replacement among the ways of a set (default lru)\n");
+    printf("  -protocol mesi|moesi\n");
+    printf("                Coherence protocol (default mesi); moesi shares dirty\n");
+    printf("                blocks and supplies them cache-to-cache\n");
+    printf("  -bus atomic|split\n");
+    printf("                Bus transactions (default atomic); split overlaps misses\n");
+    printf("                to different blocks and pipelines memory responses\n");
+    printf("  -memory-delay D\n");
+    printf("                Cycles before memory sends a block (default 14)\n");
+    printf("  -bus-delay D  Cycles from bus grant to BusRd/BusRdX (default 1)\n");
+    printf("  -imem-size S  Instruction memory words per core (default 1024)\n");
+    printf("  -store-buffer N\n");
+    printf("                Stores buffered per core between MEM and the cache,\n");
+    printf("                0-64 (default 0 = none); loads may pass older stores\n");
+    printf("                to other addresses (TSO) and fence waits for them\n");
+    printf("  -mshrs N      Miss status holding registers per data cache, 0-16\n");
+    printf("                (default 0 = blocking); hits and independent\n");
+    printf("                instructions go on under a load miss, and a split\n");
+    printf("                bus carries up to N misses per cache at once\n");
+    printf("  -prefetch none|next-line|stride|stream\n");
+    printf("                Data prefetcher (default none, needs -mshrs)\n");
+    printf("  -prefetch-degree N\n");
+    printf("                Blocks prefetched per trigger, 1-8 (default 2)\n");
+    printf("  -kernel auto|generic\n");
+    printf("                Run a cache kernel compiled for the geometry when one\n");
+    printf("                exists (auto, the default) or always the generic one\n");
+    printf("  -config FILE  Read name = value settings with the names of the\n");
+    printf("                options above; later options override them\n");
+    printf("  -threads T    Clock the cores on T host threads (default 1)\n");
+    printf("  -trace-format text|binary|compressed\n");
+    printf("                Encoding of the core and bus traces (default text)\n");
+    printf("  -async-trace block|drop\n");
+    printf("                Write traces on a background thread; when its buffer\n");
+    printf("                is full, wait (block) or discard records (drop)\n");
+    printf("  -trace-buffer N\n");
+    printf("                Records buffered per trace file (default 4096)\n");
+    printf("  -dump-format full|trim|sparse|binary\n");
+    printf("                Format of memout, regout, dsram and tsram (default full)\n");
+    printf("  -trace-window START:STOP\n");
+    printf("                Trace global cycles START to STOP-1 only\n");
+    printf("  -trace-on-pc CORE:PC\n");
+    printf("                Start tracing when CORE fetches PC (hex)\n");
+    printf("  -trace-on-addr ADDR\n");
+    printf("                Start tracing when a bus transaction uses ADDR (hex)\n");
+    printf("  -trace-cores LIST\n");
+    printf("                Write pipeline traces of these cores only, e.g. 0,2-3\n");
+    printf("  -trace-bus-cmd LIST\n");
+    printf("                Bus commands written to the bus trace: rd,rdx,flush\n");
+    printf("  -trace-bus-addr LO:HI\n");
+    printf("                Bus addresses written to the bus trace (hex)\n");
+    printf("  -checkpoint AT FILE\n");
+    printf("                Write a checkpoint at global cycle AT, or when core\n");
+    printf("                CORE is about to fetch PC if AT is CORE:PC (hex)\n");
+    printf("  -restore FILE Start from a checkpoint instead of imem/memin files\n");
+    printf("  -fast-forward AT\n");
+    printf("                Execute functionally, without timing, until every core\n");
+    printf("                has executed AT instructions, or until core CORE is\n");
+    printf("                about to execute PC if AT is CORE:PC (hex); the rest\n");
+    printf("                of the run is simulated in detail\n");
+    printf("  -warm-caches  Update the data caches while fast-forwarding\n");
+    printf("  -sample ERROR Simulate only sample units in detail, fast-forwarding with\n");
+    printf("                warm caches in between, and estimate cycles, CPI and miss\n");
+    printf("                rate to a CPI error of ERROR percent (99.7%% confidence)\n");
+    printf("  -sample-unit UNIT:WARMUP[:PERIOD]\n");
+    printf("                Instructions per core measured in each unit (default\n");
+    printf("                1000), simulated in detail before it (default 2000) and\n");
+    printf("                from one unit to the next at first, at least\n");
+    printf("                UNIT+WARMUP (default 20 x (UNIT+WARMUP))\n");
+    printf("  -convert-trace IN OUT\n");
+    printf("                Convert binary trace IN to the text format in OUT\n");
+    printf("  -batch FILE   Run every simulation listed in manifest FILE\n");
+    printf("  -jobs J       Simulate J batch runs at a time (default: host CPUs)\n");
+    printf("Without files, default names are used for every core. With files,\n");
+    printf("6N+3 names are expected in the order: imem[N] memin memout regout[N]\n");
+    printf("coretrace[N] bustrace dsram[N] tsram[N] stats[N].\n");
 }
 
-/* File I/O Functions */
+/* Run Setup */
 
 /**
- * @brief Load instruction memory files for all cores
- * @param cores Array of processor cores
- * @param files Array of IMEM filenames
+ * @brief Convert a binary trace file back to the text format
+ * @param in_file Binary trace file
+ * @param out_file Text trace file to write
  * @return true if successful, false on error
  */
-bool load_imem_files(core_t cores[4], const char* files[4]) {
-    for (int i = 0; i < 4; i++) {
-        FILE* f = fopen(files[i], "r");
-        if (!f) {
-            printf("Error: Failed to open IMEM file %s\n", files[i]);
-            return false;
-        }
+bool convert_trace_file(const char* in_file, const char* out_file) {
+    FILE* in = fopen(in_file, "rb");
+    if (!in) {
+        printf("Error: Failed to open trace file %s\n", in_file);
+        return false;
+    }
+    FILE* out = fopen(out_file, "w");
+    if (!out) {
+        printf("Error: Failed to open output file %s\n", out_file);
+        fclose(in);
+        return false;
+    }
 
-        int addr = 0;
-        uint32_t value;
-        while (addr < 1024 && fscanf(f, "%x", &value) == 1) {
-            cores[i].imem[addr++] = value;
-        }
-        fclose(f);
+    bool ok = sim_convert_trace(in, out);
+    if (!ok) {
+        printf("Error: %s is not a valid binary trace\n", in_file);
     }
-    return true;
+    fclose(in);
+    fclose(out);
+    return ok;
 }
 
 /**
- * @brief Save final register states
- * @param cores Array of processor cores
- * @param files Array of output filenames
+ * @brief Load instruction memory files for all cores and main memory
+ * @param sim Simulation context
+ * @param files Run file names
  * @return true if successful, false on error
  */
-bool save_register_states(core_t cores[4], const char* files[4]) {
-    for (int i = 0; i < 4; i++) {
-        FILE* f = fopen(files[i], "w");
-        if (!f) {
-            printf("Error: Failed to open register output file %s\n", files[i]);
-            return false;
-        }
+bool load_input_files(sim_context_t* sim, const sim_files_t* files) {
+    // A missing memin file leaves memory zeroed
+    if (!sim_load_memory(sim, files->memin) && sim_get_load_status(sim) != SIM_LOAD_MISSING) {
+        return false;
+    }
 
-        for (int r = 2; r < 16; r++) {
-            fprintf(f, "%08X\n", register_get_value(&cores[i].registers[r]));
+    for (int i = 0; i < sim_num_cores(sim); i++) {
+        if (!sim_load_imem(sim, i, files->imem[i])) {
+            return false;
         }
-        fclose(f);
     }
     return true;
 }
 
-/**
- * @brief Save cache states (DSRAM and TSRAM)
- * @param cores Array of processor cores
- * @param dsram_files Array of DSRAM output filenames
- * @param tsram_files Array of TSRAM output filenames
- * @return true if successful, false on error
- */
-bool save_cache_states(core_t cores[4], const char* dsram_files[4], const char* tsram_files[4]) {
-    for (int i = 0; i < 4; i++) {
-        // Save DSRAM
-        FILE* dsram = fopen(dsram_files[i], "w");
-        if (!dsram) {
-            printf("Error: Failed to open DSRAM output file %s\n", dsram_files[i]);
-            return false;
+int main(int argc, char* argv[]) {
+    // Leading options come before the (optional) list of file names
+    sim_config_t config;
+    sim_config_default(&config);
+    const char* in_dir = NULL;
+    const char* out_dir = NULL;
+    const char* manifest = NULL;
+    const char* trace_cores = NULL;
+    const char* restore_file = NULL;
+    run_checkpoint_t checkpoint = { NULL, -1, 0, 0 };
+    run_fast_forward_t fast_forward = { false, -1, 0, 0, false };
+    run_sample_t sample = { false };
+    sim_sample_default(&sample.config);
+    sample.config.period = 0;
+    int num_jobs = 0;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        const char* opt = argv[argi];
+        bool has_value = argi + 1 < argc;
+
+        if (strcmp(opt, "-event") == 0) {
+            config.event_driven = true;
         }
-
-        for (int j = 0; j < CACHE_SIZE; j++) {
-            fprintf(dsram, "%08X\n", cores[i].cache.dsram[j]);
+        else if (strcmp(opt, "-forwarding") == 0) {
+            config.forwarding = true;
         }
-        fclose(dsram);
-
-        // Save TSRAM
-        FILE* tsram = fopen(tsram_files[i], "w");
-        if (!tsram) {
-            printf("Error: Failed to open TSRAM output file %s\n", tsram_files[i]);
-            return false;
+        else if (strcmp(opt, "-cores") == 0 && has_value) {
+            config.num_cores = atoi(argv[++argi]);
+            if (config.num_cores < 1) {
+                printf("Error: Core count must be at least 1\n");
+                return 1;
+            }
         }
-
-        for (int j = 0; j < NUM_SETS; j++) {
-            uint32_t entry = (cores[i].cache.tsram[j].state << 12) |
-                cores[i].cache.tsram[j].tag;
-            fprintf(tsram, "%08X\n", entry);
+        else if (strcmp(opt, "-threads") == 0 && has_value) {
+            config.num_threads = atoi(argv[++argi]);
+            if (config.num_threads < 1) {
+                printf("Error: Thread count must be at least 1\n");
+                return 1;
+            }
         }
-        fclose(tsram);
-    }
-    return true;
-}
-
-/**
- * @brief Save execution statistics
- * @param cores Array of processor cores
- * @param files Array of statistics output filenames
- * @return true if successful, false on error
- */
-bool save_statistics(core_t cores[4], const char* files[4]) {
-    for (int i = 0; i < 4; i++) {
-        FILE* f = fopen(files[i], "w");
-        if (!f) {
-            printf("Error: Failed to open statistics file %s\n", files[i]);
-            return false;
+        else if (strcmp(opt, "-memory-bits") == 0 && has_value) {
+            config.memory_bits = atoi(argv[++argi]);
+            if (config.memory_bits < 10 || config.memory_bits > 32) {
+                printf("Error: Memory address width must be 10 to 32 bits\n");
+                return 1;
+            }
         }
-
-        fprintf(f, "cycles %d\n", cores[i].cycles);
-        fprintf(f, "instructions %d\n", cores[i].instructions);
-        fprintf(f, "read_hit %d\n", cores[i].cache.read_hit);
-        fprintf(f, "write_hit %d\n", cores[i].cache.write_hit);
-        fprintf(f, "read_miss %d\n", cores[i].cache.read_miss);
-        fprintf(f, "write_miss %d\n", cores[i].cache.write_miss);
-        fprintf(f, "decode_stall %d\n", cores[i].decode_stalls);
-        fprintf(f, "mem_stall %d\n", cores[i].mem_stalls);
-
-        fclose(f);
-    }
-    return true;
-}
-
-int main(int argc, char* argv[]) {
-    // Define default filenames if not provided as arguments
-    const char* default_files[] = {
-        "imem0.txt", "imem1.txt", "imem2.txt", "imem3.txt",     // IMEM (0-3)
-        "memin.txt", "memout.txt",                               // Memory (4-5)
-        "regout0.txt", "regout1.txt", "regout2.txt", "regout3.txt", // Registers (6-9)
-        "core0trace.txt", "core1trace.txt", "core2trace.txt", "core3trace.txt", // Traces (10-13)
-        "bustrace.txt",                                          // Bus trace (14)
-        "dsram0.txt", "dsram1.txt", "dsram2.txt", "dsram3.txt", // DSRAM (15-18)
-        "tsram0.txt", "tsram1.txt", "tsram2.txt", "tsram3.txt", // TSRAM (19-22)
-        "stats0.txt", "stats1.txt", "stats2.txt", "stats3.txt"  // Statistics (23-26)
-    };
-
-    const char** files = (argc == 28) ? (const char**)(argv + 1) : default_files;
-
-    // Open trace files
-    FILE* core_trace_files[4];
-    for (int i = 0; i < 4; i++) {
-        core_trace_files[i] = fopen(files[i + 10], "w");
-        if (!core_trace_files[i]) {
-            printf("Error: Failed to open core trace file %s\n", files[i + 10]);
+        else if (strcmp(opt, "-cache-ways") == 0 && has_value) {
+            config.cache_ways = atoi(argv[++argi]);
+            if (config.cache_ways < 1 || config.cache_ways > 16 ||
+                (config.cache_ways & (config.cache_ways - 1)) != 0) {
+                printf("Error: Cache associativity must be 1, 2, 4, 8 or 16\n");
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-cache-policy") == 0 && has_value) {
+            if (!parse_cache_policy(argv[++argi], &config.cache_policy)) {
+                printf("Error: Unknown replacement policy %s\n", argv[argi]);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-config") == 0 && has_value) {
+            if (!load_config_file(argv[++argi], &config)) {
+                return 1;
+            }
+        }
+        else if (is_config_option(opt + 1) && has_value) {
+            if (!parse_config_option(opt + 1, argv[++argi], &config)) {
+                printf("Error: Invalid value %s for option %s\n", argv[argi], opt);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-indir") == 0 && has_value) {
+            in_dir = argv[++argi];
+        }
+        else if (strcmp(opt, "-outdir") == 0 && has_value) {
+            out_dir = argv[++argi];
+        }
+        else if (strcmp(opt, "-trace-format") == 0 && has_value) {
+            if (!parse_trace_format(argv[++argi], &config.trace_format)) {
+                printf("Error: Unknown trace format %s\n", argv[argi]);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-dump-format") == 0 && has_value) {
+            if (!parse_dump_format(argv[++argi], &config.dump_format)) {
+                printf("Error: Unknown result file format %s\n", argv[argi]);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-async-trace") == 0 && has_value) {
+            if (!parse_trace_mode(argv[++argi], &config.trace_mode)) {
+                printf("Error: Unknown trace policy %s\n", argv[argi]);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-trace-buffer") == 0 && has_value) {
+            config.trace_buffer = atoi(argv[++argi]);
+            if (config.trace_buffer < 1) {
+                printf("Error: Trace buffer must hold at least 1 record\n");
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-trace-cores") == 0 && has_value) {
+            trace_cores = argv[++argi];
+        }
+        else if (strncmp(opt, "-trace-", 7) == 0 && has_value) {
+            if (!parse_trace_filter_option(opt + 1, argv[++argi], &config.trace_filter)) {
+                printf("Error: Invalid value %s for option %s\n", argv[argi], opt);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-checkpoint") == 0 && argi + 2 < argc) {
+            if (!parse_checkpoint_point(argv[++argi], &checkpoint)) {
+                printf("Error: Invalid checkpoint point %s\n", argv[argi]);
+                return 1;
+            }
+            checkpoint.file = argv[++argi];
+        }
+        else if (strcmp(opt, "-restore") == 0 && has_value) {
+            restore_file = argv[++argi];
+        }
+        else if (strcmp(opt, "-fast-forward") == 0 && has_value) {
+            if (!parse_fast_forward_point(argv[++argi], &fast_forward)) {
+                printf("Error: Invalid fast-forward point %s\n", argv[argi]);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-warm-caches") == 0) {
+            fast_forward.warm_caches = true;
+        }
+        else if (strcmp(opt, "-sample") == 0 && has_value) {
+            if (!parse_sample_error(argv[++argi], &sample)) {
+                printf("Error: Sampling error target must be above 0 and at most 100 percent\n");
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-sample-unit") == 0 && has_value) {
+            if (!parse_sample_unit(argv[++argi], &sample)) {
+                printf("Error: Invalid sample unit %s\n", argv[argi]);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "-convert-trace") == 0 && argi + 2 < argc) {
+            return convert_trace_file(argv[argi + 1], argv[argi + 2]) ? 0 : 1;
+        }
+        else if (strcmp(opt, "-batch") == 0 && has_value) {
+            manifest = argv[++argi];
+        }
+        else if (strcmp(opt, "-jobs") == 0 && has_value) {
+            num_jobs = atoi(argv[++argi]);
+            if (num_jobs < 1) {
+                printf("Error: Job count must be at least 1\n");
+                return 1;
+            }
+        }
+        else {
+            printf("Error: Unknown option %s\n", opt);
+            print_usage(argv[0]);
             return 1;
         }
+        argi++;
     }
+    int num_cores = config.num_cores;
+    bool binary_traces = config.trace_format != SIM_TRACE_TEXT;
 
-    FILE* bus_trace = fopen(files[14], "w");
-    if (!bus_trace) {
-        printf("Error: Failed to open bus trace file %s\n", files[14]);
-        return 1;
+    // Batch mode: the options above are defaults for every run
+    if (manifest) {
+        return batch_run(manifest, &config, trace_cores, restore_file, in_dir, out_dir,
+            num_jobs) ? 0 : 1;
     }
-
-    // Initialize system components
-    bus_system_t* bus = (bus_system_t*)malloc(sizeof(bus_system_t));
-    main_memory_t* mem = (main_memory_t*)malloc(sizeof(main_memory_t));
-    core_t* cores = (core_t*)malloc(4 * sizeof(core_t));
-
-    if (!bus || !mem || !cores) {
-        printf("Error: Memory allocation failed\n");
+    const char* config_error = sim_config_error(&config);
+    if (config_error) {
+        printf("Error: %s\n", config_error);
         return 1;
     }
-
-    // Initialize components
-    bus_init(bus);
-    memory_init(mem);
-    memory_load(mem, files[4]);
-
-    for (int i = 0; i < 4; i++) {
-        core_init(&cores[i], i);
+    if (checkpoint.file && checkpoint.core >= num_cores) {
+        printf("Error: Checkpoint core %d does not exist\n", checkpoint.core);
+        return 1;
     }
-
-    if (!load_imem_files(cores, files)) {
+    if (fast_forward.enabled && fast_forward.core >= num_cores) {
+        printf("Error: Fast-forward core %d does not exist\n", fast_forward.core);
         return 1;
     }
 
-    // Main simulation loop
-    bool all_done;
-    do {
-        // 1. Memory checks bus and responds
-        memory_clock(mem, bus);
+    // Everything below is released at cleanup, also on errors
+    int status = 1;
+    sim_checkpoint_t* restore = NULL;
+    sim_context_t* sim = NULL;
+    char** default_list = NULL;
+    FILE** core_traces = NULL;
+    bool* traced = NULL;
+    FILE* bus_trace = NULL;
+
+    // The checkpoint replaces the input files
+    if (restore_file) {
+        const char* error = "";
+        restore = sim_checkpoint_load(restore_file, &error);
+        if (!restore) {
+            printf("Error: %s: %s\n", restore_file, error);
+            goto cleanup;
+        }
+    }
 
-        // 2. Update bus state
-        bus_clock(bus);
+    sim = sim_create(&config);
+    if (!sim) {
+        printf("Error: Failed to create a %d-core simulation\n", num_cores);
+        goto cleanup;
+    }
+    sim_set_log(sim, stdout);
 
-        // 3. Run cache operations
-        for (int i = 0; i < 4; i++) {
-            cache_snoop(&cores[i].cache, bus);
-            cache_handle_bus_response(&cores[i].cache, bus);
-            cache_clock(&cores[i].cache, bus);
+    // Use explicit file names if a complete list was given, defaults otherwise
+    sim_files_t files;
+    if (argc - argi == 6 * num_cores + 3) {
+        files_from_list(&files, (const char**)(argv + argi), num_cores);
+    }
+    else {
+        default_list = make_default_file_list(&config, in_dir, out_dir);
+        if (!default_list) {
+            printf("Error: Memory allocation failed\n");
+            goto cleanup;
         }
+        files_from_list(&files, (const char**)default_list, num_cores);
+    }
 
-        // 4. Run cores and log traces
-        for (int i = 0; i < 4; i++) {
-            if (!cores[i].halted || !pipeline_is_empty(&cores[i].pipe)) {
-                write_core_trace(core_trace_files[i], &cores[i]);
-            }
-            core_clock(&cores[i], bus);
-        }
+    core_traces = (FILE**)calloc(num_cores, sizeof(FILE*));
+    traced = (bool*)malloc(num_cores * sizeof(bool));
+    if (!core_traces || !traced) {
+        printf("Error: Memory allocation failed\n");
+        goto cleanup;
+    }
+    if (!parse_core_list(trace_cores, num_cores, traced)) {
+        printf("Error: Invalid trace core list %s\n", trace_cores);
+        goto cleanup;
+    }
 
-        // Log bus activity
-        if (bus->bus_cmd != BUS_NO_CMD && bus->new_request) {
-            fprintf(bus_trace, "%d %d %d %05X %08X %d\n",
-                bus->global_cycles,
-                bus->bus_origid,
-                bus->bus_cmd,
-                bus->bus_addr,
-                bus->bus_data,
-                bus->bus_shared.Q);
-            bus->new_request = false;
-        }
+    if (!open_trace_files(sim, &files, binary_traces, traced, core_traces, &bus_trace) ||
+        !(restore ? sim_restore_checkpoint(sim, restore) : load_input_files(sim, &files))) {
+        goto cleanup;
+    }
 
-        bus->bus_shared.Q = bus->bus_shared.D;
-        bus->global_cycles++;
+    // Skip the start of the program without timing
+    if (fast_forward.enabled) {
+        run_fast_forward(sim, &fast_forward);
+    }
 
-        // Check if all cores are done
-        all_done = true;
-        for (int i = 0; i < 4; i++) {
-            all_done &= cores[i].halted && pipeline_is_empty(&cores[i].pipe);
-        }
-    } while (!all_done);
+    // Warm up to the checkpoint, then continue to the end as usual
+    if (checkpoint.file && !run_to_checkpoint(sim, &checkpoint)) {
+        goto cleanup;
+    }
+
+    // Run until every core has halted and drained its pipeline
+    if (sample.enabled) {
+        run_sampled(sim, &sample);
+    }
+    else {
+        sim_run(sim);
+    }
 
     // Save final states
-    memory_save(mem, files[5]);
-    save_register_states(cores, files + 6);
-    save_cache_states(cores, files + 15, files + 19);
-    save_statistics(cores, files + 23);
+    save_output_files(sim, &files);
+    status = 0;
 
-    // Cleanup
-    for (int i = 0; i < 4; i++) {
-        fclose(core_trace_files[i]);
+cleanup:
+    if (core_traces) {
+        close_trace_files(sim, num_cores, core_traces, bus_trace);
     }
-    fclose(bus_trace);
-
-    free(cores);
-    free(mem);
-    free(bus);
+    if (sim && sim_get_dropped_traces(sim) > 0) {
+        printf("Warning: %llu trace records dropped\n",
+            (unsigned long long)sim_get_dropped_traces(sim));
+    }
+    free(core_traces);
+    free(traced);
+    free_file_list(default_list, num_cores);
+    sim_destroy(sim);
+    sim_checkpoint_destroy(restore);
 
-    return 0;
+    return status;
 }
\ No newline at end of file
@@ -1,51 +1,307 @@
 // main_memory.c
+#include <stdlib.h>
+#include <string.h>
 #include "main_memory.h"
-#include <stdio.h>
 
-void memory_init(main_memory_t* mem) {
-    for (int i = 0; i < MEMORY_SIZE; i++) {
-        mem->data[i] = 0;
+/** Contents of every page that has never been written */
+static const uint32_t zero_page[MEMORY_PAGE_SIZE];
+
+bool memory_init(main_memory_t* mem, int addr_bits, int response_delay) {
+    mem->addr_mask = (uint32_t)(((uint64_t)1 << addr_bits) - 1);
+    mem->num_tables = (uint32_t)((memory_size(mem) + (1u << MEMORY_TABLE_SHIFT) - 1) >> MEMORY_TABLE_SHIFT);
+    mem->tables = (memory_table_t**)malloc(mem->num_tables * sizeof(memory_table_t*));
+    if (!mem->tables) return false;
+
+    for (int p = 0; p < MEMORY_TABLE_SIZE; p++) {
+        mem->zero_table.pages[p] = zero_page;
+        mem->zero_table.private_page[p] = false;
+    }
+    for (uint32_t t = 0; t < mem->num_tables; t++) {
+        mem->tables[t] = &mem->zero_table;
     }
     mem->waiting_to_respond = false;
     mem->wait_cycles = 0;
+    mem->response_delay = (uint32_t)response_delay;
     mem->block_addr = 0;
     mem->words_to_send = 0;
+    mem->supply_block = 0;
+    mem->supply_words = 0;
+    mem->responses = NULL;
+    mem->num_responses = 0;
+    mem->response_slots = 1;
+    mem->sending = -1;
+    mem->arrivals = 0;
+    mem->log = NULL;
+    return true;
+}
+
+bool memory_enable_split(main_memory_t* mem, int num_cores, int slots) {
+    mem->responses = (memory_response_t*)calloc((size_t)num_cores * slots, sizeof(memory_response_t));
+    if (!mem->responses) return false;
+    mem->num_responses = num_cores * slots;
+    mem->response_slots = slots;
+    return true;
+}
+
+void memory_clear(main_memory_t* mem) {
+    for (uint32_t t = 0; t < mem->num_tables; t++) {
+        memory_table_t* table = mem->tables[t];
+        if (table == &mem->zero_table) continue;
+
+        for (int p = 0; p < MEMORY_TABLE_SIZE; p++) {
+            if (table->private_page[p]) {
+                free((void*)table->pages[p]);
+            }
+        }
+        free(table);
+        mem->tables[t] = &mem->zero_table;
+    }
+}
+
+void memory_free(main_memory_t* mem) {
+    free(mem->responses);
+    mem->responses = NULL;
+    if (!mem->tables) return;
+    memory_clear(mem);
+    free(mem->tables);
+    mem->tables = NULL;
+}
+
+/**
+ * @brief Get the table of an address, allocating it on first use
+ * @param mem Pointer to memory structure
+ * @param addr Word address (within the address width)
+ * @return Page table, or NULL on allocation failure
+ */
+static memory_table_t* own_table(main_memory_t* mem, uint32_t addr) {
+    memory_table_t** slot = &mem->tables[addr >> MEMORY_TABLE_SHIFT];
+    if (*slot == &mem->zero_table) {
+        memory_table_t* table = (memory_table_t*)malloc(sizeof(memory_table_t));
+        if (!table) return NULL;
+        *table = mem->zero_table;
+        *slot = table;
+    }
+    return *slot;
+}
+
+bool memory_write(main_memory_t* mem, uint32_t addr, uint32_t value) {
+    addr &= mem->addr_mask;
+    uint32_t p = (addr >> MEMORY_PAGE_BITS) & (MEMORY_TABLE_SIZE - 1);
+    uint32_t offset = addr & (MEMORY_PAGE_SIZE - 1);
+    memory_table_t* table = mem->tables[addr >> MEMORY_TABLE_SHIFT];
+
+    if (!table->private_page[p]) {
+        // Writing the value already there needs no copy
+        if (table->pages[p][offset] == value) {
+            return true;
+        }
+
+        table = own_table(mem, addr);
+        uint32_t* copy = (uint32_t*)malloc(MEMORY_PAGE_SIZE * sizeof(uint32_t));
+        if (!table || !copy) {
+            free(copy);
+            return false;
+        }
+        memcpy(copy, table->pages[p], MEMORY_PAGE_SIZE * sizeof(uint32_t));
+        table->pages[p] = copy;
+        table->private_page[p] = true;
+    }
+
+    ((uint32_t*)table->pages[p])[offset] = value;
+    return true;
 }
 
-void memory_load(main_memory_t* mem, const char* filename) {
-    FILE* f = fopen(filename, "r");
-    if (!f) return;
+bool memory_attach_image(main_memory_t* mem, const memory_image_t* image) {
+    memory_clear(mem);
+    if (!image) return true;
+
+    uint64_t pages = memory_size(mem) >> MEMORY_PAGE_BITS;
+    for (uint32_t p = 0; p < image->num_pages && p < pages; p++) {
+        if (!image->pages[p]) continue;
+
+        uint32_t addr = p << MEMORY_PAGE_BITS;
+        memory_table_t* table = own_table(mem, addr);
+        if (!table) return false;
+        table->pages[p & (MEMORY_TABLE_SIZE - 1)] = image->pages[p];
+    }
+    return true;
+}
 
-    int addr = 0;
-    uint32_t value;
-    while (addr < MEMORY_SIZE && fscanf(f, "%x", &value) == 1) {
-        mem->data[addr++] = value;
+/**
+ * @brief Load sink writing words into memory
+ */
+static bool store_memory(void* target, uint32_t addr, const uint32_t* words, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (!memory_write((main_memory_t*)target, addr + i, words[i])) return false;
     }
+    return true;
+}
 
-    fclose(f);
+load_status_t memory_load(main_memory_t* mem, const char* filename, int* error_line) {
+    uint32_t max_words = mem->addr_mask == UINT32_MAX ? UINT32_MAX : mem->addr_mask + 1;
+    return load_words(filename, max_words, store_memory, mem, error_line);
 }
 
-void memory_save(main_memory_t* mem, const char* filename) {
-    FILE* f = fopen(filename, "w");
-    if (!f) return;
+bool memory_save(main_memory_t* mem, const char* filename, dump_format_t format) {
+    dump_file_t* dump = dump_open(filename, format);
+    if (!dump) return false;
+
+    // Regions and pages never written are passed as zero runs
+    uint64_t size = memory_size(mem);
+    for (uint32_t t = 0; t < mem->num_tables; t++) {
+        const memory_table_t* table = mem->tables[t];
+        uint64_t base = (uint64_t)t << MEMORY_TABLE_SHIFT;
+        uint32_t words = (uint32_t)(size - base < (1u << MEMORY_TABLE_SHIFT) ?
+            size - base : (1u << MEMORY_TABLE_SHIFT));
 
-    for (int i = 0; i < MEMORY_SIZE; i++) {
-        fprintf(f, "%08X\n", mem->data[i]);
+        if (table == &mem->zero_table) {
+            dump_zeros(dump, words);
+            continue;
+        }
+        for (uint32_t p = 0; p < words >> MEMORY_PAGE_BITS; p++) {
+            if (table->pages[p] == zero_page) {
+                dump_zeros(dump, MEMORY_PAGE_SIZE);
+            }
+            else {
+                dump_words(dump, table->pages[p], MEMORY_PAGE_SIZE);
+            }
+        }
     }
+    return dump_close(dump);
+}
 
-    fclose(f);
+/**
+ * @brief Write a Flush word from a cache and log it
+ * @param mem Pointer to memory structure
+ * @param bus Pointer to system bus carrying the word
+ */
+static void write_flush(main_memory_t* mem, bus_system_t* bus) {
+    memory_write(mem, bus->bus_addr, bus->bus_data);
+    if (mem->log) {
+        fprintf(mem->log, "Memory update flush from %d : adrress %u to %d\n", bus->bus_origid, bus->bus_addr, bus->bus_data);
+    }
+}
+
+/**
+ * @brief Take a Flush word on a split-transaction bus
+ * @param mem Pointer to memory structure
+ * @param bus Pointer to system bus carrying the word
+ */
+static void take_flush_split(main_memory_t* mem, bus_system_t* bus) {
+    // The read the word answers, among the slots of its destination
+    memory_response_t* slot = NULL;
+    int index = -1;
+    if (bus->bus_dest < bus->num_cores) {
+        uint32_t block = bus->bus_addr & ~(bus->block_size - 1);
+        int first = bus->bus_dest * mem->response_slots;
+        for (int i = first; i < first + mem->response_slots; i++) {
+            if (mem->responses[i].pending && mem->responses[i].block == block) {
+                slot = &mem->responses[i];
+                index = i;
+                break;
+            }
+        }
+    }
+
+    // Our own word was taken
+    if (bus->bus_origid == bus->memory_id) {
+        if (slot && ++slot->sent == bus->block_size) {
+            slot->pending = false;
+            mem->sending = -1;
+        }
+        return;
+    }
+
+    // A block supplied cache-to-cache in our place stays dirty in its owner
+    if (slot && slot->supplied) {
+        if (++slot->sent == bus->block_size) {
+            slot->pending = false;
+        }
+        return;
+    }
+
+    // A cache answers in our place and the block is written back on the way
+    write_flush(mem, bus);
+    if (slot) {
+        slot->pending = false;
+        if (mem->sending == index) {
+            bus->ports[bus->memory_id].request = false;
+            mem->sending = -1;
+        }
+    }
+}
+
+/**
+ * @brief Clock memory on a split-transaction bus
+ * @param mem Pointer to memory structure
+ * @param bus Pointer to system bus
+ */
+static void memory_clock_split(main_memory_t* mem, bus_system_t* bus) {
+    if (bus->bus_cmd == BUS_FLUSH) {
+        take_flush_split(mem, bus);
+    }
+
+    // All delays run at once; the oldest ready block goes out word by word
+    int ready = mem->sending;
+    for (int i = 0; i < mem->num_responses; i++) {
+        memory_response_t* slot = &mem->responses[i];
+        if (!slot->pending || slot->supplied) continue;
+
+        if (slot->wait > 0) {
+            slot->wait--;
+        }
+        else if (mem->sending < 0 && (ready < 0 || slot->order < mem->responses[ready].order)) {
+            ready = i;
+        }
+    }
+
+    // The word is offered again every cycle until taken, read afresh so
+    // write-backs that pass it on the bus are included
+    if (ready >= 0) {
+        memory_response_t* slot = &mem->responses[ready];
+        uint32_t word_addr = slot->block + slot->sent;
+        mem->sending = ready;
+        bus_respond(bus, bus->memory_id, ready / mem->response_slots, word_addr,
+            memory_read(mem, word_addr));
+    }
+
+    // Register a new read in a free slot of the requester (the bus grants
+    // no more requests than it has slots)
+    if (bus->bus_cmd == BUS_RD ||
+        (bus->bus_cmd == BUS_RDX && bus->bus_data != -1)) {
+        memory_response_t* slot = &mem->responses[bus->bus_origid * mem->response_slots];
+        for (int i = 1; slot->pending && i < mem->response_slots; i++) {
+            slot++;
+        }
+        slot->pending = true;
+        slot->supplied = bus->memory_inhibit;
+        slot->block = bus->bus_addr & ~(bus->block_size - 1);
+        slot->wait = mem->response_delay;
+        slot->sent = 0;
+        slot->order = mem->arrivals++;
+    }
 }
 
 void memory_clock(main_memory_t* mem, bus_system_t* bus) {
+    if (mem->responses) {
+        memory_clock_split(mem, bus);
+        return;
+    }
+
     // First check if we need to update memory from a FLUSH
-    if (bus->bus_cmd == BUS_FLUSH && bus->bus_origid != 4) {
+    if (bus->bus_cmd == BUS_FLUSH && bus->bus_origid != bus->memory_id) {
+        // A block supplied cache-to-cache in our place stays dirty in its owner
+        if (mem->supply_words > 0 &&
+            (bus->bus_addr & ~(bus->block_size - 1)) == mem->supply_block) {
+            mem->supply_words--;
+            return;
+        }
+
         // Update memory with the flushed data
-        mem->data[bus->bus_addr] = bus->bus_data;
-      
-       printf("Memory update flush from %d : adrress %d to %d\n", bus->bus_origid, bus->bus_addr, bus->bus_data);
+        write_flush(mem, bus);
         // If we were waiting to respond and someone else is flushing,
         // cancel our response
-        if (mem->waiting_to_respond && bus->bus_origid != 4) {  // 4 = MAIN_MEMORY
+        if (mem->waiting_to_respond && bus->bus_origid != bus->memory_id) {
             mem->waiting_to_respond = false;
             mem->wait_cycles = 0;
             mem->words_to_send = 0;
@@ -62,8 +318,8 @@ void memory_clock(main_memory_t* mem, bus_system_t* bus) {
 
         if (mem->words_to_send > 0) {
             // Send next word of block
-            uint32_t word_addr = mem->block_addr + (WORDS_IN_BLOCK - mem->words_to_send);
-            bus_request(bus, 4, BUS_FLUSH, word_addr, mem->data[word_addr]);
+            uint32_t word_addr = mem->block_addr + (bus->block_size - mem->words_to_send);
+            bus_request(bus, bus->memory_id, BUS_FLUSH, word_addr, memory_read(mem, word_addr));
             mem->words_to_send--;
 
             // If this was the last word, we're done responding
@@ -77,9 +333,249 @@ void memory_clock(main_memory_t* mem, bus_system_t* bus) {
     // Check for new read requests that need response
     if (bus->bus_cmd == BUS_RD ||
         (bus->bus_cmd == BUS_RDX && bus->bus_data != -1 )) {
+        if (bus->memory_inhibit) {
+            // A cache answers instead (MOESI)
+            mem->supply_block = bus->bus_addr & ~(bus->block_size - 1);
+            mem->supply_words = bus->block_size;
+            return;
+        }
         mem->waiting_to_respond = true;
-        mem->wait_cycles = RESPONSE_DELAY;
-        mem->block_addr = bus->bus_addr & ~(WORDS_IN_BLOCK - 1);  // Align to block
-        mem->words_to_send = WORDS_IN_BLOCK;
+        mem->wait_cycles = mem->response_delay;
+        mem->block_addr = bus->bus_addr & ~(bus->block_size - 1);  // Align to block
+        mem->words_to_send = bus->block_size;
+    }
+}
+
+uint32_t memory_idle_cycles(main_memory_t* mem, bus_system_t* bus) {
+    if (mem->responses) {
+        // Idle until the first of the outstanding delays runs out
+        if (bus->bus_cmd != BUS_NO_CMD || mem->sending >= 0) {
+            return 0;
+        }
+        uint32_t idle = 0;
+        for (int i = 0; i < mem->num_responses; i++) {
+            const memory_response_t* slot = &mem->responses[i];
+            if (!slot->pending || slot->supplied) continue;
+            if (slot->wait == 0) return 0;
+            if (idle == 0 || slot->wait < idle) idle = slot->wait;
+        }
+        return idle;
+    }
+
+    if (!mem->waiting_to_respond || bus->bus_cmd == BUS_FLUSH) {
+        return 0;
+    }
+    return mem->wait_cycles;
+}
+
+void memory_skip_cycles(main_memory_t* mem, uint32_t count) {
+    for (int i = 0; i < mem->num_responses; i++) {
+        memory_response_t* slot = &mem->responses[i];
+        if (slot->pending && !slot->supplied) {
+            slot->wait -= count;
+        }
+    }
+    if (!mem->responses) {
+        mem->wait_cycles -= count;
+    }
+}
+
+/* Memory Images */
+
+/**
+ * @brief Store a word in an image, allocating its page on first use
+ * @param image Memory image
+ * @param addr Word address
+ * @param value Value to store
+ * @return false on allocation failure
+ */
+static bool image_store(memory_image_t* image, uint32_t addr, uint32_t value) {
+    uint32_t p = addr >> MEMORY_PAGE_BITS;
+    if (p >= image->num_pages) {
+        if (value == 0) return true;
+
+        // Grow the page array to cover the address
+        uint32_t num_pages = image->num_pages ? image->num_pages : 64;
+        while (num_pages <= p) {
+            num_pages *= 2;
+        }
+        uint32_t** pages = (uint32_t**)realloc(image->pages, num_pages * sizeof(uint32_t*));
+        if (!pages) return false;
+        memset(pages + image->num_pages, 0, (num_pages - image->num_pages) * sizeof(uint32_t*));
+        image->pages = pages;
+        image->num_pages = num_pages;
+    }
+    if (!image->pages[p]) {
+        if (value == 0) return true;
+        image->pages[p] = (uint32_t*)calloc(MEMORY_PAGE_SIZE, sizeof(uint32_t));
+        if (!image->pages[p]) return false;
+    }
+    image->pages[p][addr & (MEMORY_PAGE_SIZE - 1)] = value;
+    return true;
+}
+
+/**
+ * @brief Load sink storing words into an image
+ */
+static bool store_image(void* target, uint32_t addr, const uint32_t* words, uint32_t count) {
+    memory_image_t* image = (memory_image_t*)target;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!image_store(image, addr + i, words[i])) return false;
+    }
+    image->size = addr + count;
+    return true;
+}
+
+memory_image_t* memory_image_load(const char* filename, load_status_t* status, int* error_line) {
+    memory_image_t* image = (memory_image_t*)calloc(1, sizeof(memory_image_t));
+    load_status_t result = LOAD_NO_MEMORY;
+
+    if (image) {
+        result = load_words(filename, UINT32_MAX, store_image, image, error_line);
+        if (result != LOAD_OK) {
+            memory_image_free(image);
+            image = NULL;
+        }
     }
-}
\ No newline at end of file
+    if (status) *status = result;
+    return image;
+}
+
+memory_image_t* memory_image_from_words(const uint32_t* words, uint32_t count) {
+    memory_image_t* image = (memory_image_t*)calloc(1, sizeof(memory_image_t));
+    if (!image) return NULL;
+
+    for (; image->size < count; image->size++) {
+        if (!image_store(image, image->size, words[image->size])) {
+            memory_image_free(image);
+            return NULL;
+        }
+    }
+    return image;
+}
+
+uint32_t memory_image_read(const memory_image_t* image, uint32_t addr) {
+    if ((addr >> MEMORY_PAGE_BITS) >= image->num_pages || !image->pages[addr >> MEMORY_PAGE_BITS]) {
+        return 0;
+    }
+    return image->pages[addr >> MEMORY_PAGE_BITS][addr & (MEMORY_PAGE_SIZE - 1)];
+}
+
+void memory_image_free(memory_image_t* image) {
+    if (!image) return;
+    for (uint32_t p = 0; p < image->num_pages; p++) {
+        free(image->pages[p]);
+    }
+    free(image->pages);
+    free(image);
+}
+
+/* Checkpoints */
+
+void memory_checkpoint_state(const main_memory_t* mem, ckpt_writer_t* out) {
+    ckpt_put_u8(out, mem->waiting_to_respond);
+    ckpt_put_u32(out, mem->wait_cycles);
+    ckpt_put_u32(out, mem->block_addr);
+    ckpt_put_u32(out, mem->words_to_send);
+    ckpt_put_u32(out, mem->supply_block);
+    ckpt_put_u32(out, mem->supply_words);
+
+    ckpt_put_u32(out, (uint32_t)mem->sending);
+    ckpt_put_u64(out, mem->arrivals);
+    for (int i = 0; i < mem->num_responses; i++) {
+        const memory_response_t* slot = &mem->responses[i];
+        ckpt_put_u8(out, slot->pending);
+        ckpt_put_u8(out, slot->supplied);
+        ckpt_put_u32(out, slot->block);
+        ckpt_put_u32(out, slot->wait);
+        ckpt_put_u32(out, slot->sent);
+        ckpt_put_u64(out, slot->order);
+    }
+}
+
+void memory_restore_state(main_memory_t* mem, ckpt_reader_t* in) {
+    mem->waiting_to_respond = ckpt_get_bool(in);
+    mem->wait_cycles = ckpt_get_u32(in);
+    mem->block_addr = ckpt_get_u32(in);
+    mem->words_to_send = ckpt_get_u32(in);
+    mem->supply_block = ckpt_get_u32(in);
+    mem->supply_words = ckpt_get_u32(in);
+
+    int sending = (int)ckpt_get_u32(in);
+    if (sending < -1 || sending >= mem->num_responses) {
+        in->ok = false;
+        return;
+    }
+    mem->sending = sending;
+    mem->arrivals = ckpt_get_u64(in);
+    for (int i = 0; i < mem->num_responses; i++) {
+        memory_response_t* slot = &mem->responses[i];
+        slot->pending = ckpt_get_bool(in);
+        slot->supplied = ckpt_get_bool(in);
+        slot->block = ckpt_get_u32(in);
+        slot->wait = ckpt_get_u32(in);
+        slot->sent = ckpt_get_u32(in);
+        slot->order = ckpt_get_u64(in);
+    }
+}
+
+/**
+ * @brief Check whether a page needs to be stored in a checkpoint
+ */
+static bool page_in_use(const uint32_t* page) {
+    return page != zero_page &&
+        memcmp(page, zero_page, MEMORY_PAGE_SIZE * sizeof(uint32_t)) != 0;
+}
+
+void memory_checkpoint_pages(const main_memory_t* mem, ckpt_writer_t* out) {
+    // The page count is filled in once the pages have been written
+    size_t count_offset = out->size;
+    uint32_t count = 0;
+    ckpt_put_u32(out, 0);
+
+    // Untouched regions are skipped without looking at their pages
+    for (uint32_t t = 0; t < mem->num_tables; t++) {
+        const memory_table_t* table = mem->tables[t];
+        if (table == &mem->zero_table) continue;
+
+        for (uint32_t p = 0; p < MEMORY_TABLE_SIZE; p++) {
+            if (!page_in_use(table->pages[p])) continue;
+            ckpt_put_u32(out, t << MEMORY_TABLE_BITS | p);
+            ckpt_put_words(out, table->pages[p], MEMORY_PAGE_SIZE);
+            count++;
+        }
+    }
+    ckpt_patch_u32(out, count_offset, count);
+}
+
+memory_image_t* memory_image_from_checkpoint(ckpt_reader_t* in) {
+    memory_image_t* image = (memory_image_t*)calloc(1, sizeof(memory_image_t));
+    if (!image) return NULL;
+
+    uint32_t count = ckpt_get_u32(in);
+    uint32_t words[MEMORY_PAGE_SIZE];
+    for (uint32_t i = 0; i < count && in->ok; i++) {
+        uint32_t p = ckpt_get_u32(in);
+        ckpt_get_words(in, words, MEMORY_PAGE_SIZE);
+        if (!in->ok || p > UINT32_MAX >> MEMORY_PAGE_BITS) {
+            in->ok = false;
+            break;
+        }
+
+        for (uint32_t offset = 0; offset < MEMORY_PAGE_SIZE; offset++) {
+            if (!image_store(image, p << MEMORY_PAGE_BITS | offset, words[offset])) {
+                memory_image_free(image);
+                return NULL;
+            }
+        }
+        uint64_t end = ((uint64_t)p + 1) << MEMORY_PAGE_BITS;
+        if (end > image->size) {
+            image->size = end > UINT32_MAX ? UINT32_MAX : (uint32_t)end;
+        }
+    }
+    if (!in->ok) {
+        memory_image_free(image);
+        return NULL;
+    }
+    return image;
+}
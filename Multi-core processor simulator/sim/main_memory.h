@@ -3,10 +3,18 @@
  * @brief Implementation of the main system memory
  *
  * This memory module implements:
- * - 2^20 words of storage
- * - Support for block transfers (4 words per block)
- * - 16-cycle initial response delay
- * - Support for MESI coherency protocol
+ * - 2^20 words of storage by default, configurable up to 2^32 words
+ * - Support for block transfers of the bus block size (4 words by default)
+ * - Initial response delay of 16 cycles by default, configurable
+ * - Support for MESI coherency protocol, and for MOESI owners that
+ *   supply blocks in its place
+ * - Pipelined responses to several outstanding reads on a split-transaction bus
+ * - Copy-on-write pages shared with read-only memory images
+ *
+ * Storage is a two-level page table: a directory entry per 2^20 words
+ * points to a table of 1024 pages of 1024 words. Tables and pages are only
+ * allocated when first written, so memory use and start-up time follow the
+ * footprint of the program, not the configured size.
  */
 
 #ifndef MAIN_MEMORY_H
@@ -14,51 +22,183 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include "bus_system.h"
+#include "dump.h"
+#include "load.h"
+#include "checkpoint.h"
 
  /* Memory Configuration */
-#define MEMORY_SIZE (1 << 20)  ///< Total memory size in words
-#define RESPONSE_DELAY 14      ///< Initial delay cycles before response
-#define WORDS_IN_BLOCK 4       ///< Words per cache block
+#define MEMORY_DEFAULT_BITS 20 ///< Default word address width (4 MB)
+#define MEMORY_MIN_BITS 10     ///< Narrowest word address (one page)
+#define MEMORY_MAX_BITS 32     ///< Widest word address
+#define MEMORY_DEFAULT_DELAY 14 ///< Default countdown before the first response word
+
+/* Paging */
+#define MEMORY_PAGE_BITS 10                                 ///< log2 of words per page
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_BITS)            ///< Words per page
+#define MEMORY_TABLE_BITS 10                                ///< log2 of pages per table
+#define MEMORY_TABLE_SIZE (1 << MEMORY_TABLE_BITS)          ///< Pages per table
+#define MEMORY_TABLE_SHIFT (MEMORY_PAGE_BITS + MEMORY_TABLE_BITS) ///< log2 of words per table
+
+/**
+ * @brief Read-only memory contents shared by any number of memories
+ *
+ * Pages that are entirely zero are not stored. An image must not be freed
+ * while a memory still refers to it.
+ */
+typedef struct memory_image {
+    uint32_t** pages;     ///< Page contents (entries NULL = all zero)
+    uint32_t num_pages;   ///< Length of the page array
+    uint32_t size;        ///< Number of words loaded
+} memory_image_t;
+
+/**
+ * @brief Page table of 2^20 consecutive words
+ *
+ * Every page pointer refers either to a shared zero page, to a page of an
+ * attached image, or to a private copy made on the first write to it.
+ */
+typedef struct {
+    const uint32_t* pages[MEMORY_TABLE_SIZE];  ///< Current contents of each page
+    bool private_page[MEMORY_TABLE_SIZE];      ///< Page is owned by this memory
+} memory_table_t;
+
+/**
+ * @brief Read of a core awaiting its block on a split-transaction bus
+ */
+typedef struct {
+    bool pending;                ///< The block is still to be sent or to pass by
+    bool supplied;               ///< A cache supplies the block; its words are not written
+    uint32_t block;              ///< Base address of the block
+    uint32_t wait;               ///< Cycles left before the first word
+    uint32_t sent;               ///< Words taken by the bus
+    uint64_t order;              ///< Arrival number (the oldest ready read is served first)
+} memory_response_t;
 
 /**
  * @brief Main memory structure
+ *
+ * Directory entries of regions never written point to zero_table.
  */
 typedef struct {
-    uint32_t data[MEMORY_SIZE];  ///< Memory array
+    memory_table_t** tables;     ///< Directory of page tables
+    uint32_t num_tables;         ///< Directory entries
+    uint32_t addr_mask;          ///< Word address mask (size - 1)
+    memory_table_t zero_table;   ///< Table of an untouched region
 
     /* Response State */
     bool waiting_to_respond;     ///< Currently counting down to respond
     uint32_t wait_cycles;        ///< Cycles left before first response
+    uint32_t response_delay;     ///< Countdown started by each read request
     uint32_t block_addr;         ///< Base address of block being transferred
     uint32_t words_to_send;      ///< Words remaining in current block
+    uint32_t supply_block;       ///< Base address of a block a cache supplies instead (MOESI)
+    uint32_t supply_words;       ///< Supplied words still to pass without being written
+    memory_response_t* responses; ///< Reads, response_slots per core (split bus only, else NULL)
+    int num_responses;           ///< Entries in responses
+    int response_slots;          ///< Reads a core may have outstanding at once
+    int sending;                 ///< Read whose word is on the memory port (-1 = none)
+    uint64_t arrivals;           ///< Reads received on the split bus
+
+    FILE* log;                   ///< Stream for flush diagnostics (NULL = silent)
 } main_memory_t;
 
 /**
  * @brief Initialize main memory
  * @param mem Pointer to memory structure
+ * @param addr_bits Word address width (MEMORY_MIN_BITS to MEMORY_MAX_BITS)
+ * @param response_delay Cycles counted down after a read request before the
+ *        first word is sent (MEMORY_DEFAULT_DELAY gives the 16-cycle latency)
+ * @return false if the directory could not be allocated
  *
- * Sets all memory locations to 0
+ * Maps every page to the shared zero page and disables diagnostics
  */
-void memory_init(main_memory_t* mem);
+bool memory_init(main_memory_t* mem, int addr_bits, int response_delay);
 
 /**
- * @brief Load memory contents from file
+ * @brief Answer reads of a split-transaction bus
+ * @param mem Pointer to memory structure
+ * @param num_cores Number of cores on the bus
+ * @param slots Reads each core may have outstanding at once (the bus's
+ *              txn_slots)
+ * @return false if the slots could not be allocated
+ *
+ * The response delays of all outstanding reads count down together; ready
+ * blocks go out oldest first, each word read when it is offered.
+ */
+bool memory_enable_split(main_memory_t* mem, int num_cores, int slots);
+
+/**
+ * @brief Get the number of words of a memory
+ * @param mem Pointer to memory structure
+ */
+static inline uint64_t memory_size(const main_memory_t* mem) {
+    return (uint64_t)mem->addr_mask + 1;
+}
+
+/**
+ * @brief Release all tables and pages, leaving the memory zeroed
+ * @param mem Pointer to memory structure
+ */
+void memory_clear(main_memory_t* mem);
+
+/**
+ * @brief Free all memory of a memory structure initialized by memory_init
+ * @param mem Pointer to memory structure
+ */
+void memory_free(main_memory_t* mem);
+
+/**
+ * @brief Read a memory word
+ * @param mem Pointer to memory structure
+ * @param addr Word address (bits above the address width are ignored)
+ * @return Memory value
+ */
+static inline uint32_t memory_read(const main_memory_t* mem, uint32_t addr) {
+    addr &= mem->addr_mask;
+    const memory_table_t* table = mem->tables[addr >> MEMORY_TABLE_SHIFT];
+    return table->pages[(addr >> MEMORY_PAGE_BITS) & (MEMORY_TABLE_SIZE - 1)]
+        [addr & (MEMORY_PAGE_SIZE - 1)];
+}
+
+/**
+ * @brief Write a memory word, copying a shared page first if needed
+ * @param mem Pointer to memory structure
+ * @param addr Word address (bits above the address width are ignored)
+ * @param value Value to write
+ * @return true on success, false if a private page could not be allocated
+ */
+bool memory_write(main_memory_t* mem, uint32_t addr, uint32_t value);
+
+/**
+ * @brief Replace the memory contents with a shared image
  * @param mem Pointer to memory structure
- * @param filename Name of file containing memory data
+ * @param image Image to share (NULL for all zeros)
  *
- * File format: One 32-bit word per line in hex format
+ * Private pages are released; pages are copied again only when written.
+ * Image pages beyond the memory size are ignored.
+ * @return false if a page table could not be allocated
  */
-void memory_load(main_memory_t* mem, const char* filename);
+bool memory_attach_image(main_memory_t* mem, const memory_image_t* image);
+
+/**
+ * @brief Load memory contents from file
+ * @param mem Pointer to memory structure
+ * @param filename Hex text (one 32-bit word per line) or .bin image
+ * @param error_line Receives the line of a malformed word (may be NULL)
+ * @return LOAD_OK, or why loading failed
+ */
+load_status_t memory_load(main_memory_t* mem, const char* filename, int* error_line);
 
 /**
  * @brief Save memory contents to file
  * @param mem Pointer to memory structure
  * @param filename Name of file to save memory data
- *
- * File format: One 32-bit word per line in hex format
+ * @param format File encoding (DUMP_FULL: one 32-bit word per line in hex)
+ * @return true on success, false if the file could not be written
  */
-void memory_save(main_memory_t* mem, const char* filename);
+bool memory_save(main_memory_t* mem, const char* filename, dump_format_t format);
 
 /**
  * @brief Update memory state each clock cycle
@@ -72,4 +212,82 @@ void memory_save(main_memory_t* mem, const char* filename);
  */
 void memory_clock(main_memory_t* mem, bus_system_t* bus);
 
+/**
+ * @brief Get number of upcoming cycles in which memory only counts down
+ * @param mem Pointer to memory structure
+ * @param bus Pointer to system bus
+ * @return Cycles left of the response delay, or 0 if memory has work to do
+ */
+uint32_t memory_idle_cycles(main_memory_t* mem, bus_system_t* bus);
+
+/**
+ * @brief Advance the response countdown by several cycles at once
+ * @param mem Pointer to memory structure
+ * @param count Number of cycles to skip (at most memory_idle_cycles())
+ */
+void memory_skip_cycles(main_memory_t* mem, uint32_t count);
+
+/* Checkpoints */
+/**
+ * @brief Encode the response state
+ * @param mem Pointer to memory structure
+ * @param out Checkpoint state section
+ */
+void memory_checkpoint_state(const main_memory_t* mem, ckpt_writer_t* out);
+
+/**
+ * @brief Decode the response state
+ * @param mem Pointer to memory structure
+ * @param in Checkpoint state section
+ *
+ * An out-of-range sending slot clears in->ok.
+ */
+void memory_restore_state(main_memory_t* mem, ckpt_reader_t* in);
+
+/**
+ * @brief Encode every page that is not all zero
+ * @param mem Pointer to memory structure
+ * @param out Checkpoint memory section
+ */
+void memory_checkpoint_pages(const main_memory_t* mem, ckpt_writer_t* out);
+
+/**
+ * @brief Decode a checkpoint memory section into an image
+ * @param in Checkpoint memory section
+ * @return New image, or NULL on a malformed section or allocation failure
+ */
+memory_image_t* memory_image_from_checkpoint(ckpt_reader_t* in);
+
+/* Memory Images */
+/**
+ * @brief Load a memory image from file
+ * @param filename Hex text (one 32-bit word per line) or .bin image
+ * @param status Receives LOAD_OK or why loading failed (may be NULL)
+ * @param error_line Receives the line of a malformed word (may be NULL)
+ * @return New image, or NULL on failure
+ */
+memory_image_t* memory_image_load(const char* filename, load_status_t* status, int* error_line);
+
+/**
+ * @brief Create a memory image from a word array starting at address 0
+ * @param words Memory words
+ * @param count Number of words
+ * @return New image, or NULL on allocation failure
+ */
+memory_image_t* memory_image_from_words(const uint32_t* words, uint32_t count);
+
+/**
+ * @brief Read a word of an image
+ * @param image Memory image
+ * @param addr Word address
+ * @return Image value (0 outside of the image)
+ */
+uint32_t memory_image_read(const memory_image_t* image, uint32_t addr);
+
+/**
+ * @brief Free a memory image
+ * @param image Memory image (may be NULL)
+ */
+void memory_image_free(memory_image_t* image);
+
 #endif
\ No newline at end of file
@@ -4,77 +4,100 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "register.h"
+#include "platform.h"
 
 // IF/ID Register
 typedef struct {
-    Register pc;          // Program Counter
-    Register instruction; // Full instruction
-    bool valid;          // Valid bit
+    uint32_t pc;          // Program Counter
+    uint32_t instruction; // Full instruction
 } IF_ID_Reg;
 
 // ID/EX Register
 typedef struct {
-    Register pc;          // Program Counter
-    Register opcode;      // Operation Code
-    Register rd;          // Destination register
-    Register rs;         // Source register 1
-    Register rt;         // Source register 2
-    Register rs_value;    // Value of rs
-    Register rt_value;    // Value of rt
-    Register immediate;   // Immediate field
-    bool write_reg;
-    bool valid;          // Valid bit
-    bool is_mem_access;  // Does this instruction access memory
+    uint32_t pc;          // Program Counter
+    uint32_t rd;          // Destination register (data to store for sw)
+    uint32_t rs_value;    // Value of rs
+    uint32_t rt_value;    // Value of rt
+    uint16_t immediate;   // Immediate field
+    uint8_t opcode;       // Operation Code
+    uint8_t rs;           // Source register 1
+    uint8_t rt;           // Source register 2
+    bool write_reg;       // Should write to register file
 } ID_EX_Reg;
 
 // EX/MEM Register
 typedef struct {
-    Register pc;           // Program Counter
-    Register alu_result;   // ALU computation result
-    Register rd;          // Destination register
-    Register mem_addr;    // Memory address (if needed)
-    Register mem_write_data; // Data to write to memory
-    bool valid;           // Valid bit
+    uint32_t pc;           // Program Counter
+    uint32_t alu_result;   // ALU computation result
+    uint32_t rd;           // Destination register (data to store for sw)
+    uint32_t mem_addr;     // Memory address (if needed)
+    uint32_t mem_write_data; // Data to write to memory
     bool is_mem_read;     // Memory read operation
     bool is_mem_write;    // Memory write operation
     bool write_reg;       // Should write to register file
+    bool is_fence;        // Fence: wait until the store buffer is empty
 } EX_MEM_Reg;
 
 // MEM/WB Register
 typedef struct {
-    Register pc;          // Program Counter
-    Register write_data;  // Data to write back to register
-    Register rd;         // Destination register
-    bool valid;          // Valid bit
+    uint32_t pc;          // Program Counter
+    uint32_t write_data;  // Data to write back to register
+    uint32_t rd;          // Destination register
     bool write_reg;      // Should write to register file
+    bool is_mem_read;    // Data came from memory (set by MEM for decode's forwarding check)
 } MEM_WB_Reg;
 
-// Pipeline Registers
+// Everything latched at a clock edge: PC, register file and pipeline
+// registers, packed into three host cache lines
 typedef struct {
+    SIM_ALIGNED(SIM_CACHE_LINE) uint32_t pc;  // Program counter
+    uint32_t registers[16];  // Register file (R0-R15)
     IF_ID_Reg if_id;
     ID_EX_Reg id_ex;
     EX_MEM_Reg ex_mem;
     MEM_WB_Reg mem_wb;
-} Pipeline_Regs;
+} Pipeline_State;
 
-// Initialize pipeline registers
-void pipeline_regs_init(Pipeline_Regs* regs);
+// Latches a stall can hold (bits of Pipeline_Regs.held)
+#define PIPE_IF_ID  0x01
+#define PIPE_ID_EX  0x02
+#define PIPE_EX_MEM 0x04
+#define PIPE_MEM_WB 0x08
+#define PIPE_PC     0x10
 
-// Clock update for all pipeline registers
-void pipeline_regs_clock_update(Pipeline_Regs* regs);
+// Pipeline Registers
+//
+// The stages read the current bank (the Q outputs) and write the next one
+// (the D inputs), which starts each cycle as a copy of the current bank. The
+// clock edge swaps the two banks, after copying back every latch held by a
+// stall, so nothing is copied field by field.
+typedef struct {
+    Pipeline_State banks[2];
+    Pipeline_State* cur;   // State of this cycle
+    Pipeline_State* next;  // State latched at the end of this cycle
+    uint8_t held;          // Latches stalled this cycle (PIPE_* bits)
+} Pipeline_Regs;
 
-// Stall specific pipeline stage
-void pipeline_stall_stage(Pipeline_Regs* regs, int stage);
+// Initialize pipeline registers: PC 0, registers 0 and NOPs in every stage
+void pipeline_regs_init(Pipeline_Regs* regs);
 
 /**
- * @brief Enable all pipeline registers
- *
- * Sets enable signal for all registers in the pipeline to true.
- * This prepares the pipeline for the next clock cycle.
- *
+ * @brief Start a cycle with no stalls and the next state equal to the current one
  * @param regs Pointer to pipeline registers structure
  */
-void pipeline_regs_enable_all(Pipeline_Regs* regs);
+void pipeline_regs_begin_cycle(Pipeline_Regs* regs);
+
+// Clock update: latch the next state except for the held latches
+void pipeline_regs_clock_update(Pipeline_Regs* regs);
+
+// Keep latches (PIPE_* bits) at their current value at the next clock edge
+static inline void pipeline_hold(Pipeline_Regs* regs, uint8_t latches) {
+    regs->held |= latches;
+}
+
+// Check whether a latch is held this cycle
+static inline bool pipeline_is_held(const Pipeline_Regs* regs, uint8_t latch) {
+    return (regs->held & latch) != 0;
+}
 
-#endif // PIPELINE_REGS_H
\ No newline at end of file
+#endif // PIPELINE_REGS_H
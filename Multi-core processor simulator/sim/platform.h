@@ -0,0 +1,126 @@
+/**
+ * @file platform.h
+ * @brief Compiler and OS portability helpers
+ *
+ * Provides:
+ * - Cache-line alignment for structures shared between host threads
+ * - Aligned heap allocation
+ * - Minimal atomic operations and spin-wait hints
+ * - Directory creation
+ */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define SIM_CACHE_LINE 64  ///< Host cache line size in bytes
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#include <intrin.h>
+#define SIM_ALIGNED(n) __declspec(align(n))
+#else
+#define SIM_ALIGNED(n) __attribute__((aligned(n)))
+#endif
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include <errno.h>
+
+/**
+ * @brief Allocate memory aligned to a given boundary
+ * @param size Number of bytes
+ * @param alignment Alignment in bytes (power of two)
+ * @return Pointer to zeroed memory, or NULL on failure
+ */
+static inline void* sim_aligned_alloc(size_t size, size_t alignment) {
+    void* ptr;
+#if defined(_MSC_VER)
+    ptr = _aligned_malloc(size, alignment);
+#else
+    if (posix_memalign(&ptr, alignment, size) != 0) ptr = NULL;
+#endif
+    if (ptr) {
+        unsigned char* bytes = (unsigned char*)ptr;
+        for (size_t i = 0; i < size; i++) bytes[i] = 0;
+    }
+    return ptr;
+}
+
+/**
+ * @brief Free memory returned by sim_aligned_alloc
+ * @param ptr Pointer to free (may be NULL)
+ */
+static inline void sim_aligned_free(void* ptr) {
+#if defined(_MSC_VER)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+/**
+ * @brief Atomically read a shared counter
+ */
+static inline long sim_atomic_load(volatile long* ptr) {
+#if defined(_MSC_VER)
+    return _InterlockedOr(ptr, 0);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * @brief Atomically write a shared counter
+ */
+static inline void sim_atomic_store(volatile long* ptr, long value) {
+#if defined(_MSC_VER)
+    _InterlockedExchange(ptr, value);
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * @brief Atomically add to a shared counter
+ * @return Value after the addition
+ */
+static inline long sim_atomic_add(volatile long* ptr, long value) {
+#if defined(_MSC_VER)
+    return _InterlockedExchangeAdd(ptr, value) + value;
+#else
+    return __atomic_add_fetch(ptr, value, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/**
+ * @brief Hint to the CPU that the caller is busy-waiting
+ */
+static inline void sim_cpu_relax(void) {
+#if defined(_MSC_VER)
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * @brief Create a directory
+ * @param path Directory path (the parent must exist)
+ * @return 0 if the directory was created or already exists, -1 otherwise
+ */
+static inline int sim_make_dir(const char* path) {
+#if defined(_WIN32)
+    int result = _mkdir(path);
+#else
+    int result = mkdir(path, 0777);
+#endif
+    return (result == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+#endif /* PLATFORM_H */
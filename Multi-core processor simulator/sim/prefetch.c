@@ -0,0 +1,260 @@
+/**
+ * @file prefetch.c
+ * @brief Implementation of the data prefetch policies
+ *
+ * A policy is a training function listed in prefetch_policies; further
+ * policies are added with one function and one entry there.
+ */
+
+#include <string.h>
+#include "prefetch.h"
+
+/**
+ * @brief Queue a block unless it is already queued
+ * @param pf Prefetcher
+ * @param block Block address
+ */
+static void queue_block(prefetcher_t* pf, uint32_t block) {
+    for (int i = 0; i < pf->count; i++) {
+        if (pf->queue[(pf->queue_head + i) % PREFETCH_QUEUE_SIZE] == block) {
+            return;
+        }
+    }
+
+    // A full queue drops its oldest candidate, which is the least timely
+    if (pf->count == PREFETCH_QUEUE_SIZE) {
+        prefetch_pop(pf);
+    }
+    pf->queue[(pf->queue_head + pf->count) % PREFETCH_QUEUE_SIZE] = block;
+    pf->count++;
+}
+
+/**
+ * @brief Queue the blocks of the next degree steps from an address
+ * @param pf Prefetcher
+ * @param addr Word address of the triggering access
+ * @param step Words between the predicted accesses
+ */
+static void queue_ahead(prefetcher_t* pf, uint32_t addr, int32_t step) {
+    uint32_t mask = ~(((uint32_t)1 << pf->block_bits) - 1);
+    for (int k = 1; k <= pf->degree; k++) {
+        uint32_t next = addr + (uint32_t)step * (uint32_t)k;
+        if ((next & mask) != (addr & mask)) {
+            queue_block(pf, next & mask);
+        }
+    }
+}
+
+/* Policies */
+
+/**
+ * @brief Next-line: blocks following a miss or the first use of a prefetch
+ */
+static void train_next_line(prefetcher_t* pf, uint32_t pc, uint32_t addr, prefetch_event_t event) {
+    (void)pc;
+    if (event != PREFETCH_HIT) {
+        queue_ahead(pf, addr, (int32_t)1 << pf->block_bits);
+    }
+}
+
+/**
+ * @brief Stride: per-PC reference prediction table
+ *
+ * A stride that stops repeating loses one step of confidence before it is
+ * replaced, so an occasional jump (the start of the next loop) does not
+ * retrain the entry.
+ */
+static void train_stride(prefetcher_t* pf, uint32_t pc, uint32_t addr, prefetch_event_t event) {
+    (void)event;
+    prefetch_stride_t* entry = &pf->strides[pc & (PREFETCH_STRIDE_ENTRIES - 1)];
+    if (!entry->valid || entry->pc != pc) {
+        entry->valid = true;
+        entry->confidence = 0;
+        entry->pc = pc;
+        entry->last_addr = addr;
+        entry->stride = 0;
+        return;
+    }
+
+    // A retried or repeated access teaches nothing
+    if (addr == entry->last_addr) {
+        return;
+    }
+    int32_t stride = (int32_t)(addr - entry->last_addr);
+    uint32_t last = entry->last_addr;
+    entry->last_addr = addr;
+    if (stride != entry->stride) {
+        if (entry->confidence > 0) {
+            entry->confidence--;
+        }
+        else {
+            entry->stride = stride;
+        }
+        return;
+    }
+    if (entry->confidence < 3) {
+        entry->confidence++;
+    }
+
+    // Strides within a block trigger once per block and advance by blocks
+    int32_t block_size = (int32_t)1 << pf->block_bits;
+    if (stride > -block_size && stride < block_size) {
+        if ((addr >> pf->block_bits) == (last >> pf->block_bits)) {
+            return;
+        }
+        stride = stride > 0 ? block_size : -block_size;
+    }
+    queue_ahead(pf, addr, stride);
+}
+
+/**
+ * @brief Stream: sequential streams started by misses to adjacent blocks
+ */
+static void train_stream(prefetcher_t* pf, uint32_t pc, uint32_t addr, prefetch_event_t event) {
+    (void)pc;
+    if (event == PREFETCH_HIT) {
+        return;
+    }
+    uint32_t block = addr >> pf->block_bits;
+    pf->steps++;
+
+    prefetch_stream_t* victim = &pf->streams[0];
+    for (int i = 0; i < PREFETCH_STREAMS; i++) {
+        prefetch_stream_t* stream = &pf->streams[i];
+        if (!stream->valid) {
+            if (victim->valid) victim = stream;
+            continue;
+        }
+        if (victim->valid && stream->used < victim->used) {
+            victim = stream;
+        }
+
+        int32_t ahead = (int32_t)(block - stream->head);
+        if (ahead == 0) {
+            return;
+        }
+        if (!stream->confirmed) {
+            if (event != PREFETCH_MISS || (ahead != 1 && ahead != -1)) continue;
+            stream->confirmed = true;
+            stream->direction = (int8_t)ahead;
+        }
+        else if (ahead * stream->direction <= 0 || ahead * stream->direction > pf->degree) {
+            continue;
+        }
+
+        // The access reached the stream: run degree blocks ahead of it
+        stream->head = block;
+        stream->used = pf->steps;
+        queue_ahead(pf, addr, (int32_t)stream->direction << pf->block_bits);
+        return;
+    }
+
+    // A miss outside every stream may start a new one
+    if (event == PREFETCH_MISS) {
+        victim->valid = true;
+        victim->confirmed = false;
+        victim->direction = 0;
+        victim->head = block;
+        victim->used = pf->steps;
+    }
+}
+
+typedef void (*prefetch_train_fn)(prefetcher_t* pf, uint32_t pc, uint32_t addr,
+    prefetch_event_t event);
+
+/** Training function of each policy, indexed by prefetch_policy_t */
+static const prefetch_train_fn prefetch_policies[] = {
+    NULL,             // PREFETCH_NONE
+    train_next_line,  // PREFETCH_NEXT_LINE
+    train_stride,     // PREFETCH_STRIDE
+    train_stream      // PREFETCH_STREAM
+};
+
+/* Interface */
+
+void prefetch_init(prefetcher_t* pf, prefetch_policy_t policy, int degree, int block_bits) {
+    memset(pf, 0, sizeof(*pf));
+    pf->policy = policy;
+    pf->degree = degree;
+    pf->block_bits = block_bits;
+}
+
+void prefetch_train(prefetcher_t* pf, uint32_t pc, uint32_t addr, prefetch_event_t event) {
+    prefetch_train_fn train = prefetch_policies[pf->policy];
+    if (train) {
+        train(pf, pc, addr, event);
+    }
+}
+
+bool prefetch_peek(const prefetcher_t* pf, uint32_t* block) {
+    if (pf->count == 0) {
+        return false;
+    }
+    *block = pf->queue[pf->queue_head];
+    return true;
+}
+
+void prefetch_pop(prefetcher_t* pf) {
+    pf->queue_head = (pf->queue_head + 1) % PREFETCH_QUEUE_SIZE;
+    pf->count--;
+}
+
+/* Checkpoints */
+
+void prefetch_checkpoint(const prefetcher_t* pf, ckpt_writer_t* out) {
+    ckpt_put_u32(out, (uint32_t)pf->count);
+    for (int i = 0; i < pf->count; i++) {
+        ckpt_put_u32(out, pf->queue[(pf->queue_head + i) % PREFETCH_QUEUE_SIZE]);
+    }
+    for (int i = 0; i < PREFETCH_STRIDE_ENTRIES; i++) {
+        const prefetch_stride_t* entry = &pf->strides[i];
+        ckpt_put_u8(out, entry->valid);
+        ckpt_put_u8(out, entry->confidence);
+        ckpt_put_u32(out, entry->pc);
+        ckpt_put_u32(out, entry->last_addr);
+        ckpt_put_u32(out, (uint32_t)entry->stride);
+    }
+    for (int i = 0; i < PREFETCH_STREAMS; i++) {
+        const prefetch_stream_t* stream = &pf->streams[i];
+        ckpt_put_u8(out, stream->valid);
+        ckpt_put_u8(out, stream->confirmed);
+        ckpt_put_u8(out, (uint8_t)stream->direction);
+        ckpt_put_u32(out, stream->head);
+        ckpt_put_u32(out, stream->used);
+    }
+    ckpt_put_u32(out, pf->steps);
+}
+
+void prefetch_restore(prefetcher_t* pf, ckpt_reader_t* in) {
+    uint32_t count = ckpt_get_u32(in);
+    if (count > PREFETCH_QUEUE_SIZE) {
+        in->ok = false;
+        return;
+    }
+    pf->queue_head = 0;
+    pf->count = (int)count;
+    for (int i = 0; i < pf->count; i++) {
+        pf->queue[i] = ckpt_get_u32(in);
+    }
+    for (int i = 0; i < PREFETCH_STRIDE_ENTRIES; i++) {
+        prefetch_stride_t* entry = &pf->strides[i];
+        entry->valid = ckpt_get_bool(in);
+        entry->confidence = ckpt_get_enum(in, 3);
+        entry->pc = ckpt_get_u32(in);
+        entry->last_addr = ckpt_get_u32(in);
+        entry->stride = (int32_t)ckpt_get_u32(in);
+    }
+    for (int i = 0; i < PREFETCH_STREAMS; i++) {
+        prefetch_stream_t* stream = &pf->streams[i];
+        stream->valid = ckpt_get_bool(in);
+        stream->confirmed = ckpt_get_bool(in);
+        int8_t direction = (int8_t)ckpt_get_u8(in);
+        if (direction < -1 || direction > 1) {
+            in->ok = false;
+        }
+        stream->direction = direction;
+        stream->head = ckpt_get_u32(in);
+        stream->used = ckpt_get_u32(in);
+    }
+    pf->steps = ckpt_get_u32(in);
+}
@@ -0,0 +1,143 @@
+/**
+ * @file prefetch.h
+ * @brief Hardware data prefetcher of a data cache
+ *
+ * The prefetcher is told about every demand access of its cache and queues
+ * the blocks it expects to be used next; cache_clock requests them through
+ * free MSHRs as low-priority bus requests. Each policy is one training
+ * function in the table in prefetch.c:
+ * - next-line: a miss, or the first use of a prefetched block, queues the
+ *   next degree blocks (tagged next-line prefetching)
+ * - stride: a table indexed by the PC of the load or store learns the
+ *   address stride of each instruction and, once the same stride has been
+ *   seen twice, queues the blocks of its next degree accesses (strides
+ *   shorter than a block advance by whole blocks)
+ * - stream: two misses to adjacent blocks start an ascending or descending
+ *   stream; a later miss or use within degree blocks ahead of it moves the
+ *   stream there and queues the degree blocks that follow
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "checkpoint.h"
+
+#define PREFETCH_MAX_DEGREE 8     ///< Most blocks queued per trigger
+#define PREFETCH_QUEUE_SIZE 16    ///< Candidate blocks waiting for an MSHR
+#define PREFETCH_STRIDE_ENTRIES 16 ///< Per-PC stride table entries (power of two)
+#define PREFETCH_STREAMS 4        ///< Streams tracked at once
+
+/**
+ * @brief Prefetch policy
+ */
+typedef enum {
+    PREFETCH_NONE = 0,       ///< No prefetching
+    PREFETCH_NEXT_LINE = 1,  ///< Following blocks of a miss or a used prefetch
+    PREFETCH_STRIDE = 2,     ///< Per-PC stride prediction
+    PREFETCH_STREAM = 3      ///< Sequential streams confirmed by two misses
+} prefetch_policy_t;
+
+/**
+ * @brief Outcome of a demand access, as reported to the prefetcher
+ */
+typedef enum {
+    PREFETCH_HIT = 0,   ///< Hit on a block fetched on demand, or merged into a demand miss
+    PREFETCH_MISS = 1,  ///< Miss that started a new request
+    PREFETCH_USE = 2    ///< First access to a prefetched block, arrived or still in flight
+} prefetch_event_t;
+
+/**
+ * @brief Stride table entry of one load or store instruction
+ */
+typedef struct {
+    bool valid;           ///< Entry holds an instruction
+    uint8_t confidence;   ///< Times the stride repeated in a row (saturates at 3)
+    uint32_t pc;          ///< Instruction address
+    uint32_t last_addr;   ///< Word address of its last access
+    int32_t stride;       ///< Difference between its last two addresses
+} prefetch_stride_t;
+
+/**
+ * @brief Sequential stream
+ */
+typedef struct {
+    bool valid;           ///< Entry is in use
+    bool confirmed;       ///< A second miss fixed the direction
+    int8_t direction;     ///< +1 ascending, -1 descending (confirmed streams)
+    uint32_t head;        ///< Last demand block of the stream
+    uint32_t used;        ///< Training step of the last access (for replacement)
+} prefetch_stream_t;
+
+/**
+ * @brief Prefetcher state of one cache
+ */
+typedef struct {
+    prefetch_policy_t policy;   ///< Training function in use
+    int degree;                 ///< Blocks queued per trigger
+    int block_bits;             ///< log2 of the block size in words
+
+    /* Candidates */
+    uint32_t queue[PREFETCH_QUEUE_SIZE];  ///< Ring of block addresses, oldest at queue_head
+    int queue_head;             ///< Oldest candidate
+    int count;                  ///< Candidates queued
+
+    /* Training State */
+    prefetch_stride_t strides[PREFETCH_STRIDE_ENTRIES];  ///< Stride table, by PC
+    prefetch_stream_t streams[PREFETCH_STREAMS];         ///< Tracked streams
+    uint32_t steps;             ///< Accesses trained on (stream replacement clock)
+} prefetcher_t;
+
+/**
+ * @brief Initialize a prefetcher with empty tables
+ * @param pf Prefetcher
+ * @param policy Prefetch policy (PREFETCH_NONE never queues anything)
+ * @param degree Blocks queued per trigger (1 to PREFETCH_MAX_DEGREE)
+ * @param block_bits log2 of the block size in words
+ */
+void prefetch_init(prefetcher_t* pf, prefetch_policy_t policy, int degree, int block_bits);
+
+/**
+ * @brief Train on a demand access and queue the blocks it predicts
+ * @param pf Prefetcher
+ * @param pc Address of the load or store instruction
+ * @param addr Word address accessed
+ * @param event Whether the access hit, missed or used a prefetched block
+ *
+ * When the queue is full the oldest candidates make room.
+ */
+void prefetch_train(prefetcher_t* pf, uint32_t pc, uint32_t addr, prefetch_event_t event);
+
+/**
+ * @brief Get the oldest queued block
+ * @param pf Prefetcher
+ * @param block Receives the block address
+ * @return false if the queue is empty
+ */
+bool prefetch_peek(const prefetcher_t* pf, uint32_t* block);
+
+/**
+ * @brief Remove the oldest queued block
+ * @param pf Prefetcher with at least one queued block
+ */
+void prefetch_pop(prefetcher_t* pf);
+
+/**
+ * @brief Encode the queue and training tables
+ * @param pf Prefetcher
+ * @param out Checkpoint state section
+ */
+void prefetch_checkpoint(const prefetcher_t* pf, ckpt_writer_t* out);
+
+/**
+ * @brief Decode the state written by prefetch_checkpoint
+ * @param pf Initialized prefetcher (keeps its policy, degree and block size)
+ * @param in Checkpoint state section
+ *
+ * The tables of every policy are restored, so a checkpoint taken under one
+ * policy can be continued under another.
+ */
+void prefetch_restore(prefetcher_t* pf, ckpt_reader_t* in);
+
+#endif /* PREFETCH_H */
@@ -15,17 +15,30 @@ typedef struct {
 // Initialize register with default values
 void register_init(Register* reg);
 
+// The accessors below are inline so that clocked signals cost no calls
+
 // Set the next value (D input)
-void register_set_next(Register* reg, uint32_t value);
+static inline void register_set_next(Register* reg, uint32_t value) {
+    reg->D = value;
+}
 
 // Update current value on clock edge (Q output)
-void register_clock_update(Register* reg);
+static inline void register_clock_update(Register* reg) {
+    if (reg->enable) {
+        reg->Q = reg->D;
+        reg->valid = true;
+    }
+}
 
 // Get current value
-uint32_t register_get_value(Register* reg);
+static inline uint32_t register_get_value(const Register* reg) {
+    return reg->Q;
+}
 
 // Set enable signal
-void register_set_enable(Register* reg, bool enable);
+static inline void register_set_enable(Register* reg, bool enable) {
+    reg->enable = enable;
+}
 
 // Set valid signal
 void register_set_valid(Register* reg, bool valid);
@@ -0,0 +1,628 @@
+// run_files.c
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "run_files.h"
+#include "bus_system.h"
+
+/* File Naming */
+
+void files_from_list(sim_files_t* files, const char** list, int num_cores) {
+    int n = num_cores;
+    files->imem = list;
+    files->memin = list[n];
+    files->memout = list[n + 1];
+    files->regout = list + n + 2;
+    files->core_trace = list + 2 * n + 2;
+    files->bus_trace = list[3 * n + 2];
+    files->dsram = list + 3 * n + 3;
+    files->tsram = list + 4 * n + 3;
+    files->stats = list + 5 * n + 3;
+}
+
+char* make_file_name(const char* dir, const char* name, int index) {
+    char base[64];
+    snprintf(base, sizeof(base), name, index);
+
+    size_t dir_len = dir ? strlen(dir) : 0;
+    char* path = (char*)malloc(dir_len + strlen(base) + 2);
+    if (!path) return NULL;
+
+    if (dir_len > 0) {
+        sprintf(path, "%s/%s", dir, base);
+    }
+    else {
+        strcpy(path, base);
+    }
+    return path;
+}
+
+void free_file_list(char** list, int num_cores) {
+    if (!list) return;
+    for (int i = 0; i < 6 * num_cores + 3; i++) {
+        free(list[i]);
+    }
+    free(list);
+}
+
+char** make_default_file_list(const sim_config_t* config, const char* in_dir,
+    const char* out_dir) {
+    bool binary_traces = config->trace_format != SIM_TRACE_TEXT;
+    bool binary_dumps = config->dump_format == SIM_DUMP_BINARY;
+    const char* core_trace = binary_traces ? "core%dtrace.bin" : "core%dtrace.txt";
+    int n = config->num_cores;
+    char** list = (char**)calloc(6 * n + 3, sizeof(char*));
+    if (!list) return NULL;
+
+    for (int i = 0; i < n; i++) {
+        list[i] = make_file_name(in_dir, "imem%d.txt", i);
+        list[n + 2 + i] = make_file_name(out_dir, binary_dumps ? "regout%d.bin" : "regout%d.txt", i);
+        list[2 * n + 2 + i] = make_file_name(out_dir, core_trace, i);
+        list[3 * n + 3 + i] = make_file_name(out_dir, binary_dumps ? "dsram%d.bin" : "dsram%d.txt", i);
+        list[4 * n + 3 + i] = make_file_name(out_dir, binary_dumps ? "tsram%d.bin" : "tsram%d.txt", i);
+        list[5 * n + 3 + i] = make_file_name(out_dir, "stats%d.txt", i);
+    }
+    list[n] = make_file_name(in_dir, "memin.txt", 0);
+    list[n + 1] = make_file_name(out_dir, binary_dumps ? "memout.bin" : "memout.txt", 0);
+    list[3 * n + 2] = make_file_name(out_dir, binary_traces ? "bustrace.bin" : "bustrace.txt", 0);
+
+    for (int i = 0; i < 6 * n + 3; i++) {
+        if (!list[i]) {
+            free_file_list(list, n);
+            return NULL;
+        }
+    }
+    return list;
+}
+
+/* Run Setup and Results */
+
+bool parse_trace_format(const char* name, sim_trace_format_t* format) {
+    if (strcmp(name, "text") == 0) {
+        *format = SIM_TRACE_TEXT;
+    }
+    else if (strcmp(name, "binary") == 0) {
+        *format = SIM_TRACE_BINARY;
+    }
+    else if (strcmp(name, "compressed") == 0) {
+        *format = SIM_TRACE_COMPRESSED;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_dump_format(const char* name, sim_dump_format_t* format) {
+    if (strcmp(name, "full") == 0) {
+        *format = SIM_DUMP_FULL;
+    }
+    else if (strcmp(name, "trim") == 0) {
+        *format = SIM_DUMP_TRIM;
+    }
+    else if (strcmp(name, "sparse") == 0) {
+        *format = SIM_DUMP_SPARSE;
+    }
+    else if (strcmp(name, "binary") == 0) {
+        *format = SIM_DUMP_BINARY;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_cache_policy(const char* name, sim_cache_policy_t* policy) {
+    if (strcmp(name, "lru") == 0) {
+        *policy = SIM_CACHE_LRU;
+    }
+    else if (strcmp(name, "plru") == 0) {
+        *policy = SIM_CACHE_PLRU;
+    }
+    else if (strcmp(name, "random") == 0) {
+        *policy = SIM_CACHE_RANDOM;
+    }
+    else if (strcmp(name, "rrip") == 0) {
+        *policy = SIM_CACHE_RRIP;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_trace_mode(const char* name, sim_trace_mode_t* mode) {
+    if (strcmp(name, "block") == 0) {
+        *mode = SIM_TRACE_ASYNC_BLOCK;
+    }
+    else if (strcmp(name, "drop") == 0) {
+        *mode = SIM_TRACE_ASYNC_DROP;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parse an unsigned number that must end at a given character
+ * @param str Text to parse
+ * @param base Number base (10 or 16)
+ * @param stop Character expected after the number ('\0' for the end)
+ * @param result Receives the number
+ * @return Pointer past the stop character, or NULL on a syntax error
+ */
+static const char* parse_number(const char* str, int base, char stop, uint64_t* result) {
+    char* end;
+    // strtoull would also accept leading blanks and signs
+    if (!isxdigit((unsigned char)*str)) return NULL;
+    *result = strtoull(str, &end, base);
+    if (end == str || *end != stop) return NULL;
+    return stop ? end + 1 : end;
+}
+
+/**
+ * @brief Parse a "LO:HI" pair of numbers
+ */
+static bool parse_range(const char* str, int base, uint64_t* lo, uint64_t* hi) {
+    str = parse_number(str, base, ':', lo);
+    return str && parse_number(str, base, '\0', hi) && *lo <= *hi;
+}
+
+/**
+ * @brief Parse a comma-separated list of bus command names into a mask
+ */
+static bool parse_bus_cmds(const char* list, unsigned* cmds) {
+    static const char* names[] = { "rd", "rdx", "flush" };
+    *cmds = 0;
+    if (strcmp(list, "none") == 0) return true;
+
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        int cmd = 0;
+        for (int i = 0; i < 3; i++) {
+            if (strlen(names[i]) == len && strncmp(list, names[i], len) == 0) {
+                cmd = BUS_RD + i;
+            }
+        }
+        if (cmd == 0) return false;
+        *cmds |= 1u << cmd;
+        list += len;
+        if (*list == ',') list++;
+    }
+    return *cmds != 0;
+}
+
+bool parse_trace_filter_option(const char* name, const char* value, sim_trace_filter_t* filter) {
+    uint64_t lo, hi;
+
+    if (strcmp(name, "trace-window") == 0) {
+        if (!parse_range(value, 10, &lo, &hi)) return false;
+        filter->start_cycle = lo;
+        filter->stop_cycle = hi;
+    }
+    else if (strcmp(name, "trace-on-pc") == 0) {
+        // Core index in decimal, PC in hex like the trace files
+        const char* pc = parse_number(value, 10, ':', &lo);
+        if (!pc || !parse_number(pc, 16, '\0', &hi) || lo > INT32_MAX || hi > UINT32_MAX) {
+            return false;
+        }
+        filter->trigger_core = (int)lo;
+        filter->trigger_pc = (uint32_t)hi;
+    }
+    else if (strcmp(name, "trace-on-addr") == 0) {
+        if (!parse_number(value, 16, '\0', &lo) || lo > UINT32_MAX) return false;
+        filter->trigger_on_addr = true;
+        filter->trigger_addr = (uint32_t)lo;
+    }
+    else if (strcmp(name, "trace-bus-cmd") == 0) {
+        return parse_bus_cmds(value, &filter->bus_cmds);
+    }
+    else if (strcmp(name, "trace-bus-addr") == 0) {
+        if (!parse_range(value, 16, &lo, &hi) || hi > UINT32_MAX) return false;
+        filter->bus_addr_min = (uint32_t)lo;
+        filter->bus_addr_max = (uint32_t)hi;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a decimal number within a range
+ */
+static bool parse_int_range(const char* value, int min, int max, int* result) {
+    uint64_t number;
+    if (!parse_number(value, 10, '\0', &number) || number < (uint64_t)min ||
+        number > (uint64_t)max) {
+        return false;
+    }
+    *result = (int)number;
+    return true;
+}
+
+/** Names of the settings accepted by parse_config_option */
+static const char* const config_options[] = {
+    "cores", "threads", "memory-bits", "cache-size", "block-size", "cache-ways",
+    "cache-policy", "protocol", "bus", "memory-delay", "bus-delay", "imem-size", "store-buffer",
+    "mshrs", "prefetch", "prefetch-degree", "forwarding", "event", "kernel"
+};
+
+bool is_config_option(const char* name) {
+    for (size_t i = 0; i < sizeof(config_options) / sizeof(config_options[0]); i++) {
+        if (strcmp(name, config_options[i]) == 0) return true;
+    }
+    return false;
+}
+
+bool parse_config_option(const char* name, const char* value, sim_config_t* config) {
+    int number;
+
+    // Only the syntax and sign are checked here; sim_config_error checks
+    // the combination once every setting is known
+    if (strcmp(name, "cores") == 0) {
+        return parse_int_range(value, 1, BUS_MAX_CORES, &config->num_cores);
+    }
+    if (strcmp(name, "threads") == 0) {
+        return parse_int_range(value, 1, INT32_MAX, &config->num_threads);
+    }
+    if (strcmp(name, "memory-bits") == 0) {
+        return parse_int_range(value, 10, 32, &config->memory_bits);
+    }
+    if (strcmp(name, "cache-size") == 0) {
+        return parse_int_range(value, 1, INT32_MAX, &config->cache_size);
+    }
+    if (strcmp(name, "block-size") == 0) {
+        return parse_int_range(value, 1, INT32_MAX, &config->block_size);
+    }
+    if (strcmp(name, "cache-ways") == 0) {
+        return parse_int_range(value, 1, INT32_MAX, &config->cache_ways);
+    }
+    if (strcmp(name, "cache-policy") == 0) {
+        return parse_cache_policy(value, &config->cache_policy);
+    }
+    if (strcmp(name, "protocol") == 0) {
+        if (strcmp(value, "mesi") == 0) {
+            config->protocol = SIM_MESI;
+        }
+        else if (strcmp(value, "moesi") == 0) {
+            config->protocol = SIM_MOESI;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(name, "bus") == 0) {
+        if (strcmp(value, "atomic") == 0) {
+            config->bus_mode = SIM_BUS_ATOMIC;
+        }
+        else if (strcmp(value, "split") == 0) {
+            config->bus_mode = SIM_BUS_SPLIT;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(name, "memory-delay") == 0) {
+        return parse_int_range(value, 0, SIM_MAX_DELAY, &config->memory_delay);
+    }
+    if (strcmp(name, "bus-delay") == 0) {
+        return parse_int_range(value, 0, SIM_MAX_DELAY, &config->bus_delay);
+    }
+    if (strcmp(name, "imem-size") == 0) {
+        return parse_int_range(value, 1, INT32_MAX, &config->imem_size);
+    }
+    if (strcmp(name, "store-buffer") == 0) {
+        return parse_int_range(value, 0, INT32_MAX, &config->store_buffer);
+    }
+    if (strcmp(name, "mshrs") == 0) {
+        return parse_int_range(value, 0, INT32_MAX, &config->mshrs);
+    }
+    if (strcmp(name, "prefetch") == 0) {
+        if (strcmp(value, "none") == 0) {
+            config->prefetch = SIM_PREFETCH_NONE;
+        }
+        else if (strcmp(value, "next-line") == 0) {
+            config->prefetch = SIM_PREFETCH_NEXT_LINE;
+        }
+        else if (strcmp(value, "stride") == 0) {
+            config->prefetch = SIM_PREFETCH_STRIDE;
+        }
+        else if (strcmp(value, "stream") == 0) {
+            config->prefetch = SIM_PREFETCH_STREAM;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(name, "prefetch-degree") == 0) {
+        return parse_int_range(value, 1, INT32_MAX, &config->prefetch_degree);
+    }
+    if (strcmp(name, "forwarding") == 0) {
+        if (!parse_int_range(value, 0, INT32_MAX, &number)) return false;
+        config->forwarding = number != 0;
+        return true;
+    }
+    if (strcmp(name, "event") == 0) {
+        if (!parse_int_range(value, 0, INT32_MAX, &number)) return false;
+        config->event_driven = number != 0;
+        return true;
+    }
+    if (strcmp(name, "kernel") == 0) {
+        if (strcmp(value, "auto") != 0 && strcmp(value, "generic") != 0) return false;
+        config->generic_kernel = strcmp(value, "generic") == 0;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Strip leading and trailing blanks in place
+ * @return Pointer to the first non-blank character
+ */
+static char* trim(char* str) {
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+    size_t len = strlen(str);
+    while (len > 0 && isspace((unsigned char)str[len - 1])) {
+        str[--len] = '\0';
+    }
+    return str;
+}
+
+bool load_config_file(const char* filename, sim_config_t* config) {
+    FILE* f = fopen(filename, "r");
+    if (!f) {
+        printf("Error: Failed to open config file %s\n", filename);
+        return false;
+    }
+
+    char line[256];
+    int line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        line_number++;
+        line[strcspn(line, "#")] = '\0';
+        char* name = trim(line);
+        if (*name == '\0') continue;
+
+        char* value = strchr(name, '=');
+        if (value) {
+            *value++ = '\0';
+            name = trim(name);
+            value = trim(value);
+        }
+        if (!value || !parse_config_option(name, value, config)) {
+            printf("Error: %s:%d: invalid setting %s\n", filename, line_number, name);
+            ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+bool parse_core_list(const char* list, int num_cores, bool* enabled) {
+    bool all = !list || strcmp(list, "all") == 0;
+    for (int i = 0; i < num_cores; i++) {
+        enabled[i] = all;
+    }
+    if (all || strcmp(list, "none") == 0) return true;
+
+    // Comma-separated core indices and inclusive "first-last" ranges
+    while (*list) {
+        uint64_t first, last;
+        size_t len = strcspn(list, ",");
+        const char* dash = memchr(list, '-', len);
+        char item[32];
+        if (len == 0 || len >= sizeof(item)) return false;
+        memcpy(item, list, len);
+        item[len] = '\0';
+
+        if (dash) {
+            item[dash - list] = ':';
+            if (!parse_range(item, 10, &first, &last)) return false;
+        }
+        else if (!parse_number(item, 10, '\0', &first)) {
+            return false;
+        }
+        else {
+            last = first;
+        }
+        if (last >= (uint64_t)num_cores) return false;
+
+        for (uint64_t i = first; i <= last; i++) {
+            enabled[i] = true;
+        }
+        list += len;
+        if (*list == ',') list++;
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a decimal count, or CORE:PC with the PC in hex
+ * @param value Text to parse
+ * @param core Receives the core, or -1 for a count
+ * @param pc Receives the PC
+ * @param count Receives the count
+ */
+static bool parse_run_point(const char* value, int* core, uint32_t* pc, uint64_t* count) {
+    uint64_t index, address;
+    const char* pc_text = strchr(value, ':') ? parse_number(value, 10, ':', &index) : NULL;
+
+    if (!pc_text) {
+        *core = -1;
+        return parse_number(value, 10, '\0', count) != NULL;
+    }
+    if (!parse_number(pc_text, 16, '\0', &address) || index > INT32_MAX ||
+        address > UINT32_MAX) {
+        return false;
+    }
+    *core = (int)index;
+    *pc = (uint32_t)address;
+    return true;
+}
+
+bool parse_checkpoint_point(const char* value, run_checkpoint_t* point) {
+    return parse_run_point(value, &point->core, &point->pc, &point->cycle);
+}
+
+bool parse_fast_forward_point(const char* value, run_fast_forward_t* point) {
+    point->enabled = parse_run_point(value, &point->core, &point->pc, &point->instructions);
+    return point->enabled;
+}
+
+void run_fast_forward(sim_context_t* sim, const run_fast_forward_t* point) {
+    uint64_t executed = point->core >= 0 ?
+        sim_fast_forward_to_pc(sim, point->core, point->pc, UINT64_MAX, point->warm_caches) :
+        sim_fast_forward(sim, point->instructions, point->warm_caches);
+    printf("Fast-forwarded %llu instructions, detailed simulation resumes at cycle %llu\n",
+        (unsigned long long)executed, (unsigned long long)sim_get_cycle(sim));
+}
+
+bool parse_sample_error(const char* value, run_sample_t* sample) {
+    char* end;
+    double percent = strtod(value, &end);
+    if (end == value || *end != '\0' || !(percent > 0 && percent <= 100)) {
+        return false;
+    }
+    sample->config.error = percent / 100;
+    sample->enabled = true;
+    return true;
+}
+
+bool parse_sample_unit(const char* value, run_sample_t* sample) {
+    uint64_t unit, warmup, period = 0;
+    const char* rest = parse_number(value, 10, ':', &unit);
+    if (!rest || unit == 0) return false;
+
+    // The period is optional
+    const char* period_text = strchr(rest, ':') ? parse_number(rest, 10, ':', &warmup) : NULL;
+    if (period_text ? !parse_number(period_text, 10, '\0', &period) || period == 0 :
+        !parse_number(rest, 10, '\0', &warmup)) {
+        return false;
+    }
+    // Units closer than their own length would leave nothing to fast-forward
+    if (period != 0 && period < unit + warmup) return false;
+
+    sample->config.unit = unit;
+    sample->config.warmup = warmup;
+    sample->config.period = period;
+    return true;
+}
+
+void run_sampled(sim_context_t* sim, const run_sample_t* sample) {
+    sim_sample_config_t config = sample->config;
+    if (config.period == 0) {
+        config.period = SIM_SAMPLE_PERIOD_UNITS * (config.unit + config.warmup);
+    }
+    sim_run_sampled(sim, &config);
+
+    // Report the least certain core
+    sim_sample_estimate_t estimate;
+    sim_get_sample_estimate(sim, 0, &estimate);
+    int units = estimate.units;
+    if (units == 0) {
+        printf("No sample units taken (the program ended during the first warm-up): "
+            "estimate unavailable\n");
+        return;
+    }
+    if (units == 1) {
+        printf("Sampled 1 unit: too few for an error bound, estimate unavailable; "
+            "use a shorter period\n");
+        return;
+    }
+
+    double error = 0;
+    for (int i = 0; i < sim_num_cores(sim); i++) {
+        sim_get_sample_estimate(sim, i, &estimate);
+        if (estimate.cpi > 0 && estimate.cpi_error / estimate.cpi > error) {
+            error = estimate.cpi_error / estimate.cpi;
+        }
+    }
+    printf("Sampled %d units, %llu instructions apart: CPI within %.2f%% (target %.2f%%)\n",
+        units, (unsigned long long)estimate.period, 100 * error, 100 * config.error);
+
+    // The error shrinks with the square root of the number of units
+    if (error > config.error) {
+        double scale = (config.error / error) * (config.error / error);
+        printf("The target needs units about %llu instructions apart\n",
+            (unsigned long long)(estimate.period * scale));
+    }
+}
+
+bool run_to_checkpoint(sim_context_t* sim, const run_checkpoint_t* point) {
+    if (point->core >= 0) {
+        sim_step_to_pc(sim, point->core, point->pc, UINT64_MAX);
+    }
+    else if (point->cycle > sim_get_cycle(sim)) {
+        sim_step(sim, point->cycle - sim_get_cycle(sim));
+    }
+
+    // Failures are reported on the simulation log
+    if (!sim_save_checkpoint(sim, point->file)) {
+        return false;
+    }
+    printf("Checkpoint written to %s at cycle %llu\n", point->file,
+        (unsigned long long)sim_get_cycle(sim));
+    return true;
+}
+
+bool open_trace_files(sim_context_t* sim, const sim_files_t* files, bool binary,
+    const bool* enabled, FILE** core_traces, FILE** bus_trace) {
+    const char* mode = binary ? "wb" : "w";
+    for (int i = 0; i < sim_num_cores(sim); i++) {
+        if (enabled && !enabled[i]) continue;
+        core_traces[i] = fopen(files->core_trace[i], mode);
+        if (!core_traces[i] || !sim_set_core_trace(sim, i, core_traces[i])) {
+            printf("Error: Failed to open core trace file %s\n", files->core_trace[i]);
+            return false;
+        }
+    }
+
+    *bus_trace = fopen(files->bus_trace, mode);
+    if (!*bus_trace || !sim_set_bus_trace(sim, *bus_trace)) {
+        printf("Error: Failed to open bus trace file %s\n", files->bus_trace);
+        return false;
+    }
+    return true;
+}
+
+void close_trace_files(sim_context_t* sim, int num_cores, FILE** core_traces, FILE* bus_trace) {
+    // Binary traces buffer a block inside the simulation
+    if (sim) {
+        sim_flush_traces(sim);
+        for (int i = 0; i < num_cores; i++) {
+            sim_set_core_trace(sim, i, NULL);
+        }
+        sim_set_bus_trace(sim, NULL);
+    }
+
+    for (int i = 0; i < num_cores; i++) {
+        if (core_traces[i]) {
+            fclose(core_traces[i]);
+        }
+    }
+    if (bus_trace) {
+        fclose(bus_trace);
+    }
+}
+
+bool save_output_files(sim_context_t* sim, const sim_files_t* files) {
+    bool ok = sim_save_memory(sim, files->memout);
+    for (int i = 0; i < sim_num_cores(sim) && ok; i++) {
+        ok = sim_save_registers(sim, i, files->regout[i]);
+    }
+    for (int i = 0; i < sim_num_cores(sim) && ok; i++) {
+        ok = sim_save_cache(sim, i, files->dsram[i], files->tsram[i]);
+    }
+    for (int i = 0; i < sim_num_cores(sim) && ok; i++) {
+        ok = sim_save_statistics(sim, i, files->stats[i]);
+    }
+    return ok;
+}
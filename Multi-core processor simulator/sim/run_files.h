@@ -0,0 +1,285 @@
+/**
+ * @file run_files.h
+ * @brief Input/output file naming and result files of a simulation run
+ *
+ * Shared by the single-run command line and the batch runner:
+ * - Mapping of the positional 6N+3 file list onto named groups
+ * - Default file names for any number of cores and directories
+ * - Opening trace files and saving all result files of a run
+ */
+
+#ifndef RUN_FILES_H
+#define RUN_FILES_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "sim.h"
+
+/**
+ * @brief Input/output file names for one simulation run
+ *
+ * The positional command line lists the files in this order (6N+3 names,
+ * which is the original 27-argument form for N = 4).
+ */
+typedef struct {
+    const char** imem;        ///< Instruction memory per core
+    const char* memin;        ///< Initial main memory
+    const char* memout;       ///< Final main memory
+    const char** regout;      ///< Final registers per core
+    const char** core_trace;  ///< Pipeline trace per core
+    const char* bus_trace;    ///< Bus trace
+    const char** dsram;       ///< Final DSRAM per core
+    const char** tsram;       ///< Final TSRAM per core
+    const char** stats;       ///< Statistics per core
+} sim_files_t;
+
+/**
+ * @brief Point of a run at which a checkpoint is written
+ */
+typedef struct {
+    const char* file;     ///< Checkpoint file (NULL = no checkpoint)
+    int core;             ///< Write when this core is about to fetch pc (-1 = at cycle)
+    uint32_t pc;          ///< PC of the core trigger
+    uint64_t cycle;       ///< Global cycle, if there is no core trigger
+} run_checkpoint_t;
+
+/**
+ * @brief Point up to which a run executes functionally
+ */
+typedef struct {
+    bool enabled;          ///< Fast-forward before the detailed run
+    int core;              ///< Stop when this core is about to execute pc (-1 = by count)
+    uint32_t pc;           ///< PC of the core trigger
+    uint64_t instructions; ///< Instructions per core, if there is no core trigger
+    bool warm_caches;      ///< Warm the data caches while fast-forwarding
+} run_fast_forward_t;
+
+/**
+ * @brief Sampling parameters of a run
+ */
+typedef struct {
+    bool enabled;                ///< Sample instead of simulating the rest in detail
+    sim_sample_config_t config;  ///< Unit lengths and error target (period 0 = default)
+} run_sample_t;
+
+/* File Naming */
+
+/**
+ * @brief Map a flat list of 6N+3 file names onto the named groups
+ * @param files Structure to fill
+ * @param list Flat list in command-line order
+ * @param num_cores Number of cores
+ */
+void files_from_list(sim_files_t* files, const char** list, int num_cores);
+
+/**
+ * @brief Build a file name inside a directory
+ * @param dir Directory (NULL or empty for the current directory)
+ * @param name File name pattern, may contain one %d for the core index
+ * @param index Core index substituted into the pattern
+ * @return Newly allocated path
+ */
+char* make_file_name(const char* dir, const char* name, int index);
+
+/**
+ * @brief Generate the default file names for any number of cores
+ * @param config Run parameters; binary trace and result formats are named
+ *               .bin instead of .txt
+ * @param in_dir Directory holding imem*.txt and memin.txt (may be NULL)
+ * @param out_dir Directory receiving all outputs (may be NULL)
+ * @return Newly allocated flat list of 6N+3 names, NULL on failure
+ */
+char** make_default_file_list(const sim_config_t* config, const char* in_dir,
+    const char* out_dir);
+
+/**
+ * @brief Free a list created by make_default_file_list
+ * @param list File list (may be NULL)
+ * @param num_cores Number of cores the list was built for
+ */
+void free_file_list(char** list, int num_cores);
+
+/* Run Setup and Results */
+
+/**
+ * @brief Parse a trace format name
+ * @param name "text", "binary" or "compressed"
+ * @param format Receives the format
+ * @return false on an unknown name
+ */
+bool parse_trace_format(const char* name, sim_trace_format_t* format);
+
+/**
+ * @brief Parse a result file format name
+ * @param name "full", "trim", "sparse" or "binary"
+ * @param format Receives the format
+ * @return false on an unknown name
+ */
+bool parse_dump_format(const char* name, sim_dump_format_t* format);
+
+/**
+ * @brief Parse a cache replacement policy name
+ * @param name "lru", "plru", "random" or "rrip"
+ * @param policy Receives the policy
+ * @return false on an unknown name
+ */
+bool parse_cache_policy(const char* name, sim_cache_policy_t* policy);
+
+/**
+ * @brief Parse the back-pressure policy of the background trace writer
+ * @param name "block" or "drop"
+ * @param mode Receives the matching asynchronous trace mode
+ * @return false on an unknown name
+ */
+bool parse_trace_mode(const char* name, sim_trace_mode_t* mode);
+
+/**
+ * @brief Parse one trace filter option
+ * @param name Option name without the leading dash: "trace-window" (START:STOP
+ *             cycles), "trace-on-pc" (CORE:PC), "trace-on-addr" (ADDR),
+ *             "trace-bus-cmd" (rd,rdx,flush or none) or "trace-bus-addr" (LO:HI)
+ * @param value Option value; PCs and addresses are hexadecimal
+ * @param filter Filter to update
+ * @return false on an unknown name or a malformed value
+ */
+bool parse_trace_filter_option(const char* name, const char* value, sim_trace_filter_t* filter);
+
+/**
+ * @brief Check whether a name is one of the settings of parse_config_option
+ * @param name Setting name without a leading dash
+ */
+bool is_config_option(const char* name);
+
+/**
+ * @brief Parse one system parameter
+ * @param name "cores", "threads", "memory-bits", "cache-size", "block-size",
+ *             "cache-ways", "cache-policy", "protocol" (mesi or moesi),
+ *             "bus" (atomic or split), "memory-delay", "bus-delay",
+ *             "imem-size", "store-buffer", "mshrs", "prefetch" (none,
+ *             next-line, stride or stream), "prefetch-degree",
+ *             "forwarding" (0 or 1), "event" (0 or 1) or "kernel" (auto or
+ *             generic)
+ * @param value Option value in decimal, or a name for cache-policy, protocol,
+ *              bus, prefetch and kernel
+ * @param config Configuration to update
+ * @return false on an unknown name or a malformed value; the combination is
+ *         checked by sim_config_error
+ */
+bool parse_config_option(const char* name, const char* value, sim_config_t* config);
+
+/**
+ * @brief Apply the settings of a configuration file
+ * @param filename File of "name = value" lines with parse_config_option
+ *                 names; '#' starts a comment
+ * @param config Configuration to update
+ * @return false if the file could not be read or has an invalid line
+ *         (reported on stdout)
+ */
+bool load_config_file(const char* filename, sim_config_t* config);
+
+/**
+ * @brief Parse the list of cores whose pipeline trace is written
+ * @param list "all", "none" or indices and ranges such as "0,2-3" (NULL = all)
+ * @param num_cores Number of cores
+ * @param enabled Array receiving one flag per core
+ * @return false on a malformed list or a core index out of range
+ */
+bool parse_core_list(const char* list, int num_cores, bool* enabled);
+
+/**
+ * @brief Parse the point at which a checkpoint is written
+ * @param value Global cycle in decimal, or CORE:PC (PC in hex)
+ * @param point Receives the cycle or the core trigger
+ * @return false on a malformed value
+ */
+bool parse_checkpoint_point(const char* value, run_checkpoint_t* point);
+
+/**
+ * @brief Run up to the checkpoint point and write the checkpoint
+ * @param sim Simulation context
+ * @param point Checkpoint point and file
+ * @return false if the checkpoint could not be written
+ *
+ * A run that finishes before the point writes its final state.
+ */
+bool run_to_checkpoint(sim_context_t* sim, const run_checkpoint_t* point);
+
+/**
+ * @brief Parse the point up to which a run is fast-forwarded
+ * @param value Instructions per core in decimal, or CORE:PC (PC in hex)
+ * @param point Receives the count or the core trigger, and is enabled
+ * @return false on a malformed value
+ */
+bool parse_fast_forward_point(const char* value, run_fast_forward_t* point);
+
+/**
+ * @brief Execute functionally up to the fast-forward point
+ * @param sim Simulation context
+ * @param point Fast-forward point
+ *
+ * The number of instructions executed and the cycle at which detailed
+ * simulation resumes are reported on stdout.
+ */
+void run_fast_forward(sim_context_t* sim, const run_fast_forward_t* point);
+
+/**
+ * @brief Parse the error target of a sampled run
+ * @param value Relative CPI error in percent, above 0 and at most 100
+ * @param sample Receives the target, and is enabled
+ * @return false on a malformed value
+ */
+bool parse_sample_error(const char* value, run_sample_t* sample);
+
+/**
+ * @brief Parse the unit, warm-up and period lengths of a sampled run
+ * @param value UNIT:WARMUP or UNIT:WARMUP:PERIOD in instructions per core,
+ *              UNIT at least 1 and PERIOD at least UNIT + WARMUP
+ * @param sample Receives the lengths (period 0 if not given)
+ * @return false on a malformed value or a period shorter than a unit
+ *         with its warm-up
+ */
+bool parse_sample_unit(const char* value, run_sample_t* sample);
+
+/**
+ * @brief Run to completion in sampling mode
+ * @param sim Simulation context
+ * @param sample Sampling parameters
+ *
+ * The number of units and the largest CPI error over the cores are
+ * reported on stdout, with the period that would meet a missed target,
+ * or that there is no estimate because fewer than two units were taken;
+ * the estimates go to the statistics files.
+ */
+void run_sampled(sim_context_t* sim, const run_sample_t* sample);
+
+/**
+ * @brief Open trace files and attach them to the simulation
+ * @param sim Simulation context
+ * @param files Run file names
+ * @param binary Open the files for a binary trace format
+ * @param enabled Cores whose trace file is opened (NULL = all)
+ * @param core_traces Array receiving the opened core trace files
+ * @param bus_trace Receives the opened bus trace file
+ * @return true if successful, false on error
+ */
+bool open_trace_files(sim_context_t* sim, const sim_files_t* files, bool binary,
+    const bool* enabled, FILE** core_traces, FILE** bus_trace);
+
+/**
+ * @brief Detach trace files from the simulation and close them
+ * @param sim Simulation context the files are attached to (may be NULL)
+ * @param num_cores Number of cores
+ * @param core_traces Core trace files (entries may be NULL)
+ * @param bus_trace Bus trace file (may be NULL)
+ */
+void close_trace_files(sim_context_t* sim, int num_cores, FILE** core_traces, FILE* bus_trace);
+
+/**
+ * @brief Save final memory, registers, caches and statistics
+ * @param sim Simulation context
+ * @param files Run file names
+ * @return true if successful, false on error
+ */
+bool save_output_files(sim_context_t* sim, const sim_files_t* files);
+
+#endif /* RUN_FILES_H */
@@ -0,0 +1,138 @@
+/**
+ * @file sample.c
+ * @brief Implementation of the sampled-simulation statistics
+ *
+ * Both ratios use the ratio estimator R = sum(y) / sum(x). Its standard
+ * error is the standard deviation of the residuals y - R * x divided by
+ * the mean x and the square root of the number of units, which also
+ * covers units of different sizes and units in which a core was halted.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sample.h"
+
+/**
+ * @brief Add one unit's x and y to a set of sums
+ */
+static void add_sums(sample_sums_t* sums, double x, double y) {
+    sums->x += x;
+    sums->y += y;
+    sums->xx += x * x;
+    sums->xy += x * y;
+    sums->yy += y * y;
+}
+
+/**
+ * @brief Evaluate a ratio estimator
+ * @param sums Sums over the units
+ * @param n Number of units
+ * @param error Receives the confidence half-width (HUGE_VAL below two units)
+ * @return The ratio (0 if x is zero in every unit)
+ */
+static double ratio(const sample_sums_t* sums, int n, double* error) {
+    if (sums->x <= 0) {
+        *error = 0;
+        return 0;
+    }
+    double r = sums->y / sums->x;
+    if (n < 2) {
+        *error = HUGE_VAL;
+        return r;
+    }
+
+    // Sum of squared residuals; rounding may take it just below zero
+    double residuals = sums->yy - 2 * r * sums->xy + r * r * sums->xx;
+    if (residuals < 0) residuals = 0;
+    *error = SAMPLE_Z * sqrt(residuals / (n - 1) * n) / sums->x;
+    return r;
+}
+
+/**
+ * @brief Add a unit to the running sums of every core
+ * @param sampler Sampler
+ * @param units The unit's entries
+ * @param even The unit is even-numbered
+ */
+static void add_unit(sampler_t* sampler, const sample_unit_t* units, bool even) {
+    for (int i = 0; i < sampler->num_cores; i++) {
+        sample_core_t* core = &sampler->cores[i];
+        const sample_unit_t* unit = &units[i];
+        add_sums(&core->cpi, unit->instructions, unit->cycles);
+        add_sums(&core->miss, unit->accesses, unit->misses);
+        if (even) {
+            add_sums(&core->half_cpi, unit->instructions, unit->cycles);
+        }
+    }
+}
+
+bool sample_init(sampler_t* sampler, int num_cores) {
+    memset(sampler, 0, sizeof(*sampler));
+    sampler->num_cores = num_cores;
+    sampler->cores = (sample_core_t*)calloc(num_cores, sizeof(sample_core_t));
+    return sampler->cores != NULL;
+}
+
+void sample_free(sampler_t* sampler) {
+    free(sampler->units);
+    free(sampler->cores);
+    sampler->units = NULL;
+    sampler->cores = NULL;
+}
+
+void sample_reset(sampler_t* sampler) {
+    sampler->count = 0;
+    memset(sampler->cores, 0, sampler->num_cores * sizeof(sample_core_t));
+}
+
+bool sample_add(sampler_t* sampler, const sample_unit_t* units) {
+    if (sampler->count == sampler->capacity) {
+        int capacity = sampler->capacity ? 2 * sampler->capacity : 2 * SAMPLE_MIN_UNITS;
+        sample_unit_t* grown = (sample_unit_t*)realloc(sampler->units,
+            (size_t)capacity * sampler->num_cores * sizeof(sample_unit_t));
+        if (!grown) return false;
+        sampler->units = grown;
+        sampler->capacity = capacity;
+    }
+
+    memcpy(&sampler->units[(size_t)sampler->count * sampler->num_cores], units,
+        sampler->num_cores * sizeof(sample_unit_t));
+    add_unit(sampler, units, sampler->count % 2 == 0);
+    sampler->count++;
+    return true;
+}
+
+double sample_cpi_error(const sampler_t* sampler, bool half) {
+    int n = half ? (sampler->count + 1) / 2 : sampler->count;
+    double worst = 0;
+
+    for (int i = 0; i < sampler->num_cores; i++) {
+        const sample_core_t* core = &sampler->cores[i];
+        double error;
+        double cpi = ratio(half ? &core->half_cpi : &core->cpi, n, &error);
+        if (cpi > 0 && error / cpi > worst) {
+            worst = error / cpi;
+        }
+    }
+    return n < 2 ? HUGE_VAL : worst;
+}
+
+void sample_thin(sampler_t* sampler) {
+    int kept = (sampler->count + 1) / 2;
+    size_t width = sampler->num_cores;
+
+    sample_reset(sampler);
+    for (int u = 0; u < kept; u++) {
+        sample_unit_t* unit = &sampler->units[u * width];
+        memmove(unit, &sampler->units[2 * u * width], width * sizeof(sample_unit_t));
+        add_unit(sampler, unit, u % 2 == 0);
+    }
+    sampler->count = kept;
+}
+
+void sample_estimate(const sampler_t* sampler, int core, sample_estimate_t* estimate) {
+    const sample_core_t* sums = &sampler->cores[core];
+    estimate->cpi = ratio(&sums->cpi, sampler->count, &estimate->cpi_error);
+    estimate->miss_rate = ratio(&sums->miss, sampler->count, &estimate->miss_rate_error);
+}
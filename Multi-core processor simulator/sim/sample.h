@@ -0,0 +1,134 @@
+/**
+ * @file sample.h
+ * @brief Statistics of a sampled simulation
+ *
+ * A sampled run simulates short units in detail, spread evenly over the
+ * program (systematic sampling, as in SMARTS), and executes the rest
+ * functionally. Each unit contributes every core's cycles, instructions,
+ * cache accesses and misses. CPI and the miss rate are estimated as ratios
+ * over all units, with a confidence interval from the spread of the units
+ * around that ratio.
+ *
+ * Running sums are kept both over all units and over the even-numbered
+ * ones, so the error with every other unit dropped is known at any time:
+ * once it meets the target, sample_thin drops those units and the caller
+ * doubles its sampling period.
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SAMPLE_MIN_UNITS 30  ///< Fewest units an estimate is thinned to
+#define SAMPLE_Z 3.0         ///< Standard errors per confidence half-width (99.7%)
+
+/**
+ * @brief What one core did during one unit
+ */
+typedef struct {
+    uint32_t cycles;        ///< Cycles clocked
+    uint32_t instructions;  ///< Instructions fetched
+    uint32_t accesses;      ///< Data cache reads and writes
+    uint32_t misses;        ///< Of those, misses
+} sample_unit_t;
+
+/**
+ * @brief Sums of a ratio estimator y / x over a set of units
+ */
+typedef struct {
+    double x;    ///< Sum of x
+    double y;    ///< Sum of y
+    double xx;   ///< Sum of x * x
+    double xy;   ///< Sum of x * y
+    double yy;   ///< Sum of y * y
+} sample_sums_t;
+
+/**
+ * @brief Running sums of one core
+ */
+typedef struct {
+    sample_sums_t cpi;       ///< Cycles over instructions, all units
+    sample_sums_t miss;      ///< Misses over accesses, all units
+    sample_sums_t half_cpi;  ///< Cycles over instructions, even units
+} sample_core_t;
+
+/**
+ * @brief Units recorded so far
+ */
+typedef struct {
+    int num_cores;          ///< Cores per unit
+    int count;              ///< Units recorded
+    int capacity;           ///< Units allocated
+    sample_unit_t* units;   ///< Unit u of core i at units[u * num_cores + i]
+    sample_core_t* cores;   ///< Running sums per core
+} sampler_t;
+
+/**
+ * @brief Estimate of one core's behaviour over the whole run
+ */
+typedef struct {
+    double cpi;              ///< Cycles per instruction
+    double cpi_error;        ///< Half-width of its confidence interval
+    double miss_rate;        ///< Data cache misses per access
+    double miss_rate_error;  ///< Half-width of its confidence interval
+} sample_estimate_t;
+
+/**
+ * @brief Initialize an empty sampler
+ * @param sampler Sampler
+ * @param num_cores Cores per unit
+ * @return false if the per-core sums could not be allocated
+ */
+bool sample_init(sampler_t* sampler, int num_cores);
+
+/**
+ * @brief Free the units and sums
+ * @param sampler Sampler (may be zero-filled and never initialized)
+ */
+void sample_free(sampler_t* sampler);
+
+/**
+ * @brief Drop every unit
+ * @param sampler Sampler
+ */
+void sample_reset(sampler_t* sampler);
+
+/**
+ * @brief Record a unit
+ * @param sampler Sampler
+ * @param units What each core did, num_cores entries
+ * @return false if the unit could not be stored
+ */
+bool sample_add(sampler_t* sampler, const sample_unit_t* units);
+
+/**
+ * @brief Largest relative CPI error over the cores
+ * @param sampler Sampler
+ * @param half Use the even-numbered units only
+ * @return Confidence half-width over CPI of the least certain core
+ *         (HUGE_VAL with fewer than two units)
+ *
+ * Cores that executed nothing in the units are ignored.
+ */
+double sample_cpi_error(const sampler_t* sampler, bool half);
+
+/**
+ * @brief Drop the odd-numbered units
+ * @param sampler Sampler with an even number of units
+ *
+ * The kept units are every other one of the old spacing, so they sample
+ * the program evenly at twice the period.
+ */
+void sample_thin(sampler_t* sampler);
+
+/**
+ * @brief Estimate CPI and miss rate of a core
+ * @param sampler Sampler
+ * @param core Core index
+ * @param estimate Receives the ratios and their confidence half-widths
+ */
+void sample_estimate(const sampler_t* sampler, int core, sample_estimate_t* estimate);
+
+#endif /* SAMPLE_H */
@@ -0,0 +1,1333 @@
+/**
+ * @file sim.c
+ * @brief Implementation of the embeddable simulator library
+ *
+ * Each cycle is clocked in the same order as the original main loop:
+ * 1. Main memory checks the bus and responds
+ * 2. The bus arbitrates and drives the next transaction
+ * 3. Every cache snoops/handles responses and every core runs its pipeline
+ * 4. The bus trace is written and the shared line is clocked
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "core.h"
+#include "bus_system.h"
+#include "main_memory.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "trace_queue.h"
+#include "dump.h"
+#include "checkpoint.h"
+#include "sample.h"
+
+/**
+ * @brief Complete state of one simulated system
+ */
+struct sim_context {
+    sim_config_t config;      ///< Parameters given at creation
+    bus_system_t bus;         ///< System bus
+    main_memory_t* mem;       ///< Main memory
+    core_t* cores;            ///< Cache-line aligned array of cores
+    thread_pool_t* pool;      ///< Host threads clocking the cores
+    sim_load_status_t load_status;  ///< Result of the last file load
+
+    /* Output Streams (owned by the caller) */
+    FILE* log;                ///< Errors and diagnostics (may be NULL)
+    FILE** core_traces;       ///< Pipeline trace per core (entries may be NULL)
+    FILE* bus_trace;          ///< Bus trace (may be NULL)
+
+    /* Binary Trace Encoders (NULL for text traces) */
+    trace_writer_t** core_writers;  ///< Encoder per core trace
+    trace_writer_t* bus_writer;     ///< Encoder of the bus trace
+    trace_queue_t* trace_queue;     ///< Background writer (NULL = synchronous)
+
+    /* Trace Control */
+    sim_trace_filter_t trace_filter;  ///< Window, triggers and bus filters
+    bool trace_triggered;             ///< A trigger has fired (or none is set)
+    bool trace_active;                ///< Current cycle is traced
+
+    /* Sampled Execution */
+    sampler_t sampler;        ///< Units of the last sampled run (allocated by the first)
+    uint64_t sample_period;   ///< Final distance between its units
+};
+
+/* Trace Output */
+
+/**
+ * @brief Capture the traced pipeline and register state of a core
+ * @param rec Record to fill
+ * @param core Processor core
+ */
+static void read_core_trace(core_trace_record_t* rec, core_t* core) {
+    rec->cycle = core->cycles;
+    const Pipeline_State* state = core->pipe.cur;
+    rec->pc[0] = state->pc;
+    rec->pc[1] = state->if_id.pc;
+    rec->pc[2] = state->id_ex.pc;
+    rec->pc[3] = state->ex_mem.pc;
+    rec->pc[4] = state->mem_wb.pc;
+    for (int r = 2; r < 16; r++) {
+        rec->regs[r - 2] = state->registers[r];
+    }
+}
+
+/**
+ * @brief Write the trace lines of a core for a number of unchanged cycles
+ * @param sim Simulation context
+ * @param i Core index
+ * @param count Number of cycles (1 for a regular clock cycle)
+ *
+ * The state is captured once; the cycle number advances per line. In the
+ * asynchronous modes the record is only queued for the writer thread.
+ */
+static void write_core_trace(sim_context_t* sim, int i, int count) {
+    core_trace_record_t rec;
+    read_core_trace(&rec, &sim->cores[i]);
+
+    if (sim->trace_queue) {
+        trace_queue_push_core(sim->trace_queue, i, &rec, count);
+    }
+    else {
+        trace_emit_core(sim->core_traces[i], sim->core_writers[i], &rec, count);
+    }
+}
+
+/**
+ * @brief Write the bus trace line of the current transaction
+ * @param sim Simulation context
+ */
+static void write_bus_trace(sim_context_t* sim) {
+    bus_system_t* bus = &sim->bus;
+    bus_trace_record_t rec;
+    rec.cycle = bus->global_cycles;
+    rec.origid = bus->bus_origid;
+    rec.cmd = bus->bus_cmd;
+    rec.addr = bus->bus_addr;
+    rec.data = bus->bus_data;
+    rec.shared = bus->bus_shared.Q;
+
+    if (sim->trace_queue) {
+        trace_queue_push_bus(sim->trace_queue, sim->config.num_cores, &rec);
+    }
+    else {
+        trace_emit_bus(sim->bus_trace, sim->bus_writer, &rec);
+    }
+}
+
+/* Trace Control */
+
+/**
+ * @brief Check the triggers and decide whether the current cycle is traced
+ * @param sim Simulation context
+ *
+ * Called once per cycle after the bus has been clocked, so the new bus
+ * transaction and every core's fetch PC for this cycle are visible. Trace
+ * records are only built while tracing is active.
+ */
+static void update_trace_state(sim_context_t* sim) {
+    const sim_trace_filter_t* filter = &sim->trace_filter;
+    bus_system_t* bus = &sim->bus;
+
+    if (!sim->trace_triggered) {
+        if (filter->trigger_core >= 0 && filter->trigger_core < bus->num_cores &&
+            sim->cores[filter->trigger_core].pipe.cur->pc == filter->trigger_pc) {
+            sim->trace_triggered = true;
+        }
+        if (filter->trigger_on_addr && bus->new_request && bus->bus_cmd != BUS_NO_CMD &&
+            bus->bus_addr == filter->trigger_addr) {
+            sim->trace_triggered = true;
+        }
+    }
+
+    uint64_t cycle = (uint64_t)bus->global_cycles;
+    sim->trace_active = sim->trace_triggered &&
+        cycle >= filter->start_cycle && cycle < filter->stop_cycle;
+}
+
+/**
+ * @brief Check whether the current bus transaction passes the bus filters
+ * @param sim Simulation context
+ */
+static bool bus_trace_selected(sim_context_t* sim) {
+    const sim_trace_filter_t* filter = &sim->trace_filter;
+    bus_system_t* bus = &sim->bus;
+
+    return ((filter->bus_cmds >> bus->bus_cmd) & 1) &&
+        bus->bus_addr >= filter->bus_addr_min && bus->bus_addr <= filter->bus_addr_max;
+}
+
+/* Event-Driven Execution */
+
+/**
+ * @brief Skip cycles in which no component can change state
+ * @param sim Simulation context
+ * @param max_cycles Upper bound on the number of cycles to skip
+ * @return Number of cycles skipped (0 if the system is not quiescent)
+ *
+ * While every core is frozen on a cache miss and main memory is only
+ * counting down its response delay, each cycle repeats the previous one except
+ * for counters. Those counters and the repeated trace lines are produced in
+ * bulk so the output is identical to running the cycles one by one.
+ */
+static int skip_quiescent_cycles(sim_context_t* sim, uint64_t max_cycles) {
+    bus_system_t* bus = &sim->bus;
+    uint32_t idle = memory_idle_cycles(sim->mem, bus);
+    if (idle == 0 || !bus_is_quiescent(bus)) {
+        return 0;
+    }
+
+    for (int i = 0; i < bus->num_cores; i++) {
+        if (!core_is_frozen(&sim->cores[i])) {
+            return 0;
+        }
+    }
+
+    int count = (int)(idle < max_cycles ? idle : max_cycles);
+
+    // Tracing can only switch on or off at a window boundary; no trigger
+    // can fire while every core is frozen and the bus is idle
+    uint64_t cycle = (uint64_t)bus->global_cycles;
+    const sim_trace_filter_t* filter = &sim->trace_filter;
+    if (cycle < filter->start_cycle && filter->start_cycle - cycle < (uint64_t)count) {
+        count = (int)(filter->start_cycle - cycle);
+    }
+    else if (cycle < filter->stop_cycle && filter->stop_cycle - cycle < (uint64_t)count) {
+        count = (int)(filter->stop_cycle - cycle);
+    }
+    update_trace_state(sim);
+
+    for (int i = 0; i < bus->num_cores; i++) {
+        core_t* core = &sim->cores[i];
+        if (core_is_done(core)) {
+            continue;
+        }
+
+        // Trace state is identical for the whole stretch
+        if (sim->trace_active && sim->core_traces[i]) {
+            write_core_trace(sim, i, count);
+        }
+        core_skip_cycles(core, count);
+    }
+
+    memory_skip_cycles(sim->mem, (uint32_t)count);
+    bus->global_cycles += count;
+    return count;
+}
+
+/* Parallel Core Execution */
+
+/**
+ * @brief Run caches and pipelines of one worker's share of the cores
+ * @param arg Simulation context
+ * @param worker Worker index
+ * @param num_workers Number of workers
+ *
+ * A core's cache and pipeline only touch that core, its own bus port and
+ * read-only bus state, so cores can be clocked in any order or in parallel
+ * once memory and the bus have been clocked for the cycle.
+ */
+static void run_core_phase(void* arg, int worker, int num_workers) {
+    sim_context_t* sim = (sim_context_t*)arg;
+    bus_system_t* bus = &sim->bus;
+    int first = bus->num_cores * worker / num_workers;
+    int last = bus->num_cores * (worker + 1) / num_workers;
+
+    for (int i = first; i < last; i++) {
+        core_t* core = &sim->cores[i];
+
+        // Cache snoops the bus and handles responses
+        cache_bus_cycle(&core->cache, bus);
+
+        // Pipeline runs and logs its trace
+        if (sim->trace_active && sim->core_traces[i] &&
+            !core_is_done(core)) {
+            write_core_trace(sim, i, 1);
+        }
+        core_clock(core, bus);
+    }
+}
+
+/**
+ * @brief Simulate one clock cycle of the whole system
+ * @param sim Simulation context
+ */
+static void clock_cycle(sim_context_t* sim) {
+    bus_system_t* bus = &sim->bus;
+
+    // 1. Memory checks bus and responds
+    memory_clock(sim->mem, bus);
+
+    // 2. Update bus state
+    bus_clock(bus);
+    update_trace_state(sim);
+
+    // 3. Run cache operations, cores and core traces (possibly in parallel)
+    thread_pool_run(sim->pool, run_core_phase, sim);
+
+    // Log bus activity
+    if (bus->bus_cmd != BUS_NO_CMD && bus->new_request) {
+        if (sim->trace_active && sim->bus_trace && bus_trace_selected(sim)) {
+            write_bus_trace(sim);
+        }
+        bus->new_request = false;
+    }
+
+    bus_latch_shared(bus);
+    bus->global_cycles++;
+}
+
+/* Functional Execution */
+
+/**
+ * @brief Update the data caches for a functional load or store
+ * @param arg Simulation context
+ * @param core_id Accessing core
+ * @param addr Word address
+ * @param is_write True for a store
+ *
+ * Other caches are only looked at when the access would have gone to the
+ * bus: on a miss, or on a store to a block that may be shared.
+ */
+static void warm_caches(void* arg, int core_id, uint32_t addr, bool is_write) {
+    sim_context_t* sim = (sim_context_t*)arg;
+    cache_t* cache = &sim->cores[core_id].cache;
+    bool shared = false;
+
+    if (cache_warm_needs_snoop(cache, addr, is_write)) {
+        for (int i = 0; i < sim->config.num_cores; i++) {
+            if (i != core_id && cache_warm_snoop(&sim->cores[i].cache, addr, is_write)) {
+                shared = true;
+            }
+        }
+    }
+    cache_warm_access(cache, sim->mem, addr, is_write, shared);
+}
+
+/**
+ * @brief Check whether the detailed model has nothing in flight
+ * @param sim Simulation context
+ */
+static bool is_drained(sim_context_t* sim) {
+    for (int i = 0; i < sim->config.num_cores; i++) {
+        if (!core_is_drained(&sim->cores[i])) {
+            return false;
+        }
+    }
+    return bus_is_idle(&sim->bus);
+}
+
+/**
+ * @brief Complete the instructions in flight and bring main memory up to date
+ * @param sim Simulation context
+ * @param warm_caches Keep the cache contents; otherwise the caches are emptied
+ */
+static void enter_functional(sim_context_t* sim, bool warm_caches) {
+    for (int i = 0; i < sim->config.num_cores; i++) {
+        sim->cores[i].draining = true;
+    }
+    while (!is_drained(sim)) {
+        clock_cycle(sim);
+    }
+    for (int i = 0; i < sim->config.num_cores; i++) {
+        sim->cores[i].draining = false;
+        cache_write_back(&sim->cores[i].cache, sim->mem, !warm_caches);
+    }
+}
+
+/**
+ * @brief Execute all cores functionally, round-robin
+ * @param sim Simulation context
+ * @param count Most instructions per core
+ * @param stop_core Core whose stop_pc ends the run (-1 = none)
+ * @param stop_pc PC before which stop_core stops
+ * @param warm Warm the caches
+ * @return Instructions executed by all cores together
+ */
+static uint64_t run_functional(sim_context_t* sim, uint64_t count, int stop_core,
+    uint32_t stop_pc, bool warm) {
+    if (sim_is_done(sim)) {
+        return 0;
+    }
+    enter_functional(sim, warm);
+
+    uint64_t total = 0;
+    for (uint64_t issued = 0; issued < count;) {
+        uint64_t step = count - issued < SIM_FUNCTIONAL_QUANTUM ?
+            count - issued : SIM_FUNCTIONAL_QUANTUM;
+        bool running = false;
+        for (int i = 0; i < sim->config.num_cores; i++) {
+            core_t* core = &sim->cores[i];
+            if (core->halted) continue;
+
+            uint64_t done = core_run_functional(core, sim->mem, step,
+                i == stop_core ? stop_pc : CORE_NO_PC, warm ? warm_caches : NULL, sim);
+            total += done;
+
+            // The stop PC ends the run for every core; so does halting before it
+            if (i == stop_core && (done < step || core->halted)) {
+                return total;
+            }
+            running = running || !core->halted;
+        }
+        if (!running) break;
+        issued += step;
+    }
+    return total;
+}
+
+/* Sampled Execution */
+
+/**
+ * @brief Read the counters a sample unit is measured with
+ * @param sim Simulation context
+ * @param counters Receives the current counters of every core
+ */
+static void read_sample_counters(sim_context_t* sim, sample_unit_t* counters) {
+    for (int i = 0; i < sim->config.num_cores; i++) {
+        const core_t* core = &sim->cores[i];
+        const cache_t* cache = &core->cache;
+        counters[i].cycles = (uint32_t)core->cycles;
+        counters[i].instructions = (uint32_t)core->instructions;
+        counters[i].misses = (uint32_t)(cache->read_miss + cache->write_miss);
+        counters[i].accesses = counters[i].misses + (uint32_t)(cache->read_hit + cache->write_hit);
+    }
+}
+
+/**
+ * @brief Simulate in detail until the cores have fetched a number of instructions
+ * @param sim Simulation context
+ * @param instructions Instructions per core still running, on average
+ */
+static void run_detailed(sim_context_t* sim, uint64_t instructions) {
+    uint64_t running = 0;
+    uint64_t start = 0;
+    for (int i = 0; i < sim->config.num_cores; i++) {
+        running += !sim->cores[i].halted;
+        start += (uint32_t)sim->cores[i].instructions;
+    }
+
+    uint64_t target = instructions * running;
+    for (;;) {
+        uint64_t fetched = 0;
+        for (int i = 0; i < sim->config.num_cores; i++) {
+            fetched += (uint32_t)sim->cores[i].instructions;
+        }
+        fetched -= start;
+        if (fetched >= target) break;
+
+        // No core fetches more than one instruction per cycle
+        if (sim_step(sim, (target - fetched + running - 1) / running) == 0) break;
+    }
+}
+
+/* Lifetime */
+
+void sim_config_default(sim_config_t* config) {
+    config->num_cores = 4;
+    config->num_threads = 1;
+    config->memory_bits = MEMORY_DEFAULT_BITS;
+    config->cache_size = CACHE_DEFAULT_SIZE;
+    config->block_size = BLOCK_DEFAULT_SIZE;
+    config->cache_ways = 1;
+    config->cache_policy = SIM_CACHE_LRU;
+    config->protocol = SIM_MESI;
+    config->bus_mode = SIM_BUS_ATOMIC;
+    config->memory_delay = MEMORY_DEFAULT_DELAY;
+    config->bus_delay = BUS_DEFAULT_DELAY;
+    config->imem_size = IMEM_DEFAULT_SIZE;
+    config->store_buffer = 0;
+    config->mshrs = 0;
+    config->prefetch = SIM_PREFETCH_NONE;
+    config->prefetch_degree = 2;
+    config->forwarding = false;
+    config->event_driven = false;
+    config->generic_kernel = false;
+    config->trace_format = SIM_TRACE_TEXT;
+    config->trace_mode = SIM_TRACE_SYNC;
+    config->trace_buffer = TRACE_QUEUE_DEFAULT_CAPACITY;
+    sim_trace_filter_default(&config->trace_filter);
+    config->dump_format = SIM_DUMP_FULL;
+}
+
+/**
+ * @brief Get the data cache organization of a configuration
+ * @param config Simulation parameters
+ * @param geometry Receives the organization
+ */
+static void get_cache_geometry(const sim_config_t* config, cache_geometry_t* geometry) {
+    geometry->size = config->cache_size;
+    geometry->block_size = config->block_size;
+    geometry->ways = config->cache_ways;
+    geometry->policy = (cache_policy_t)config->cache_policy;
+}
+
+const char* sim_config_error(const sim_config_t* config) {
+    if (config->num_cores < 1 || config->num_cores > BUS_MAX_CORES) {
+        return "Core count must be 1 to 1024";
+    }
+    if (config->num_threads < 1) {
+        return "Thread count must be at least 1";
+    }
+    if (config->memory_bits < MEMORY_MIN_BITS || config->memory_bits > MEMORY_MAX_BITS) {
+        return "Memory address width must be 10 to 32 bits";
+    }
+
+    cache_geometry_t geometry;
+    get_cache_geometry(config, &geometry);
+    const char* error = cache_geometry_error(&geometry);
+    if (error) return error;
+    if (config->memory_bits < 32 && (uint64_t)config->cache_size > (uint64_t)1 << config->memory_bits) {
+        return "Cache must not be larger than main memory";
+    }
+
+    if (config->protocol != SIM_MESI && config->protocol != SIM_MOESI) {
+        return "Unknown coherence protocol";
+    }
+    if (config->bus_mode != SIM_BUS_ATOMIC && config->bus_mode != SIM_BUS_SPLIT) {
+        return "Unknown bus mode";
+    }
+    if (config->memory_delay < 0 || config->memory_delay > SIM_MAX_DELAY) {
+        return "Memory delay must be 0 to 1048576 cycles";
+    }
+    if (config->bus_delay < 0 || config->bus_delay > SIM_MAX_DELAY) {
+        return "Bus delay must be 0 to 1048576 cycles";
+    }
+    if (config->imem_size < 1 || config->imem_size > IMEM_MAX_SIZE ||
+        (config->imem_size & (config->imem_size - 1)) != 0) {
+        return "Instruction memory size must be a power of two up to 1M words";
+    }
+    if (config->store_buffer < 0 || config->store_buffer > STORE_BUFFER_MAX) {
+        return "Store buffer must hold 0 to 64 stores";
+    }
+    if (config->mshrs < 0 || config->mshrs > CACHE_MAX_MSHRS) {
+        return "MSHRs must number 0 to 16";
+    }
+    if (config->prefetch != SIM_PREFETCH_NONE && config->mshrs == 0) {
+        return "Prefetching needs MSHRs";
+    }
+    if (config->prefetch_degree < 1 || config->prefetch_degree > PREFETCH_MAX_DEGREE) {
+        return "Prefetch degree must be 1 to 8";
+    }
+    if (config->trace_mode != SIM_TRACE_SYNC && config->trace_buffer < 1) {
+        return "Trace buffer must hold at least 1 record";
+    }
+    return NULL;
+}
+
+sim_context_t* sim_create(const sim_config_t* config) {
+    if (sim_config_error(config)) {
+        return NULL;
+    }
+
+    sim_context_t* sim = (sim_context_t*)calloc(1, sizeof(sim_context_t));
+    if (!sim) return NULL;
+    sim->config = *config;
+
+    // More threads than cores would only add synchronization
+    if (sim->config.num_threads > sim->config.num_cores) {
+        sim->config.num_threads = sim->config.num_cores;
+    }
+
+    int num_cores = sim->config.num_cores;
+    bool split = sim->config.bus_mode == SIM_BUS_SPLIT;
+
+    // Only a split bus carries several misses of one cache at once
+    int outstanding = split && sim->config.mshrs > 0 ? sim->config.mshrs : 1;
+    sim->mem = (main_memory_t*)calloc(1, sizeof(main_memory_t));
+    sim->cores = (core_t*)sim_aligned_alloc(num_cores * sizeof(core_t), SIM_CACHE_LINE);
+    if (sim->cores) {
+        memset(sim->cores, 0, num_cores * sizeof(core_t));
+    }
+    sim->core_traces = (FILE**)calloc(num_cores, sizeof(FILE*));
+    sim->core_writers = (trace_writer_t**)calloc(num_cores, sizeof(trace_writer_t*));
+    if (!sim->mem || !sim->cores || !sim->core_traces || !sim->core_writers ||
+        !memory_init(sim->mem, sim->config.memory_bits, sim->config.memory_delay) ||
+        (split && !memory_enable_split(sim->mem, num_cores, outstanding)) ||
+        !bus_init(&sim->bus, num_cores, sim->config.block_size, sim->config.bus_delay, split,
+            outstanding)) {
+        sim_destroy(sim);
+        return NULL;
+    }
+
+    sim->pool = thread_pool_create(sim->config.num_threads);
+    if (!sim->pool) {
+        sim_destroy(sim);
+        return NULL;
+    }
+
+    // One ring per core trace plus one for the bus trace
+    if (sim->config.trace_mode != SIM_TRACE_SYNC) {
+        sim->trace_queue = trace_queue_create(num_cores + 1, sim->config.trace_buffer,
+            sim->config.trace_mode == SIM_TRACE_ASYNC_DROP ? TRACE_QUEUE_DROP : TRACE_QUEUE_BLOCK);
+        if (!sim->trace_queue) {
+            sim_destroy(sim);
+            return NULL;
+        }
+    }
+
+    sim->bus.addr_mask = sim->mem->addr_mask;
+    cache_geometry_t geometry;
+    get_cache_geometry(&sim->config, &geometry);
+    for (int i = 0; i < num_cores; i++) {
+        if (!core_init(&sim->cores[i], i, sim->config.imem_size, &geometry,
+            sim->config.store_buffer)) {
+            sim_destroy(sim);
+            return NULL;
+        }
+        sim->cores[i].forwarding = sim->config.forwarding;
+        cache_select_kernel(&sim->cores[i].cache, !sim->config.generic_kernel);
+        sim->cores[i].cache.protocol = (cache_protocol_t)sim->config.protocol;
+        if (sim->config.mshrs > 0 &&
+            !cache_enable_mshrs(&sim->cores[i].cache, sim->config.mshrs, outstanding)) {
+            sim_destroy(sim);
+            return NULL;
+        }
+        if (sim->config.prefetch != SIM_PREFETCH_NONE) {
+            cache_enable_prefetch(&sim->cores[i].cache, (prefetch_policy_t)sim->config.prefetch,
+                sim->config.prefetch_degree);
+        }
+    }
+
+    sim_set_trace_filter(sim, &config->trace_filter);
+    return sim;
+}
+
+void sim_destroy(sim_context_t* sim) {
+    if (!sim) return;
+
+    // Queued records go out before their encoders are flushed
+    trace_queue_destroy(sim->trace_queue);
+    if (sim->core_writers) {
+        for (int i = 0; i < sim->config.num_cores; i++) {
+            trace_writer_destroy(sim->core_writers[i]);
+        }
+    }
+    trace_writer_destroy(sim->bus_writer);
+    thread_pool_destroy(sim->pool);
+    if (sim->bus.ports) {
+        bus_free(&sim->bus);
+    }
+    if (sim->mem) {
+        memory_free(sim->mem);
+    }
+    if (sim->cores) {
+        for (int i = 0; i < sim->config.num_cores; i++) {
+            core_free(&sim->cores[i]);
+        }
+    }
+    sim_aligned_free(sim->cores);
+    free(sim->mem);
+    free(sim->core_traces);
+    free(sim->core_writers);
+    sample_free(&sim->sampler);
+    free(sim);
+}
+
+/* Input */
+
+/**
+ * @brief Record a load result and report failures
+ * @param sim Simulation context
+ * @param status Load result
+ * @param filename Loaded file
+ * @param line Line of a malformed word
+ * @param report_missing Report a missing file (memin may be absent)
+ * @return true if the file was loaded
+ */
+static bool finish_load(sim_context_t* sim, load_status_t status, const char* filename,
+    int line, bool report_missing) {
+    sim->load_status = (sim_load_status_t)status;
+    if (status == LOAD_OK) return true;
+
+    if (sim->log) {
+        if (status == LOAD_MISSING) {
+            if (report_missing) {
+                fprintf(sim->log, "Error: Failed to open IMEM file %s\n", filename);
+            }
+        }
+        else if (status == LOAD_MALFORMED) {
+            fprintf(sim->log, "Error: %s:%d: %s\n", filename, line, load_status_message(status));
+        }
+        else {
+            fprintf(sim->log, "Error: %s: %s\n", filename, load_status_message(status));
+        }
+    }
+    return false;
+}
+
+bool sim_load_imem(sim_context_t* sim, int core, const char* filename) {
+    if (core < 0 || core >= sim->config.num_cores) return false;
+
+    int line = 0;
+    load_status_t status = core_load_imem(&sim->cores[core], filename, &line);
+    return finish_load(sim, status, filename, line, true);
+}
+
+bool sim_load_imem_words(sim_context_t* sim, int core, const uint32_t* words, int count) {
+    if (core < 0 || core >= sim->config.num_cores) return false;
+
+    for (int addr = 0; addr < count && (uint32_t)addr < sim->cores[core].imem_size; addr++) {
+        core_write_imem(&sim->cores[core], (uint32_t)addr, words[addr]);
+    }
+    return true;
+}
+
+bool sim_load_memory(sim_context_t* sim, const char* filename) {
+    int line = 0;
+    load_status_t status = memory_load(sim->mem, filename, &line);
+    return finish_load(sim, status, filename, line, false);
+}
+
+sim_load_status_t sim_get_load_status(sim_context_t* sim) {
+    return sim->load_status;
+}
+
+const char* sim_load_status_message(sim_load_status_t status) {
+    return load_status_message((load_status_t)status);
+}
+
+void sim_load_memory_words(sim_context_t* sim, const uint32_t* words, uint32_t count) {
+    for (uint32_t addr = 0; addr < count && addr <= sim->mem->addr_mask; addr++) {
+        memory_write(sim->mem, addr, words[addr]);
+    }
+}
+
+/* Shared Images */
+
+sim_image_t* sim_image_load(const char* filename, sim_load_status_t* status,
+    int* error_line) {
+    load_status_t result;
+    sim_image_t* image = memory_image_load(filename, &result, error_line);
+    if (status) *status = (sim_load_status_t)result;
+    return image;
+}
+
+sim_image_t* sim_image_from_words(const uint32_t* words, uint32_t count) {
+    return memory_image_from_words(words, count);
+}
+
+void sim_image_destroy(sim_image_t* image) {
+    memory_image_free(image);
+}
+
+bool sim_load_imem_image(sim_context_t* sim, int core, const sim_image_t* image) {
+    if (core < 0 || core >= sim->config.num_cores) return false;
+
+    // Instruction memory is private to the core and read every cycle, so it
+    // is copied rather than shared
+    for (uint32_t addr = 0; addr < sim->cores[core].imem_size; addr++) {
+        core_write_imem(&sim->cores[core], addr, memory_image_read(image, addr));
+    }
+    return true;
+}
+
+bool sim_load_memory_image(sim_context_t* sim, const sim_image_t* image) {
+    return memory_attach_image(sim->mem, image);
+}
+
+/* Checkpoints */
+
+bool sim_save_checkpoint(sim_context_t* sim, const char* filename) {
+    ckpt_writer_t state;
+    ckpt_writer_t memory;
+    ckpt_writer_init(&state);
+    ckpt_writer_init(&memory);
+
+    ckpt_put_u32(&state, (uint32_t)sim->config.cache_size);
+    ckpt_put_u32(&state, (uint32_t)sim->config.block_size);
+    ckpt_put_u32(&state, (uint32_t)sim->config.cache_ways);
+    ckpt_put_u8(&state, (uint8_t)sim->config.cache_policy);
+    ckpt_put_u8(&state, (uint8_t)sim->config.protocol);
+    ckpt_put_u8(&state, (uint8_t)sim->config.bus_mode);
+    ckpt_put_u32(&state, (uint32_t)sim->config.imem_size);
+    ckpt_put_u32(&state, (uint32_t)sim->config.store_buffer);
+    ckpt_put_u32(&state, (uint32_t)sim->config.mshrs);
+    bus_checkpoint(&sim->bus, &state);
+    memory_checkpoint_state(sim->mem, &state);
+    for (int i = 0; i < sim->config.num_cores; i++) {
+        core_checkpoint(&sim->cores[i], &state);
+    }
+    memory_checkpoint_pages(sim->mem, &memory);
+
+    bool ok = checkpoint_write(filename, sim->config.num_cores, sim->config.memory_bits,
+        sim_get_cycle(sim), &state, &memory);
+    if (!ok && sim->log) {
+        fprintf(sim->log, "Error: Failed to write checkpoint file %s\n", filename);
+    }
+    ckpt_writer_free(&state);
+    ckpt_writer_free(&memory);
+    return ok;
+}
+
+sim_checkpoint_t* sim_checkpoint_load(const char* filename, const char** error) {
+    return checkpoint_read(filename, error);
+}
+
+void sim_checkpoint_destroy(sim_checkpoint_t* ckpt) {
+    checkpoint_free(ckpt);
+}
+
+uint64_t sim_checkpoint_cycle(const sim_checkpoint_t* ckpt) {
+    return ckpt->cycle;
+}
+
+bool sim_restore_checkpoint(sim_context_t* sim, const sim_checkpoint_t* ckpt) {
+    if (ckpt->num_cores != sim->config.num_cores || ckpt->memory_bits != sim->config.memory_bits) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Checkpoint of %d cores and %d-bit memory does not match "
+                "%d cores and %d-bit memory\n", ckpt->num_cores, ckpt->memory_bits,
+                sim->config.num_cores, sim->config.memory_bits);
+        }
+        return false;
+    }
+
+    ckpt_reader_t in;
+    ckpt_reader_init(&in, ckpt->state, ckpt->state_size);
+
+    // The cache geometry, protocol, bus mode, program size, store buffer
+    // depth and MSHR count decide the layout and meaning of the saved
+    // state; the bus and memory delays, the prefetch policy and forwarding
+    // only shape the cycles still to come
+    static const char* const policy_names[] = { "LRU", "PLRU", "random", "RRIP" };
+    static const char* const protocol_names[] = { "MESI", "MOESI" };
+    static const char* const bus_names[] = { "an atomic", "a split-transaction" };
+    const sim_config_t* config = &sim->config;
+    int cache_size = (int)ckpt_get_u32(&in);
+    int block_size = (int)ckpt_get_u32(&in);
+    int cache_ways = (int)ckpt_get_u32(&in);
+    sim_cache_policy_t cache_policy = (sim_cache_policy_t)ckpt_get_enum(&in, SIM_CACHE_RRIP);
+    sim_protocol_t protocol = (sim_protocol_t)ckpt_get_enum(&in, SIM_MOESI);
+    sim_bus_mode_t bus_mode = (sim_bus_mode_t)ckpt_get_enum(&in, SIM_BUS_SPLIT);
+    int imem_size = (int)ckpt_get_u32(&in);
+    int store_buffer = (int)ckpt_get_u32(&in);
+    int mshrs = (int)ckpt_get_u32(&in);
+    if (in.ok && (cache_size != config->cache_size || block_size != config->block_size ||
+        cache_ways != config->cache_ways || cache_policy != config->cache_policy)) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Checkpoint of %d-word %d-way %s caches with %d-word "
+                "blocks does not match %d-word %d-way %s caches with %d-word blocks\n",
+                cache_size, cache_ways, policy_names[cache_policy], block_size,
+                config->cache_size, config->cache_ways, policy_names[config->cache_policy],
+                config->block_size);
+        }
+        return false;
+    }
+    if (in.ok && protocol != config->protocol) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Checkpoint of %s caches does not match %s caches\n",
+                protocol_names[protocol], protocol_names[config->protocol]);
+        }
+        return false;
+    }
+    if (in.ok && bus_mode != config->bus_mode) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Checkpoint of %s bus does not match %s bus\n",
+                bus_names[bus_mode], bus_names[config->bus_mode]);
+        }
+        return false;
+    }
+    if (in.ok && imem_size != config->imem_size) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Checkpoint of %d-word instruction memories does not "
+                "match %d-word instruction memories\n", imem_size, config->imem_size);
+        }
+        return false;
+    }
+    if (in.ok && store_buffer != config->store_buffer) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Checkpoint of %d-entry store buffers does not match "
+                "%d-entry store buffers\n", store_buffer, config->store_buffer);
+        }
+        return false;
+    }
+    if (in.ok && mshrs != config->mshrs) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Checkpoint of caches with %d MSHRs does not match "
+                "caches with %d MSHRs\n", mshrs, config->mshrs);
+        }
+        return false;
+    }
+    bus_restore(&sim->bus, &in);
+    memory_restore_state(sim->mem, &in);
+    for (int i = 0; i < sim->config.num_cores && in.ok; i++) {
+        core_restore(&sim->cores[i], &in);
+    }
+    if (!in.ok || in.pos != in.size) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Checkpoint state is corrupt\n");
+        }
+        return false;
+    }
+
+    sim_set_trace_filter(sim, &sim->trace_filter);
+    return memory_attach_image(sim->mem, ckpt->memory);
+}
+
+/* Output Streams */
+
+void sim_set_log(sim_context_t* sim, FILE* log) {
+    sim->log = log;
+    sim->mem->log = log;
+}
+
+/**
+ * @brief Replace the binary encoder of a trace stream
+ * @param sim Simulation context
+ * @param writer Encoder slot; the old encoder is flushed and freed
+ * @param trace New stream (may be NULL)
+ * @param kind Record kind
+ * @param id Core index (0 for the bus)
+ * @return false if a new encoder was needed and could not be created
+ */
+static bool attach_trace_writer(sim_context_t* sim, trace_writer_t** writer, FILE* trace,
+    trace_kind_t kind, int id) {
+    // Records queued for the old stream are written first
+    if (sim->trace_queue) {
+        trace_queue_sync(sim->trace_queue);
+    }
+    trace_writer_destroy(*writer);
+    *writer = NULL;
+    if (!trace || sim->config.trace_format == SIM_TRACE_TEXT) {
+        return true;
+    }
+
+    *writer = trace_writer_create(trace, kind, id,
+        sim->config.trace_format == SIM_TRACE_COMPRESSED);
+    if (!*writer && sim->log) {
+        fprintf(sim->log, "Error: Failed to start binary trace\n");
+    }
+    return *writer != NULL;
+}
+
+bool sim_set_core_trace(sim_context_t* sim, int core, FILE* trace) {
+    if (core < 0 || core >= sim->config.num_cores) return false;
+    bool ok = attach_trace_writer(sim, &sim->core_writers[core], trace, TRACE_KIND_CORE, core);
+    sim->core_traces[core] = ok ? trace : NULL;
+    if (sim->trace_queue) {
+        trace_queue_set_output(sim->trace_queue, core, sim->core_traces[core],
+            sim->core_writers[core]);
+    }
+    return ok;
+}
+
+bool sim_set_bus_trace(sim_context_t* sim, FILE* trace) {
+    bool ok = attach_trace_writer(sim, &sim->bus_writer, trace, TRACE_KIND_BUS, 0);
+    sim->bus_trace = ok ? trace : NULL;
+    if (sim->trace_queue) {
+        trace_queue_set_output(sim->trace_queue, sim->config.num_cores, sim->bus_trace,
+            sim->bus_writer);
+    }
+    return ok;
+}
+
+bool sim_flush_traces(sim_context_t* sim) {
+    bool ok = true;
+    if (sim->trace_queue) {
+        trace_queue_sync(sim->trace_queue);
+    }
+    for (int i = 0; i < sim->config.num_cores; i++) {
+        if (sim->core_writers[i] && !trace_writer_flush(sim->core_writers[i])) {
+            ok = false;
+        }
+    }
+    if (sim->bus_writer && !trace_writer_flush(sim->bus_writer)) {
+        ok = false;
+    }
+    return ok;
+}
+
+void sim_trace_filter_default(sim_trace_filter_t* filter) {
+    filter->start_cycle = 0;
+    filter->stop_cycle = UINT64_MAX;
+    filter->trigger_core = -1;
+    filter->trigger_pc = 0;
+    filter->trigger_on_addr = false;
+    filter->trigger_addr = 0;
+    filter->bus_cmds = SIM_TRACE_ALL_BUS_CMDS;
+    filter->bus_addr_min = 0;
+    filter->bus_addr_max = UINT32_MAX;
+}
+
+void sim_set_trace_filter(sim_context_t* sim, const sim_trace_filter_t* filter) {
+    sim->trace_filter = *filter;
+    sim->trace_triggered = filter->trigger_core < 0 && !filter->trigger_on_addr;
+}
+
+uint64_t sim_get_dropped_traces(sim_context_t* sim) {
+    return sim->trace_queue ? trace_queue_dropped(sim->trace_queue) : 0;
+}
+
+bool sim_convert_trace(FILE* in, FILE* out) {
+    return trace_convert(in, out);
+}
+
+/* Execution */
+
+bool sim_is_done(sim_context_t* sim) {
+    for (int i = 0; i < sim->config.num_cores; i++) {
+        if (!core_is_done(&sim->cores[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t sim_step(sim_context_t* sim, uint64_t cycles) {
+    uint64_t done = 0;
+
+    while (done < cycles && !sim_is_done(sim)) {
+        // Fast-forward through stretches where everyone waits on memory
+        if (sim->config.event_driven) {
+            done += skip_quiescent_cycles(sim, cycles - done);
+            if (done == cycles) break;
+        }
+
+        clock_cycle(sim);
+        done++;
+    }
+    return done;
+}
+
+uint64_t sim_step_to_pc(sim_context_t* sim, int core, uint32_t pc, uint64_t max_cycles) {
+    if (core < 0 || core >= sim->config.num_cores) return 0;
+
+    // The PC register holds the address fetched in the next cycle
+    uint64_t done = 0;
+    while (done < max_cycles && sim->cores[core].pipe.cur->pc != pc) {
+        uint64_t stepped = sim_step(sim, 1);
+        if (stepped == 0) break;
+        done += stepped;
+    }
+    return done;
+}
+
+uint64_t sim_fast_forward(sim_context_t* sim, uint64_t instructions, bool warm_caches) {
+    return run_functional(sim, instructions, -1, CORE_NO_PC, warm_caches);
+}
+
+uint64_t sim_fast_forward_to_pc(sim_context_t* sim, int core, uint32_t pc,
+    uint64_t max_instructions, bool warm_caches) {
+    if (core < 0 || core >= sim->config.num_cores) return 0;
+    return run_functional(sim, max_instructions, core, pc, warm_caches);
+}
+
+void sim_sample_default(sim_sample_config_t* sample) {
+    sample->unit = 1000;
+    sample->warmup = 2000;
+    sample->period = SIM_SAMPLE_PERIOD_UNITS * (sample->unit + sample->warmup);
+    sample->error = 0.03;
+}
+
+uint64_t sim_run_sampled(sim_context_t* sim, const sim_sample_config_t* sample) {
+    int num_cores = sim->config.num_cores;
+    uint64_t first_cycle = (uint64_t)sim->bus.global_cycles;
+    sample_unit_t* start = (sample_unit_t*)malloc(2 * num_cores * sizeof(sample_unit_t));
+    if (sim->sampler.cores) {
+        sample_reset(&sim->sampler);
+    }
+    if (!start || (!sim->sampler.cores && !sample_init(&sim->sampler, num_cores))) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Failed to allocate the sampling state\n");
+        }
+        free(start);
+        return sim_run(sim);
+    }
+    sample_unit_t* unit = start + num_cores;
+
+    uint64_t detailed = sample->warmup + sample->unit;
+    uint64_t period = sample->period;
+
+    // The first unit is measured right away, so that a program shorter
+    // than one period still gets one
+    uint64_t gap = detailed;
+    while (!sim_is_done(sim)) {
+        // Functional warming up to the next detailed warm-up
+        if (gap > detailed) {
+            sim_fast_forward(sim, gap - detailed, true);
+        }
+        run_detailed(sim, sample->warmup);
+        read_sample_counters(sim, start);
+        run_detailed(sim, sample->unit);
+        read_sample_counters(sim, unit);
+
+        uint32_t instructions = 0;
+        for (int i = 0; i < num_cores; i++) {
+            unit[i].cycles -= start[i].cycles;
+            unit[i].instructions -= start[i].instructions;
+            unit[i].accesses -= start[i].accesses;
+            unit[i].misses -= start[i].misses;
+            instructions |= unit[i].instructions;
+        }
+
+        // Every core halted before the unit started: only the drain is left
+        if (instructions == 0) {
+            sim_run(sim);
+            break;
+        }
+        if (!sample_add(&sim->sampler, unit)) {
+            if (sim->log) {
+                fprintf(sim->log, "Error: Failed to store sample unit %d\n",
+                    sim->sampler.count);
+            }
+            sim_run(sim);
+            break;
+        }
+
+        // Half of the units would do: keep every other one, twice as far apart.
+        // The next unit is the first of the new spacing, so it stays one
+        // old period away.
+        gap = period;
+        if (sim->sampler.count % 2 == 0 && sim->sampler.count >= 2 * SAMPLE_MIN_UNITS &&
+            sample_cpi_error(&sim->sampler, true) <= sample->error) {
+            sample_thin(&sim->sampler);
+            period *= 2;
+        }
+    }
+
+    sim->sample_period = period;
+    free(start);
+    return (uint64_t)sim->bus.global_cycles - first_cycle;
+}
+
+uint64_t sim_run(sim_context_t* sim) {
+    return sim_step(sim, UINT64_MAX);
+}
+
+/* Queries */
+
+int sim_num_cores(sim_context_t* sim) {
+    return sim->config.num_cores;
+}
+
+const char* sim_get_kernel(sim_context_t* sim) {
+    return cache_kernel_name(&sim->cores[0].cache);
+}
+
+uint64_t sim_get_cycle(sim_context_t* sim) {
+    return (uint64_t)sim->bus.global_cycles;
+}
+
+bool sim_get_core_stats(sim_context_t* sim, int core, sim_core_stats_t* stats) {
+    if (core < 0 || core >= sim->config.num_cores) return false;
+
+    core_t* c = &sim->cores[core];
+    stats->cycles = c->cycles;
+    stats->instructions = c->instructions;
+    stats->read_hit = c->cache.read_hit;
+    stats->write_hit = c->cache.write_hit;
+    stats->read_miss = c->cache.read_miss;
+    stats->write_miss = c->cache.write_miss;
+    stats->decode_stalls = c->decode_stalls;
+    stats->mem_stalls = c->mem_stalls;
+    stats->stalls_avoided = c->stalls_avoided;
+    stats->supplied_clean = c->cache.supplied_clean;
+    stats->supplied_dirty = c->cache.supplied_dirty;
+    stats->bus_requests = sim->bus.ports[core].requests;
+    stats->bus_wait_cycles = sim->bus.ports[core].wait_cycles;
+    stats->stores_buffered = c->stores_buffered;
+    stats->loads_forwarded = c->loads_forwarded;
+    stats->mshr_merged = c->cache.mshr_merged;
+    stats->mshr_full = c->cache.mshr_full;
+    stats->mshr_peak = c->cache.mshr_peak;
+    stats->mshr_cycles = c->cache.mshr_cycles;
+    stats->prefetch_issued = c->cache.prefetch_issued;
+    stats->prefetch_useful = c->cache.prefetch_useful;
+    stats->prefetch_late = c->cache.prefetch_late;
+    stats->prefetch_polluting = c->cache.prefetch_polluting;
+    stats->functional_instructions = c->functional_instructions;
+    return true;
+}
+
+bool sim_get_sample_estimate(sim_context_t* sim, int core, sim_sample_estimate_t* estimate) {
+    if (core < 0 || core >= sim->config.num_cores) return false;
+
+    memset(estimate, 0, sizeof(*estimate));
+    if (!sim->sampler.cores) return true;
+    estimate->period = sim->sample_period;
+    if (sim->sampler.count == 0) return true;
+
+    const core_t* c = &sim->cores[core];
+    sample_estimate_t ratios;
+    sample_estimate(&sim->sampler, core, &ratios);
+    estimate->units = sim->sampler.count;
+    estimate->instructions = c->functional_instructions + (uint32_t)c->instructions;
+    estimate->cycles = ratios.cpi * (double)estimate->instructions;
+    estimate->cycles_error = ratios.cpi_error * (double)estimate->instructions;
+    estimate->cpi = ratios.cpi;
+    estimate->cpi_error = ratios.cpi_error;
+    estimate->miss_rate = ratios.miss_rate;
+    estimate->miss_rate_error = ratios.miss_rate_error;
+    return true;
+}
+
+uint32_t sim_get_register(sim_context_t* sim, int core, int reg) {
+    if (core < 0 || core >= sim->config.num_cores || reg < 0 || reg > 15) return 0;
+    return sim->cores[core].pipe.cur->registers[reg];
+}
+
+uint32_t sim_read_memory(sim_context_t* sim, uint32_t addr) {
+    return addr <= sim->mem->addr_mask ? memory_read(sim->mem, addr) : 0;
+}
+
+/* Result Files */
+
+/**
+ * @brief Write a word array in the configured result file format
+ * @param sim Simulation context
+ * @param filename File to create
+ * @param words Word values
+ * @param count Number of words
+ * @param what File description for the error message
+ * @return true on success
+ */
+static bool save_words(sim_context_t* sim, const char* filename, const uint32_t* words,
+    uint32_t count, const char* what) {
+    dump_file_t* dump = dump_open(filename, (dump_format_t)sim->config.dump_format);
+    if (dump) {
+        dump_words(dump, words, count);
+        if (dump_close(dump)) return true;
+    }
+    if (sim->log) {
+        fprintf(sim->log, "Error: Failed to write %s file %s\n", what, filename);
+    }
+    return false;
+}
+
+bool sim_save_memory(sim_context_t* sim, const char* filename) {
+    return memory_save(sim->mem, filename, (dump_format_t)sim->config.dump_format);
+}
+
+bool sim_save_registers(sim_context_t* sim, int core, const char* filename) {
+    if (core < 0 || core >= sim->config.num_cores) return false;
+
+    uint32_t values[14];
+    for (int r = 2; r < 16; r++) {
+        values[r - 2] = sim->cores[core].pipe.cur->registers[r];
+    }
+    return save_words(sim, filename, values, 14, "register output");
+}
+
+bool sim_save_cache(sim_context_t* sim, int core, const char* dsram_file,
+    const char* tsram_file) {
+    if (core < 0 || core >= sim->config.num_cores) return false;
+    cache_t* cache = &sim->cores[core].cache;
+
+    if (!save_words(sim, dsram_file, cache->dsram, cache->size, "DSRAM output")) {
+        return false;
+    }
+
+    // TSRAM entries are packed as state << 12 | tag; wider memories and
+    // fewer sets need wider tags and move the state up accordingly
+    int tag_bits = sim->config.memory_bits - cache->tag_shift;
+    int state_shift = tag_bits > 12 ? tag_bits : 12;
+    uint32_t* entries = (uint32_t*)malloc(cache->num_lines * sizeof(uint32_t));
+    if (!entries) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Memory allocation failed\n");
+        }
+        return false;
+    }
+    for (int j = 0; j < cache->num_lines; j++) {
+        entries[j] = ((uint32_t)cache->tsram[j].state << state_shift) | cache->tsram[j].tag;
+    }
+    bool ok = save_words(sim, tsram_file, entries, cache->num_lines, "TSRAM output");
+    free(entries);
+    return ok;
+}
+
+bool sim_save_statistics(sim_context_t* sim, int core, const char* filename) {
+    sim_core_stats_t stats;
+    if (!sim_get_core_stats(sim, core, &stats)) return false;
+
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        if (sim->log) {
+            fprintf(sim->log, "Error: Failed to open statistics file %s\n", filename);
+        }
+        return false;
+    }
+
+    fprintf(f, "cycles %d\n", stats.cycles);
+    fprintf(f, "instructions %d\n", stats.instructions);
+    fprintf(f, "read_hit %d\n", stats.read_hit);
+    fprintf(f, "write_hit %d\n", stats.write_hit);
+    fprintf(f, "read_miss %d\n", stats.read_miss);
+    fprintf(f, "write_miss %d\n", stats.write_miss);
+    fprintf(f, "decode_stall %d\n", stats.decode_stalls);
+    fprintf(f, "mem_stall %d\n", stats.mem_stalls);
+
+    // Instructions fast-forwarded before (or between) the detailed cycles above
+    if (stats.functional_instructions > 0) {
+        fprintf(f, "functional_instructions %llu\n",
+            (unsigned long long)stats.functional_instructions);
+    }
+
+    // Whole-run estimate of a sampled run, each with its 99.7% confidence
+    // half-width; one unit gives no error bound, so no estimate
+    sim_sample_estimate_t estimate;
+    sim_get_sample_estimate(sim, core, &estimate);
+    if (estimate.period > 0) {
+        fprintf(f, "sample_units %d\n", estimate.units);
+        fprintf(f, "sample_period %llu\n", (unsigned long long)estimate.period);
+    }
+    if (estimate.units > 1) {
+        fprintf(f, "est_cycles %.0f\n", estimate.cycles);
+        fprintf(f, "est_cycles_error %.0f\n", estimate.cycles_error);
+        fprintf(f, "est_cpi %.4f\n", estimate.cpi);
+        fprintf(f, "est_cpi_error %.4f\n", estimate.cpi_error);
+        fprintf(f, "est_miss_rate %.4f\n", estimate.miss_rate);
+        fprintf(f, "est_miss_rate_error %.4f\n", estimate.miss_rate_error);
+    }
+
+    // Cycles decode would have stalled had results waited for writeback
+    if (sim->config.forwarding) {
+        fprintf(f, "stalls_avoided %d\n", stats.stalls_avoided);
+    }
+
+    // Every cache-to-cache supply replaced a memory round trip: the
+    // response delay plus one cycle per word of the block
+    if (sim->config.protocol == SIM_MOESI) {
+        int supplied = stats.supplied_clean + stats.supplied_dirty;
+        fprintf(f, "c2c_clean %d\n", stats.supplied_clean);
+        fprintf(f, "c2c_dirty %d\n", stats.supplied_dirty);
+        fprintf(f, "roundtrips_saved %d\n", supplied);
+        fprintf(f, "roundtrip_cycles_saved %lld\n",
+            (long long)supplied * (sim->config.memory_delay + sim->config.block_size));
+    }
+
+    // Queueing latency from posting a BusRd/BusRdX to its grant
+    if (sim->config.bus_mode == SIM_BUS_SPLIT) {
+        fprintf(f, "bus_requests %d\n", stats.bus_requests);
+        fprintf(f, "bus_wait %d\n", stats.bus_wait_cycles);
+    }
+
+    // Stores that left MEM without waiting for the cache, and loads that
+    // never reached it
+    if (sim->config.store_buffer > 0) {
+        fprintf(f, "sb_stores %d\n", stats.stores_buffered);
+        fprintf(f, "sb_forwards %d\n", stats.loads_forwarded);
+    }
+
+    // Loads that joined a miss to their block, MSHRs in use summed over
+    // the cycles and at most, and accesses that waited for a free one
+    if (sim->config.mshrs > 0) {
+        fprintf(f, "mshr_merged %d\n", stats.mshr_merged);
+        fprintf(f, "mshr_occupancy %d\n", stats.mshr_cycles);
+        fprintf(f, "mshr_peak %d\n", stats.mshr_peak);
+        fprintf(f, "mshr_full %d\n", stats.mshr_full);
+    }
+
+    // Prefetches sent, used in time or reached while still in flight, and
+    // demand misses to the blocks they displaced
+    if (sim->config.prefetch != SIM_PREFETCH_NONE) {
+        fprintf(f, "prefetch_issued %d\n", stats.prefetch_issued);
+        fprintf(f, "prefetch_useful %d\n", stats.prefetch_useful);
+        fprintf(f, "prefetch_late %d\n", stats.prefetch_late);
+        fprintf(f, "prefetch_polluting %d\n", stats.prefetch_polluting);
+    }
+
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,700 @@
+/**
+ * @file sim.h
+ * @brief Embeddable simulator library API
+ *
+ * A sim_context_t owns one complete simulated system (cores, caches, bus
+ * and main memory) and has no global state, so any number of contexts can
+ * be created, run and destroyed in the same process, also from different
+ * host threads. The sim executable is a thin command-line front end on top
+ * of this API.
+ *
+ * Typical use:
+ * @code
+ * sim_config_t cfg;
+ * sim_config_default(&cfg);
+ * sim_context_t* sim = sim_create(&cfg);
+ * sim_load_imem(sim, 0, "imem0.txt");
+ * sim_load_memory(sim, "memin.txt");
+ * sim_run(sim);
+ * sim_core_stats_t stats;
+ * sim_get_core_stats(sim, 0, &stats);
+ * sim_destroy(sim);
+ * @endcode
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Symbol export for the shared library build */
+#if defined(_WIN32) && defined(SIM_SHARED)
+#if defined(SIM_BUILD_DLL)
+#define SIM_API __declspec(dllexport)
+#else
+#define SIM_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__) && defined(SIM_BUILD_DLL)
+#define SIM_API __attribute__((visibility("default")))
+#else
+#define SIM_API
+#endif
+
+/**
+ * @brief Encoding of the core and bus trace streams
+ */
+typedef enum {
+    SIM_TRACE_TEXT = 0,      ///< Original text lines
+    SIM_TRACE_BINARY = 1,    ///< Delta-encoded binary records
+    SIM_TRACE_COMPRESSED = 2 ///< Binary records in compressed blocks
+} sim_trace_format_t;
+
+/**
+ * @brief Where trace records are formatted and written
+ */
+typedef enum {
+    SIM_TRACE_SYNC = 0,        ///< On the simulation threads, every cycle
+    SIM_TRACE_ASYNC_BLOCK = 1, ///< On a writer thread; wait when its buffer is full
+    SIM_TRACE_ASYNC_DROP = 2   ///< On a writer thread; drop and count records when full
+} sim_trace_mode_t;
+
+/**
+ * @brief Encoding of memout, regout, dsram and tsram
+ */
+typedef enum {
+    SIM_DUMP_FULL = 0,    ///< One hex word per line (original files)
+    SIM_DUMP_TRIM = 1,    ///< As SIM_DUMP_FULL without trailing zero words
+    SIM_DUMP_SPARSE = 2,  ///< "address:value" hex line per non-zero word
+    SIM_DUMP_BINARY = 3   ///< Raw 32-bit little-endian words
+} sim_dump_format_t;
+
+/**
+ * @brief Replacement policy of set-associative data caches
+ *
+ * Invalid ways are filled first under every policy.
+ */
+typedef enum {
+    SIM_CACHE_LRU = 0,     ///< Least recently used way
+    SIM_CACHE_PLRU = 1,    ///< Tree pseudo-LRU
+    SIM_CACHE_RANDOM = 2,  ///< Pseudo-random way, reproducible from run to run
+    SIM_CACHE_RRIP = 3     ///< Static re-reference interval prediction (2-bit)
+} sim_cache_policy_t;
+
+/**
+ * @brief Cache coherence protocol
+ */
+typedef enum {
+    SIM_MESI = 0,   ///< Original protocol; dirty blocks are written back when shared
+    SIM_MOESI = 1   ///< Owned state; caches supply blocks in place of main memory
+} sim_protocol_t;
+
+/**
+ * @brief Bus transaction model
+ */
+typedef enum {
+    SIM_BUS_ATOMIC = 0,  ///< Original bus; a BusRd/BusRdX holds it until its block has arrived
+    SIM_BUS_SPLIT = 1    ///< Requests and tagged responses are decoupled; misses overlap
+} sim_bus_mode_t;
+
+/**
+ * @brief Data prefetch policy (needs MSHRs)
+ */
+typedef enum {
+    SIM_PREFETCH_NONE = 0,       ///< No prefetching
+    SIM_PREFETCH_NEXT_LINE = 1,  ///< Following blocks of a miss or a used prefetch
+    SIM_PREFETCH_STRIDE = 2,     ///< Per-PC stride prediction
+    SIM_PREFETCH_STREAM = 3      ///< Sequential streams confirmed by two misses
+} sim_prefetch_t;
+
+/**
+ * @brief Result of loading an input file
+ */
+typedef enum {
+    SIM_LOAD_OK = 0,          ///< All words loaded
+    SIM_LOAD_MISSING = 1,     ///< File could not be opened
+    SIM_LOAD_MALFORMED = 2,   ///< Text that is not a 32-bit hex word
+    SIM_LOAD_TRUNCATED = 3,   ///< Binary image that is not a whole number of words
+    SIM_LOAD_READ_ERROR = 4,  ///< Read failed
+    SIM_LOAD_NO_MEMORY = 5    ///< Allocation failed
+} sim_load_status_t;
+
+/**
+ * @brief Which cycles and transactions are written to the traces
+ *
+ * Tracing starts at the later of start_cycle and the first trigger and ends
+ * at stop_cycle (global cycles). Without triggers only the window applies;
+ * with both triggers, whichever fires first starts tracing. Cores are
+ * selected by attaching or not attaching a core trace stream. Nothing is
+ * formatted for cycles outside the window or for filtered bus transactions.
+ */
+typedef struct {
+    uint64_t start_cycle;   ///< First traced cycle
+    uint64_t stop_cycle;    ///< First cycle no longer traced (UINT64_MAX = never stop)
+    int trigger_core;       ///< Start when this core fetches trigger_pc (-1 = no PC trigger)
+    uint32_t trigger_pc;    ///< PC of the PC trigger
+    bool trigger_on_addr;   ///< Start when a bus transaction uses trigger_addr
+    uint32_t trigger_addr;  ///< Address of the bus trigger
+    unsigned bus_cmds;      ///< Bus commands written to the bus trace, bit (1 << cmd) each
+    uint32_t bus_addr_min;  ///< Lowest bus address written to the bus trace
+    uint32_t bus_addr_max;  ///< Highest bus address written to the bus trace
+} sim_trace_filter_t;
+
+#define SIM_TRACE_ALL_BUS_CMDS 0xE  ///< BusRd, BusRdX and Flush (commands 1-3)
+
+#define SIM_MAX_DELAY (1 << 20)     ///< Longest memory or bus delay in cycles
+
+#define SIM_FUNCTIONAL_QUANTUM 64   ///< Instructions a core executes functionally before the next core
+
+#define SIM_SAMPLE_PERIOD_UNITS 20  ///< Default sampling period, in units with their warm-up
+
+/**
+ * @brief Simulation parameters fixed at creation time
+ */
+typedef struct {
+    int num_cores;        ///< Number of processor cores
+    int num_threads;      ///< Host threads clocking the cores (1 = serial)
+    int memory_bits;      ///< Main memory word address width, 10-32 (20 = 4 MB)
+    int cache_size;       ///< Data cache words per core, a power of two (default 256)
+    int block_size;       ///< Words per cache block and bus transfer, a power of two (default 4)
+    int cache_ways;       ///< Data cache associativity: 1 (direct-mapped), 2, 4, 8 or 16
+    sim_cache_policy_t cache_policy;  ///< Victim selection among the ways of a set
+    sim_protocol_t protocol;          ///< Coherence protocol
+    sim_bus_mode_t bus_mode;          ///< Atomic or split-transaction bus
+    int memory_delay;     ///< Cycles main memory counts down before sending a block (default 14)
+    int bus_delay;        ///< Cycles from granting BusRd/BusRdX to driving it (default 1)
+    int imem_size;        ///< Instruction memory words per core, a power of two (default 1024)
+    int store_buffer;     ///< Store buffer entries per core, 0-64 (0 = stores write the cache in MEM)
+    int mshrs;            ///< Miss status holding registers per data cache, 0-16 (0 = blocking cache)
+    sim_prefetch_t prefetch;          ///< Data prefetch policy
+    int prefetch_degree;  ///< Blocks prefetched per trigger, 1-8 (default 2)
+    bool forwarding;      ///< Forward results to dependent instructions (false = stall until writeback)
+    bool event_driven;    ///< Skip quiescent memory-wait cycles
+    bool generic_kernel;  ///< Use the generic cache kernel even if a specialized one matches
+    sim_trace_format_t trace_format;  ///< Encoding of trace streams
+    sim_trace_mode_t trace_mode;      ///< Synchronous or background trace output
+    int trace_buffer;                 ///< Records buffered per trace stream (async modes)
+    sim_trace_filter_t trace_filter;  ///< Initial trace window, triggers and bus filters
+    sim_dump_format_t dump_format;    ///< Encoding of the memory, register and cache files
+} sim_config_t;
+
+/**
+ * @brief Per-core statistics (the contents of stats<i>.txt)
+ */
+typedef struct {
+    int cycles;           ///< Total execution cycles
+    int instructions;     ///< Total instructions executed
+    int read_hit;         ///< Cache read hits
+    int write_hit;        ///< Cache write hits
+    int read_miss;        ///< Cache read misses
+    int write_miss;       ///< Cache write misses
+    int decode_stalls;    ///< Stalls due to data hazards
+    int mem_stalls;       ///< Stalls due to cache misses
+    int stalls_avoided;   ///< Decode stalls the forwarding network saved
+    int supplied_clean;   ///< Blocks supplied from Exclusive in place of memory (MOESI)
+    int supplied_dirty;   ///< Blocks supplied from Modified/Owned in place of memory (MOESI)
+    int bus_requests;     ///< BusRd/BusRdX requests granted the bus
+    int bus_wait_cycles;  ///< Cycles those requests queued before their grant
+    int stores_buffered;  ///< Stores retired through the store buffer
+    int loads_forwarded;  ///< Loads answered from the store buffer
+    int mshr_merged;      ///< Loads merged into an outstanding miss to their block
+    int mshr_full;        ///< Accesses that waited for a free MSHR or way
+    int mshr_peak;        ///< Most MSHRs in use at once
+    int mshr_cycles;      ///< MSHRs in use summed over the cycles
+    int prefetch_issued;  ///< Prefetches sent to the bus
+    int prefetch_useful;  ///< Prefetched blocks accessed after they had arrived
+    int prefetch_late;    ///< Prefetches a demand access reached while still in flight
+    int prefetch_polluting;  ///< Demand misses to blocks a prefetch evicted
+    uint64_t functional_instructions;  ///< Instructions executed by sim_fast_forward
+} sim_core_stats_t;
+
+/**
+ * @brief Parameters of a sampled run (see sim_run_sampled)
+ *
+ * Lengths are instructions per core, as for sim_fast_forward.
+ */
+typedef struct {
+    uint64_t unit;      ///< Instructions measured in each sample unit (default 1000)
+    uint64_t warmup;    ///< Instructions simulated in detail before each unit (default 2000)
+    uint64_t period;    ///< Initial distance from one unit to the next, at least unit + warmup (default: see SIM_SAMPLE_PERIOD_UNITS)
+    double error;       ///< Target relative half-width of the CPI confidence intervals (default 0.03)
+} sim_sample_config_t;
+
+/**
+ * @brief Estimate of a sampled run for one core
+ *
+ * Every half-width spans three standard errors (99.7% confidence).
+ */
+typedef struct {
+    int units;              ///< Sample units the estimate is based on (below 2 = no error bound)
+    uint64_t period;        ///< Final distance from one unit to the next (0 = no sampled run)
+    uint64_t instructions;  ///< Instructions executed functionally and in detail
+    double cycles;          ///< Estimated cycles of the whole run
+    double cycles_error;    ///< Confidence half-width of cycles
+    double cpi;             ///< Estimated cycles per instruction
+    double cpi_error;       ///< Confidence half-width of cpi
+    double miss_rate;       ///< Estimated data cache misses per access
+    double miss_rate_error; ///< Confidence half-width of miss_rate
+} sim_sample_estimate_t;
+
+typedef struct sim_context sim_context_t;
+
+/**
+ * @brief Read-only word image (program or initial memory contents)
+ *
+ * An image is parsed once and can then be loaded into any number of
+ * contexts, also concurrently. Main memory shares the image pages
+ * copy-on-write, so the image must outlive every context it was loaded into.
+ */
+typedef struct memory_image sim_image_t;
+
+/**
+ * @brief Loaded checkpoint of a complete simulated system
+ *
+ * A checkpoint is read once and can then be restored into any number of
+ * contexts, also concurrently, to start divergent runs from the same
+ * point. Main memory shares the checkpoint pages copy-on-write, so the
+ * checkpoint must outlive every context restored from it.
+ */
+typedef struct checkpoint sim_checkpoint_t;
+
+/* Lifetime */
+
+/**
+ * @brief Fill a configuration with the default 4-core, single-thread setup
+ * @param config Configuration to fill
+ */
+SIM_API void sim_config_default(sim_config_t* config);
+
+/**
+ * @brief Check a configuration
+ * @param config Simulation parameters
+ * @return NULL if sim_create accepts them, otherwise a static sentence
+ *         describing the first invalid parameter
+ */
+SIM_API const char* sim_config_error(const sim_config_t* config);
+
+/**
+ * @brief Create a simulation context
+ * @param config Simulation parameters (copied)
+ * @return New context with all memories zeroed, or NULL on invalid
+ *         parameters or allocation failure
+ */
+SIM_API sim_context_t* sim_create(const sim_config_t* config);
+
+/**
+ * @brief Destroy a context and free all of its memory
+ * @param sim Simulation context (may be NULL)
+ *
+ * Trace and log streams set by the caller are not closed.
+ */
+SIM_API void sim_destroy(sim_context_t* sim);
+
+/* Input */
+
+/*
+ * Input files are hex text (whitespace-separated 32-bit words, usually one
+ * per line) or, if the name ends in ".bin", raw little-endian words as
+ * written with SIM_DUMP_BINARY. Loading stops with an error at the first
+ * malformed word; the error message names its line.
+ */
+
+/**
+ * @brief Load a core's instruction memory from a file
+ * @param sim Simulation context
+ * @param core Core index
+ * @param filename Hex text or .bin image
+ * @return true on success, false if the file is missing or malformed
+ *         (see sim_get_load_status)
+ */
+SIM_API bool sim_load_imem(sim_context_t* sim, int core, const char* filename);
+
+/**
+ * @brief Load a core's instruction memory from a word array
+ * @param sim Simulation context
+ * @param core Core index
+ * @param words Instruction words
+ * @param count Number of words (at most sim_config_t.imem_size words are used)
+ * @return true on success, false on invalid core index
+ */
+SIM_API bool sim_load_imem_words(sim_context_t* sim, int core, const uint32_t* words, int count);
+
+/**
+ * @brief Load main memory from a file
+ * @param sim Simulation context
+ * @param filename Hex text or .bin image
+ * @return true on success, false if the file is missing or malformed
+ *         (see sim_get_load_status)
+ *
+ * A missing file leaves memory zeroed, like the original simulator.
+ */
+SIM_API bool sim_load_memory(sim_context_t* sim, const char* filename);
+
+/**
+ * @brief Get the result of the last sim_load_imem or sim_load_memory call
+ * @param sim Simulation context
+ */
+SIM_API sim_load_status_t sim_get_load_status(sim_context_t* sim);
+
+/**
+ * @brief Describe a load result
+ * @param status Load result
+ * @return Static message
+ */
+SIM_API const char* sim_load_status_message(sim_load_status_t status);
+
+/**
+ * @brief Load main memory from a word array starting at address 0
+ * @param sim Simulation context
+ * @param words Memory words
+ * @param count Number of words
+ */
+SIM_API void sim_load_memory_words(sim_context_t* sim, const uint32_t* words, uint32_t count);
+
+/* Shared Images */
+
+/**
+ * @brief Parse an input file into an image
+ * @param filename Hex text or .bin image
+ * @param status Receives SIM_LOAD_OK or why loading failed (may be NULL)
+ * @param error_line Receives the line of a malformed word (may be NULL)
+ * @return New image, or NULL on failure
+ */
+SIM_API sim_image_t* sim_image_load(const char* filename, sim_load_status_t* status,
+    int* error_line);
+
+/**
+ * @brief Create an image from a word array
+ * @param words Words starting at address 0
+ * @param count Number of words
+ * @return New image, or NULL on allocation failure
+ */
+SIM_API sim_image_t* sim_image_from_words(const uint32_t* words, uint32_t count);
+
+/**
+ * @brief Free an image
+ * @param image Image (may be NULL)
+ */
+SIM_API void sim_image_destroy(sim_image_t* image);
+
+/**
+ * @brief Load a core's instruction memory from an image
+ * @param sim Simulation context
+ * @param core Core index
+ * @param image Program image (at most sim_config_t.imem_size words are copied)
+ * @return false on invalid core index
+ */
+SIM_API bool sim_load_imem_image(sim_context_t* sim, int core, const sim_image_t* image);
+
+/**
+ * @brief Share an image as the initial main memory contents
+ * @param sim Simulation context
+ * @param image Memory image, or NULL for all zeros
+ *
+ * Pages are copied into the context only when the simulation writes them.
+ * @return false on allocation failure
+ */
+SIM_API bool sim_load_memory_image(sim_context_t* sim, const sim_image_t* image);
+
+/* Checkpoints */
+
+/*
+ * A checkpoint holds every core (pipeline registers, register file, PC,
+ * counters and instruction memory), every cache including a pending miss
+ * or flush, the bus with its pending transaction and request lines, the
+ * main memory response state and all non-zero memory pages. Configuration
+ * that does not change results (threads, event-driven mode, traces and
+ * result formats) is not stored and may differ between the saving and the
+ * restoring context.
+ */
+
+/**
+ * @brief Write the current state to a checkpoint file
+ * @param sim Simulation context (between cycles, i.e. not inside sim_step)
+ * @param filename File to create
+ * @return false if the file could not be written
+ */
+SIM_API bool sim_save_checkpoint(sim_context_t* sim, const char* filename);
+
+/**
+ * @brief Read a checkpoint file
+ * @param filename Checkpoint file
+ * @param error Receives a static description of the failure (may be NULL)
+ * @return New checkpoint, or NULL if the file is missing or malformed
+ */
+SIM_API sim_checkpoint_t* sim_checkpoint_load(const char* filename, const char** error);
+
+/**
+ * @brief Free a checkpoint
+ * @param ckpt Checkpoint (may be NULL)
+ */
+SIM_API void sim_checkpoint_destroy(sim_checkpoint_t* ckpt);
+
+/**
+ * @brief Get the global cycle at which a checkpoint was taken
+ * @param ckpt Checkpoint
+ */
+SIM_API uint64_t sim_checkpoint_cycle(const sim_checkpoint_t* ckpt);
+
+/**
+ * @brief Replace the complete state of a context with a checkpoint
+ * @param sim Simulation context with the same core count and memory width
+ * @param ckpt Checkpoint
+ * @return false if the checkpoint does not fit the context or is corrupt;
+ *         the context must then be destroyed
+ *
+ * Trace triggers are re-armed, so a trace window applies from the restored
+ * cycle on.
+ */
+SIM_API bool sim_restore_checkpoint(sim_context_t* sim, const sim_checkpoint_t* ckpt);
+
+/* Output Streams */
+
+/**
+ * @brief Set the stream for error and diagnostic messages
+ * @param sim Simulation context
+ * @param log Stream, or NULL to discard messages (the default)
+ */
+SIM_API void sim_set_log(sim_context_t* sim, FILE* log);
+
+/**
+ * @brief Set the pipeline trace stream of a core
+ * @param sim Simulation context
+ * @param core Core index
+ * @param trace Stream, or NULL to disable tracing (the default). Binary
+ *              trace formats need a stream opened in binary mode.
+ * @return false on invalid core index or if the binary header could not be
+ *         written (tracing is then disabled)
+ */
+SIM_API bool sim_set_core_trace(sim_context_t* sim, int core, FILE* trace);
+
+/**
+ * @brief Set the bus trace stream
+ * @param sim Simulation context
+ * @param trace Stream, or NULL to disable tracing (the default)
+ * @return false if the binary header could not be written
+ */
+SIM_API bool sim_set_bus_trace(sim_context_t* sim, FILE* trace);
+
+/**
+ * @brief Write queued records and buffered binary blocks to their streams
+ * @param sim Simulation context
+ * @return false if a trace write failed
+ *
+ * Call before closing trace streams when a binary format or a background
+ * writer is used. Replacing a stream or destroying the context also
+ * flushes it.
+ */
+SIM_API bool sim_flush_traces(sim_context_t* sim);
+
+/**
+ * @brief Fill a trace filter that traces every cycle and transaction
+ * @param filter Filter to fill
+ */
+SIM_API void sim_trace_filter_default(sim_trace_filter_t* filter);
+
+/**
+ * @brief Replace the trace window, triggers and bus filters
+ * @param sim Simulation context
+ * @param filter Filter (copied); triggers are re-armed
+ */
+SIM_API void sim_set_trace_filter(sim_context_t* sim, const sim_trace_filter_t* filter);
+
+/**
+ * @brief Get the number of trace records dropped by SIM_TRACE_ASYNC_DROP
+ * @param sim Simulation context
+ */
+SIM_API uint64_t sim_get_dropped_traces(sim_context_t* sim);
+
+/**
+ * @brief Regenerate the text form of a binary core or bus trace
+ * @param in Binary trace stream
+ * @param out Text output stream
+ * @return false on a malformed or truncated trace
+ */
+SIM_API bool sim_convert_trace(FILE* in, FILE* out);
+
+/* Execution */
+
+/**
+ * @brief Advance the simulation by up to a number of cycles
+ * @param sim Simulation context
+ * @param cycles Maximum number of cycles to simulate
+ * @return Number of cycles actually simulated (less if all cores finished)
+ */
+SIM_API uint64_t sim_step(sim_context_t* sim, uint64_t cycles);
+
+/**
+ * @brief Advance the simulation until a core is about to fetch a PC
+ * @param sim Simulation context
+ * @param core Core index
+ * @param pc Instruction address
+ * @param max_cycles Maximum number of cycles to simulate
+ * @return Number of cycles simulated (0 if the core is already at pc)
+ *
+ * Stops between cycles, before the cycle in which the core fetches pc, so
+ * a checkpoint taken then resumes with that fetch.
+ */
+SIM_API uint64_t sim_step_to_pc(sim_context_t* sim, int core, uint32_t pc, uint64_t max_cycles);
+
+/**
+ * @brief Execute instructions functionally, without timing
+ * @param sim Simulation context
+ * @param instructions Most instructions each core executes
+ * @param warm_caches Update the data caches as the accesses would, so the
+ *                    detailed simulation resumes with warm caches
+ * @return Instructions executed by all cores together
+ *
+ * Instructions in flight are first completed in detail: the cores stop
+ * fetching until their pipelines, store buffers, caches and the bus are
+ * empty. The cores then execute round-robin, SIM_FUNCTIONAL_QUANTUM
+ * instructions at a time, directly on main memory and without advancing
+ * any cycle counter, and sim_step or sim_run continue in full detail from
+ * the state reached. Without warming the caches are written back and
+ * emptied first, so the detailed simulation resumes with cold caches.
+ * Results match a detailed run for programs whose threads synchronize
+ * through memory; the interleaving of racing accesses may differ.
+ */
+SIM_API uint64_t sim_fast_forward(sim_context_t* sim, uint64_t instructions, bool warm_caches);
+
+/**
+ * @brief Execute functionally until a core is about to execute a PC
+ * @param sim Simulation context
+ * @param core Core index
+ * @param pc Instruction address
+ * @param max_instructions Most instructions each core executes
+ * @param warm_caches Update the data caches as the accesses would
+ * @return Instructions executed by all cores together
+ *
+ * As sim_fast_forward, stopping every core once core is about to execute
+ * pc, so that detailed simulation starts with it.
+ */
+SIM_API uint64_t sim_fast_forward_to_pc(sim_context_t* sim, int core, uint32_t pc,
+    uint64_t max_instructions, bool warm_caches);
+
+/**
+ * @brief Fill sampling parameters with the defaults
+ * @param sample Parameters to fill
+ */
+SIM_API void sim_sample_default(sim_sample_config_t* sample);
+
+/**
+ * @brief Run to completion, simulating only evenly spaced units in detail
+ * @param sim Simulation context
+ * @param sample Unit, warm-up and initial period lengths and the error target
+ * @return Number of cycles simulated in detail by this call
+ *
+ * The cores run warmup instructions in detail, then a measured unit,
+ * and repeat this every period with the program fast-forwarded with warm
+ * caches in between; the first unit starts at once. Each
+ * core's CPI and miss rate are estimated from the units, and its cycles
+ * as CPI times all the instructions it executed (sim_get_sample_estimate).
+ * Whenever half of the units would still meet the error target, every
+ * other unit is dropped and the period doubles, so a long program is
+ * measured only as densely as the target needs; a program too short or
+ * too irregular for the target reports the error it reached.
+ */
+SIM_API uint64_t sim_run_sampled(sim_context_t* sim, const sim_sample_config_t* sample);
+
+/**
+ * @brief Run until every core has halted and drained its pipeline
+ * @param sim Simulation context
+ * @return Number of cycles simulated by this call
+ */
+SIM_API uint64_t sim_run(sim_context_t* sim);
+
+/**
+ * @brief Check whether every core has halted and drained its pipeline
+ * @param sim Simulation context
+ */
+SIM_API bool sim_is_done(sim_context_t* sim);
+
+/* Queries */
+
+/**
+ * @brief Get the number of cores
+ * @param sim Simulation context
+ */
+SIM_API int sim_num_cores(sim_context_t* sim);
+
+/**
+ * @brief Get the name of the cache kernel the cores run
+ * @param sim Simulation context
+ * @return "generic" or the organization it is compiled for, e.g. "256w-4b-1way"
+ */
+SIM_API const char* sim_get_kernel(sim_context_t* sim);
+
+/**
+ * @brief Get the global cycle counter
+ * @param sim Simulation context
+ */
+SIM_API uint64_t sim_get_cycle(sim_context_t* sim);
+
+/**
+ * @brief Get a core's statistics
+ * @param sim Simulation context
+ * @param core Core index
+ * @param stats Structure to fill
+ * @return false on invalid core index
+ */
+SIM_API bool sim_get_core_stats(sim_context_t* sim, int core, sim_core_stats_t* stats);
+
+/**
+ * @brief Get a core's estimate from the last sim_run_sampled
+ * @param sim Simulation context
+ * @param core Core index
+ * @param estimate Structure to fill (period = 0 without a sampled run)
+ * @return false on invalid core index
+ */
+SIM_API bool sim_get_sample_estimate(sim_context_t* sim, int core,
+    sim_sample_estimate_t* estimate);
+
+/**
+ * @brief Read an architectural register of a core
+ * @param sim Simulation context
+ * @param core Core index
+ * @param reg Register number (0-15)
+ * @return Register value (0 on invalid arguments)
+ */
+SIM_API uint32_t sim_get_register(sim_context_t* sim, int core, int reg);
+
+/**
+ * @brief Read a word of main memory
+ * @param sim Simulation context
+ * @param addr Word address
+ * @return Memory value (0 beyond the memory size)
+ */
+SIM_API uint32_t sim_read_memory(sim_context_t* sim, uint32_t addr);
+
+/* Result Files */
+
+/**
+ * @brief Write main memory (memout.txt format)
+ * @return false if the file could not be opened
+ */
+SIM_API bool sim_save_memory(sim_context_t* sim, const char* filename);
+
+/**
+ * @brief Write R2-R15 of a core (regout<i>.txt format)
+ * @return false on invalid core index or if the file could not be opened
+ */
+SIM_API bool sim_save_registers(sim_context_t* sim, int core, const char* filename);
+
+/**
+ * @brief Write a core's DSRAM and TSRAM (dsram<i>.txt / tsram<i>.txt format)
+ *
+ * Both hold one entry per cache line, set by set and way by way within a
+ * set, so a direct-mapped cache gives the original files.
+ * @return false on invalid core index or if a file could not be opened
+ */
+SIM_API bool sim_save_cache(sim_context_t* sim, int core, const char* dsram_file,
+    const char* tsram_file);
+
+/**
+ * @brief Write a core's statistics (stats<i>.txt format)
+ * @return false on invalid core index or if the file could not be opened
+ */
+SIM_API bool sim_save_statistics(sim_context_t* sim, int core, const char* filename);
+
+#endif /* SIM_H */
@@ -0,0 +1,255 @@
+/**
+ * @file thread_pool.c
+ * @brief Implementation of the spinning host thread pool
+ */
+
+#include "thread_pool.h"
+#include "platform.h"
+#include <stdbool.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+typedef HANDLE thread_handle_t;
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+typedef pthread_t thread_handle_t;
+#endif
+
+#define SPINS_BEFORE_YIELD 4096  ///< Busy-wait iterations before yielding the CPU
+#define BACKOFF_SPINS 64          ///< Polling attempts that only spin
+#define BACKOFF_YIELDS 128        ///< Polling attempts before sleeping
+
+struct thread_pool {
+    /* Dispatch State (written by worker 0) */
+    SIM_ALIGNED(SIM_CACHE_LINE) volatile long generation;  ///< Incremented per task
+    thread_pool_task_fn fn;            ///< Current task
+    void* arg;                         ///< Current task argument
+    volatile long stop;                ///< Set to terminate the workers
+
+    /* Completion State (written by workers 1..N-1) */
+    SIM_ALIGNED(SIM_CACHE_LINE) volatile long finished;    ///< Workers done with current task
+
+    int num_workers;                   ///< Workers including the caller
+    int spin_limit;                    ///< Busy-wait iterations before yielding
+    thread_handle_t* threads;          ///< Handles of workers 1..N-1
+    struct worker_arg* worker_args;    ///< Per-thread start arguments
+};
+
+struct worker_arg {
+    thread_pool_t* pool;
+    int worker;
+};
+
+/**
+ * @brief Give up the CPU to another runnable thread
+ */
+static void yield_cpu(void) {
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+int thread_pool_host_cpus(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+/**
+ * @brief Spin until a counter differs from a known value
+ * @return The new counter value
+ */
+static long wait_for_change(volatile long* counter, long seen, int spin_limit) {
+    int spins = 0;
+    long value;
+    while ((value = sim_atomic_load(counter)) == seen) {
+        if (++spins < spin_limit) {
+            sim_cpu_relax();
+        }
+        else {
+            yield_cpu();
+        }
+    }
+    return value;
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI worker_main(LPVOID param)
+#else
+static void* worker_main(void* param)
+#endif
+{
+    struct worker_arg* wa = (struct worker_arg*)param;
+    thread_pool_t* pool = wa->pool;
+    long seen = 0;
+
+    for (;;) {
+        seen = wait_for_change(&pool->generation, seen, pool->spin_limit);
+        if (sim_atomic_load(&pool->stop)) {
+            break;
+        }
+        pool->fn(pool->arg, wa->worker, pool->num_workers);
+        sim_atomic_add(&pool->finished, 1);
+    }
+    return 0;
+}
+
+thread_pool_t* thread_pool_create(int num_workers) {
+    if (num_workers < 1) return NULL;
+
+    thread_pool_t* pool = (thread_pool_t*)sim_aligned_alloc(sizeof(thread_pool_t), SIM_CACHE_LINE);
+    if (!pool) return NULL;
+
+    pool->num_workers = num_workers;
+
+    // Spinning only pays off when every worker has a CPU of its own
+    pool->spin_limit = num_workers <= thread_pool_host_cpus() ? SPINS_BEFORE_YIELD : 0;
+    pool->threads = (thread_handle_t*)calloc(num_workers, sizeof(thread_handle_t));
+    pool->worker_args = (struct worker_arg*)calloc(num_workers, sizeof(struct worker_arg));
+    if (!pool->threads || !pool->worker_args) {
+        free(pool->threads);
+        free(pool->worker_args);
+        sim_aligned_free(pool);
+        return NULL;
+    }
+
+    for (int i = 1; i < num_workers; i++) {
+        pool->worker_args[i].pool = pool;
+        pool->worker_args[i].worker = i;
+#if defined(_WIN32)
+        pool->threads[i] = CreateThread(NULL, 0, worker_main, &pool->worker_args[i], 0, NULL);
+        bool failed = pool->threads[i] == NULL;
+#else
+        bool failed = pthread_create(&pool->threads[i], NULL, worker_main, &pool->worker_args[i]) != 0;
+#endif
+        if (failed) {
+            // Run with the workers that did start
+            pool->num_workers = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_run(thread_pool_t* pool, thread_pool_task_fn fn, void* arg) {
+    if (pool->num_workers == 1) {
+        fn(arg, 0, 1);
+        return;
+    }
+
+    pool->fn = fn;
+    pool->arg = arg;
+    sim_atomic_store(&pool->finished, 0);
+    sim_atomic_add(&pool->generation, 1);
+
+    fn(arg, 0, pool->num_workers);
+
+    // Wait for the other workers
+    int spins = 0;
+    while (sim_atomic_load(&pool->finished) != pool->num_workers - 1) {
+        if (++spins < pool->spin_limit) {
+            sim_cpu_relax();
+        }
+        else {
+            yield_cpu();
+        }
+    }
+}
+
+int thread_pool_size(thread_pool_t* pool) {
+    return pool->num_workers;
+}
+
+void thread_pool_destroy(thread_pool_t* pool) {
+    if (!pool) return;
+
+    sim_atomic_store(&pool->stop, 1);
+    sim_atomic_add(&pool->generation, 1);
+    for (int i = 1; i < pool->num_workers; i++) {
+#if defined(_WIN32)
+        WaitForSingleObject(pool->threads[i], INFINITE);
+        CloseHandle(pool->threads[i]);
+#else
+        pthread_join(pool->threads[i], NULL);
+#endif
+    }
+    free(pool->threads);
+    free(pool->worker_args);
+    sim_aligned_free(pool);
+}
+
+/* Single Threads */
+
+struct host_thread {
+    thread_handle_t handle;  ///< OS thread
+    host_thread_fn fn;       ///< Thread function
+    void* arg;               ///< Thread function argument
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI host_thread_main(LPVOID param)
+#else
+static void* host_thread_main(void* param)
+#endif
+{
+    host_thread_t* thread = (host_thread_t*)param;
+    thread->fn(thread->arg);
+    return 0;
+}
+
+host_thread_t* host_thread_start(host_thread_fn fn, void* arg) {
+    host_thread_t* thread = (host_thread_t*)calloc(1, sizeof(host_thread_t));
+    if (!thread) return NULL;
+
+    thread->fn = fn;
+    thread->arg = arg;
+#if defined(_WIN32)
+    thread->handle = CreateThread(NULL, 0, host_thread_main, thread, 0, NULL);
+    bool failed = thread->handle == NULL;
+#else
+    bool failed = pthread_create(&thread->handle, NULL, host_thread_main, thread) != 0;
+#endif
+    if (failed) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void host_thread_join(host_thread_t* thread) {
+    if (!thread) return;
+#if defined(_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+}
+
+void host_thread_backoff(int attempt) {
+    if (attempt < BACKOFF_SPINS) {
+        sim_cpu_relax();
+    }
+    else if (attempt < BACKOFF_YIELDS) {
+        yield_cpu();
+    }
+    else {
+#if defined(_WIN32)
+        Sleep(1);
+#else
+        struct timespec delay = { 0, 1000000 };
+        nanosleep(&delay, NULL);
+#endif
+    }
+}
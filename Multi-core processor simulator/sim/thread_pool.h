@@ -0,0 +1,94 @@
+/**
+ * @file thread_pool.h
+ * @brief Fixed-size pool of host threads for per-cycle parallel work
+ *
+ * The pool is built for very short, frequent tasks (one per simulated
+ * cycle): workers spin on a generation counter instead of sleeping on a
+ * condition variable, and fall back to yielding the CPU when idle for long.
+ * The calling thread always takes part as worker 0.
+ *
+ * Single background threads (for long-running service loops such as the
+ * trace writer) are started with host_thread_start().
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/**
+ * @brief Task executed by every worker
+ * @param arg User argument passed to thread_pool_run
+ * @param worker Worker index (0 is the calling thread)
+ * @param num_workers Total number of workers
+ */
+typedef void (*thread_pool_task_fn)(void* arg, int worker, int num_workers);
+
+typedef struct thread_pool thread_pool_t;
+
+/**
+ * @brief Create a pool
+ * @param num_workers Total workers including the calling thread (>= 1)
+ * @return New pool, or NULL on failure
+ */
+thread_pool_t* thread_pool_create(int num_workers);
+
+/**
+ * @brief Run a task on all workers and wait for all of them to finish
+ * @param pool Thread pool
+ * @param fn Task function
+ * @param arg Argument passed to every invocation
+ */
+void thread_pool_run(thread_pool_t* pool, thread_pool_task_fn fn, void* arg);
+
+/**
+ * @brief Get the number of workers in the pool
+ * @param pool Thread pool
+ * @return Worker count including the calling thread
+ */
+int thread_pool_size(thread_pool_t* pool);
+
+/**
+ * @brief Get the number of host CPUs available to the process
+ * @return CPU count (at least 1)
+ */
+int thread_pool_host_cpus(void);
+
+/**
+ * @brief Stop all worker threads and free the pool
+ * @param pool Thread pool (may be NULL)
+ */
+void thread_pool_destroy(thread_pool_t* pool);
+
+/* Single Threads */
+
+/**
+ * @brief Entry point of a background thread
+ * @param arg User argument passed to host_thread_start
+ */
+typedef void (*host_thread_fn)(void* arg);
+
+typedef struct host_thread host_thread_t;
+
+/**
+ * @brief Start a background thread
+ * @param fn Thread function
+ * @param arg Argument passed to fn
+ * @return Thread handle, or NULL on failure
+ */
+host_thread_t* host_thread_start(host_thread_fn fn, void* arg);
+
+/**
+ * @brief Wait for a background thread to return and free its handle
+ * @param thread Thread handle (may be NULL)
+ */
+void host_thread_join(host_thread_t* thread);
+
+/**
+ * @brief Wait a little longer on each failed polling attempt
+ * @param attempt Number of consecutive failed attempts so far
+ *
+ * Spins first, then yields the CPU, and finally sleeps for a millisecond
+ * so that an idle poller does not steal time from the simulation.
+ */
+void host_thread_backoff(int attempt);
+
+#endif /* THREAD_POOL_H */
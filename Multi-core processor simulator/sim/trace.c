@@ -0,0 +1,657 @@
+/**
+ * @file trace.c
+ * @brief Implementation of the text and binary trace formats
+ *
+ * Blocks are compressed with a small LZ77 coder in the style of LZ4:
+ * a sequence is a token byte (literal count in the high nibble, match
+ * length - 4 in the low nibble, 15 meaning "more length bytes follow"),
+ * the literals, and a 16-bit match offset. The last sequence of a block
+ * has literals only. Delta-encoded trace records repeat the same few byte
+ * patterns, which this finds cheaply without an external library.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#define TRACE_VERSION 1             ///< Binary format version
+#define TRACE_HEADER_SIZE 32        ///< Bytes in the file header
+#define TRACE_FLAG_COMPRESSED 1     ///< Header flag: blocks may be compressed
+#define TRACE_RECORD_MAX 128        ///< Upper bound on one encoded record
+#define TRACE_BLOCK_CAPACITY (TRACE_BLOCK_SIZE + TRACE_RECORD_MAX)
+
+/* Core record change mask */
+#define TRACE_CORE_PC(i) (1u << (i))        ///< Pipeline stage PC changed
+#define TRACE_CORE_REG(r) (1u << (5 + (r))) ///< R2+r changed
+#define TRACE_CORE_CYCLE (1u << 19)         ///< Cycle is not previous + 1
+#define TRACE_CORE_REPEAT (1u << 20)        ///< Repeat count follows
+
+/* Bus record flag byte (bits 0-1 hold the command) */
+#define TRACE_BUS_SHARED 0x04  ///< Shared line changed
+#define TRACE_BUS_ORIGID 0x08  ///< Originator changed
+#define TRACE_BUS_ADDR 0x10    ///< Address is not previous + 1
+#define TRACE_BUS_DATA 0x20    ///< Data changed
+
+/* Compressor */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+static const char trace_magic[8] = { 'S', 'I', 'M', 'T', 'R', 'A', 'C', 'E' };
+
+struct trace_writer {
+    FILE* out;                    ///< Destination stream
+    trace_kind_t kind;            ///< Record kind
+    bool compress;                ///< Compress blocks
+    bool failed;                  ///< A write has failed
+
+    uint8_t* raw;                 ///< Block being encoded
+    size_t used;                  ///< Bytes used in raw
+    uint8_t* packed;              ///< Compressed block
+    uint32_t* hash_table;         ///< Compressor match positions
+
+    /* Delta State (reset at every block) */
+    core_trace_record_t prev_core;  ///< Last core record
+    int repeat;                     ///< Unchanged cycles not yet written
+    bus_trace_record_t prev_bus;    ///< Last bus record
+};
+
+/* Text Format */
+
+/**
+ * @brief Format PC value for trace output
+ * @param buffer Output buffer
+ * @param pc Program counter value
+ */
+static void format_pc(char* buffer, uint32_t pc) {
+    if (pc == (uint32_t)-1) {
+        sprintf(buffer, "---");
+    }
+    else {
+        sprintf(buffer, "%03X", pc);
+    }
+}
+
+void trace_format_core_state(char* buffer, const core_trace_record_t* rec) {
+    char fetch[12], decode[12], execute[12], mem[12], wb[12];
+
+    // Format pipeline stage PCs
+    format_pc(fetch, rec->pc[0]);
+    format_pc(decode, rec->pc[1]);
+    format_pc(execute, rec->pc[2]);
+    format_pc(mem, rec->pc[3]);
+    format_pc(wb, rec->pc[4]);
+
+    int len = sprintf(buffer, " %s %s %s %s %s", fetch, decode, execute, mem, wb);
+
+    // Append register values
+    for (int r = 0; r < 14; r++) {
+        len += sprintf(buffer + len, " %08X", rec->regs[r]);
+    }
+    sprintf(buffer + len, "\n");
+}
+
+void trace_print_bus(FILE* out, const bus_trace_record_t* rec) {
+    fprintf(out, "%d %d %d %05X %08X %d\n",
+        rec->cycle,
+        rec->origid,
+        rec->cmd,
+        rec->addr,
+        rec->data,
+        (int)rec->shared);
+}
+
+/* Encoding Helpers */
+
+/**
+ * @brief Map a signed difference to an unsigned varint value
+ */
+static uint32_t zigzag_encode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/**
+ * @brief Inverse of zigzag_encode
+ */
+static int32_t zigzag_decode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * @brief Append a LEB128 varint to the block
+ */
+static void put_varint(trace_writer_t* writer, uint32_t value) {
+    while (value >= 0x80) {
+        writer->raw[writer->used++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    writer->raw[writer->used++] = (uint8_t)value;
+}
+
+/**
+ * @brief Read a LEB128 varint
+ * @param pos Read position, advanced past the value
+ * @param end End of the data
+ * @param value Receives the value
+ * @return false if the data ends inside the value
+ */
+static bool get_varint(const uint8_t** pos, const uint8_t* end, uint32_t* value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= end) return false;
+        uint8_t byte = *(*pos)++;
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Store a 32-bit little-endian value
+ */
+static void put_u32(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+    dst[2] = (uint8_t)(value >> 16);
+    dst[3] = (uint8_t)(value >> 24);
+}
+
+/**
+ * @brief Load a 32-bit little-endian value
+ */
+static uint32_t get_u32(const uint8_t* src) {
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) |
+        ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+/**
+ * @brief Set the delta state to the state every block starts from
+ */
+static void reset_core_state(core_trace_record_t* core) {
+    memset(core, 0, sizeof(*core));
+    core->cycle = -1;
+}
+
+/* Block Compression */
+
+/**
+ * @brief Append a run length extension (a run of 255s and a remainder)
+ */
+static void lz_put_length(uint8_t* dst, size_t* op, size_t length) {
+    while (length >= 255) {
+        dst[(*op)++] = 255;
+        length -= 255;
+    }
+    dst[(*op)++] = (uint8_t)length;
+}
+
+/**
+ * @brief Append one sequence of literals and an optional match
+ * @return false if the output would exceed its capacity
+ */
+static bool lz_put_sequence(uint8_t* dst, size_t capacity, size_t* op,
+    const uint8_t* literals, size_t num_literals, size_t offset, size_t match_len) {
+    // Worst case: token, both length extensions, literals and offset
+    size_t needed = 1 + num_literals / 255 + 1 + num_literals + 2 + match_len / 255 + 1;
+    if (*op + needed > capacity) return false;
+
+    size_t match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t* token = &dst[(*op)++];
+    *token = (uint8_t)(((num_literals < 15 ? num_literals : 15) << 4) |
+        (match_code < 15 ? match_code : 15));
+
+    if (num_literals >= 15) {
+        lz_put_length(dst, op, num_literals - 15);
+    }
+    memcpy(dst + *op, literals, num_literals);
+    *op += num_literals;
+
+    if (match_len) {
+        dst[(*op)++] = (uint8_t)offset;
+        dst[(*op)++] = (uint8_t)(offset >> 8);
+        if (match_code >= 15) {
+            lz_put_length(dst, op, match_code - 15);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Compress a block
+ * @param src Uncompressed data
+ * @param len Uncompressed size
+ * @param dst Output buffer
+ * @param capacity Output buffer size
+ * @param table Hash table of 1 << LZ_HASH_BITS entries
+ * @return Compressed size, or 0 if it would not fit in capacity
+ */
+static size_t lz_compress(const uint8_t* src, size_t len, uint8_t* dst,
+    size_t capacity, uint32_t* table) {
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t op = 0;
+
+    // Entries hold position + 1 so that 0 means empty
+    memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+
+    while (ip + LZ_MIN_MATCH <= len) {
+        uint32_t seq;
+        memcpy(&seq, src + ip, sizeof(seq));
+        uint32_t hash = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t)(ip + 1);
+
+        uint32_t found;
+        if (candidate == 0 || ip - (candidate - 1) > LZ_MAX_OFFSET ||
+            (memcpy(&found, src + candidate - 1, sizeof(found)), found != seq)) {
+            ip++;
+            continue;
+        }
+        candidate--;
+
+        size_t match_len = LZ_MIN_MATCH;
+        while (ip + match_len < len && src[candidate + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+
+        if (!lz_put_sequence(dst, capacity, &op, src + anchor, ip - anchor,
+            ip - candidate, match_len)) {
+            return 0;
+        }
+        ip += match_len;
+        anchor = ip;
+    }
+
+    // Trailing literals
+    if (anchor < len &&
+        !lz_put_sequence(dst, capacity, &op, src + anchor, len - anchor, 0, 0)) {
+        return 0;
+    }
+    return op;
+}
+
+/**
+ * @brief Read a run length extension
+ * @return false if the data ends inside the extension
+ */
+static bool lz_get_length(const uint8_t** ip, const uint8_t* end, size_t* length) {
+    uint8_t byte;
+    do {
+        if (*ip >= end) return false;
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/**
+ * @brief Decompress a block
+ * @param src Compressed data
+ * @param len Compressed size
+ * @param dst Output buffer
+ * @param raw_len Expected uncompressed size
+ * @return false on malformed data
+ */
+static bool lz_decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t raw_len) {
+    const uint8_t* ip = src;
+    const uint8_t* end = src + len;
+    size_t op = 0;
+
+    while (op < raw_len) {
+        if (ip >= end) return false;
+        uint8_t token = *ip++;
+
+        size_t num_literals = token >> 4;
+        if (num_literals == 15 && !lz_get_length(&ip, end, &num_literals)) return false;
+        if (num_literals > (size_t)(end - ip) || num_literals > raw_len - op) return false;
+        memcpy(dst + op, ip, num_literals);
+        ip += num_literals;
+        op += num_literals;
+        if (op == raw_len) break;
+
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && !lz_get_length(&ip, end, &match_len)) return false;
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || match_len > raw_len - op) return false;
+
+        // Byte by byte: the match may overlap the bytes it produces
+        for (size_t i = 0; i < match_len; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return ip == end;
+}
+
+/* Binary Writer */
+
+/**
+ * @brief Write out the pending repeat of unchanged core cycles
+ */
+static void put_pending_repeat(trace_writer_t* writer) {
+    if (writer->repeat > 0) {
+        put_varint(writer, TRACE_CORE_REPEAT);
+        put_varint(writer, (uint32_t)writer->repeat);
+        writer->repeat = 0;
+    }
+}
+
+/**
+ * @brief Write the current block to the stream and start a new one
+ */
+static void write_block(trace_writer_t* writer) {
+    put_pending_repeat(writer);
+    if (writer->used > 0) {
+        const uint8_t* data = writer->raw;
+        size_t stored = writer->used;
+
+        if (writer->compress) {
+            size_t packed = lz_compress(writer->raw, writer->used, writer->packed,
+                writer->used - 1, writer->hash_table);
+            if (packed > 0) {
+                data = writer->packed;
+                stored = packed;
+            }
+        }
+
+        uint8_t header[8];
+        put_u32(header, (uint32_t)writer->used);
+        put_u32(header + 4, (uint32_t)stored);
+        if (fwrite(header, 1, sizeof(header), writer->out) != sizeof(header) ||
+            fwrite(data, 1, stored, writer->out) != stored) {
+            writer->failed = true;
+        }
+    }
+
+    writer->used = 0;
+    reset_core_state(&writer->prev_core);
+    memset(&writer->prev_bus, 0, sizeof(writer->prev_bus));
+}
+
+trace_writer_t* trace_writer_create(FILE* out, trace_kind_t kind, int id, bool compress) {
+    trace_writer_t* writer = (trace_writer_t*)calloc(1, sizeof(trace_writer_t));
+    if (!writer) return NULL;
+
+    writer->out = out;
+    writer->kind = kind;
+    writer->compress = compress;
+    writer->raw = (uint8_t*)malloc(TRACE_BLOCK_CAPACITY);
+    if (compress) {
+        writer->packed = (uint8_t*)malloc(TRACE_BLOCK_CAPACITY);
+        writer->hash_table = (uint32_t*)malloc(sizeof(uint32_t) << LZ_HASH_BITS);
+    }
+    if (!writer->raw || (compress && (!writer->packed || !writer->hash_table))) {
+        trace_writer_destroy(writer);
+        return NULL;
+    }
+    reset_core_state(&writer->prev_core);
+
+    // Fixed header
+    uint8_t header[TRACE_HEADER_SIZE] = { 0 };
+    memcpy(header, trace_magic, sizeof(trace_magic));
+    header[8] = TRACE_VERSION;
+    header[10] = (uint8_t)kind;
+    put_u32(header + 12, (uint32_t)id);
+    put_u32(header + 16, compress ? TRACE_FLAG_COMPRESSED : 0);
+    put_u32(header + 20, TRACE_BLOCK_CAPACITY);
+    if (fwrite(header, 1, sizeof(header), out) != sizeof(header)) {
+        trace_writer_destroy(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+void trace_write_core(trace_writer_t* writer, const core_trace_record_t* rec) {
+    core_trace_record_t* prev = &writer->prev_core;
+
+    // Unchanged state on the next cycle only extends the pending repeat
+    if (rec->cycle == prev->cycle + 1 &&
+        memcmp(rec->pc, prev->pc, sizeof(rec->pc)) == 0 &&
+        memcmp(rec->regs, prev->regs, sizeof(rec->regs)) == 0) {
+        writer->repeat++;
+        prev->cycle++;
+        return;
+    }
+
+    put_pending_repeat(writer);
+    if (writer->used >= TRACE_BLOCK_SIZE) {
+        write_block(writer);
+    }
+
+    uint32_t mask = 0;
+    if (rec->cycle != prev->cycle + 1) mask |= TRACE_CORE_CYCLE;
+    for (int i = 0; i < 5; i++) {
+        if (rec->pc[i] != prev->pc[i]) mask |= TRACE_CORE_PC(i);
+    }
+    for (int r = 0; r < 14; r++) {
+        if (rec->regs[r] != prev->regs[r]) mask |= TRACE_CORE_REG(r);
+    }
+
+    put_varint(writer, mask);
+    if (mask & TRACE_CORE_CYCLE) {
+        put_varint(writer, zigzag_encode(rec->cycle - (prev->cycle + 1)));
+    }
+    for (int i = 0; i < 5; i++) {
+        // Bubbles (-1) become 0
+        if (mask & TRACE_CORE_PC(i)) put_varint(writer, rec->pc[i] + 1);
+    }
+    for (int r = 0; r < 14; r++) {
+        if (mask & TRACE_CORE_REG(r)) put_varint(writer, rec->regs[r] ^ prev->regs[r]);
+    }
+    *prev = *rec;
+}
+
+void trace_write_core_repeat(trace_writer_t* writer, const core_trace_record_t* rec, int count) {
+    if (count <= 0) return;
+    trace_write_core(writer, rec);
+    writer->repeat += count - 1;
+    writer->prev_core.cycle += count - 1;
+}
+
+void trace_write_bus(trace_writer_t* writer, const bus_trace_record_t* rec) {
+    bus_trace_record_t* prev = &writer->prev_bus;
+    if (writer->used >= TRACE_BLOCK_SIZE) {
+        write_block(writer);
+    }
+
+    uint8_t flags = (uint8_t)(rec->cmd & 3);
+    if (rec->shared != prev->shared) flags |= TRACE_BUS_SHARED;
+    if (rec->origid != prev->origid) flags |= TRACE_BUS_ORIGID;
+    if (rec->addr != prev->addr + 1) flags |= TRACE_BUS_ADDR;
+    if (rec->data != prev->data) flags |= TRACE_BUS_DATA;
+
+    writer->raw[writer->used++] = flags;
+    put_varint(writer, zigzag_encode(rec->cycle - prev->cycle));
+    if (flags & TRACE_BUS_SHARED) put_varint(writer, rec->shared);
+    if (flags & TRACE_BUS_ORIGID) put_varint(writer, (uint32_t)rec->origid);
+    if (flags & TRACE_BUS_ADDR) put_varint(writer, zigzag_encode((int32_t)(rec->addr - prev->addr)));
+    if (flags & TRACE_BUS_DATA) put_varint(writer, rec->data ^ prev->data);
+    *prev = *rec;
+}
+
+bool trace_writer_flush(trace_writer_t* writer) {
+    write_block(writer);
+    if (fflush(writer->out) != 0) {
+        writer->failed = true;
+    }
+    return !writer->failed;
+}
+
+bool trace_writer_destroy(trace_writer_t* writer) {
+    if (!writer) return true;
+
+    bool ok = writer->raw ? trace_writer_flush(writer) : false;
+    free(writer->raw);
+    free(writer->packed);
+    free(writer->hash_table);
+    free(writer);
+    return ok;
+}
+
+/* Output */
+
+void trace_emit_core(FILE* out, trace_writer_t* writer, const core_trace_record_t* rec, int count) {
+    if (writer) {
+        trace_write_core_repeat(writer, rec, count);
+        return;
+    }
+
+    // The state is formatted once; only the cycle number advances per line
+    char state[TRACE_LINE_MAX];
+    trace_format_core_state(state, rec);
+    for (int c = 0; c < count; c++) {
+        fprintf(out, "%d%s", rec->cycle + c, state);
+    }
+}
+
+void trace_emit_bus(FILE* out, trace_writer_t* writer, const bus_trace_record_t* rec) {
+    if (writer) {
+        trace_write_bus(writer, rec);
+    }
+    else {
+        trace_print_bus(out, rec);
+    }
+}
+
+/* Conversion */
+
+/**
+ * @brief Print the text lines of one block of a core trace
+ * @return false on malformed data
+ */
+static bool convert_core_block(const uint8_t* pos, const uint8_t* end, FILE* out) {
+    core_trace_record_t rec;
+    char state[TRACE_LINE_MAX];
+    reset_core_state(&rec);
+    trace_format_core_state(state, &rec);
+
+    while (pos < end) {
+        uint32_t mask, value;
+        if (!get_varint(&pos, end, &mask)) return false;
+
+        if (mask == TRACE_CORE_REPEAT) {
+            if (!get_varint(&pos, end, &value)) return false;
+            for (uint32_t i = 0; i < value; i++) {
+                fprintf(out, "%d%s", ++rec.cycle, state);
+            }
+            continue;
+        }
+        if (mask >= TRACE_CORE_REPEAT) return false;
+
+        int32_t skip = 0;
+        if (mask & TRACE_CORE_CYCLE) {
+            if (!get_varint(&pos, end, &value)) return false;
+            skip = zigzag_decode(value);
+        }
+        rec.cycle += 1 + skip;
+        for (int i = 0; i < 5; i++) {
+            if (mask & TRACE_CORE_PC(i)) {
+                if (!get_varint(&pos, end, &value)) return false;
+                rec.pc[i] = value - 1;
+            }
+        }
+        for (int r = 0; r < 14; r++) {
+            if (mask & TRACE_CORE_REG(r)) {
+                if (!get_varint(&pos, end, &value)) return false;
+                rec.regs[r] ^= value;
+            }
+        }
+
+        trace_format_core_state(state, &rec);
+        fprintf(out, "%d%s", rec.cycle, state);
+    }
+    return true;
+}
+
+/**
+ * @brief Print the text lines of one block of a bus trace
+ * @return false on malformed data
+ */
+static bool convert_bus_block(const uint8_t* pos, const uint8_t* end, FILE* out) {
+    bus_trace_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+
+    while (pos < end) {
+        uint8_t flags = *pos++;
+        uint32_t value;
+        if (flags & ~(TRACE_BUS_SHARED | TRACE_BUS_ORIGID | TRACE_BUS_ADDR | TRACE_BUS_DATA | 3)) {
+            return false;
+        }
+
+        rec.cmd = flags & 3;
+        if (!get_varint(&pos, end, &value)) return false;
+        rec.cycle += zigzag_decode(value);
+        if (flags & TRACE_BUS_SHARED) {
+            if (!get_varint(&pos, end, &rec.shared)) return false;
+        }
+        if (flags & TRACE_BUS_ORIGID) {
+            if (!get_varint(&pos, end, &value)) return false;
+            rec.origid = (int)value;
+        }
+        if (flags & TRACE_BUS_ADDR) {
+            if (!get_varint(&pos, end, &value)) return false;
+            rec.addr += (uint32_t)zigzag_decode(value);
+        }
+        else {
+            rec.addr++;
+        }
+        if (flags & TRACE_BUS_DATA) {
+            if (!get_varint(&pos, end, &value)) return false;
+            rec.data ^= value;
+        }
+
+        trace_print_bus(out, &rec);
+    }
+    return true;
+}
+
+bool trace_convert(FILE* in, FILE* out) {
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), in) != sizeof(header) ||
+        memcmp(header, trace_magic, sizeof(trace_magic)) != 0 ||
+        header[8] != TRACE_VERSION || header[10] > TRACE_KIND_BUS) {
+        return false;
+    }
+    trace_kind_t kind = (trace_kind_t)header[10];
+    uint32_t capacity = get_u32(header + 20);
+    if (capacity == 0 || capacity > (1u << 28)) return false;
+
+    uint8_t* raw = (uint8_t*)malloc(capacity);
+    uint8_t* packed = (uint8_t*)malloc(capacity);
+    bool ok = raw && packed;
+
+    uint8_t block_header[8];
+    size_t got;
+    while (ok && (got = fread(block_header, 1, sizeof(block_header), in)) > 0) {
+        uint32_t raw_len = get_u32(block_header);
+        uint32_t stored = get_u32(block_header + 4);
+        if (got != sizeof(block_header) || raw_len > capacity || stored > raw_len) {
+            ok = false;
+            break;
+        }
+
+        // Stored uncompressed when compression did not pay off
+        if (stored == raw_len) {
+            ok = fread(raw, 1, raw_len, in) == raw_len;
+        }
+        else {
+            ok = fread(packed, 1, stored, in) == stored &&
+                lz_decompress(packed, stored, raw, raw_len);
+        }
+
+        if (ok) {
+            ok = kind == TRACE_KIND_CORE ?
+                convert_core_block(raw, raw + raw_len, out) :
+                convert_bus_block(raw, raw + raw_len, out);
+        }
+    }
+
+    free(raw);
+    free(packed);
+    return ok;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file trace.h
+ * @brief Text formatting and compact binary encoding of core and bus traces
+ *
+ * Binary trace file layout (all integers little-endian):
+ * - 32-byte header: magic "SIMTRACE", version, trace kind, core id, flags
+ *   and the maximum uncompressed block size
+ * - Blocks: 32-bit raw size, 32-bit stored size, then the block data, which
+ *   is compressed if the stored size is smaller than the raw size
+ *
+ * Each block holds whole records, delta-encoded against the previous record
+ * of the same block (the state is reset at every block start):
+ * - Core record: varint change mask (bits 0-4 pipeline PCs, bits 5-18
+ *   R2-R15, bit 19 cycle is not previous + 1), followed by the changed
+ *   values; or TRACE_CORE_REPEAT and a count of consecutive cycles with an
+ *   unchanged state
+ * - Bus record: flag byte (command, changed fields), cycle delta and the
+ *   changed fields
+ *
+ * Values are stored as LEB128 varints; registers and data as the XOR with
+ * their previous value, addresses as a zigzag difference.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_LINE_MAX 160              ///< Longest formatted text trace line
+#define TRACE_BLOCK_SIZE (64 * 1024)    ///< Uncompressed bytes per block
+
+/**
+ * @brief Kind of records in a trace file
+ */
+typedef enum {
+    TRACE_KIND_CORE = 0,  ///< Pipeline trace of one core
+    TRACE_KIND_BUS = 1    ///< Bus transaction trace
+} trace_kind_t;
+
+/**
+ * @brief One line of a core trace
+ */
+typedef struct {
+    int cycle;            ///< Core cycle counter
+    uint32_t pc[5];       ///< PC in fetch, decode, execute, memory, writeback (-1 = bubble)
+    uint32_t regs[14];    ///< R2-R15
+} core_trace_record_t;
+
+/**
+ * @brief One line of the bus trace
+ */
+typedef struct {
+    int cycle;            ///< Global cycle counter
+    int origid;           ///< Transaction originator
+    int cmd;              ///< Bus command (0-3)
+    uint32_t addr;        ///< Bus address
+    uint32_t data;        ///< Bus data
+    uint32_t shared;      ///< Shared line
+} bus_trace_record_t;
+
+typedef struct trace_writer trace_writer_t;
+
+/* Text Format */
+
+/**
+ * @brief Format the part of a core trace line after the cycle number
+ * @param buffer Output buffer (at least TRACE_LINE_MAX bytes)
+ * @param rec Trace record
+ *
+ * Includes the trailing newline, so a line is "%d" cycle + this state.
+ */
+void trace_format_core_state(char* buffer, const core_trace_record_t* rec);
+
+/**
+ * @brief Write a bus trace record as a text line
+ * @param out Output stream
+ * @param rec Trace record
+ */
+void trace_print_bus(FILE* out, const bus_trace_record_t* rec);
+
+/* Binary Writer */
+
+/**
+ * @brief Start a binary trace on an open stream
+ * @param out Stream opened in binary mode (owned by the caller)
+ * @param kind Record kind
+ * @param id Core index (0 for the bus trace)
+ * @param compress Compress each block
+ * @return New writer, or NULL on allocation or write failure
+ */
+trace_writer_t* trace_writer_create(FILE* out, trace_kind_t kind, int id, bool compress);
+
+/**
+ * @brief Append a core trace record
+ * @param writer Trace writer
+ * @param rec Trace record
+ */
+void trace_write_core(trace_writer_t* writer, const core_trace_record_t* rec);
+
+/**
+ * @brief Append a record followed by copies for the next cycles
+ * @param writer Trace writer
+ * @param rec First trace record
+ * @param count Total number of lines (cycles rec->cycle .. rec->cycle + count - 1)
+ */
+void trace_write_core_repeat(trace_writer_t* writer, const core_trace_record_t* rec, int count);
+
+/**
+ * @brief Append a bus trace record
+ * @param writer Trace writer
+ * @param rec Trace record
+ */
+void trace_write_bus(trace_writer_t* writer, const bus_trace_record_t* rec);
+
+/**
+ * @brief Write the pending block to the stream
+ * @param writer Trace writer
+ * @return false if a write failed since the writer was created
+ */
+bool trace_writer_flush(trace_writer_t* writer);
+
+/**
+ * @brief Flush and free a writer (the stream is not closed)
+ * @param writer Trace writer (may be NULL)
+ * @return false if a write failed
+ */
+bool trace_writer_destroy(trace_writer_t* writer);
+
+/* Output */
+
+/**
+ * @brief Write a core record in the stream's format
+ * @param out Text stream (used when writer is NULL)
+ * @param writer Binary encoder of the stream (NULL for text)
+ * @param rec First trace record
+ * @param count Lines for cycles rec->cycle .. rec->cycle + count - 1 with
+ *              the same state
+ */
+void trace_emit_core(FILE* out, trace_writer_t* writer, const core_trace_record_t* rec, int count);
+
+/**
+ * @brief Write a bus record in the stream's format
+ * @param out Text stream (used when writer is NULL)
+ * @param writer Binary encoder of the stream (NULL for text)
+ * @param rec Trace record
+ */
+void trace_emit_bus(FILE* out, trace_writer_t* writer, const bus_trace_record_t* rec);
+
+/* Conversion */
+
+/**
+ * @brief Regenerate the text trace from a binary trace
+ * @param in Binary trace stream
+ * @param out Text output stream
+ * @return false on a malformed or truncated trace
+ */
+bool trace_convert(FILE* in, FILE* out);
+
+#endif /* TRACE_H */
@@ -0,0 +1,225 @@
+/**
+ * @file trace_queue.c
+ * @brief Implementation of the asynchronous trace writer
+ *
+ * Ring indices are free-running counters; the slot is the index modulo
+ * the power-of-two capacity and the fill level is head - tail in unsigned
+ * arithmetic, so wrap-around needs no special case. The producer publishes
+ * a slot by storing head with release semantics after filling it, and the
+ * consumer frees it by storing tail after the record has been written.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "trace_queue.h"
+#include "thread_pool.h"
+#include "platform.h"
+
+/**
+ * @brief One queued trace record
+ */
+typedef struct {
+    union {
+        core_trace_record_t core;  ///< Core record
+        bus_trace_record_t bus;    ///< Bus record
+    } rec;
+    int count;                     ///< Lines of a core record (0 = bus record)
+} trace_entry_t;
+
+/**
+ * @brief Ring of one trace stream
+ *
+ * The producer and consumer indices live on separate host cache lines.
+ */
+typedef struct {
+    SIM_ALIGNED(SIM_CACHE_LINE) volatile long head;  ///< Next slot to fill (producer)
+    uint64_t dropped;                                ///< Records discarded (producer)
+
+    SIM_ALIGNED(SIM_CACHE_LINE) volatile long tail;  ///< Next slot to drain (consumer)
+    trace_entry_t* slots;                            ///< Record storage
+    FILE* out;                                       ///< Text destination
+    trace_writer_t* writer;                          ///< Binary destination
+} trace_ring_t;
+
+struct trace_queue {
+    trace_ring_t* rings;          ///< Ring per stream
+    int num_streams;              ///< Number of rings
+    unsigned long capacity;       ///< Slots per ring (power of two)
+    trace_queue_policy_t policy;  ///< Behavior on a full ring
+    volatile long stop;           ///< Set to end the writer thread
+    host_thread_t* thread;        ///< Writer thread
+};
+
+/**
+ * @brief Write every record currently queued in a ring
+ * @return Number of records written
+ */
+static int drain_ring(trace_queue_t* queue, trace_ring_t* ring) {
+    unsigned long head = (unsigned long)sim_atomic_load(&ring->head);
+    unsigned long tail = (unsigned long)ring->tail;
+    int written = 0;
+
+    while (tail != head) {
+        trace_entry_t* entry = &ring->slots[tail & (queue->capacity - 1)];
+        if (entry->count > 0) {
+            trace_emit_core(ring->out, ring->writer, &entry->rec.core, entry->count);
+        }
+        else {
+            trace_emit_bus(ring->out, ring->writer, &entry->rec.bus);
+        }
+        tail++;
+        written++;
+
+        // Free slots in batches to keep the producer's line quiet
+        if ((tail & 63) == 0) {
+            sim_atomic_store(&ring->tail, (long)tail);
+        }
+    }
+    sim_atomic_store(&ring->tail, (long)tail);
+    return written;
+}
+
+/**
+ * @brief Writer thread: drain all rings until stopped
+ */
+static void writer_main(void* arg) {
+    trace_queue_t* queue = (trace_queue_t*)arg;
+    int idle = 0;
+
+    for (;;) {
+        // Read the flag before draining so that records pushed before the
+        // stop request are always written
+        bool stopping = sim_atomic_load(&queue->stop) != 0;
+
+        int written = 0;
+        for (int i = 0; i < queue->num_streams; i++) {
+            written += drain_ring(queue, &queue->rings[i]);
+        }
+
+        if (written > 0) {
+            idle = 0;
+        }
+        else if (stopping) {
+            break;
+        }
+        else {
+            host_thread_backoff(idle++);
+        }
+    }
+}
+
+/**
+ * @brief Reserve the next slot of a ring for the producer
+ * @return Slot to fill, or NULL if the record is dropped
+ */
+static trace_entry_t* reserve_slot(trace_queue_t* queue, trace_ring_t* ring) {
+    unsigned long head = (unsigned long)ring->head;
+    int attempt = 0;
+
+    while (head - (unsigned long)sim_atomic_load(&ring->tail) >= queue->capacity) {
+        if (queue->policy == TRACE_QUEUE_DROP) {
+            ring->dropped++;
+            return NULL;
+        }
+        host_thread_backoff(attempt++);
+    }
+    return &ring->slots[head & (queue->capacity - 1)];
+}
+
+/**
+ * @brief Publish the slot returned by reserve_slot
+ */
+static void commit_slot(trace_ring_t* ring) {
+    sim_atomic_store(&ring->head, (long)((unsigned long)ring->head + 1));
+}
+
+trace_queue_t* trace_queue_create(int num_streams, int capacity, trace_queue_policy_t policy) {
+    trace_queue_t* queue = (trace_queue_t*)calloc(1, sizeof(trace_queue_t));
+    if (!queue) return NULL;
+
+    queue->num_streams = num_streams;
+    queue->policy = policy;
+    queue->capacity = 1;
+    while (queue->capacity < (unsigned long)capacity) {
+        queue->capacity <<= 1;
+    }
+
+    queue->rings = (trace_ring_t*)sim_aligned_alloc(num_streams * sizeof(trace_ring_t), SIM_CACHE_LINE);
+    if (!queue->rings) {
+        free(queue);
+        return NULL;
+    }
+    for (int i = 0; i < num_streams; i++) {
+        queue->rings[i].slots = (trace_entry_t*)malloc(queue->capacity * sizeof(trace_entry_t));
+        if (!queue->rings[i].slots) {
+            trace_queue_destroy(queue);
+            return NULL;
+        }
+    }
+
+    queue->thread = host_thread_start(writer_main, queue);
+    if (!queue->thread) {
+        trace_queue_destroy(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+void trace_queue_set_output(trace_queue_t* queue, int stream, FILE* out, trace_writer_t* writer) {
+    queue->rings[stream].out = out;
+    queue->rings[stream].writer = writer;
+}
+
+void trace_queue_push_core(trace_queue_t* queue, int stream, const core_trace_record_t* rec, int count) {
+    trace_ring_t* ring = &queue->rings[stream];
+    trace_entry_t* entry = reserve_slot(queue, ring);
+    if (!entry) return;
+
+    entry->rec.core = *rec;
+    entry->count = count;
+    commit_slot(ring);
+}
+
+void trace_queue_push_bus(trace_queue_t* queue, int stream, const bus_trace_record_t* rec) {
+    trace_ring_t* ring = &queue->rings[stream];
+    trace_entry_t* entry = reserve_slot(queue, ring);
+    if (!entry) return;
+
+    entry->rec.bus = *rec;
+    entry->count = 0;
+    commit_slot(ring);
+}
+
+void trace_queue_sync(trace_queue_t* queue) {
+    for (int i = 0; i < queue->num_streams; i++) {
+        trace_ring_t* ring = &queue->rings[i];
+        int attempt = 0;
+        while (sim_atomic_load(&ring->tail) != ring->head) {
+            host_thread_backoff(attempt++);
+        }
+    }
+}
+
+uint64_t trace_queue_dropped(trace_queue_t* queue) {
+    uint64_t dropped = 0;
+    for (int i = 0; i < queue->num_streams; i++) {
+        dropped += queue->rings[i].dropped;
+    }
+    return dropped;
+}
+
+void trace_queue_destroy(trace_queue_t* queue) {
+    if (!queue) return;
+
+    if (queue->thread) {
+        sim_atomic_store(&queue->stop, 1);
+        host_thread_join(queue->thread);
+    }
+    if (queue->rings) {
+        for (int i = 0; i < queue->num_streams; i++) {
+            free(queue->rings[i].slots);
+        }
+        sim_aligned_free(queue->rings);
+    }
+    free(queue);
+}
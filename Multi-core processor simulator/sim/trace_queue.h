@@ -0,0 +1,90 @@
+/**
+ * @file trace_queue.h
+ * @brief Asynchronous trace output through a background writer thread
+ *
+ * Every trace stream (one per core plus the bus) has its own bounded
+ * single-producer/single-consumer ring of fixed-size records. The thread
+ * that clocks a core is the only producer of that core's ring, and one
+ * background thread drains all rings, formats or encodes the records and
+ * writes them to the streams. Pushing a record is a copy and a release
+ * store; the simulation only waits when a ring is full and the policy is
+ * TRACE_QUEUE_BLOCK.
+ */
+
+#ifndef TRACE_QUEUE_H
+#define TRACE_QUEUE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "trace.h"
+
+#define TRACE_QUEUE_DEFAULT_CAPACITY 4096  ///< Records buffered per stream
+
+/**
+ * @brief What a producer does when its ring is full
+ */
+typedef enum {
+    TRACE_QUEUE_BLOCK = 0,  ///< Wait for the writer thread (no records lost)
+    TRACE_QUEUE_DROP = 1    ///< Discard the record and count it
+} trace_queue_policy_t;
+
+typedef struct trace_queue trace_queue_t;
+
+/**
+ * @brief Create the rings and start the writer thread
+ * @param num_streams Number of trace streams
+ * @param capacity Records per ring (rounded up to a power of two)
+ * @param policy Behavior on a full ring
+ * @return New queue, or NULL on failure
+ */
+trace_queue_t* trace_queue_create(int num_streams, int capacity, trace_queue_policy_t policy);
+
+/**
+ * @brief Set the destination of a stream
+ * @param queue Trace queue
+ * @param stream Stream index
+ * @param out Text stream (may be NULL)
+ * @param writer Binary encoder (NULL for text)
+ *
+ * The ring must be empty, see trace_queue_sync().
+ */
+void trace_queue_set_output(trace_queue_t* queue, int stream, FILE* out, trace_writer_t* writer);
+
+/**
+ * @brief Queue a core record
+ * @param queue Trace queue
+ * @param stream Stream index
+ * @param rec Trace record
+ * @param count Number of lines with this state (see trace_emit_core)
+ */
+void trace_queue_push_core(trace_queue_t* queue, int stream, const core_trace_record_t* rec, int count);
+
+/**
+ * @brief Queue a bus record
+ * @param queue Trace queue
+ * @param stream Stream index
+ * @param rec Trace record
+ */
+void trace_queue_push_bus(trace_queue_t* queue, int stream, const bus_trace_record_t* rec);
+
+/**
+ * @brief Wait until the writer thread has written every queued record
+ * @param queue Trace queue
+ *
+ * Must not be called while producers are pushing.
+ */
+void trace_queue_sync(trace_queue_t* queue);
+
+/**
+ * @brief Get the number of records discarded on full rings
+ * @param queue Trace queue
+ */
+uint64_t trace_queue_dropped(trace_queue_t* queue);
+
+/**
+ * @brief Write all queued records, stop the writer thread and free the queue
+ * @param queue Trace queue (may be NULL)
+ */
+void trace_queue_destroy(trace_queue_t* queue);
+
+#endif /* TRACE_QUEUE_H */